@@ -0,0 +1,149 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "lib.h"
+#include "mail-storage.h"
+#include "mail-search-build.h"
+#include "mail-namespace.h"
+#include "doveadm.h"
+#include "doveadm-mail.h"
+#include "doveadm-mailbox-list-iter.h"
+
+#include <sysexits.h>
+
+#include "doveadm-rbox-plugin.h"
+#include "doveadm-rbox-tier.h"
+
+const char *doveadm_rbox_plugin_version = DOVECOT_ABI_VERSION;
+
+/*
+ * doveadm rbox tier: flag mails older than N days or larger than M bytes
+ * for the alternate storage. The mails are flagged in small transactions,
+ * each followed by an index sync in which rbox moves the batch with
+ * parallel server side copies, so the mailbox is only locked per batch.
+ */
+struct rbox_tier_cmd_context {
+  struct doveadm_mail_cmd_context ctx;
+  struct rbox_tier_settings set;
+  struct mail_search_args *mail_search_args;
+};
+
+static int cmd_rbox_tier_box(struct rbox_tier_cmd_context *ctx, const struct mailbox_info *info) {
+  struct mailbox *box;
+  unsigned int count;
+  int ret;
+
+  box = mailbox_alloc(info->ns->list, info->vname, MAILBOX_FLAG_IGNORE_ACLS);
+  ret = rbox_tier_check_mailbox(box);
+  if (ret <= 0) {
+    if (ret < 0) {
+      i_error("Mailbox %s: no alternate storage configured", info->vname);
+      doveadm_mail_failed_error(&ctx->ctx, MAIL_ERROR_NOTPOSSIBLE);
+    }
+    mailbox_free(&box);
+    return ret;
+  }
+
+  ret = rbox_tier_mailbox(&ctx->set, ctx->mail_search_args, box, doveadm_is_killed, &count);
+  if (ret < 0 && !doveadm_is_killed()) {
+    doveadm_mail_failed_mailbox(&ctx->ctx, box);
+  }
+  if (ret == 0 && doveadm_debug) {
+    i_debug("Mailbox %s: %u mails moved to the alternate storage", info->vname, count);
+  }
+  mailbox_free(&box);
+  return ret;
+}
+
+static int cmd_rbox_tier_run(struct doveadm_mail_cmd_context *_ctx, struct mail_user *user) {
+  struct rbox_tier_cmd_context *ctx = (struct rbox_tier_cmd_context *)_ctx;
+  struct doveadm_mailbox_list_iter *iter;
+  const struct mailbox_info *info;
+  int ret = 0;
+
+  iter = doveadm_mailbox_list_iter_init(_ctx, user, _ctx->search_args, MAILBOX_LIST_ITER_NO_AUTO_BOXES);
+  while ((info = doveadm_mailbox_list_iter_next(iter)) != NULL) {
+    if ((info->flags & (MAILBOX_NOSELECT | MAILBOX_NONEXISTENT)) != 0) {
+      continue;
+    }
+    T_BEGIN {
+      if (cmd_rbox_tier_box(ctx, info) < 0) {
+        ret = -1;
+      }
+    } T_END;
+  }
+  if (doveadm_mailbox_list_iter_deinit(&iter) < 0) {
+    ret = -1;
+  }
+  return ret;
+}
+
+static void cmd_rbox_tier_init(struct doveadm_mail_cmd_context *_ctx, const char *const args[]) {
+  struct rbox_tier_cmd_context *ctx = (struct rbox_tier_cmd_context *)_ctx;
+
+  if (args[0] == NULL || (ctx->set.min_age_days == 0 && ctx->set.min_size == 0)) {
+    doveadm_mail_help_name("rbox tier");
+  }
+  _ctx->search_args = doveadm_mail_mailbox_search_args_build(args);
+  ctx->mail_search_args = rbox_tier_build_search_args(&ctx->set);
+}
+
+static void cmd_rbox_tier_deinit(struct doveadm_mail_cmd_context *_ctx) {
+  struct rbox_tier_cmd_context *ctx = (struct rbox_tier_cmd_context *)_ctx;
+
+  if (ctx->mail_search_args != NULL) {
+    mail_search_args_unref(&ctx->mail_search_args);
+  }
+}
+
+static bool cmd_rbox_tier_parse_arg(struct doveadm_mail_cmd_context *_ctx, int c) {
+  struct rbox_tier_cmd_context *ctx = (struct rbox_tier_cmd_context *)_ctx;
+
+  int ret = rbox_tier_parse_option(&ctx->set, c, optarg);
+  if (ret < 0) {
+    i_fatal_status(EX_USAGE, "Invalid -%c parameter: %s", c, optarg);
+  }
+  return ret > 0;
+}
+
+static struct doveadm_mail_cmd_context *cmd_rbox_tier_alloc(void) {
+  struct rbox_tier_cmd_context *ctx;
+
+  ctx = doveadm_mail_cmd_alloc(struct rbox_tier_cmd_context);
+  rbox_tier_settings_init(&ctx->set);
+  ctx->ctx.getopt_args = "d:s:b:i:";
+  ctx->ctx.v.parse_arg = cmd_rbox_tier_parse_arg;
+  ctx->ctx.v.init = cmd_rbox_tier_init;
+  ctx->ctx.v.deinit = cmd_rbox_tier_deinit;
+  ctx->ctx.v.run = cmd_rbox_tier_run;
+  return &ctx->ctx;
+}
+
+static struct doveadm_cmd_ver2 doveadm_cmd_rbox_tier = {
+    .name = "rbox tier",
+    .mail_cmd = cmd_rbox_tier_alloc,
+    .usage = DOVEADM_CMD_MAIL_USAGE_PREFIX
+    "[-d <min age days>] [-s <min size>] [-b <batch size>] [-i <interval msecs>] <mailbox mask> [...]",
+DOVEADM_CMD_PARAMS_START
+DOVEADM_CMD_MAIL_COMMON
+DOVEADM_CMD_PARAM('d', "min-age-days", CMD_PARAM_INT64, 0)
+DOVEADM_CMD_PARAM('s', "min-size", CMD_PARAM_INT64, 0)
+DOVEADM_CMD_PARAM('b', "batch-size", CMD_PARAM_INT64, 0)
+DOVEADM_CMD_PARAM('i', "interval", CMD_PARAM_INT64, 0)
+DOVEADM_CMD_PARAM('\0', "mailbox-mask", CMD_PARAM_ARRAY, CMD_PARAM_FLAG_POSITIONAL)
+DOVEADM_CMD_PARAMS_END
+};
+
+void doveadm_rbox_plugin_init(struct module *module ATTR_UNUSED) {
+  doveadm_cmd_register_ver2(&doveadm_cmd_rbox_tier);
+}
+
+void doveadm_rbox_plugin_deinit(void) {}
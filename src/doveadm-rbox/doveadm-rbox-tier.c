@@ -0,0 +1,179 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "lib.h"
+#include "array.h"
+#include "ioloop.h"
+#include "strnum.h"
+#include "mail-index.h"
+#include "mail-storage-private.h"
+#include "mailbox-list-private.h"
+#include "mail-search-build.h"
+
+#include "doveadm-rbox-tier.h"
+
+void rbox_tier_settings_init(struct rbox_tier_settings *set) {
+  i_zero(set);
+  set->batch_size = RBOX_TIER_DEFAULT_BATCH_SIZE;
+  set->interval_msecs = RBOX_TIER_DEFAULT_INTERVAL_MSECS;
+}
+
+int rbox_tier_parse_option(struct rbox_tier_settings *set, int c, const char *value) {
+  switch (c) {
+    case 'd':
+      return str_to_uint(value, &set->min_age_days) < 0 ? -1 : 1;
+    case 's':
+      return str_to_uoff(value, &set->min_size) < 0 ? -1 : 1;
+    case 'b':
+      return str_to_uint(value, &set->batch_size) < 0 || set->batch_size == 0 ? -1 : 1;
+    case 'i':
+      return str_to_uint(value, &set->interval_msecs) < 0 ? -1 : 1;
+    default:
+      return 0;
+  }
+}
+
+/* a normal transaction like doveadm altmove uses: the index sync skips the changes of external transactions,
+ * the flag would be set without rbox ever moving the mail */
+static struct mailbox_transaction_context *rbox_tier_transaction_begin(struct mailbox *box) {
+#ifdef DOVECOT_CEPH_PLUGIN_HAVE_MAIL_STORAGE_TRANSACTION_OLD_SIGNATURE
+  return mailbox_transaction_begin(box, (enum mailbox_transaction_flags)0);
+#else
+  return mailbox_transaction_begin(box, (enum mailbox_transaction_flags)0, "doveadm rbox tier");
+#endif
+}
+
+static struct mail_search_arg *rbox_tier_add_search_arg(struct mail_search_args *args, struct mail_search_arg *parent,
+                                                        enum mail_search_arg_type type) {
+  struct mail_search_arg *arg = p_new(args->pool, struct mail_search_arg, 1);
+  arg->type = type;
+  arg->next = parent->value.subargs;
+  parent->value.subargs = arg;
+  return arg;
+}
+
+struct mail_search_args *rbox_tier_build_search_args(const struct rbox_tier_settings *set) {
+  struct mail_search_args *args = mail_search_build_init();
+  struct mail_search_arg *parent, *arg;
+
+  parent = mail_search_build_add(args, SEARCH_OR);
+  if (set->min_age_days > 0) {
+    arg = rbox_tier_add_search_arg(args, parent, SEARCH_BEFORE);
+    arg->value.date_type = MAIL_SEARCH_DATE_TYPE_SAVED;
+    arg->value.search_flags = MAIL_SEARCH_ARG_FLAG_UTC_TIMES;
+    arg->value.time = ioloop_time - (time_t)set->min_age_days * 24 * 3600;
+  }
+  if (set->min_size > 0) {
+    arg = rbox_tier_add_search_arg(args, parent, SEARCH_LARGER);
+    arg->value.size = set->min_size;
+  }
+  return args;
+}
+
+int rbox_tier_check_mailbox(struct mailbox *box) {
+  if (strcmp(box->storage->name, "rbox") != 0) {
+    return 0;
+  }
+  if (box->list->set.alt_dir == NULL || *box->list->set.alt_dir == '\0') {
+    return -1;
+  }
+  return 1;
+}
+
+/* uids of the matching mails which are still in the primary storage. a mail whose move failed has its flag
+ * reverted by the sync, so it is collected again by the next run */
+static int rbox_tier_collect(struct mail_search_args *search_args, struct mailbox *box, ARRAY_TYPE(uint32_t) *uids) {
+  struct mailbox_transaction_context *t;
+  struct mail_search_context *search_ctx;
+  struct mail *mail;
+  int ret;
+
+  t = rbox_tier_transaction_begin(box);
+  mail_search_args_init(search_args, box, FALSE, NULL);
+  search_ctx = mailbox_search_init(t, search_args, NULL, 0, NULL);
+  while (mailbox_search_next(search_ctx, &mail)) {
+    const struct mail_index_record *rec = mail_index_lookup(box->view, mail->seq);
+    if ((rec->flags & MAIL_INDEX_MAIL_FLAG_BACKEND) != 0) {
+      continue;
+    }
+    array_append(uids, &mail->uid, 1);
+  }
+  ret = mailbox_search_deinit(&search_ctx);
+  mail_search_args_deinit(search_args);
+  if (mailbox_transaction_commit(&t) < 0) {
+    ret = -1;
+  }
+  return ret;
+}
+
+/* blocking wait of msecs in an ioloop of its own, the ioloop of the command is not run meanwhile */
+static void rbox_tier_wait(unsigned int msecs) {
+  struct ioloop *ioloop = io_loop_create();
+  struct timeout *to = timeout_add_short(msecs, io_loop_stop, ioloop);
+  io_loop_run(ioloop);
+  timeout_remove(&to);
+  io_loop_destroy(&ioloop);
+}
+
+static int rbox_tier_move_batch(struct mailbox *box, const uint32_t *uids, unsigned int count) {
+  struct mailbox_transaction_context *t;
+  struct mail *mail;
+  unsigned int i;
+
+  t = rbox_tier_transaction_begin(box);
+  mail = mail_alloc(t, 0, NULL);
+  for (i = 0; i < count; i++) {
+    if (mail_set_uid(mail, uids[i])) {
+      mail_update_flags(mail, MODIFY_ADD, (enum mail_flags)MAIL_INDEX_MAIL_FLAG_BACKEND);
+    }
+  }
+  mail_free(&mail);
+  if (mailbox_transaction_commit(&t) < 0) {
+    return -1;
+  }
+  /* rbox moves the flagged mails while syncing the index */
+  return mailbox_sync(box, 0);
+}
+
+int rbox_tier_mailbox(const struct rbox_tier_settings *set, struct mail_search_args *search_args, struct mailbox *box,
+                      bool (*is_killed)(void), unsigned int *count_r) {
+  ARRAY_TYPE(uint32_t) uids;
+  const uint32_t *uid;
+  unsigned int i, n, count;
+  int ret;
+
+  *count_r = 0;
+  if (mailbox_sync(box, 0) < 0) {
+    return -1;
+  }
+
+  i_array_init(&uids, 128);
+  ret = rbox_tier_collect(search_args, box, &uids);
+  uid = array_get(&uids, &count);
+  for (i = 0; ret == 0 && i < count; i += n) {
+    if (i > 0 && set->interval_msecs > 0) {
+      /* leave the cluster and the mailbox lock to the users between batches */
+      rbox_tier_wait(set->interval_msecs);
+    }
+    if (is_killed != NULL && is_killed()) {
+      ret = -1;
+      break;
+    }
+    n = I_MIN(set->batch_size, count - i);
+    if (rbox_tier_move_batch(box, uid + i, n) < 0) {
+      ret = -1;
+      break;
+    }
+    *count_r += n;
+  }
+  array_free(&uids);
+  return ret;
+}
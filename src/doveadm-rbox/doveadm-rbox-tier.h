@@ -0,0 +1,46 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_DOVEADM_RBOX_DOVEADM_RBOX_TIER_H_
+#define SRC_DOVEADM_RBOX_DOVEADM_RBOX_TIER_H_
+
+#define RBOX_TIER_DEFAULT_BATCH_SIZE 100
+#define RBOX_TIER_DEFAULT_INTERVAL_MSECS 100
+
+struct mailbox;
+struct mail_search_args;
+
+/*
+ * doveadm rbox tier, without the doveadm command glue: selects the mails
+ * older than N days or larger than M bytes and flags them for the alternate
+ * storage in batches.
+ */
+struct rbox_tier_settings {
+  unsigned int min_age_days;
+  uoff_t min_size;
+  unsigned int batch_size;
+  unsigned int interval_msecs;
+};
+
+void rbox_tier_settings_init(struct rbox_tier_settings *set);
+/* returns 1 if c is a tier option, 0 if it is none and -1 if its value is invalid */
+int rbox_tier_parse_option(struct rbox_tier_settings *set, int c, const char *value);
+struct mail_search_args *rbox_tier_build_search_args(const struct rbox_tier_settings *set);
+
+/* returns 1 if the mails of box can be tiered, 0 if box is no rbox mailbox and -1 if it has no alternate storage */
+int rbox_tier_check_mailbox(struct mailbox *box);
+/* flags the matching mails of box, which are still in the primary storage, in transactions of batch_size mails.
+ * each batch is followed by an index sync, in which rbox moves the mails. is_killed may be NULL, it stops the
+ * command between two batches. returns 0 and the number of flagged mails in count_r, -1 on failure */
+int rbox_tier_mailbox(const struct rbox_tier_settings *set, struct mail_search_args *search_args, struct mailbox *box,
+                      bool (*is_killed)(void), unsigned int *count_r);
+
+#endif  // SRC_DOVEADM_RBOX_DOVEADM_RBOX_TIER_H_
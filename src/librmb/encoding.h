@@ -210,6 +210,24 @@ inline void encode(const std::string &s, ceph::bufferlist &bl, uint64_t features
   if (len)
     bl.append(s.data(), len);
 }
+inline void decode(std::string &s, ceph::bufferlist::iterator &p) {
+  __u32 len;
+  decode(len, p);
+  s.clear();
+  p.copy(len, s);
+}
+// bufferlist (string compatible), decoded without copying the data
+inline void encode(const ceph::bufferlist &s, ceph::bufferlist &bl) {
+  __u32 len = s.length();
+  encode(len, bl);
+  bl.append(s);
+}
+inline void decode(ceph::bufferlist &s, ceph::bufferlist::iterator &p) {
+  __u32 len;
+  decode(len, p);
+  s.clear();
+  p.copy(len, s);
+}
 // const char* (encode only, string compatible)
 inline void encode(const char *s, ceph::bufferlist &bl) {
   __u32 len = strlen(s);
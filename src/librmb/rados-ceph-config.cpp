@@ -57,7 +57,7 @@ bool RadosCephConfig::is_valid_key_value(const std::string &key, const std::stri
   } else if (get_config()->get_update_attributes_key().compare(key) == 0) {
     success = value.compare("true") == 0 || value.compare("false") == 0;
   } else if (get_config()->get_metadata_storage_module_key().compare(key) == 0) {
-    success = value.compare("default") == 0 || value.compare("ima") == 0;
+    success = value.compare("default") == 0 || value.compare("ima") == 0 || value.compare("bin") == 0;
   } else if (get_config()->get_metadata_storage_attribute_key().compare(key) == 0) {
     success = true;
   }
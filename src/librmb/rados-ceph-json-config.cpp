@@ -42,6 +42,8 @@ RadosCephJsonConfig::RadosCephJsonConfig()
       user_suffix("_u"),
       public_namespace("public"),
       update_attributes("false"),
+      mail_attribute_mask(0),
+      updateable_attribute_mask(0),
       metadata_storage_module("default"),
       metadata_storage_attribute("ima"),
       key_user_mapping("user_mapping"),
@@ -70,10 +72,20 @@ void RadosCephJsonConfig::set_default_mail_attributes() {
   mail_attributes.append(std::string(1, static_cast<char>(RBOX_METADATA_ORIG_MAILBOX)));
   mail_attributes.append(std::string(1, static_cast<char>(RBOX_METADATA_MAIL_UID)));
   mail_attributes.append(std::string(1, static_cast<char>(RBOX_METADATA_VERSION)));
+  mail_attribute_mask = to_key_mask(mail_attributes);
 }
 
 void RadosCephJsonConfig::set_default_updateable_attributes() {
   updateable_attributes.append(std::string(1, static_cast<char>(RBOX_METADATA_ORIG_MAILBOX)));
+  updateable_attribute_mask = to_key_mask(updateable_attributes);
+}
+
+uint32_t RadosCephJsonConfig::to_key_mask(const std::string &attributes) {
+  uint32_t mask = 0;
+  for (std::string::const_iterator it = attributes.begin(); it != attributes.end(); ++it) {
+    mask |= rbox_metadata_bit(*it);
+  }
+  return mask;
 }
 
 bool RadosCephJsonConfig::from_json(librados::bufferlist *buffer) {
@@ -100,9 +112,11 @@ bool RadosCephJsonConfig::from_json(librados::bufferlist *buffer) {
 
     json_t *mail_attributes_ = json_object_get(root, key_mail_attributes.c_str());
     mail_attributes = json_string_value(mail_attributes_);
+    mail_attribute_mask = to_key_mask(mail_attributes);
 
     json_t *updateable_attributes_ = json_object_get(root, key_updateable_attributes.c_str());
     updateable_attributes = json_string_value(updateable_attributes_);
+    updateable_attribute_mask = to_key_mask(updateable_attributes);
 
     json_t *metadata_storage_ = json_object_get(root, key_metadata_storage_module.c_str());
     metadata_storage_module = json_string_value(metadata_storage_);
@@ -154,25 +168,19 @@ std::string RadosCephJsonConfig::to_string() {
   return ss.str();
 }
 
-bool RadosCephJsonConfig::is_mail_attribute(enum rbox_metadata_key key) {
-  return mail_attributes.find_first_of(static_cast<char>(key), 0) != std::string::npos;
-}
-
-bool RadosCephJsonConfig::is_updateable_attribute(enum rbox_metadata_key key) {
-  return updateable_attributes.find_first_of(static_cast<char>(key), 0) != std::string::npos;
-}
-
 void RadosCephJsonConfig::update_mail_attribute(const char *value) {
   if (value == NULL) {
     return;
   }
   mail_attributes = value;
+  mail_attribute_mask = to_key_mask(mail_attributes);
 }
 void RadosCephJsonConfig::update_updateable_attribute(const char *value) {
   if (value == NULL) {
     return;
   }
   updateable_attributes = value;
+  updateable_attribute_mask = to_key_mask(updateable_attributes);
 }
 
 } /* namespace librmb */
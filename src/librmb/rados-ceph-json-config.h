@@ -52,14 +52,21 @@ class RadosCephJsonConfig {
 
   void set_public_namespace(const std::string& public_namespace_) { public_namespace = public_namespace_; }
 
-  void set_mail_attributes(const std::string& mail_attributes_) { mail_attributes = mail_attributes_; }
+  void set_mail_attributes(const std::string& mail_attributes_) {
+    mail_attributes = mail_attributes_;
+    mail_attribute_mask = to_key_mask(mail_attributes);
+  }
   void set_update_attributes(const std::string& update_attributes_) { update_attributes = update_attributes_; }
   void set_updateable_attributes(const std::string& updateable_attributes_) {
     updateable_attributes = updateable_attributes_;
+    updateable_attribute_mask = to_key_mask(updateable_attributes);
   }
 
-  bool is_mail_attribute(enum rbox_metadata_key key);
-  bool is_updateable_attribute(enum rbox_metadata_key key);
+  // called for each attribute of each saved mail, so the attribute strings are kept as key masks
+  bool is_mail_attribute(enum rbox_metadata_key key) { return (mail_attribute_mask & rbox_metadata_bit(key)) != 0; }
+  bool is_updateable_attribute(enum rbox_metadata_key key) {
+    return (updateable_attribute_mask & rbox_metadata_bit(key)) != 0;
+  }
   bool is_update_attributes() { return update_attributes.compare("true") == 0; }
 
   void set_metadata_storage_module(const std::string metadata_storage_module_) {
@@ -90,6 +97,7 @@ class RadosCephJsonConfig {
  private:
   void set_default_mail_attributes();
   void set_default_updateable_attributes();
+  static uint32_t to_key_mask(const std::string& attributes);
 
  private:
   std::string cfg_object_name;
@@ -102,6 +110,8 @@ class RadosCephJsonConfig {
   std::string mail_attributes;
   std::string update_attributes;
   std::string updateable_attributes;
+  uint32_t mail_attribute_mask;
+  uint32_t updateable_attribute_mask;
 
   std::string metadata_storage_module;
   std::string metadata_storage_attribute;
@@ -101,6 +101,13 @@ int RadosClusterImpl::initialize() {
 
 bool RadosClusterImpl::is_connected() { return RadosClusterImpl::connected; }
 
+int RadosClusterImpl::watch_flush() {
+  if (!RadosClusterImpl::connected) {
+    return 0;
+  }
+  return RadosClusterImpl::cluster->watch_flush();
+}
+
 int RadosClusterImpl::connect() {
   int ret = 0;
   if (RadosClusterImpl::cluster_ref_count > 0 && !RadosClusterImpl::connected) {
@@ -37,6 +37,7 @@ class RadosClusterImpl : public RadosCluster {
   int dictionary_create(const std::string &pool, const std::string &username, const std::string &oid,
                         RadosDictionary **dictionary);
   bool is_connected();
+  int watch_flush();
   librados::Rados &get_cluster() { return *cluster; }
 
  private:
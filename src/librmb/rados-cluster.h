@@ -33,6 +33,8 @@ class RadosCluster {
   virtual int io_ctx_create(const std::string &pool, librados::IoCtx *io_ctx) = 0;
   virtual int get_config_option(const char *option, std::string *value) = 0;
   virtual bool is_connected() = 0;
+  /* wait for the watch callbacks in progress */
+  virtual int watch_flush() = 0;
 };
 
 }  // namespace librmb
@@ -0,0 +1,100 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-completion-group.h"
+
+#include <errno.h>
+#include <chrono>
+
+namespace librmb {
+
+struct CompletionGroupOp {
+  RadosCompletionGroup *group;
+  librados::AioCompletion *completion;
+  librados::ObjectWriteOperation *op;
+  int ignored_error;
+  int *result;
+};
+
+RadosCompletionGroup::RadosCompletionGroup() : outstanding(0), first_error(0) {}
+
+RadosCompletionGroup::~RadosCompletionGroup() {
+  // the callbacks of pending operations still reference the group
+  (void)wait();
+}
+
+int RadosCompletionGroup::aio_operate(librados::IoCtx *io_ctx, const std::string &oid,
+                                      librados::ObjectWriteOperation *op, const int &ignored_error, int *result) {
+  CompletionGroupOp *group_op = new CompletionGroupOp();
+  group_op->group = this;
+  group_op->op = op;
+  group_op->ignored_error = ignored_error;
+  group_op->result = result;
+  group_op->completion = librados::Rados::aio_create_completion(group_op, complete_cb, nullptr);
+
+  outstanding++;
+  int ret = io_ctx->aio_operate(oid, group_op->completion, op);
+  if (ret < 0) {
+    outstanding--;
+    group_op->completion->release();
+    delete group_op->op;
+    delete group_op;
+  }
+  return ret;
+}
+
+void RadosCompletionGroup::complete_cb(librados::completion_t cb, void *arg) {
+  CompletionGroupOp *group_op = static_cast<CompletionGroupOp *>(arg);
+  int ret = group_op->completion->get_return_value();
+  if (group_op->result != nullptr) {
+    *group_op->result = ret;
+  }
+  if (ret < 0 && ret == group_op->ignored_error) {
+    ret = 0;
+  }
+  // librados holds its own reference while the callback runs
+  group_op->completion->release();
+  delete group_op->op;
+  group_op->group->finish(ret);
+  delete group_op;
+}
+
+void RadosCompletionGroup::finish(const int &ret) {
+  std::lock_guard<std::mutex> guard(lock);
+  if (ret < 0 && first_error == 0) {
+    first_error = ret;
+  }
+  outstanding--;
+  cond.notify_all();
+}
+
+int RadosCompletionGroup::wait(const int64_t &timeout_ms) {
+  std::unique_lock<std::mutex> guard(lock);
+  if (timeout_ms > 0) {
+    if (!cond.wait_for(guard, std::chrono::milliseconds(timeout_ms), [this] { return outstanding == 0; })) {
+      return -ETIMEDOUT;
+    }
+  } else {
+    cond.wait(guard, [this] { return outstanding == 0; });
+  }
+  int ret = first_error;
+  first_error = 0;
+  return ret;
+}
+
+void RadosCompletionGroup::wait_below(const int &max_ops) {
+  // a window of less than one operation would never open
+  int window = max_ops > 0 ? max_ops : 1;
+  std::unique_lock<std::mutex> guard(lock);
+  cond.wait(guard, [this, window] { return outstanding < window; });
+}
+
+}  // namespace librmb
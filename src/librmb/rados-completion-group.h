@@ -0,0 +1,65 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_COMPLETION_GROUP_H_
+#define SRC_LIBRMB_RADOS_COMPLETION_GROUP_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include <rados/librados.hpp>
+
+namespace librmb {
+
+/**
+ * Tracks a group of asynchron write operations.
+ *
+ * Each operation is counted on submission and uncounted by the librados
+ * completion callback, which also frees the completion and the operation.
+ * The first error is kept until the group is waited for, so waiting
+ * for all operations of the group is a single condition wait.
+ */
+class RadosCompletionGroup {
+ public:
+  RadosCompletionGroup();
+  virtual ~RadosCompletionGroup();
+
+  /* submit op, op is deleted once the operation completed. ignored_error counts as success, e.g. -ENOENT of a
+   * remove. result, if given, receives the return value of op before the group is notified */
+  int aio_operate(librados::IoCtx *io_ctx, const std::string &oid, librados::ObjectWriteOperation *op,
+                  const int &ignored_error = 0, int *result = nullptr);
+  /* wait for all operations, timeout_ms = 0 waits without deadline. returns the first error
+   * since the last wait, -ETIMEDOUT if the deadline passed before all operations completed */
+  int wait(const int64_t &timeout_ms = 0);
+  /* wait until less than max_ops operations are in flight */
+  void wait_below(const int &max_ops);
+  int get_outstanding() { return outstanding; }
+
+ private:
+  RadosCompletionGroup(const RadosCompletionGroup &) = delete;
+  RadosCompletionGroup &operator=(const RadosCompletionGroup &) = delete;
+
+  void finish(const int &ret);
+  static void complete_cb(librados::completion_t cb, void *arg);
+
+ private:
+  std::atomic<int> outstanding;
+  int first_error;
+  std::mutex lock;
+  std::condition_variable cond;
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_COMPLETION_GROUP_H_
@@ -42,6 +42,21 @@ class RadosDovecotCephCfgImpl : public RadosDovecotCephCfg {
   void update_metadata(const std::string &key, const char *value_) { dovecot_cfg.update_metadata(key, value_); }
 
   bool is_ceph_posix_bugfix_enabled() { return dovecot_cfg.is_ceph_posix_bugfix_enabled(); }
+  bool is_mailbox_manifest_enabled() { return dovecot_cfg.is_mailbox_manifest_enabled(); }
+  bool is_index_repair_enabled() { return dovecot_cfg.is_index_repair_enabled(); }
+  bool is_mailbox_notify_enabled() { return dovecot_cfg.is_mailbox_notify_enabled(); }
+  uint64_t get_read_ahead_size() { return dovecot_cfg.get_read_ahead_size(); }
+  uint64_t get_save_flush_size() { return dovecot_cfg.get_save_flush_size(); }
+  int get_write_window() { return dovecot_cfg.get_write_window(); }
+  int get_sync_window() { return dovecot_cfg.get_sync_window(); }
+  int get_expunge_window() { return dovecot_cfg.get_expunge_window(); }
+  int get_rebuild_window() { return dovecot_cfg.get_rebuild_window(); }
+  int get_copy_window() { return dovecot_cfg.get_copy_window(); }
+  int get_metadata_cache_size() { return dovecot_cfg.get_metadata_cache_size(); }
+  int get_metadata_cache_ttl() { return dovecot_cfg.get_metadata_cache_ttl(); }
+  int get_index_snapshot_interval() { return dovecot_cfg.get_index_snapshot_interval(); }
+  int get_precache_window() { return dovecot_cfg.get_precache_window(); }
+  uint64_t get_prefetch_size() { return dovecot_cfg.get_prefetch_size(); }
   // rados config
   bool is_user_mapping() { return rados_cfg.is_user_mapping(); }
   void set_config_valid(bool is_valid_) {
@@ -31,6 +31,21 @@ class RadosDovecotCephCfg {
   virtual void update_updatable_attributes(const char *value) = 0;
   virtual void update_pool_name_metadata(const char *value) = 0;
   virtual bool is_ceph_posix_bugfix_enabled() = 0;
+  virtual bool is_mailbox_manifest_enabled() = 0;
+  virtual bool is_index_repair_enabled() = 0;
+  virtual bool is_mailbox_notify_enabled() = 0;
+  virtual uint64_t get_read_ahead_size() = 0;
+  virtual uint64_t get_save_flush_size() = 0;
+  virtual int get_write_window() = 0;
+  virtual int get_sync_window() = 0;
+  virtual int get_expunge_window() = 0;
+  virtual int get_rebuild_window() = 0;
+  virtual int get_copy_window() = 0;
+  virtual int get_metadata_cache_size() = 0;
+  virtual int get_metadata_cache_ttl() = 0;
+  virtual int get_index_snapshot_interval() = 0;
+  virtual int get_precache_window() = 0;
+  virtual uint64_t get_prefetch_size() = 0;
   virtual const std::string &get_pool_name_metadata_key() = 0;
   virtual const std::string &get_update_attributes_key() = 0;
   virtual const std::string &get_mail_attributes_key() = 0;
@@ -21,13 +21,59 @@ RadosConfig::RadosConfig()
       rbox_cluster_name("rbox_cluster_name"),
       rados_username("rados_user_name"),
       prefix_keyword("k"),
-      bugfix_cephfs_posix_hardlinks("rbox_bugfix_cephfs_21652") {
+      bugfix_cephfs_posix_hardlinks("rbox_bugfix_cephfs_21652"),
+      read_ahead_size("rbox_read_ahead_size"),
+      save_flush_size("rbox_save_flush_size"),
+      write_window("rbox_write_window"),
+      expunge_window("rbox_expunge_window"),
+      sync_window("rbox_sync_window"),
+      copy_window("rbox_copy_window"),
+      rebuild_window("rbox_rebuild_window"),
+      mailbox_manifest("rbox_mailbox_manifest"),
+      index_repair("rbox_index_repair"),
+      index_snapshot_interval("rbox_index_snapshot_interval"),
+      mailbox_notify("rbox_mailbox_notify"),
+      metadata_cache_size("rbox_metadata_cache_size"),
+      metadata_cache_ttl("rbox_metadata_cache_ttl"),
+      prefetch_size("rbox_prefetch_size"),
+      precache_window("rbox_precache_window") {
   config[pool_name] = "mail_storage";
 
   config[rbox_cfg_object_name] = "rbox_cfg";
   config[rbox_cluster_name] = "ceph";
   config[rados_username] = "client.admin";
   config[bugfix_cephfs_posix_hardlinks] = "false";
+  // initial range read (bytes) of a mail stream, 0 reads the complete mail at once
+  config[read_ahead_size] = "65536";
+  // while saving, chunks of this size (bytes) are written to rados as soon as they are complete, 0 disables
+  config[save_flush_size] = "8388608";
+  // max. number of chunk writes per mail in flight
+  config[write_window] = "4";
+  // max. number of object removes in flight while expunging
+  config[expunge_window] = "64";
+  // max. number of metadata updates in flight while syncing flags and keywords
+  config[sync_window] = "64";
+  // max. number of copy or move operations of a transaction in flight
+  config[copy_window] = "64";
+  // max. number of metadata reads in flight while rebuilding the index
+  config[rebuild_window] = "128";
+  // keep a manifest object per mailbox listing its mail objects
+  config[mailbox_manifest] = "false";
+  // repair a corrupted index by comparing it with the objects before rebuilding it
+  config[index_repair] = "false";
+  // min. seconds between two snapshots of the index of a mailbox (LAYOUT=rados only), 0 disables them
+  config[index_snapshot_interval] = "0";
+  // notify the other processes which opened a mailbox of its changes via rados watch/notify
+  config[mailbox_notify] = "false";
+  // max. number of mails whose metadata is cached per process, 0 disables the cache
+  config[metadata_cache_size] = "4096";
+  // max. seconds the metadata of a mail is cached, bounds how long changes of other processes go unnoticed. 0: unlimited
+  config[metadata_cache_ttl] = "30";
+  // max. bytes of mails read ahead while fetching several mails (mail_prefetch_count), 0 disables prefetching
+  config[prefetch_size] = "16777216";
+  // max. number of mails whose metadata is read ahead in parallel while walking a mailbox in sequence order,
+  // 0 disables it. the results go into the metadata cache, so the window is at most rbox_metadata_cache_size
+  config[precache_window] = "64";
   is_valid = false;
 }
 
@@ -52,6 +98,102 @@ void RadosConfig::update_metadata(const std::string &key, const char *value_) {
   }
 }
 
+uint64_t RadosConfig::get_read_ahead_size() {
+  try {
+    return std::stoull(config[read_ahead_size]);
+  } catch (const std::exception &e) {
+    return 0;
+  }
+}
+
+uint64_t RadosConfig::get_save_flush_size() {
+  try {
+    return std::stoull(config[save_flush_size]);
+  } catch (const std::exception &e) {
+    return 0;
+  }
+}
+
+int RadosConfig::get_write_window() {
+  try {
+    return std::stoi(config[write_window]);
+  } catch (const std::exception &e) {
+    return 1;
+  }
+}
+
+int RadosConfig::get_expunge_window() {
+  try {
+    return std::stoi(config[expunge_window]);
+  } catch (const std::exception &e) {
+    return 1;
+  }
+}
+
+int RadosConfig::get_sync_window() {
+  try {
+    return std::stoi(config[sync_window]);
+  } catch (const std::exception &e) {
+    return 1;
+  }
+}
+
+int RadosConfig::get_copy_window() {
+  try {
+    return std::stoi(config[copy_window]);
+  } catch (const std::exception &e) {
+    return 64;
+  }
+}
+
+int RadosConfig::get_rebuild_window() {
+  try {
+    return std::stoi(config[rebuild_window]);
+  } catch (const std::exception &e) {
+    return 128;
+  }
+}
+
+int RadosConfig::get_index_snapshot_interval() {
+  try {
+    return std::stoi(config[index_snapshot_interval]);
+  } catch (const std::exception &e) {
+    return 0;
+  }
+}
+
+int RadosConfig::get_metadata_cache_size() {
+  try {
+    return std::stoi(config[metadata_cache_size]);
+  } catch (const std::exception &e) {
+    return 0;
+  }
+}
+
+int RadosConfig::get_metadata_cache_ttl() {
+  try {
+    return std::stoi(config[metadata_cache_ttl]);
+  } catch (const std::exception &e) {
+    return 0;
+  }
+}
+
+uint64_t RadosConfig::get_prefetch_size() {
+  try {
+    return std::stoull(config[prefetch_size]);
+  } catch (const std::exception &e) {
+    return 0;
+  }
+}
+
+int RadosConfig::get_precache_window() {
+  try {
+    return std::stoi(config[precache_window]);
+  } catch (const std::exception &e) {
+    return 0;
+  }
+}
+
 RadosConfig::~RadosConfig() {}
 
 } /* namespace librmb */
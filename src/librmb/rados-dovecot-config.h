@@ -12,6 +12,7 @@
 #ifndef SRC_LIBRMB_RADOS_DOVECOT_CONFIG_H_
 #define SRC_LIBRMB_RADOS_DOVECOT_CONFIG_H_
 
+#include <stdint.h>
 #include <map>
 #include <string>
 
@@ -45,7 +46,22 @@ class RadosConfig {
   bool is_ceph_posix_bugfix_enabled() {
     return config[bugfix_cephfs_posix_hardlinks].compare("true") == 0 ? true : false;
   }
+  bool is_mailbox_manifest_enabled() { return config[mailbox_manifest].compare("true") == 0; }
+  bool is_index_repair_enabled() { return config[index_repair].compare("true") == 0; }
+  bool is_mailbox_notify_enabled() { return config[mailbox_notify].compare("true") == 0; }
   void set_rbox_cfg_object_name(const std::string &value) { config[rbox_cfg_object_name] = value; }
+  uint64_t get_read_ahead_size();
+  uint64_t get_save_flush_size();
+  int get_write_window();
+  int get_sync_window();
+  int get_expunge_window();
+  int get_rebuild_window();
+  int get_copy_window();
+  int get_metadata_cache_size();
+  int get_metadata_cache_ttl();
+  int get_index_snapshot_interval();
+  int get_precache_window();
+  uint64_t get_prefetch_size();
 
 
  private:
@@ -60,6 +76,21 @@ class RadosConfig {
   std::string rados_username;
   std::string prefix_keyword;
   std::string bugfix_cephfs_posix_hardlinks;
+  std::string read_ahead_size;
+  std::string save_flush_size;
+  std::string write_window;
+  std::string expunge_window;
+  std::string sync_window;
+  std::string copy_window;
+  std::string rebuild_window;
+  std::string mailbox_manifest;
+  std::string index_repair;
+  std::string index_snapshot_interval;
+  std::string mailbox_notify;
+  std::string metadata_cache_size;
+  std::string metadata_cache_ttl;
+  std::string prefetch_size;
+  std::string precache_window;
   bool is_valid;
 };
 
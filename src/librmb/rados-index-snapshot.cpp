@@ -0,0 +1,124 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-index-snapshot.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sstream>
+
+#include "rados-util.h"
+
+namespace librmb {
+
+const char *RadosIndexSnapshot::OID_PREFIX = "index_snapshot.";
+const int RadosIndexSnapshot::VERSION = 1;
+
+// xattrs of the snapshot object
+static const char *SNAPSHOT_XATTR_VERSION = "V";
+static const char *SNAPSHOT_XATTR_FILES = "F";
+
+std::string RadosIndexSnapshot::get_oid(const std::string &mailbox_guid) { return OID_PREFIX + mailbox_guid; }
+
+bool RadosIndexSnapshot::is_snapshot_oid(const std::string &oid) {
+  return oid.compare(0, strlen(OID_PREFIX), OID_PREFIX) == 0;
+}
+
+int RadosIndexSnapshot::save(librados::IoCtx *io_ctx, const std::string &mailbox_guid,
+                             const std::map<std::string, librados::bufferlist> &files) {
+  librados::bufferlist data;
+  for (std::map<std::string, librados::bufferlist>::const_iterator it = files.begin(); it != files.end(); ++it) {
+    data.append(it->second);
+  }
+  librados::bufferlist version;
+  version.append(std::to_string(VERSION));
+  librados::bufferlist file_table;
+  file_table.append(encode_file_table(files));
+
+  librados::ObjectWriteOperation op;
+  op.write_full(data);
+  op.setxattr(SNAPSHOT_XATTR_VERSION, version);
+  op.setxattr(SNAPSHOT_XATTR_FILES, file_table);
+  return io_ctx->operate(get_oid(mailbox_guid), &op);
+}
+
+int RadosIndexSnapshot::load(librados::IoCtx *io_ctx, const std::string &mailbox_guid,
+                             std::map<std::string, librados::bufferlist> *files) {
+  librados::bufferlist version;
+  librados::bufferlist file_table;
+  librados::bufferlist data;
+  int version_err = 0;
+  int file_table_err = 0;
+  int data_err = 0;
+
+  librados::ObjectReadOperation op;
+  op.getxattr(SNAPSHOT_XATTR_VERSION, &version, &version_err);
+  op.getxattr(SNAPSHOT_XATTR_FILES, &file_table, &file_table_err);
+  // a length of 0 reads the whole object
+  op.read(0, 0, &data, &data_err);
+  int ret = io_ctx->operate(get_oid(mailbox_guid), &op, nullptr);
+  if (ret < 0) {
+    return ret;
+  }
+  if (version_err < 0 || file_table_err < 0 || data_err < 0 || version.to_str() != std::to_string(VERSION)) {
+    return -EINVAL;
+  }
+
+  std::map<std::string, uint64_t> sizes;
+  if (!decode_file_table(file_table.to_str(), &sizes)) {
+    return -EINVAL;
+  }
+  uint64_t offset = 0;
+  for (std::map<std::string, uint64_t>::iterator it = sizes.begin(); it != sizes.end(); ++it) {
+    if (offset + it->second > data.length()) {
+      return -EINVAL;
+    }
+    (*files)[it->first].substr_of(data, offset, it->second);
+    offset += it->second;
+  }
+  return 0;
+}
+
+int RadosIndexSnapshot::stat(librados::IoCtx *io_ctx, const std::string &mailbox_guid, time_t *save_time) {
+  uint64_t size;
+  return io_ctx->stat(get_oid(mailbox_guid), &size, save_time);
+}
+
+int RadosIndexSnapshot::remove(librados::IoCtx *io_ctx, const std::string &mailbox_guid) {
+  return io_ctx->remove(get_oid(mailbox_guid));
+}
+
+/* file names and sizes in the order of the data, "name:size;name:size" */
+std::string RadosIndexSnapshot::encode_file_table(const std::map<std::string, librados::bufferlist> &files) {
+  std::ostringstream value;
+  for (std::map<std::string, librados::bufferlist>::const_iterator it = files.begin(); it != files.end(); ++it) {
+    if (it != files.begin()) {
+      value << ';';
+    }
+    value << it->first << ':' << it->second.length();
+  }
+  return value.str();
+}
+
+bool RadosIndexSnapshot::decode_file_table(const std::string &value, std::map<std::string, uint64_t> *sizes) {
+  std::istringstream in(value);
+  std::string file;
+  while (std::getline(in, file, ';')) {
+    size_t pos = file.rfind(':');
+    if (pos == std::string::npos || pos == 0 || !RadosUtils::is_numeric(file.substr(pos + 1))) {
+      return false;
+    }
+    (*sizes)[file.substr(0, pos)] = std::stoull(file.substr(pos + 1));
+  }
+  return true;
+}
+
+}  // namespace librmb
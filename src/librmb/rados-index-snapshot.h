@@ -0,0 +1,61 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_INDEX_SNAPSHOT_H_
+#define SRC_LIBRMB_RADOS_INDEX_SNAPSHOT_H_
+
+#include <time.h>
+#include <map>
+#include <string>
+
+#include <rados/librados.hpp>
+
+namespace librmb {
+
+/**
+ * Snapshot of the dovecot index files of a mailbox.
+ *
+ * The files (index, log and cache) are packed into the data of a single
+ * object in the namespace of the mailbox owner, named after the mailbox
+ * guid, so that a renamed mailbox keeps its snapshot and a new mailbox of
+ * the same name doesn't get it.
+ * The file table and the format version are xattrs of the object, data and
+ * xattrs are written by one operation, so a snapshot is never partial.
+ *
+ * A node without local index files restores the snapshot instead of
+ * rebuilding the index from all mail objects.
+ */
+class RadosIndexSnapshot {
+ public:
+  static const char *OID_PREFIX;
+  static const int VERSION;
+
+  static std::string get_oid(const std::string &mailbox_guid);
+  static bool is_snapshot_oid(const std::string &oid);
+
+  /* replace the snapshot with files (file name => content) */
+  static int save(librados::IoCtx *io_ctx, const std::string &mailbox_guid,
+                  const std::map<std::string, librados::bufferlist> &files);
+  /* -ENOENT if there is no snapshot, -EINVAL if it has an unknown version or is damaged */
+  static int load(librados::IoCtx *io_ctx, const std::string &mailbox_guid,
+                  std::map<std::string, librados::bufferlist> *files);
+  /* time of the last save, -ENOENT if there is no snapshot */
+  static int stat(librados::IoCtx *io_ctx, const std::string &mailbox_guid, time_t *save_time);
+  static int remove(librados::IoCtx *io_ctx, const std::string &mailbox_guid);
+
+ private:
+  static std::string encode_file_table(const std::map<std::string, librados::bufferlist> &files);
+  static bool decode_file_table(const std::string &value, std::map<std::string, uint64_t> *sizes);
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_INDEX_SNAPSHOT_H_
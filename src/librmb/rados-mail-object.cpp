@@ -27,14 +27,95 @@ const char RadosMailObject::X_ATTR_VERSION_VALUE[] = "0.1";
 const char RadosMailObject::DATA_BUFFER_NAME[] = "RADOS_MAIL_BUFFER";
 
 RadosMailObject::RadosMailObject() {
+  this->oid_formatted = true;
   this->object_size = -1;
-  this->active_op = false;
+  this->flushed_size = 0;
+  this->completion_group = &own_completion_group;
   this->save_date_rados = -1;
+  this->metadata_indexed = false;
+  this->metadata_value_mask = 0;
 }
 RadosMailObject::~RadosMailObject() {}
 
+void RadosMailObject::index_metadata() {
+  for (int i = 0; i < RBOX_METADATA_KEY_COUNT; i++) {
+    metadata_table[i] = nullptr;
+  }
+  for (map<string, ceph::bufferlist>::const_iterator it = attrset.begin(); it != attrset.end(); ++it) {
+    int index = it->first.size() == 1 ? rbox_metadata_index(it->first[0]) : -1;
+    if (index >= 0) {
+      metadata_table[index] = &it->second;
+    }
+  }
+  metadata_value_mask = 0;
+  metadata_indexed = true;
+}
+
+bool RadosMailObject::get_metadata(rbox_metadata_key key, uint64_t *value_r) {
+  int index = rbox_metadata_index(key);
+  uint32_t bit = rbox_metadata_bit(key);
+  if ((RBOX_METADATA_NUMERIC_KEYS & bit) == 0) {
+    return false;
+  }
+  const ceph::bufferlist *bl = lookup_metadata(index);
+  if (bl == nullptr) {
+    return false;
+  }
+  if ((metadata_value_mask & bit) == 0) {
+    string value = bl->to_str();
+    if (!RadosUtils::is_numeric(value)) {
+      return false;
+    }
+    try {
+      metadata_values[index] = std::stoull(value);
+    } catch (const std::exception &e) {
+      return false;
+    }
+    metadata_value_mask |= bit;
+  }
+  *value_r = metadata_values[index];
+  return true;
+}
+
+void RadosMailObject::reset() {
+  // pending operations of the previous mail
+  (void)own_completion_group.wait();
+
+  // the object itself, the capacity of the oid and the completion group are what is reused.
+  // the metadata maps give their nodes back, librados clears the attrset on a load anyway.
+  oid.clear();
+  oid_formatted = true;
+  memset(guid, 0, sizeof(guid));
+  object_size = -1;
+  flushed_size = 0;
+  completion_group = &own_completion_group;
+  mail_buffer.clear();
+  save_date_rados = -1;
+  attrset.clear();
+  loaded_attrset.clear();
+  extended_attrset.clear();
+  metadata_indexed = false;
+  metadata_value_mask = 0;
+}
+
 void RadosMailObject::set_guid(const uint8_t *_guid) { memcpy(this->guid, _guid, sizeof(this->guid)); }
 
+void RadosMailObject::set_oid(const uint8_t *_oid_guid) {
+  memcpy(this->oid_guid, _oid_guid, sizeof(this->oid_guid));
+  oid_formatted = false;
+}
+
+void RadosMailObject::format_oid() {
+  // same format as guid_128_to_string
+  static const char hex[] = "0123456789abcdef";
+  oid.resize(GUID_128_SIZE * 2);
+  for (int i = 0; i < GUID_128_SIZE; i++) {
+    oid[i * 2] = hex[oid_guid[i] >> 4];
+    oid[i * 2 + 1] = hex[oid_guid[i] & 0x0f];
+  }
+  oid_formatted = true;
+}
+
 std::string RadosMailObject::to_string(const string &padding) {
   string uid = get_metadata(RBOX_METADATA_MAIL_UID);
   string recv_time_str = get_metadata(RBOX_METADATA_RECEIVED_TIME);
@@ -16,6 +16,7 @@
 #include <iostream>
 #include <sstream>
 #include <map>
+#include "rados-completion-group.h"
 #include "rados-metadata.h"
 #include "rados-types.h"
 #include <rados/librados.hpp>
@@ -25,49 +26,96 @@ namespace librmb {
 using std::string;
 using std::map;
 
-using librados::AioCompletion;
-using librados::ObjectWriteOperation;
-
 class RadosMailObject {
  public:
   RadosMailObject();
   virtual ~RadosMailObject();
 
+  // clear the object for reuse, the oid keeps its memory
+  void reset();
+
   void set_oid(const char* _oid) {
   this->oid = _oid;
+  oid_formatted = true;
+}
+void set_oid(const string& _oid) {
+  this->oid = _oid;
+  oid_formatted = true;
 }
-void set_oid(const string& _oid) { this->oid = _oid; }
+// oid in binary form, it is formatted on the first get_oid()
+void set_oid(const uint8_t* oid_guid);
 void set_guid(const uint8_t* guid);
 void set_mail_size(const uint64_t& _size) { object_size = _size; }
-void set_active_op(bool _active) { this->active_op = _active; }
+void set_flushed_size(const uint64_t& _size) { flushed_size = _size; }
 void set_rados_save_date(const time_t& _save_date) { this->save_date_rados = _save_date; }
 
-const string& get_oid() { return this->oid; }
+const string& get_oid() {
+  if (!oid_formatted) {
+    format_oid();
+  }
+  return this->oid;
+}
 const uint64_t& get_mail_size() { return this->object_size; }
+// bytes already written to rados, the mail buffer only holds the data following them
+const uint64_t& get_flushed_size() { return this->flushed_size; }
 
 time_t* get_rados_save_date() { return &this->save_date_rados; }
 uint8_t* get_guid_ref() { return this->guid; }
 librados::bufferlist* get_mail_buffer() { return &this->mail_buffer; }
-map<string, ceph::bufferlist>* get_metadata() { return &this->attrset; }
+// The attributes are kept as a map, because librados reads and writes them as one. Lookups by key
+// go through a table of pointers into the map, which is a cache over it. The map is therefore only
+// changed by the methods below, which keep the table valid or rebuild it on the next lookup.
+const map<string, ceph::bufferlist>* get_metadata() const { return &this->attrset; }
+bool has_metadata() const { return !attrset.empty(); }
+// exchange all attributes, e.g. with those read by librados
+void swap_metadata(map<string, ceph::bufferlist>* attrs) {
+  attrset.swap(*attrs);
+  metadata_indexed = false;
+}
+void clear_metadata() {
+  attrset.clear();
+  metadata_indexed = false;
+}
+// librados reads the attributes of a pending read operation here, take them over with swap_metadata()
+map<string, ceph::bufferlist>* get_metadata_load_buffer() { return &this->loaded_attrset; }
 
-map<AioCompletion*, ObjectWriteOperation*>* get_completion_op_map() { return &completion_op; }
+// pending write operations of the mail, by default each mail has its own group
+RadosCompletionGroup* get_completion_group() { return completion_group; }
+// share the completion group, e.g. with all mails of a transaction. group must outlive the pending operations
+void set_completion_group(RadosCompletionGroup* group) { this->completion_group = group; }
 
 string get_metadata(rbox_metadata_key key) {
-  string str_key(1, static_cast<char>(key));
-  return get_metadata(str_key);
+  const ceph::bufferlist* bl = lookup_metadata(rbox_metadata_index(key));
+  return bl != nullptr ? bl->to_str() : string();
 }
 
 string get_metadata(const string& key) {
+  if (key.size() == 1 && rbox_metadata_index(key[0]) >= 0) {
+    return get_metadata(static_cast<rbox_metadata_key>(key[0]));
+  }
   string value;
-  if (attrset.find(key) != attrset.end()) {
-    value = attrset[key].to_str();
+  map<string, ceph::bufferlist>::const_iterator it = attrset.find(key);
+  if (it != attrset.end()) {
+    value = it->second.to_str();
   }
   return value;
 }
 
-bool has_active_op() { return active_op; }
+// value of a numeric key, false if it is not set or no number
+bool get_metadata(rbox_metadata_key key, uint64_t* value_r);
+
 string to_string(const string& padding);
-void add_metadata(const RadosMetadata& metadata) { attrset[metadata.key] = metadata.bl; }
+void add_metadata(const RadosMetadata& metadata) { add_metadata(metadata.key, metadata.bl); }
+void add_metadata(const string& key, const ceph::bufferlist& value) {
+  ceph::bufferlist& bl = attrset[key];
+  bl = value;
+  int index = key.size() == 1 ? rbox_metadata_index(key[0]) : -1;
+  if (metadata_indexed && index >= 0) {
+    // inserting doesn't move the other values
+    metadata_table[index] = &bl;
+    metadata_value_mask &= ~(static_cast<uint32_t>(1) << index);
+  }
+}
 
 map<string, ceph::bufferlist>* get_extended_metadata() { return &this->extended_attrset; }
 void add_extended_metadata(RadosMetadata& metadata) { extended_attrset[metadata.key] = metadata.bl; }
@@ -79,20 +127,43 @@ const string get_extended_metadata(string& key) {
   return value;
   }
 
+ private:
+  const ceph::bufferlist* lookup_metadata(int index) {
+    if (index < 0) {
+      return nullptr;
+    }
+    if (!metadata_indexed) {
+      index_metadata();
+    }
+    return metadata_table[index];
+  }
+  void index_metadata();
+  void format_oid();
+
  private:
   string oid;
+  uint8_t oid_guid[GUID_128_SIZE];
+  bool oid_formatted;
 
   uint8_t guid[GUID_128_SIZE] = {};
   uint64_t object_size;  // byte
-  map<AioCompletion*, ObjectWriteOperation*> completion_op;
+  uint64_t flushed_size;  // byte
+  RadosCompletionGroup* completion_group;
+  RadosCompletionGroup own_completion_group;
 
-  bool active_op;
   ceph::bufferlist mail_buffer;
   time_t save_date_rados;
 
   map<string, ceph::bufferlist> attrset;
+  map<string, ceph::bufferlist> loaded_attrset;
   map<string, ceph::bufferlist> extended_attrset;
 
+  // values of attrset by rbox_metadata_index, numeric values are parsed on first use
+  bool metadata_indexed;
+  const ceph::bufferlist* metadata_table[RBOX_METADATA_KEY_COUNT];
+  uint64_t metadata_values[RBOX_METADATA_KEY_COUNT];
+  uint32_t metadata_value_mask;
+
  public:
   static const char X_ATTR_VERSION_VALUE[];
   static const char DATA_BUFFER_NAME[];
@@ -0,0 +1,224 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-mailbox-list.h"
+
+#include <errno.h>
+#include <string.h>
+#include <utility>
+
+namespace librmb {
+
+const char *RadosMailboxList::OID = "mailbox_list";
+const char *RadosMailboxList::MAILBOX_PREFIX = "m.";
+const char *RadosMailboxList::SUBSCRIPTION_PREFIX = "s.";
+const char *RadosMailboxList::NO_GUID = "-";
+
+// max. number of keys read by a single operation
+static const uint64_t MAILBOX_LIST_PAGE_SIZE = 1024;
+// renames which lost against a concurrent update are retried
+static const int MAILBOX_LIST_RENAME_RETRIES = 3;
+
+int RadosMailboxList::save(librados::IoCtx *io_ctx, const std::map<std::string, std::string> &mailboxes,
+                           const std::set<std::string> &subscriptions) {
+  std::map<std::string, librados::bufferlist> kv_map;
+  for (std::map<std::string, std::string>::const_iterator it = mailboxes.begin(); it != mailboxes.end(); ++it) {
+    kv_map[MAILBOX_PREFIX + it->first].append(it->second.empty() ? NO_GUID : it->second);
+  }
+  for (std::set<std::string>::const_iterator it = subscriptions.begin(); it != subscriptions.end(); ++it) {
+    kv_map[SUBSCRIPTION_PREFIX + *it];
+  }
+  // two processes importing the list at the same time must not drop the updates made after the first import
+  librados::ObjectWriteOperation op;
+  op.create(true);
+  op.omap_set(kv_map);
+  return io_ctx->operate(OID, &op);
+}
+
+int RadosMailboxList::load(librados::IoCtx *io_ctx, std::map<std::string, std::string> *mailboxes,
+                           std::set<std::string> *subscriptions) {
+  return read(io_ctx, mailboxes, subscriptions, false);
+}
+
+int RadosMailboxList::read(librados::IoCtx *io_ctx, std::map<std::string, std::string> *mailboxes,
+                           std::set<std::string> *subscriptions, bool raw) {
+  std::string start_after;
+  size_t mailbox_prefix_len = strlen(MAILBOX_PREFIX);
+  size_t subscription_prefix_len = strlen(SUBSCRIPTION_PREFIX);
+  bool more = true;
+
+  while (more) {
+    std::map<std::string, librados::bufferlist> kv_map;
+    librados::ObjectReadOperation op;
+    int err = 0;
+#ifdef HAVE_OMAP_GET_VALS2
+    op.omap_get_vals2(start_after, MAILBOX_LIST_PAGE_SIZE, &kv_map, &more, &err);
+#else
+    op.omap_get_vals(start_after, MAILBOX_LIST_PAGE_SIZE, &kv_map, &err);
+    more = kv_map.size() == MAILBOX_LIST_PAGE_SIZE;
+#endif
+    int ret = io_ctx->operate(OID, &op, nullptr);
+    if (ret < 0) {
+      return ret;
+    }
+    if (err < 0) {
+      return err;
+    }
+    if (kv_map.empty()) {
+      break;
+    }
+    for (std::map<std::string, librados::bufferlist>::iterator it = kv_map.begin(); it != kv_map.end(); ++it) {
+      const std::string &key = it->first;
+      if (key.compare(0, mailbox_prefix_len, MAILBOX_PREFIX) == 0) {
+        if (mailboxes != nullptr) {
+          std::string guid = it->second.to_str();
+          (*mailboxes)[key.substr(mailbox_prefix_len)] = !raw && guid.compare(NO_GUID) == 0 ? "" : guid;
+        }
+      } else if (key.compare(0, subscription_prefix_len, SUBSCRIPTION_PREFIX) == 0) {
+        if (subscriptions != nullptr) {
+          subscriptions->insert(key.substr(subscription_prefix_len));
+        }
+      }
+    }
+    start_after = kv_map.rbegin()->first;
+  }
+  return 0;
+}
+
+int RadosMailboxList::lookup(librados::IoCtx *io_ctx, const std::string &name, bool *exists_r,
+                             std::string *mailbox_guid) {
+  std::set<std::string> keys;
+  std::string key = MAILBOX_PREFIX + name;
+  keys.insert(key);
+  std::map<std::string, librados::bufferlist> kv_map;
+  librados::ObjectReadOperation op;
+  int err = 0;
+  op.omap_get_vals_by_keys(keys, &kv_map, &err);
+  int ret = io_ctx->operate(OID, &op, nullptr);
+  if (ret < 0) {
+    return ret;
+  }
+  if (err < 0) {
+    return err;
+  }
+  std::map<std::string, librados::bufferlist>::iterator it = kv_map.find(key);
+  *exists_r = it != kv_map.end();
+  if (*exists_r && mailbox_guid != nullptr) {
+    *mailbox_guid = it->second.to_str();
+    if (mailbox_guid->compare(NO_GUID) == 0) {
+      mailbox_guid->clear();
+    }
+  }
+  return 0;
+}
+
+int RadosMailboxList::add_mailbox(librados::IoCtx *io_ctx, const std::string &name, const std::string &mailbox_guid) {
+  std::string key = MAILBOX_PREFIX + name;
+  std::map<std::string, librados::bufferlist> kv_map;
+  kv_map[key].append(mailbox_guid.empty() ? NO_GUID : mailbox_guid);
+  // a missing key compares equal to an empty value. an imported mailbox without guid gets the guid, the import
+  // of the list may have found the directory of the mailbox just created.
+  librados::bufferlist no_guid;
+  no_guid.append(NO_GUID);
+  librados::bufferlist expected[] = {librados::bufferlist(), no_guid};
+
+  int ret = -ECANCELED;
+  for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]) && ret == -ECANCELED; i++) {
+    std::map<std::string, std::pair<librados::bufferlist, int> > assertions;
+    assertions[key] = std::make_pair(expected[i], LIBRADOS_CMPXATTR_OP_EQ);
+    librados::ObjectWriteOperation op;
+    int cmp_ret = 0;
+    op.assert_exists();
+    op.omap_cmp(assertions, &cmp_ret);
+    op.omap_set(kv_map);
+    ret = io_ctx->operate(OID, &op);
+  }
+  return ret == -ECANCELED ? -EEXIST : ret;
+}
+
+int RadosMailboxList::remove_mailbox(librados::IoCtx *io_ctx, const std::string &name) {
+  std::set<std::string> keys;
+  keys.insert(MAILBOX_PREFIX + name);
+  librados::ObjectWriteOperation op;
+  op.assert_exists();
+  op.omap_rm_keys(keys);
+  return io_ctx->operate(OID, &op);
+}
+
+int RadosMailboxList::rename_mailbox(librados::IoCtx *io_ctx, const std::string &old_name,
+                                     const std::string &new_name, char separator) {
+  std::string child_prefix = old_name + separator;
+  int ret = -ECANCELED;
+
+  for (int i = 0; i < MAILBOX_LIST_RENAME_RETRIES && ret == -ECANCELED; i++) {
+    std::map<std::string, std::string> mailboxes;
+    ret = read(io_ctx, &mailboxes, nullptr, true);
+    if (ret < 0) {
+      return ret;
+    }
+    if (mailboxes.find(old_name) == mailboxes.end()) {
+      return -ENOENT;
+    }
+    if (mailboxes.find(new_name) != mailboxes.end()) {
+      return -EEXIST;
+    }
+
+    // the old keys must still have the values read, otherwise a concurrent update is lost
+    std::map<std::string, std::pair<librados::bufferlist, int> > assertions;
+    std::set<std::string> old_keys;
+    std::map<std::string, librados::bufferlist> new_keys;
+    for (std::map<std::string, std::string>::iterator it = mailboxes.begin(); it != mailboxes.end(); ++it) {
+      std::string name;
+      if (it->first == old_name) {
+        name = new_name;
+      } else if (it->first.compare(0, child_prefix.size(), child_prefix) == 0) {
+        name = new_name + separator + it->first.substr(child_prefix.size());
+      } else {
+        continue;
+      }
+      if (mailboxes.find(name) != mailboxes.end()) {
+        return -EEXIST;
+      }
+      librados::bufferlist value;
+      value.append(it->second);
+      assertions[MAILBOX_PREFIX + it->first] = std::make_pair(value, LIBRADOS_CMPXATTR_OP_EQ);
+      // the new names must still be free
+      assertions[MAILBOX_PREFIX + name] = std::make_pair(librados::bufferlist(), LIBRADOS_CMPXATTR_OP_EQ);
+      old_keys.insert(MAILBOX_PREFIX + it->first);
+      new_keys[MAILBOX_PREFIX + name].append(it->second.empty() ? NO_GUID : it->second);
+    }
+
+    librados::ObjectWriteOperation op;
+    int cmp_ret = 0;
+    op.omap_cmp(assertions, &cmp_ret);
+    op.omap_rm_keys(old_keys);
+    op.omap_set(new_keys);
+    ret = io_ctx->operate(OID, &op);
+  }
+  return ret;
+}
+
+int RadosMailboxList::set_subscribed(librados::IoCtx *io_ctx, const std::string &name, bool subscribed) {
+  librados::ObjectWriteOperation op;
+  op.assert_exists();
+  if (subscribed) {
+    std::map<std::string, librados::bufferlist> kv_map;
+    kv_map[SUBSCRIPTION_PREFIX + name];
+    op.omap_set(kv_map);
+  } else {
+    std::set<std::string> keys;
+    keys.insert(SUBSCRIPTION_PREFIX + name);
+    op.omap_rm_keys(keys);
+  }
+  return io_ctx->operate(OID, &op);
+}
+
+}  // namespace librmb
@@ -0,0 +1,70 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_MAILBOX_LIST_H_
+#define SRC_LIBRMB_RADOS_MAILBOX_LIST_H_
+
+#include <map>
+#include <set>
+#include <string>
+
+#include <rados/librados.hpp>
+
+namespace librmb {
+
+/**
+ * Mailboxes and subscriptions of a user.
+ *
+ * The list is a single omap object in the namespace of the user. Each
+ * mailbox has a key with the mailbox guid as value, each subscription a key
+ * of its own, so the whole list is read with one omap read.
+ *
+ * Only save() creates the list, all other updates fail with -ENOENT as long
+ * as there is none. This way a user's list is imported once, completely,
+ * instead of growing from the mailboxes created after the switch.
+ *
+ * A mailbox key never has an empty value (NO_GUID for imported mailboxes),
+ * so comparing a key with an empty value (omap_cmp) asserts its absence.
+ */
+class RadosMailboxList {
+ public:
+  static const char *OID;
+  static const char *MAILBOX_PREFIX;
+  static const char *SUBSCRIPTION_PREFIX;
+  static const char *NO_GUID;
+
+  /* create the list, mailboxes maps mailbox name => mailbox guid (may be empty). -EEXIST if the user has a list */
+  static int save(librados::IoCtx *io_ctx, const std::map<std::string, std::string> &mailboxes,
+                  const std::set<std::string> &subscriptions);
+  /* -ENOENT if the user has no list */
+  static int load(librados::IoCtx *io_ctx, std::map<std::string, std::string> *mailboxes,
+                  std::set<std::string> *subscriptions);
+  /* exists_r is false if the list doesn't contain the mailbox, -ENOENT if the user has no list */
+  static int lookup(librados::IoCtx *io_ctx, const std::string &name, bool *exists_r, std::string *mailbox_guid);
+
+  /* -EEXIST if the list contains the mailbox, unless it has been imported without guid */
+  static int add_mailbox(librados::IoCtx *io_ctx, const std::string &name, const std::string &mailbox_guid);
+  static int remove_mailbox(librados::IoCtx *io_ctx, const std::string &name);
+  /* rename the mailbox and its children (name + separator + child) with a single operation. -ENOENT if
+   * there is no such mailbox, -EEXIST if the new name is taken */
+  static int rename_mailbox(librados::IoCtx *io_ctx, const std::string &old_name, const std::string &new_name,
+                            char separator);
+  static int set_subscribed(librados::IoCtx *io_ctx, const std::string &name, bool subscribed);
+
+ private:
+  /* raw keeps the guids as they are stored */
+  static int read(librados::IoCtx *io_ctx, std::map<std::string, std::string> *mailboxes,
+                  std::set<std::string> *subscriptions, bool raw);
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_MAILBOX_LIST_H_
@@ -0,0 +1,301 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-mailbox-manifest.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sstream>
+#include <vector>
+
+#include "rados-util.h"
+
+namespace librmb {
+
+const char *RadosMailboxManifest::OID_PREFIX = "manifest.";
+const char *RadosMailboxManifest::FLAGS_SUFFIX = ".f";
+// no oid, written last by create() and save()
+const char *RadosMailboxManifest::GENERATION_KEY = "~generation";
+
+// max. number of keys read or written by a single operation
+static const uint64_t MANIFEST_PAGE_SIZE = 1024;
+
+std::string RadosMailboxManifest::get_oid(const std::string &mailbox_guid) { return OID_PREFIX + mailbox_guid; }
+
+bool RadosMailboxManifest::is_manifest_oid(const std::string &oid) {
+  return oid.compare(0, strlen(OID_PREFIX), OID_PREFIX) == 0;
+}
+
+int RadosMailboxManifest::create(librados::IoCtx *io_ctx, const std::string &mailbox_guid) {
+  librados::ObjectWriteOperation op;
+  op.create(true);
+  std::map<std::string, librados::bufferlist> kv_map;
+  kv_map[GENERATION_KEY].append("1");
+  op.omap_set(kv_map);
+  int ret = io_ctx->operate(get_oid(mailbox_guid), &op);
+  return ret == -EEXIST ? 0 : ret;
+}
+
+int RadosMailboxManifest::invalidate(librados::IoCtx *io_ctx, const std::string &mailbox_guid) {
+  std::set<std::string> keys;
+  keys.insert(GENERATION_KEY);
+  librados::ObjectWriteOperation op;
+  op.assert_exists();
+  op.omap_rm_keys(keys);
+  int ret = io_ctx->operate(get_oid(mailbox_guid), &op);
+  return ret == -ENOENT ? 0 : ret;
+}
+
+int RadosMailboxManifest::read_all(librados::IoCtx *io_ctx, const std::string &oid,
+                                   std::map<std::string, librados::bufferlist> *kv_map) {
+  std::string start_after;
+  bool more = true;
+
+  while (more) {
+    std::map<std::string, librados::bufferlist> page;
+    librados::ObjectReadOperation op;
+    int err = 0;
+#ifdef HAVE_OMAP_GET_VALS2
+    op.omap_get_vals2(start_after, MANIFEST_PAGE_SIZE, &page, &more, &err);
+#else
+    op.omap_get_vals(start_after, MANIFEST_PAGE_SIZE, &page, &err);
+    more = page.size() == MANIFEST_PAGE_SIZE;
+#endif
+    int ret = io_ctx->operate(oid, &op, nullptr);
+    if (ret < 0) {
+      return ret;
+    }
+    if (err < 0) {
+      return err;
+    }
+    if (page.empty()) {
+      break;
+    }
+    start_after = page.rbegin()->first;
+    kv_map->insert(page.begin(), page.end());
+  }
+  return 0;
+}
+
+int RadosMailboxManifest::save(librados::IoCtx *io_ctx, const std::string &mailbox_guid,
+                               const std::map<std::string, RadosManifestEntry> &entries) {
+  std::string oid = get_oid(mailbox_guid);
+  std::map<std::string, librados::bufferlist> existing;
+  int ret = read_all(io_ctx, oid, &existing);
+  if (ret < 0 && ret != -ENOENT) {
+    return ret;
+  }
+
+  // keys of mails which are no longer there. keys added by concurrent saves are not removed.
+  uint64_t generation = 0;
+  std::set<std::string> stale;
+  for (std::map<std::string, librados::bufferlist>::iterator it = existing.begin(); it != existing.end(); ++it) {
+    if (it->first.compare(GENERATION_KEY) == 0) {
+      std::string value = it->second.to_str();
+      generation = RadosUtils::is_numeric(value) ? std::stoull(value) : 0;
+      continue;
+    }
+    std::string key = it->first;
+    size_t suffix_len = strlen(FLAGS_SUFFIX);
+    if (key.size() > suffix_len && key.compare(key.size() - suffix_len, suffix_len, FLAGS_SUFFIX) == 0) {
+      key = key.substr(0, key.size() - suffix_len);
+    }
+    if (entries.find(key) == entries.end()) {
+      stale.insert(it->first);
+    }
+  }
+
+  // the manifest is incomplete until the generation is written again. another save of the manifest
+  // running at the same time fails the generation check.
+  librados::ObjectWriteOperation first_op;
+  first_op.create(false);
+  int cmp_ret = 0;
+  if (generation > 0) {
+    std::map<std::string, std::pair<librados::bufferlist, int>> assertions;
+    assertions[GENERATION_KEY].first = existing[GENERATION_KEY];
+    assertions[GENERATION_KEY].second = LIBRADOS_CMPXATTR_OP_EQ;
+    first_op.omap_cmp(assertions, &cmp_ret);
+  }
+  std::set<std::string> generation_key;
+  generation_key.insert(GENERATION_KEY);
+  first_op.omap_rm_keys(generation_key);
+  ret = io_ctx->operate(oid, &first_op);
+  if (ret < 0) {
+    return ret;
+  }
+
+  std::map<std::string, RadosManifestEntry>::const_iterator it = entries.begin();
+  std::set<std::string>::iterator stale_it = stale.begin();
+  while (it != entries.end() || stale_it != stale.end()) {
+    librados::ObjectWriteOperation op;
+    op.assert_exists();
+    std::map<std::string, librados::bufferlist> kv_map;
+    for (; it != entries.end() && kv_map.size() < MANIFEST_PAGE_SIZE; ++it) {
+      encode_entry(it->second, &kv_map, it->first);
+    }
+    std::set<std::string> rm_keys;
+    for (; stale_it != stale.end() && rm_keys.size() < MANIFEST_PAGE_SIZE; ++stale_it) {
+      rm_keys.insert(*stale_it);
+    }
+    if (!kv_map.empty()) {
+      op.omap_set(kv_map);
+    }
+    if (!rm_keys.empty()) {
+      op.omap_rm_keys(rm_keys);
+    }
+    ret = io_ctx->operate(oid, &op);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+
+  librados::ObjectWriteOperation last_op;
+  last_op.assert_exists();
+  std::map<std::string, librados::bufferlist> kv_map;
+  kv_map[GENERATION_KEY].append(std::to_string(generation + 1));
+  last_op.omap_set(kv_map);
+  return io_ctx->operate(oid, &last_op);
+}
+
+int RadosMailboxManifest::load(librados::IoCtx *io_ctx, const std::string &mailbox_guid,
+                               std::map<std::string, RadosManifestEntry> *entries) {
+  std::map<std::string, librados::bufferlist> kv_map;
+  int ret = read_all(io_ctx, get_oid(mailbox_guid), &kv_map);
+  if (ret < 0) {
+    return ret;
+  }
+  if (kv_map.find(GENERATION_KEY) == kv_map.end()) {
+    // a save of the manifest failed or an update of it
+    return -ENODATA;
+  }
+
+  std::set<std::string> complete;
+  std::map<std::string, RadosManifestEntry> loaded;
+  for (std::map<std::string, librados::bufferlist>::iterator it = kv_map.begin(); it != kv_map.end(); ++it) {
+    const std::string &key = it->first;
+    size_t suffix_len = strlen(FLAGS_SUFFIX);
+    if (key.compare(GENERATION_KEY) == 0) {
+      continue;
+    } else if (key.size() > suffix_len && key.compare(key.size() - suffix_len, suffix_len, FLAGS_SUFFIX) == 0) {
+      decode_flags(it->second.to_str(), &loaded[key.substr(0, key.size() - suffix_len)]);
+    } else if (decode_entry(it->second.to_str(), &loaded[key])) {
+      complete.insert(key);
+    }
+  }
+
+  // flags of a mail which has been removed in the meantime
+  for (std::map<std::string, RadosManifestEntry>::iterator it = loaded.begin(); it != loaded.end(); ++it) {
+    if (complete.find(it->first) != complete.end()) {
+      entries->insert(*it);
+    }
+  }
+  return 0;
+}
+
+void RadosMailboxManifest::add_entries(librados::ObjectWriteOperation *op,
+                                       const std::map<std::string, RadosManifestEntry> &entries) {
+  std::map<std::string, librados::bufferlist> kv_map;
+  for (std::map<std::string, RadosManifestEntry>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+    encode_entry(it->second, &kv_map, it->first);
+  }
+  op->assert_exists();
+  op->omap_set(kv_map);
+}
+
+void RadosMailboxManifest::update_flags(librados::ObjectWriteOperation *op,
+                                        const std::map<std::string, RadosManifestEntry> &entries) {
+  std::map<std::string, librados::bufferlist> kv_map;
+  for (std::map<std::string, RadosManifestEntry>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+    encode_flags(it->second, &kv_map, it->first);
+  }
+  op->assert_exists();
+  op->omap_set(kv_map);
+}
+
+void RadosMailboxManifest::remove_entries(librados::ObjectWriteOperation *op, const std::set<std::string> &oids) {
+  std::set<std::string> keys;
+  for (std::set<std::string>::const_iterator it = oids.begin(); it != oids.end(); ++it) {
+    keys.insert(*it);
+    keys.insert(*it + FLAGS_SUFFIX);
+  }
+  op->assert_exists();
+  op->omap_rm_keys(keys);
+}
+
+bool RadosMailboxManifest::to_entry(RadosMailObject *mail, bool alt_storage, RadosManifestEntry *entry) {
+  std::string uid = mail->get_metadata(RBOX_METADATA_MAIL_UID);
+  std::string guid = mail->get_metadata(RBOX_METADATA_GUID);
+  if (!RadosUtils::is_numeric(uid) || guid.empty()) {
+    return false;
+  }
+  entry->uid = std::stoul(uid);
+  entry->guid = guid;
+  entry->size = mail->get_mail_size();
+
+  std::string received_date = mail->get_metadata(RBOX_METADATA_RECEIVED_TIME);
+  entry->received_date = RadosUtils::is_numeric(received_date) ? std::stol(received_date) : 0;
+
+  std::string flags = mail->get_metadata(RBOX_METADATA_OLDV1_FLAGS);
+  entry->flags = 0;
+  if (!flags.empty() && !RadosUtils::string_to_flags(flags, &entry->flags)) {
+    entry->flags = 0;
+  }
+  entry->alt_storage = alt_storage;
+  return true;
+}
+
+void RadosMailboxManifest::encode_entry(const RadosManifestEntry &entry,
+                                        std::map<std::string, librados::bufferlist> *kv_map, const std::string &oid) {
+  std::ostringstream value;
+  value << entry.uid << ';' << entry.guid << ';' << entry.size << ';' << entry.received_date;
+  (*kv_map)[oid].append(value.str());
+  encode_flags(entry, kv_map, oid);
+}
+
+void RadosMailboxManifest::encode_flags(const RadosManifestEntry &entry,
+                                        std::map<std::string, librados::bufferlist> *kv_map, const std::string &oid) {
+  std::ostringstream value;
+  value << static_cast<unsigned int>(entry.flags) << ';' << (entry.alt_storage ? 1 : 0);
+  (*kv_map)[oid + FLAGS_SUFFIX].append(value.str());
+}
+
+bool RadosMailboxManifest::decode_entry(const std::string &value, RadosManifestEntry *entry) {
+  std::istringstream in(value);
+  char sep1, sep2;
+  uint32_t uid;
+  uint64_t size;
+  time_t received_date;
+
+  if (!(in >> uid >> sep1) || sep1 != ';' || !std::getline(in, entry->guid, ';') ||
+      !(in >> size >> sep2 >> received_date) || sep2 != ';') {
+    return false;
+  }
+  entry->uid = uid;
+  entry->size = size;
+  entry->received_date = received_date;
+  return true;
+}
+
+bool RadosMailboxManifest::decode_flags(const std::string &value, RadosManifestEntry *entry) {
+  std::istringstream in(value);
+  unsigned int flags;
+  int alt_storage;
+  char sep;
+
+  if (!(in >> flags >> sep >> alt_storage) || sep != ';') {
+    return false;
+  }
+  entry->flags = static_cast<uint8_t>(flags);
+  entry->alt_storage = alt_storage != 0;
+  return true;
+}
+
+}  // namespace librmb
@@ -0,0 +1,94 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_MAILBOX_MANIFEST_H_
+#define SRC_LIBRMB_RADOS_MAILBOX_MANIFEST_H_
+
+#include <time.h>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+
+#include <rados/librados.hpp>
+#include "rados-mail-object.h"
+
+namespace librmb {
+
+/* what the manifest keeps of a mail object */
+struct RadosManifestEntry {
+  RadosManifestEntry() : uid(0), size(0), received_date(0), flags(0), alt_storage(false) {}
+
+  uint32_t uid;
+  std::string guid;
+  uint64_t size;
+  time_t received_date;
+  // flags of the index record
+  uint8_t flags;
+  bool alt_storage;
+};
+
+/**
+ * Manifest of the mail objects of a mailbox.
+ *
+ * The manifest is an omap object in the namespace of the mailbox owner,
+ * named after the mailbox guid. Each mail object of the mailbox has an
+ * entry keyed by its oid, the flags are kept in a key of their own so that
+ * they can be updated without reading the entry.
+ *
+ * Only create() and save() create the manifest, all other updates assert
+ * that it exists. Both write the generation key last, a manifest without
+ * it is incomplete (e.g. a save failed half way or an update failed and
+ * invalidate() was called) and load() rejects it.
+ */
+class RadosMailboxManifest {
+ public:
+  static const char *OID_PREFIX;
+  static const char *FLAGS_SUFFIX;
+  static const char *GENERATION_KEY;
+
+  static std::string get_oid(const std::string &mailbox_guid);
+  static bool is_manifest_oid(const std::string &oid);
+
+  /* create an empty manifest, an existing manifest is left as it is */
+  static int create(librados::IoCtx *io_ctx, const std::string &mailbox_guid);
+  /* make the manifest entries (oid => entry). entries of other mails are removed, except those added while the
+   * manifest is saved. -ECANCELED if the manifest is saved by someone else at the same time */
+  static int save(librados::IoCtx *io_ctx, const std::string &mailbox_guid,
+                  const std::map<std::string, RadosManifestEntry> &entries);
+  /* mark the manifest as incomplete, e.g. after an update of it failed */
+  static int invalidate(librados::IoCtx *io_ctx, const std::string &mailbox_guid);
+  /* load all entries, -ENOENT if the mailbox has no manifest, -ENODATA if it is incomplete */
+  static int load(librados::IoCtx *io_ctx, const std::string &mailbox_guid,
+                  std::map<std::string, RadosManifestEntry> *entries);
+
+  /* add the updates to op, the op fails with -ENOENT if the mailbox has no manifest */
+  static void add_entries(librados::ObjectWriteOperation *op, const std::map<std::string, RadosManifestEntry> &entries);
+  static void update_flags(librados::ObjectWriteOperation *op, const std::map<std::string, RadosManifestEntry> &entries);
+  static void remove_entries(librados::ObjectWriteOperation *op, const std::set<std::string> &oids);
+
+  /* fill entry from the loaded metadata and size of mail */
+  static bool to_entry(RadosMailObject *mail, bool alt_storage, RadosManifestEntry *entry);
+
+ private:
+  static int read_all(librados::IoCtx *io_ctx, const std::string &oid,
+                      std::map<std::string, librados::bufferlist> *kv_map);
+  static void encode_entry(const RadosManifestEntry &entry, std::map<std::string, librados::bufferlist> *kv_map,
+                           const std::string &oid);
+  static void encode_flags(const RadosManifestEntry &entry, std::map<std::string, librados::bufferlist> *kv_map,
+                           const std::string &oid);
+  static bool decode_entry(const std::string &value, RadosManifestEntry *entry);
+  static bool decode_flags(const std::string &value, RadosManifestEntry *entry);
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_MAILBOX_MANIFEST_H_
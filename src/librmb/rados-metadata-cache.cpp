@@ -0,0 +1,92 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-metadata-cache.h"
+
+namespace librmb {
+
+std::list<RadosMetadataCache::Entry>::iterator RadosMetadataCache::find(const std::string &key) {
+  std::unordered_map<std::string, std::list<Entry>::iterator>::iterator it = index.find(key);
+  if (it == index.end()) {
+    return entries.end();
+  }
+  std::list<Entry>::iterator entry = it->second;
+  if (ttl > 0 && now() - entry->stored >= ttl) {
+    entries.erase(entry);
+    index.erase(it);
+    return entries.end();
+  }
+  return entry;
+}
+
+bool RadosMetadataCache::load(const std::string &pool, const std::string &nspace, const std::string &oid,
+                              RadosMailObject *mail) {
+  std::list<Entry>::iterator entry = find(get_key(pool, nspace, oid));
+  if (entry == entries.end()) {
+    return false;
+  }
+  entries.splice(entries.begin(), entries, entry);
+  std::map<std::string, ceph::bufferlist> metadata(entry->metadata);
+  mail->swap_metadata(&metadata);
+  *mail->get_extended_metadata() = entry->extended_metadata;
+  return true;
+}
+
+bool RadosMetadataCache::contains(const std::string &pool, const std::string &nspace, const std::string &oid) {
+  return find(get_key(pool, nspace, oid)) != entries.end();
+}
+
+void RadosMetadataCache::store(const std::string &pool, const std::string &nspace, const std::string &oid,
+                               RadosMailObject *mail) {
+  if (max_entries == 0) {
+    return;
+  }
+  std::string key = get_key(pool, nspace, oid);
+  std::unordered_map<std::string, std::list<Entry>::iterator>::iterator it = index.find(key);
+  if (it != index.end()) {
+    entries.splice(entries.begin(), entries, it->second);
+  } else {
+    entries.push_front(Entry());
+    entries.front().key = key;
+    index[key] = entries.begin();
+  }
+  entries.front().stored = now();
+  entries.front().metadata = *mail->get_metadata();
+  entries.front().extended_metadata = *mail->get_extended_metadata();
+  evict();
+}
+
+void RadosMetadataCache::invalidate(const std::string &pool, const std::string &nspace, const std::string &oid) {
+  std::unordered_map<std::string, std::list<Entry>::iterator>::iterator it = index.find(get_key(pool, nspace, oid));
+  if (it != index.end()) {
+    entries.erase(it->second);
+    index.erase(it);
+  }
+}
+
+void RadosMetadataCache::clear() {
+  entries.clear();
+  index.clear();
+}
+
+void RadosMetadataCache::set_max_entries(size_t max_entries_) {
+  max_entries = max_entries_;
+  evict();
+}
+
+void RadosMetadataCache::evict() {
+  while (index.size() > max_entries) {
+    index.erase(entries.back().key);
+    entries.pop_back();
+  }
+}
+
+}  // namespace librmb
@@ -0,0 +1,84 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_METADATA_CACHE_H_
+#define SRC_LIBRMB_RADOS_METADATA_CACHE_H_
+
+#include <time.h>
+
+#include <list>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+#include <rados/librados.hpp>
+#include "rados-mail-object.h"
+
+namespace librmb {
+
+/**
+ * Least recently used cache of the loaded metadata of mail objects.
+ *
+ * Mail objects are written once, so their metadata stays valid until it is
+ * updated by a sync or the mail is moved or expunged. Whoever changes the
+ * metadata of an object invalidates its entry. Changes of other processes
+ * aren't seen, so entries expire after ttl seconds and the cache is cleared
+ * on change notifications. Entries are keyed by pool, namespace and oid.
+ * Not thread safe.
+ */
+class RadosMetadataCache {
+ public:
+  explicit RadosMetadataCache(size_t max_entries_ = 0, time_t ttl_ = 0) : max_entries(max_entries_), ttl(ttl_) {}
+  virtual ~RadosMetadataCache() {}
+
+  /* copy the cached metadata to mail, false if the object is not cached or expired */
+  bool load(const std::string &pool, const std::string &nspace, const std::string &oid, RadosMailObject *mail);
+  /* cache the metadata loaded into mail */
+  void store(const std::string &pool, const std::string &nspace, const std::string &oid, RadosMailObject *mail);
+  bool contains(const std::string &pool, const std::string &nspace, const std::string &oid);
+  void invalidate(const std::string &pool, const std::string &nspace, const std::string &oid);
+  void clear();
+
+  /* 0 disables the cache */
+  void set_max_entries(size_t max_entries_);
+  size_t get_max_entries() { return max_entries; }
+  /* 0: entries don't expire */
+  void set_ttl(time_t ttl_) { ttl = ttl_; }
+  size_t size() { return index.size(); }
+
+ protected:
+  virtual time_t now() { return time(NULL); }
+
+ private:
+  struct Entry {
+    std::string key;
+    time_t stored;
+    std::map<std::string, librados::bufferlist> metadata;
+    std::map<std::string, librados::bufferlist> extended_metadata;
+  };
+  static std::string get_key(const std::string &pool, const std::string &nspace, const std::string &oid) {
+    return pool + '/' + nspace + '/' + oid;
+  }
+  /* the entry of key, expired entries are removed */
+  std::list<Entry>::iterator find(const std::string &key);
+  void evict();
+
+ private:
+  size_t max_entries;
+  time_t ttl;
+  // most recently used first
+  std::list<Entry> entries;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index;
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_METADATA_CACHE_H_
@@ -0,0 +1,380 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-metadata-storage-bin.h"
+
+#include <errno.h>
+#include <jansson.h>
+
+#include "encoding.h"
+#include "rados-metadata-storage-ima.h"
+#include "rados-util.h"
+
+namespace librmb {
+
+std::string RadosMetadataStorageBin::module_name = "bin";
+const std::string RadosMetadataStorageBin::RECORD_ATTRIBUTE = "bin";
+const uint8_t RadosMetadataStorageBin::VERSION = 1;
+
+// records of a future format have another marker
+static const uint8_t RECORD_MARKER = 0;
+
+enum bin_value_type { BIN_VALUE_STRING = 0, BIN_VALUE_UINT64 = 1 };
+
+RadosMetadataStorageBin::RadosMetadataStorageBin(librados::IoCtx *io_ctx_, RadosDovecotCephCfg *cfg_)
+    : io_ctx(io_ctx_), cfg(cfg_) {}
+
+RadosMetadataStorageBin::~RadosMetadataStorageBin() {}
+
+/* value is kept as integer only if it decodes to the same string again */
+static bool to_uint64(const ceph::bufferlist &bl, uint64_t *number) {
+  if (bl.length() == 0 || bl.length() > 20) {
+    return false;
+  }
+  std::string value = bl.to_str();
+  if ((value.size() > 1 && value[0] == '0') || !RadosUtils::is_numeric(value)) {
+    return false;
+  }
+  try {
+    *number = std::stoull(value);
+  } catch (const std::exception &e) {
+    return false;
+  }
+  return std::to_string(*number) == value;
+}
+
+void RadosMetadataStorageBin::encode_record(const std::map<std::string, ceph::bufferlist> &metadata,
+                                            const std::map<std::string, ceph::bufferlist> &keywords,
+                                            ceph::bufferlist *bl) {
+  encode(RECORD_MARKER, *bl);
+  encode(VERSION, *bl);
+
+  uint32_t count = 0;
+  for (std::map<std::string, ceph::bufferlist>::const_iterator it = metadata.begin(); it != metadata.end(); ++it) {
+    count += it->first.size() == 1 ? 1 : 0;
+  }
+  encode(count, *bl);
+  for (std::map<std::string, ceph::bufferlist>::const_iterator it = metadata.begin(); it != metadata.end(); ++it) {
+    // metadata keys are single rbox_metadata_key characters
+    if (it->first.size() != 1) {
+      continue;
+    }
+    encode(static_cast<uint8_t>(it->first[0]), *bl);
+    uint64_t number;
+    if (to_uint64(it->second, &number)) {
+      encode(static_cast<uint8_t>(BIN_VALUE_UINT64), *bl);
+      encode(number, *bl);
+    } else {
+      encode(static_cast<uint8_t>(BIN_VALUE_STRING), *bl);
+      encode(it->second, *bl);
+    }
+  }
+
+  encode(static_cast<uint32_t>(keywords.size()), *bl);
+  for (std::map<std::string, ceph::bufferlist>::const_iterator it = keywords.begin(); it != keywords.end(); ++it) {
+    encode(it->first, *bl);
+    encode(it->second, *bl);
+  }
+}
+
+bool RadosMetadataStorageBin::is_record(ceph::bufferlist &bl) {
+  return bl.length() >= 2 && static_cast<uint8_t>(bl.c_str()[0]) == RECORD_MARKER;
+}
+
+int RadosMetadataStorageBin::decode_record(ceph::bufferlist &bl, RadosMailObject *mail) {
+  if (!is_record(bl)) {
+    return -EINVAL;
+  }
+  try {
+    ceph::bufferlist::iterator it = bl.begin();
+    uint8_t marker, version;
+    decode(marker, it);
+    decode(version, it);
+    if (version != VERSION) {
+      return -EINVAL;
+    }
+
+    uint32_t count;
+    decode(count, it);
+    for (uint32_t i = 0; i < count; i++) {
+      uint8_t key, type;
+      decode(key, it);
+      decode(type, it);
+      // strings reference the data of bl
+      ceph::bufferlist value;
+      if (type == BIN_VALUE_UINT64) {
+        uint64_t number;
+        decode(number, it);
+        value.append(std::to_string(number));
+      } else if (type == BIN_VALUE_STRING) {
+        decode(value, it);
+      } else {
+        return -EINVAL;
+      }
+      mail->add_metadata(std::string(1, static_cast<char>(key)), value);
+    }
+
+    decode(count, it);
+    for (uint32_t i = 0; i < count; i++) {
+      std::string key;
+      decode(key, it);
+      decode((*mail->get_extended_metadata())[key], it);
+    }
+  } catch (const std::exception &e) {
+    // truncated record
+    return -EINVAL;
+  }
+  return 0;
+}
+
+bool RadosMetadataStorageBin::is_record_attribute(const std::string &key) { return key == RECORD_ATTRIBUTE; }
+
+bool RadosMetadataStorageBin::is_ima_attribute(const std::string &key) {
+  return key.compare(cfg->get_metadata_storage_attribute()) == 0;
+}
+
+int RadosMetadataStorageBin::load_attributes(RadosMailObject *mail, std::map<std::string, ceph::bufferlist> &attr) {
+  int ret = 0;
+  std::map<std::string, ceph::bufferlist>::iterator record = attr.find(RECORD_ATTRIBUTE);
+  std::map<std::string, ceph::bufferlist>::iterator ima = attr.find(cfg->get_metadata_storage_attribute());
+  if (record != attr.end()) {
+    ret = decode_record(record->second, mail);
+  } else if (ima != attr.end() && is_record(ima->second)) {
+    // written by the first version of bin
+    ret = decode_record(ima->second, mail);
+  } else if (ima != attr.end()) {
+    // written by ima
+    json_error_t error;
+    json_t *root = json_loads(ima->second.to_str().c_str(), 0, &error);
+    if (root == nullptr) {
+      ret = -EINVAL;
+    } else {
+      RadosMetadataStorageIma::parse_attribute(mail, root);
+      json_decref(root);
+    }
+  }
+
+  // single attributes override the record, as with ima. objects of the default module only have these.
+  for (std::map<std::string, ceph::bufferlist>::iterator it = attr.begin(); it != attr.end(); ++it) {
+    if (!is_record_attribute(it->first) && !is_ima_attribute(it->first)) {
+      mail->add_metadata(it->first, it->second);
+    }
+  }
+  return ret;
+}
+
+int RadosMetadataStorageBin::load_metadata(RadosMailObject *mail) {
+  if (mail == nullptr) {
+    return -1;
+  }
+  if (mail->get_metadata()->size() > 0) {
+    return 0;
+  }
+
+  std::map<std::string, ceph::bufferlist> attr;
+  int ret = io_ctx->getxattrs(mail->get_oid(), attr);
+  if (ret < 0) {
+    return ret;
+  }
+  ret = load_attributes(mail, attr);
+  if (ret < 0) {
+    return ret;
+  }
+
+  if (cfg->is_updateable_attribute(librmb::RBOX_METADATA_OLDV1_KEYWORDS)) {
+    ret = RadosUtils::get_all_keys_and_values(io_ctx, mail->get_oid(), mail->get_extended_metadata());
+  }
+  return ret;
+}
+
+void RadosMetadataStorageBin::prepare_load_metadata(librados::ObjectReadOperation *read_op, RadosMailObject *mail) {
+  // the raw attributes are read into the load buffer and decoded by finish_load_metadata
+  read_op->getxattrs(mail->get_metadata_load_buffer(), nullptr);
+  if (cfg->is_updateable_attribute(librmb::RBOX_METADATA_OLDV1_KEYWORDS)) {
+    RadosUtils::omap_get_all_vals(read_op, mail->get_extended_metadata());
+  }
+}
+
+int RadosMetadataStorageBin::finish_load_metadata(RadosMailObject *mail) {
+  std::map<std::string, ceph::bufferlist> attr;
+  std::map<std::string, ceph::bufferlist> omap;
+  attr.swap(*mail->get_metadata_load_buffer());
+  omap.swap(*mail->get_extended_metadata());
+  mail->clear_metadata();
+
+  int ret = load_attributes(mail, attr);
+  // omap values override the keywords of the record, as in load_metadata
+  for (std::map<std::string, ceph::bufferlist>::iterator it = omap.begin(); it != omap.end(); ++it) {
+    (*mail->get_extended_metadata())[it->first] = it->second;
+  }
+  return ret;
+}
+
+// it is required that mail->get_metadata is up to date before update.
+int RadosMetadataStorageBin::set_metadata(RadosMailObject *mail, RadosMetadata &xattr) {
+  enum rbox_metadata_key k = static_cast<enum rbox_metadata_key>(*xattr.key.c_str());
+  if (!cfg->is_updateable_attribute(k)) {
+    mail->add_metadata(xattr);
+    librados::ObjectWriteOperation op;
+    save_metadata(&op, mail);
+    return io_ctx->operate(mail->get_oid(), &op);
+  }
+  return io_ctx->setxattr(mail->get_oid(), xattr.key.c_str(), xattr.bl);
+}
+
+// it is required that mail->get_metadata is up to date before update.
+int RadosMetadataStorageBin::aio_set_metadata(RadosMailObject *mail, RadosMetadata &xattr) {
+  enum rbox_metadata_key k = static_cast<enum rbox_metadata_key>(*xattr.key.c_str());
+  librados::ObjectWriteOperation *op = new librados::ObjectWriteOperation();
+  if (!cfg->is_updateable_attribute(k)) {
+    mail->add_metadata(xattr);
+    save_metadata(op, mail);
+  } else {
+    op->setxattr(xattr.key.c_str(), xattr.bl);
+  }
+  return mail->get_completion_group()->aio_operate(io_ctx, mail->get_oid(), op);
+}
+
+void RadosMetadataStorageBin::save_metadata(librados::ObjectWriteOperation *write_op, RadosMailObject *mail) {
+  std::map<std::string, ceph::bufferlist> immutable;
+  std::map<std::string, ceph::bufferlist> keywords;
+
+  for (std::map<std::string, ceph::bufferlist>::const_iterator it = mail->get_metadata()->begin();
+       it != mail->get_metadata()->end(); ++it) {
+    enum rbox_metadata_key k = static_cast<enum rbox_metadata_key>(*it->first.c_str());
+    if (!cfg->is_updateable_attribute(k) || !cfg->is_update_attributes()) {
+      immutable[it->first] = it->second;
+    } else {
+      write_op->setxattr(it->first.c_str(), it->second);
+    }
+  }
+  if (mail->get_extended_metadata()->size() > 0) {
+    if (!cfg->is_updateable_attribute(librmb::RBOX_METADATA_OLDV1_KEYWORDS) || !cfg->is_update_attributes()) {
+      keywords = *mail->get_extended_metadata();
+    } else {
+      write_op->omap_set(*mail->get_extended_metadata());
+    }
+  }
+
+  ceph::bufferlist bl;
+  encode_record(immutable, keywords, &bl);
+  write_op->setxattr(RECORD_ATTRIBUTE.c_str(), bl);
+}
+
+bool RadosMetadataStorageBin::update_metadata(std::string &oid, std::list<RadosMetadata> &to_update) {
+  if (to_update.size() == 0) {
+    return true;
+  }
+
+  RadosMailObject obj;
+  obj.set_oid(oid);
+  if (load_metadata(&obj) < 0) {
+    return false;
+  }
+  for (std::list<RadosMetadata>::iterator it = to_update.begin(); it != to_update.end(); ++it) {
+    (*obj.get_extended_metadata())[it->key] = it->bl;
+  }
+
+  librados::ObjectWriteOperation write_op;
+  save_metadata(&write_op, &obj);
+  return io_ctx->operate(oid, &write_op) == 0;
+}
+
+int RadosMetadataStorageBin::prepare_update_metadata(librados::ObjectWriteOperation *write_op,
+                                                     std::list<RadosMetadata> &to_update,
+                                                     std::map<std::string, ceph::bufferlist> &set_keywords,
+                                                     std::set<std::string> &remove_keywords) {
+  for (std::list<RadosMetadata>::iterator it = to_update.begin(); it != to_update.end(); ++it) {
+    enum rbox_metadata_key k = static_cast<enum rbox_metadata_key>(*(*it).key.c_str());
+    if (!cfg->is_updateable_attribute(k) || !cfg->is_update_attributes()) {
+      // part of the binary record
+      return -EINVAL;
+    }
+    write_op->setxattr((*it).key.c_str(), (*it).bl);
+  }
+  if (set_keywords.empty() && remove_keywords.empty()) {
+    return 0;
+  }
+  if (!cfg->is_updateable_attribute(librmb::RBOX_METADATA_OLDV1_KEYWORDS) || !cfg->is_update_attributes()) {
+    return -EINVAL;
+  }
+  if (!set_keywords.empty()) {
+    write_op->omap_set(set_keywords);
+  }
+  if (!remove_keywords.empty()) {
+    write_op->omap_rm_keys(remove_keywords);
+  }
+  return 0;
+}
+
+int RadosMetadataStorageBin::convert_metadata(const std::string &oid) {
+  std::map<std::string, ceph::bufferlist> attr;
+  int ret = io_ctx->getxattrs(oid, attr);
+  if (ret < 0) {
+    return ret;
+  }
+  if (attr.find(RECORD_ATTRIBUTE) != attr.end()) {
+    // converted already
+    return 0;
+  }
+
+  RadosMailObject obj;
+  obj.set_oid(oid);
+  ret = load_attributes(&obj, attr);
+  if (ret < 0) {
+    return ret;
+  }
+
+  librados::ObjectWriteOperation write_op;
+  // the mail may have been expunged in the meantime, don't recreate it
+  write_op.assert_exists();
+  save_metadata(&write_op, &obj);
+  // the json of ima and single attributes which are part of the record now
+  for (std::map<std::string, ceph::bufferlist>::iterator it = attr.begin(); it != attr.end(); ++it) {
+    if (is_ima_attribute(it->first)) {
+      write_op.rmxattr(it->first.c_str());
+      continue;
+    }
+    if (it->first.size() != 1) {
+      continue;
+    }
+    enum rbox_metadata_key k = static_cast<enum rbox_metadata_key>(it->first[0]);
+    if (!cfg->is_updateable_attribute(k) || !cfg->is_update_attributes()) {
+      write_op.rmxattr(it->first.c_str());
+    }
+  }
+  ret = io_ctx->operate(oid, &write_op);
+  return ret < 0 ? ret : 1;
+}
+
+int RadosMetadataStorageBin::update_keyword_metadata(std::string &oid, RadosMetadata *metadata) {
+  int ret = -1;
+  if (metadata != nullptr && cfg->is_updateable_attribute(librmb::RBOX_METADATA_OLDV1_KEYWORDS) &&
+      cfg->is_update_attributes()) {
+    std::map<std::string, librados::bufferlist> map;
+    map.insert(std::pair<std::string, librados::bufferlist>(metadata->key, metadata->bl));
+    ret = io_ctx->omap_set(oid, map);
+  }
+  return ret;
+}
+
+int RadosMetadataStorageBin::remove_keyword_metadata(std::string &oid, std::string &key) {
+  std::set<std::string> keys;
+  keys.insert(key);
+  return io_ctx->omap_rm_keys(oid, keys);
+}
+
+int RadosMetadataStorageBin::load_keyword_metadata(std::string &oid, std::set<std::string> &keys,
+                                                   std::map<std::string, ceph::bufferlist> *metadata) {
+  return io_ctx->omap_get_vals_by_keys(oid, keys, metadata);
+}
+
+} /* namespace librmb */
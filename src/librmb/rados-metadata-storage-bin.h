@@ -0,0 +1,86 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_METADATA_STORAGE_BIN_H_
+#define SRC_LIBRMB_RADOS_METADATA_STORAGE_BIN_H_
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+
+#include "rados-dovecot-ceph-cfg.h"
+#include "rados-metadata-storage-module.h"
+
+namespace librmb {
+/*
+ * Like ima, all immutable mail attributes are saved in one rados
+ * attribute, but as a binary record in ceph encoding:
+ *
+ *   u8 marker (0), u8 version,
+ *   u32 count, count * (u8 key, u8 type, u64 value | string value),
+ *   u32 count, count * (string keyword index, string keyword)
+ *
+ * Decimal values are kept as integers. The record has an attribute of
+ * its own (RECORD_ATTRIBUTE), readers of ima never see it. Records
+ * written by ima (json) and attributes written by the default module
+ * are still read, so a pool can be switched to bin and converted one
+ * object at a time (rmb convert).
+ */
+class RadosMetadataStorageBin : public RadosStorageMetadataModule {
+ public:
+  RadosMetadataStorageBin(librados::IoCtx *io_ctx_, RadosDovecotCephCfg *cfg_);
+  virtual ~RadosMetadataStorageBin();
+  void set_io_ctx(librados::IoCtx *io_ctx_) { this->io_ctx = io_ctx_; }
+  int load_metadata(RadosMailObject *mail);
+  void prepare_load_metadata(librados::ObjectReadOperation *read_op, RadosMailObject *mail);
+  int finish_load_metadata(RadosMailObject *mail);
+  int set_metadata(RadosMailObject *mail, RadosMetadata &xattr);
+  int aio_set_metadata(RadosMailObject *mail, RadosMetadata &xattr);
+  bool update_metadata(std::string &oid, std::list<RadosMetadata> &to_update);
+  int prepare_update_metadata(librados::ObjectWriteOperation *write_op, std::list<RadosMetadata> &to_update,
+                              std::map<std::string, ceph::bufferlist> &set_keywords,
+                              std::set<std::string> &remove_keywords);
+  void save_metadata(librados::ObjectWriteOperation *write_op, RadosMailObject *mail);
+
+  int update_keyword_metadata(std::string &oid, RadosMetadata *metadata);
+  int remove_keyword_metadata(std::string &oid, std::string &key);
+  int load_keyword_metadata(std::string &oid, std::set<std::string> &keys,
+                            std::map<std::string, ceph::bufferlist> *metadata);
+
+  /* rewrite the metadata of an object written by the default or ima module as binary record, 1 if it was
+   * converted, 0 if it has a record already */
+  int convert_metadata(const std::string &oid);
+
+  static void encode_record(const std::map<std::string, ceph::bufferlist> &metadata,
+                            const std::map<std::string, ceph::bufferlist> &keywords, ceph::bufferlist *bl);
+  /* decode into the metadata and extended metadata of mail, -EINVAL if bl is no valid record */
+  static int decode_record(ceph::bufferlist &bl, RadosMailObject *mail);
+  static bool is_record(ceph::bufferlist &bl);
+
+ private:
+  int load_attributes(RadosMailObject *mail, std::map<std::string, ceph::bufferlist> &attr);
+  bool is_record_attribute(const std::string &key);
+  bool is_ima_attribute(const std::string &key);
+
+ public:
+  static std::string module_name;
+  static const std::string RECORD_ATTRIBUTE;
+  static const uint8_t VERSION;
+
+ private:
+  librados::IoCtx *io_ctx;
+  RadosDovecotCephCfg *cfg;
+};
+
+} /* namespace librmb */
+
+#endif /* SRC_LIBRMB_RADOS_METADATA_STORAGE_BIN_H_ */
@@ -25,7 +25,9 @@ int RadosMetadataStorageDefault::load_metadata(RadosMailObject *mail) {
   int ret = -1;
   if (mail != nullptr) {
     if (mail->get_metadata()->size() == 0) {
-      ret = io_ctx->getxattrs(mail->get_oid(), *mail->get_metadata());
+      std::map<string, ceph::bufferlist> attr;
+      ret = io_ctx->getxattrs(mail->get_oid(), attr);
+      mail->swap_metadata(&attr);
     } else {
       ret = 0;
     }
@@ -35,14 +37,33 @@ int RadosMetadataStorageDefault::load_metadata(RadosMailObject *mail) {
   }
   return ret;
 }
+void RadosMetadataStorageDefault::prepare_load_metadata(librados::ObjectReadOperation *read_op,
+                                                        RadosMailObject *mail) {
+  read_op->getxattrs(mail->get_metadata_load_buffer(), nullptr);
+  RadosUtils::omap_get_all_vals(read_op, mail->get_extended_metadata());
+}
+
+int RadosMetadataStorageDefault::finish_load_metadata(RadosMailObject *mail) {
+  mail->swap_metadata(mail->get_metadata_load_buffer());
+  mail->get_metadata_load_buffer()->clear();
+  return 0;
+}
+
 int RadosMetadataStorageDefault::set_metadata(RadosMailObject *mail, RadosMetadata &xattr) {
   mail->add_metadata(xattr);
   return io_ctx->setxattr(mail->get_oid(), xattr.key.c_str(), xattr.bl);
 }
 
+int RadosMetadataStorageDefault::aio_set_metadata(RadosMailObject *mail, RadosMetadata &xattr) {
+  mail->add_metadata(xattr);
+  librados::ObjectWriteOperation *op = new librados::ObjectWriteOperation();
+  op->setxattr(xattr.key.c_str(), xattr.bl);
+  return mail->get_completion_group()->aio_operate(io_ctx, mail->get_oid(), op);
+}
+
 void RadosMetadataStorageDefault::save_metadata(librados::ObjectWriteOperation *write_op, RadosMailObject *mail) {
   // update metadata
-  for (std::map<string, ceph::bufferlist>::iterator it = mail->get_metadata()->begin();
+  for (std::map<string, ceph::bufferlist>::const_iterator it = mail->get_metadata()->begin();
        it != mail->get_metadata()->end(); ++it) {
     write_op->setxattr((*it).first.c_str(), (*it).second);
   }
@@ -64,6 +85,21 @@ bool RadosMetadataStorageDefault::update_metadata(std::string &oid, std::list<Ra
   completion->release();
   return ret == 0;
 }
+int RadosMetadataStorageDefault::prepare_update_metadata(librados::ObjectWriteOperation *write_op,
+                                                         std::list<RadosMetadata> &to_update,
+                                                         std::map<std::string, ceph::bufferlist> &set_keywords,
+                                                         std::set<std::string> &remove_keywords) {
+  for (std::list<RadosMetadata>::iterator it = to_update.begin(); it != to_update.end(); ++it) {
+    write_op->setxattr((*it).key.c_str(), (*it).bl);
+  }
+  if (!set_keywords.empty()) {
+    write_op->omap_set(set_keywords);
+  }
+  if (!remove_keywords.empty()) {
+    write_op->omap_rm_keys(remove_keywords);
+  }
+  return 0;
+}
 int RadosMetadataStorageDefault::update_keyword_metadata(std::string &oid, RadosMetadata *metadata) {
   int ret = -1;
   if (metadata != nullptr) {
@@ -28,8 +28,14 @@ class RadosMetadataStorageDefault : public RadosStorageMetadataModule {
   void set_io_ctx(librados::IoCtx *io_ctx_) { this->io_ctx = io_ctx_; }
 
   int load_metadata(RadosMailObject *mail);
+  void prepare_load_metadata(librados::ObjectReadOperation *read_op, RadosMailObject *mail);
+  int finish_load_metadata(RadosMailObject *mail);
   int set_metadata(RadosMailObject *mail, RadosMetadata &xattr);
+  int aio_set_metadata(RadosMailObject *mail, RadosMetadata &xattr);
   bool update_metadata(std::string &oid, std::list<RadosMetadata> &to_update);
+  int prepare_update_metadata(librados::ObjectWriteOperation *write_op, std::list<RadosMetadata> &to_update,
+                              std::map<std::string, ceph::bufferlist> &set_keywords,
+                              std::set<std::string> &remove_keywords);
   void save_metadata(librados::ObjectWriteOperation *write_op, RadosMailObject *mail);
 
   int update_keyword_metadata(std::string &oid, RadosMetadata *metadata);
@@ -11,6 +11,7 @@
 
 #include "rados-metadata-storage-ima.h"
 #include "rados-util.h"
+#include <errno.h>
 #include <string.h>
 
 namespace librmb {
@@ -52,7 +53,7 @@ int RadosMetadataStorageIma::parse_attribute(RadosMailObject *mail, json_t *root
     } else {
       librados::bufferlist bl;
       bl.append(json_string_value(value));
-      (*mail->get_metadata())[key] = bl;
+      mail->add_metadata(key, bl);
     }
     iter = json_object_iter_next(root, iter);
   }
@@ -73,6 +74,17 @@ int RadosMetadataStorageIma::load_metadata(RadosMailObject *mail) {
     return ret;
   }
 
+  load_attributes(mail, attr);
+
+  // load other omap values.
+  if (cfg->is_updateable_attribute(librmb::RBOX_METADATA_OLDV1_KEYWORDS)) {
+    ret = RadosUtils::get_all_keys_and_values(io_ctx, mail->get_oid(), mail->get_extended_metadata());
+  }
+
+  return ret;
+}
+
+void RadosMetadataStorageIma::load_attributes(RadosMailObject *mail, std::map<std::string, ceph::bufferlist> &attr) {
   if (attr.find(cfg->get_metadata_storage_attribute()) != attr.end()) {
     // json object for immutable attributes.
     json_t *root;
@@ -86,16 +98,32 @@ int RadosMetadataStorageIma::load_metadata(RadosMailObject *mail) {
   // load other attributes
   for (std::map<string, ceph::bufferlist>::iterator it = attr.begin(); it != attr.end(); ++it) {
     if ((*it).first.compare(cfg->get_metadata_storage_attribute()) != 0) {
-      (*mail->get_metadata())[(*it).first] = (*it).second;
+      mail->add_metadata((*it).first, (*it).second);
     }
   }
+}
 
-  // load other omap values.
+void RadosMetadataStorageIma::prepare_load_metadata(librados::ObjectReadOperation *read_op, RadosMailObject *mail) {
+  // the raw attributes are read into the load buffer and prepared by finish_load_metadata
+  read_op->getxattrs(mail->get_metadata_load_buffer(), nullptr);
   if (cfg->is_updateable_attribute(librmb::RBOX_METADATA_OLDV1_KEYWORDS)) {
-    ret = RadosUtils::get_all_keys_and_values(io_ctx, mail->get_oid(), mail->get_extended_metadata());
+    RadosUtils::omap_get_all_vals(read_op, mail->get_extended_metadata());
   }
+}
 
-  return ret;
+int RadosMetadataStorageIma::finish_load_metadata(RadosMailObject *mail) {
+  std::map<string, ceph::bufferlist> attr;
+  std::map<string, ceph::bufferlist> omap;
+  attr.swap(*mail->get_metadata_load_buffer());
+  omap.swap(*mail->get_extended_metadata());
+  mail->clear_metadata();
+
+  load_attributes(mail, attr);
+  // omap values override the keywords of the json object, as in load_metadata
+  for (std::map<string, ceph::bufferlist>::iterator it = omap.begin(); it != omap.end(); ++it) {
+    (*mail->get_extended_metadata())[(*it).first] = (*it).second;
+  }
+  return 0;
 }
 
 // it is required that mail->get_metadata is up to date before update.
@@ -111,12 +139,25 @@ int RadosMetadataStorageIma::set_metadata(RadosMailObject *mail, RadosMetadata &
   }
 }
 
+// it is required that mail->get_metadata is up to date before update.
+int RadosMetadataStorageIma::aio_set_metadata(RadosMailObject *mail, RadosMetadata &xattr) {
+  enum rbox_metadata_key k = static_cast<enum rbox_metadata_key>(*xattr.key.c_str());
+  librados::ObjectWriteOperation *op = new librados::ObjectWriteOperation();
+  if (!cfg->is_updateable_attribute(k)) {
+    mail->add_metadata(xattr);
+    save_metadata(op, mail);
+  } else {
+    op->setxattr(xattr.key.c_str(), xattr.bl);
+  }
+  return mail->get_completion_group()->aio_operate(io_ctx, mail->get_oid(), op);
+}
+
 void RadosMetadataStorageIma::save_metadata(librados::ObjectWriteOperation *write_op, RadosMailObject *mail) {
   char *s = NULL;
   json_t *root = json_object();
   librados::bufferlist bl;
   if (mail->get_metadata()->size() > 0) {
-    for (std::map<string, ceph::bufferlist>::iterator it = mail->get_metadata()->begin();
+    for (std::map<string, ceph::bufferlist>::const_iterator it = mail->get_metadata()->begin();
          it != mail->get_metadata()->end(); ++it) {
       enum rbox_metadata_key k = static_cast<enum rbox_metadata_key>(*(*it).first.c_str());
       if (!cfg->is_updateable_attribute(k) || !cfg->is_update_attributes()) {
@@ -174,6 +215,32 @@ bool RadosMetadataStorageIma::update_metadata(std::string &oid, std::list<RadosM
   completion->release();
   return ret == 0;
 }
+int RadosMetadataStorageIma::prepare_update_metadata(librados::ObjectWriteOperation *write_op,
+                                                     std::list<RadosMetadata> &to_update,
+                                                     std::map<std::string, ceph::bufferlist> &set_keywords,
+                                                     std::set<std::string> &remove_keywords) {
+  for (std::list<RadosMetadata>::iterator it = to_update.begin(); it != to_update.end(); ++it) {
+    enum rbox_metadata_key k = static_cast<enum rbox_metadata_key>(*(*it).key.c_str());
+    if (!cfg->is_updateable_attribute(k) || !cfg->is_update_attributes()) {
+      // part of the json attribute
+      return -EINVAL;
+    }
+    write_op->setxattr((*it).key.c_str(), (*it).bl);
+  }
+  if (set_keywords.empty() && remove_keywords.empty()) {
+    return 0;
+  }
+  if (!cfg->is_updateable_attribute(librmb::RBOX_METADATA_OLDV1_KEYWORDS) || !cfg->is_update_attributes()) {
+    return -EINVAL;
+  }
+  if (!set_keywords.empty()) {
+    write_op->omap_set(set_keywords);
+  }
+  if (!remove_keywords.empty()) {
+    write_op->omap_rm_keys(remove_keywords);
+  }
+  return 0;
+}
 int RadosMetadataStorageIma::update_keyword_metadata(std::string &oid, RadosMetadata *metadata) {
   int ret = -1;
   if (metadata != nullptr) {
@@ -16,6 +16,7 @@
 #include "rados-metadata-storage-module.h"
 #include "rados-metadata-storage-default.h"
 #include "rados-metadata-storage-ima.h"
+#include "rados-metadata-storage-bin.h"
 #include "rados-metadata-storage.h"
 
 namespace librmb {
@@ -41,6 +42,8 @@ class RadosMetadataStorageImpl : public RadosMetadataStorage {
       std::string storage_module_name = cfg_->get_metadata_storage_module();
       if (storage_module_name.compare(librmb::RadosMetadataStorageIma::module_name) == 0) {
         storage = new librmb::RadosMetadataStorageIma(io_ctx, cfg_);
+      } else if (storage_module_name.compare(librmb::RadosMetadataStorageBin::module_name) == 0) {
+        storage = new librmb::RadosMetadataStorageBin(io_ctx, cfg_);
       } else {
         storage = new librmb::RadosMetadataStorageDefault(io_ctx);
       }
@@ -23,10 +23,21 @@ class RadosStorageMetadataModule {
   virtual void set_io_ctx(librados::IoCtx *io_ctx){};
   /* load the metadta into RadosMailObject */
   virtual int load_metadata(RadosMailObject *mail) = 0;
+  /* add the reads of load_metadata to read_op, the results are stored in mail. once read_op
+   * completed successfully, finish_load_metadata prepares them like load_metadata does */
+  virtual void prepare_load_metadata(librados::ObjectReadOperation *read_op, RadosMailObject *mail) = 0;
+  virtual int finish_load_metadata(RadosMailObject *mail) = 0;
   /* set a new metadata attribute to a mail object */
   virtual int set_metadata(RadosMailObject *mail, RadosMetadata &xattr) = 0;
+  /* asynchron version of set_metadata, the operation is added to the completion group of the mail */
+  virtual int aio_set_metadata(RadosMailObject *mail, RadosMetadata &xattr) = 0;
   /* update the given metadata attributes */
   virtual bool update_metadata(std::string &oid, std::list<RadosMetadata> &to_update) = 0;
+  /* add a blind update of mutable attributes and keywords to write_op, the object is not read. -EINVAL if one of
+   * them is part of what the module keeps immutable, those need a load_metadata and save_metadata */
+  virtual int prepare_update_metadata(librados::ObjectWriteOperation *write_op, std::list<RadosMetadata> &to_update,
+                                      std::map<std::string, ceph::bufferlist> &set_keywords,
+                                      std::set<std::string> &remove_keywords) = 0;
   /* add all metadata of RadosMailObject to write_operation */
   virtual void save_metadata(librados::ObjectWriteOperation *write_op, RadosMailObject *mail) = 0;
   /* manage keywords */
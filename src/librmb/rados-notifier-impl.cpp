@@ -0,0 +1,171 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-notifier-impl.h"
+
+#include <errno.h>
+
+namespace librmb {
+
+// watchers which don't acknowledge in time don't delay the notifier, the notify is asynchronous anyway
+const uint64_t RadosNotifierImpl::NOTIFY_TIMEOUT_MS = 5000;
+// a lost watch is re-established right away a few times, afterwards only by check()
+const int RadosNotifierImpl::WATCH_RETRIES = 3;
+
+class RadosNotifierWatch : public librados::WatchCtx2 {
+ public:
+  RadosNotifierWatch(librados::IoCtx &io_ctx_, const std::string &oid_, const std::function<void()> &callback_)
+      : oid(oid_), callback(callback_), cookie(0), error(0) {
+    io_ctx.dup(io_ctx_);
+  }
+
+  int watch() {
+    std::lock_guard<std::mutex> guard(lock);
+    return io_ctx.watch2(oid, &cookie, this);
+  }
+
+  int unwatch() {
+    std::lock_guard<std::mutex> guard(lock);
+    // a lost watch has nothing to remove
+    return error < 0 ? 0 : io_ctx.unwatch2(cookie);
+  }
+
+  int check() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (error < 0) {
+      error = rewatch();
+    }
+    return error;
+  }
+
+  void handle_notify(uint64_t notify_id, uint64_t cookie_, uint64_t notifier_id, librados::bufferlist &bl) {
+    callback();
+    librados::bufferlist reply;
+    io_ctx.notify_ack(oid, notify_id, cookie_, reply);
+  }
+
+  void handle_error(uint64_t cookie_, int err) {
+    // the watch is lost, e.g. after a reconnect. notifications may have been missed in the meantime.
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      io_ctx.unwatch2(cookie_);
+      error = rewatch();
+    }
+    // the callback sees the result of the re-watch in check()
+    callback();
+  }
+
+ private:
+  // lock is held
+  int rewatch() {
+    int ret = -ENOTCONN;
+    for (int i = 0; i < RadosNotifierImpl::WATCH_RETRIES && ret < 0; i++) {
+      ret = io_ctx.watch2(oid, &cookie, this);
+    }
+    return ret;
+  }
+
+ private:
+  librados::IoCtx io_ctx;
+  std::string oid;
+  std::function<void()> callback;
+
+  std::mutex lock;
+  uint64_t cookie;
+  // < 0 while the watch is lost
+  int error;
+};
+
+RadosNotifierImpl::RadosNotifierImpl(RadosCluster *cluster_, RadosStorage *storage_)
+    : cluster(cluster_), storage(storage_), next_handle(1) {}
+
+RadosNotifierImpl::~RadosNotifierImpl() {
+  while (!watches.empty()) {
+    unwatch(watches.begin()->first);
+  }
+}
+
+int RadosNotifierImpl::watch(const std::string &oid, const std::function<void()> &callback, uint64_t *handle) {
+  // a watch needs an existing object
+  librados::ObjectWriteOperation op;
+  op.create(false);
+  int ret = storage->get_io_ctx().operate(oid, &op);
+  if (ret < 0) {
+    return ret;
+  }
+  RadosNotifierWatch *watch = new RadosNotifierWatch(storage->get_io_ctx(), oid, callback);
+  ret = watch->watch();
+  if (ret < 0) {
+    delete watch;
+    return ret;
+  }
+  std::lock_guard<std::mutex> guard(lock);
+  *handle = next_handle++;
+  watches[*handle] = watch;
+  return 0;
+}
+
+int RadosNotifierImpl::unwatch(uint64_t handle) {
+  RadosNotifierWatch *watch;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    std::map<uint64_t, RadosNotifierWatch *>::iterator it = watches.find(handle);
+    if (it == watches.end()) {
+      return -ENOENT;
+    }
+    watch = it->second;
+    watches.erase(it);
+  }
+  int ret = watch->unwatch();
+  // callbacks already dispatched still use the watch
+  cluster->watch_flush();
+  delete watch;
+  return ret;
+}
+
+int RadosNotifierImpl::check(uint64_t handle) {
+  RadosNotifierWatch *watch;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    std::map<uint64_t, RadosNotifierWatch *>::iterator it = watches.find(handle);
+    if (it == watches.end()) {
+      return -ENOENT;
+    }
+    watch = it->second;
+  }
+  return watch->check();
+}
+
+struct RadosNotifyOp {
+  librados::AioCompletion *completion;
+  librados::bufferlist bl;
+  librados::bufferlist reply;
+};
+
+int RadosNotifierImpl::notify(const std::string &oid) {
+  RadosNotifyOp *op = new RadosNotifyOp();
+  op->completion = librados::Rados::aio_create_completion(op, notify_complete_cb, nullptr);
+  int ret = storage->get_io_ctx().aio_notify(oid, op->completion, op->bl, NOTIFY_TIMEOUT_MS, &op->reply);
+  if (ret < 0) {
+    op->completion->release();
+    delete op;
+  }
+  return ret;
+}
+
+void RadosNotifierImpl::notify_complete_cb(librados::completion_t cb, void *arg) {
+  RadosNotifyOp *op = static_cast<RadosNotifyOp *>(arg);
+  // nobody watching (-ENOENT) or slow watchers (-ETIMEDOUT) are no error of the notifier
+  op->completion->release();
+  delete op;
+}
+
+}  // namespace librmb
@@ -0,0 +1,58 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_NOTIFIER_IMPL_H_
+#define SRC_LIBRMB_RADOS_NOTIFIER_IMPL_H_
+
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <rados/librados.hpp>
+
+#include "rados-cluster.h"
+#include "rados-notifier.h"
+#include "rados-storage.h"
+
+namespace librmb {
+
+class RadosNotifierWatch;
+
+/* watch/notify of librados, the watches use the namespace the storage has when watch() is called */
+class RadosNotifierImpl : public RadosNotifier {
+ public:
+  RadosNotifierImpl(RadosCluster *cluster, RadosStorage *storage);
+  virtual ~RadosNotifierImpl();
+
+  int watch(const std::string &oid, const std::function<void()> &callback, uint64_t *handle);
+  int unwatch(uint64_t handle);
+  int notify(const std::string &oid);
+  int check(uint64_t handle);
+
+  static const int WATCH_RETRIES;
+
+ private:
+  static void notify_complete_cb(librados::completion_t cb, void *arg);
+
+ private:
+  RadosCluster *cluster;
+  RadosStorage *storage;
+
+  std::mutex lock;
+  uint64_t next_handle;
+  std::map<uint64_t, RadosNotifierWatch *> watches;
+
+  static const uint64_t NOTIFY_TIMEOUT_MS;
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_NOTIFIER_IMPL_H_
@@ -0,0 +1,49 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-notifier-local.h"
+
+#include <errno.h>
+
+namespace librmb {
+
+int RadosNotifierLocal::watch(const std::string &oid, const std::function<void()> &callback, uint64_t *handle) {
+  std::lock_guard<std::recursive_mutex> guard(lock);
+  *handle = next_handle++;
+  watches[*handle] = std::make_pair(oid, callback);
+  return 0;
+}
+
+int RadosNotifierLocal::unwatch(uint64_t handle) {
+  std::lock_guard<std::recursive_mutex> guard(lock);
+  return watches.erase(handle) > 0 ? 0 : -ENOENT;
+}
+
+int RadosNotifierLocal::check(uint64_t handle) {
+  // a local watch is never lost
+  std::lock_guard<std::recursive_mutex> guard(lock);
+  return watches.find(handle) != watches.end() ? 0 : -ENOENT;
+}
+
+int RadosNotifierLocal::notify(const std::string &oid) {
+  // the lock keeps unwatch() from returning while a callback runs, callbacks may unwatch themselves
+  std::lock_guard<std::recursive_mutex> guard(lock);
+  std::map<uint64_t, std::pair<std::string, std::function<void()> > > current(watches);
+  for (std::map<uint64_t, std::pair<std::string, std::function<void()> > >::iterator it = current.begin();
+       it != current.end(); ++it) {
+    if (it->second.first == oid && watches.find(it->first) != watches.end()) {
+      it->second.second();
+    }
+  }
+  return 0;
+}
+
+}  // namespace librmb
@@ -0,0 +1,44 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_NOTIFIER_LOCAL_H_
+#define SRC_LIBRMB_RADOS_NOTIFIER_LOCAL_H_
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "rados-notifier.h"
+
+namespace librmb {
+
+/* in-process watch/notify without a cluster, the watchers are called by notify() */
+class RadosNotifierLocal : public RadosNotifier {
+ public:
+  RadosNotifierLocal() : next_handle(1) {}
+  virtual ~RadosNotifierLocal() {}
+
+  int watch(const std::string &oid, const std::function<void()> &callback, uint64_t *handle);
+  int unwatch(uint64_t handle);
+  int notify(const std::string &oid);
+  int check(uint64_t handle);
+
+ private:
+  std::recursive_mutex lock;
+  uint64_t next_handle;
+  // handle => (oid, callback)
+  std::map<uint64_t, std::pair<std::string, std::function<void()> > > watches;
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_NOTIFIER_LOCAL_H_
@@ -0,0 +1,48 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_INTERFACES_RADOS_NOTIFIER_INTERFACE_H_
+#define SRC_LIBRMB_INTERFACES_RADOS_NOTIFIER_INTERFACE_H_
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+
+namespace librmb {
+
+/**
+ * Change notification between the processes working on a mailbox.
+ *
+ * Watchers of an object are called whenever the object is notified.
+ */
+class RadosNotifier {
+ public:
+  virtual ~RadosNotifier() {}
+
+  /* name of the notification object of a mailbox */
+  static std::string get_oid(const std::string &mailbox_guid) { return "notify." + mailbox_guid; }
+  static bool is_notify_oid(const std::string &oid) { return oid.compare(0, 7, "notify.") == 0; }
+
+  /* call callback on every notification of oid until unwatch(handle). the callback may be called from another
+   * thread */
+  virtual int watch(const std::string &oid, const std::function<void()> &callback, uint64_t *handle) = 0;
+  /* no callback is running or called once unwatch returns */
+  virtual int unwatch(uint64_t handle) = 0;
+  /* notify the watchers of oid, without waiting for them */
+  virtual int notify(const std::string &oid) = 0;
+  /* < 0 if the watch is lost and could not be re-established, notifications may have been missed. a lost watch is
+   * re-established by every call */
+  virtual int check(uint64_t handle) = 0;
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_INTERFACES_RADOS_NOTIFIER_INTERFACE_H_
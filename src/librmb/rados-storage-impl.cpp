@@ -12,6 +12,8 @@
 #include "rados-storage-impl.h"
 
 #include <algorithm>
+#include <chrono>
+#include <deque>
 #include <list>
 #include <set>
 #include <string>
@@ -31,14 +33,127 @@ using librmb::RadosStorageImpl;
 
 #define DICT_USERNAME_SEPARATOR '/'
 const char *RadosStorageImpl::CFG_OSD_MAX_WRITE_SIZE = "osd_max_write_size";
+const int RadosStorageImpl::WRITE_CHUNK_MAX_ATTEMPTS = 3;
+// failed chunks are not retried after this time or this number of retries per mail, the save is waiting for them
+const int64_t RadosStorageImpl::WRITE_CHUNK_RETRY_DEADLINE_MS = 10000;
+const int RadosStorageImpl::WRITE_CHUNK_MAX_RETRIES = 4;
+const int64_t RadosStorageImpl::WRITE_CHUNK_TARGET_LATENCY_MS = 500;
+const uint64_t RadosStorageImpl::WRITE_CHUNK_MIN_SIZE = 1024 * 1024;
+// more mail objects than this are only in use at a time while saving
+const size_t RadosStorageImpl::MAIL_OBJECT_POOL_SIZE = 64;
 
 RadosStorageImpl::RadosStorageImpl(RadosCluster *_cluster) {
   cluster = _cluster;
   max_write_size = 10;
   io_ctx_created = false;
+  write_window = 4;
+  write_chunk_size = 0;
+}
+
+RadosStorageImpl::~RadosStorageImpl() {
+  for (std::vector<librmb::RadosMailObject *>::iterator it = mail_object_pool.begin(); it != mail_object_pool.end();
+       ++it) {
+    delete *it;
+  }
+}
+
+int RadosStorageImpl::aio_write_chunk(const std::string &oid, ChunkWrite *chunk) {
+  chunk->op = new librados::ObjectWriteOperation();
+  chunk->op->write(chunk->offset, chunk->data);
+  chunk->completion = librados::Rados::aio_create_completion();
+  chunk->start = std::chrono::steady_clock::now();
+  chunk->attempts++;
+
+  int ret = get_io_ctx().aio_operate(oid, chunk->completion, chunk->op);
+  if (ret < 0) {
+    chunk->completion->release();
+    delete chunk->op;
+  }
+  return ret;
+}
+
+int RadosStorageImpl::wait_write_chunk(ChunkWrite *chunk) {
+  chunk->completion->wait_for_complete();
+  int ret = chunk->completion->get_return_value();
+  chunk->completion->release();
+  delete chunk->op;
+  return ret;
+}
+
+bool RadosStorageImpl::is_transient_write_error(const int &ret) {
+  // e.g. rados_osd_op_timeout, anything else fails again
+  return ret == -ETIMEDOUT || ret == -EAGAIN || ret == -EBUSY || ret == -EINTR;
+}
+
+void RadosStorageImpl::adapt_write_chunk_size(const uint64_t &length, const int64_t &latency_ms) {
+  // only full chunks say something about the latency of the chunk size
+  if (length < write_chunk_size) {
+    return;
+  }
+  if (latency_ms > WRITE_CHUNK_TARGET_LATENCY_MS) {
+    write_chunk_size = std::max(write_chunk_size / 2, WRITE_CHUNK_MIN_SIZE);
+  } else if (latency_ms < WRITE_CHUNK_TARGET_LATENCY_MS / 2) {
+    write_chunk_size = std::min(write_chunk_size * 2, static_cast<uint64_t>(get_max_write_size_bytes()));
+  }
+}
+
+int RadosStorageImpl::write_chunks(RadosMailObject *mail, const uint64_t &offset, const uint64_t &length) {
+  std::deque<ChunkWrite *> in_flight;
+  uint64_t pos = 0;
+  int ret = 0;
+  // the caller waits for the retries, so they are bounded per mail in number and time
+  int retries = WRITE_CHUNK_MAX_RETRIES;
+  std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(WRITE_CHUNK_RETRY_DEADLINE_MS);
+
+  while (ret >= 0 && (pos < length || !in_flight.empty())) {
+    if (pos < length && in_flight.size() < static_cast<size_t>(write_window)) {
+      ChunkWrite *chunk = new ChunkWrite();
+      uint64_t chunk_length = std::min(write_chunk_size, length - pos);
+      chunk->offset = offset + pos;
+      chunk->data.substr_of(*mail->get_mail_buffer(), pos, chunk_length);
+      chunk->attempts = 0;
+      ret = aio_write_chunk(mail->get_oid(), chunk);
+      if (ret < 0) {
+        delete chunk;
+        break;
+      }
+      in_flight.push_back(chunk);
+      pos += chunk_length;
+      continue;
+    }
+
+    ChunkWrite *chunk = in_flight.front();
+    in_flight.pop_front();
+    int chunk_ret = wait_write_chunk(chunk);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    int64_t latency_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - chunk->start).count();
+
+    if (chunk_ret >= 0) {
+      adapt_write_chunk_size(chunk->data.length(), latency_ms);
+    } else if (chunk->attempts < WRITE_CHUNK_MAX_ATTEMPTS && retries > 0 && now < deadline &&
+               is_transient_write_error(chunk_ret)) {
+      // retry the failed chunk only, behind the chunks in flight
+      retries--;
+      ret = aio_write_chunk(mail->get_oid(), chunk);
+      if (ret >= 0) {
+        in_flight.push_back(chunk);
+        continue;
+      }
+    } else {
+      ret = chunk_ret;
+    }
+    delete chunk;
+  }
+
+  // error: wait for the remaining writes, before the caller removes the object
+  for (std::deque<ChunkWrite *>::iterator it = in_flight.begin(); it != in_flight.end(); ++it) {
+    wait_write_chunk(*it);
+    delete *it;
+  }
+  return ret;
 }
 
-RadosStorageImpl::~RadosStorageImpl() {}
 int RadosStorageImpl::split_buffer_and_exec_op(RadosMailObject *current_object,
                                                librados::ObjectWriteOperation *write_op_xattr,
                                                const uint64_t &max_write) {
@@ -46,50 +161,54 @@ int RadosStorageImpl::split_buffer_and_exec_op(RadosMailObject *current_object,
     return -1;
   }
 
-  uint64_t length = 0;
-  librados::ObjectWriteOperation *op = nullptr;
-  librados::AioCompletion *completion = nullptr;
-  int ret_val, offset = 0;
+  int ret_val = 0;
   uint64_t write_buffer_size = current_object->get_mail_size();
+  // chunks written by save_mail_chunk are no longer part of the mail buffer
+  uint64_t flushed_size = current_object->get_flushed_size();
+  uint64_t tail_size = write_buffer_size - flushed_size;
 
-  // split the buffer.
-  ceph::bufferlist tmp_buffer;
   assert(max_write > 0);
+  if (write_chunk_size == 0 || write_chunk_size > max_write) {
+    write_chunk_size = max_write;
+  }
 
-  uint64_t rest = write_buffer_size % max_write;
-  int div = write_buffer_size / max_write + (rest > 0 ? 1 : 0);
-  for (int i = 0; i < div; i++) {
-    offset = i * max_write;
-
-    op = (i == 0) ? write_op_xattr : new librados::ObjectWriteOperation();
-
-    length = max_write;
-    if (write_buffer_size < ((i + 1) * length)) {
-      length = rest;
-    }
 #ifdef HAVE_ALLOC_HINT_2
-    op->set_alloc_hint2(write_buffer_size, length, librados::ALLOC_HINT_FLAG_COMPRESSIBLE);
+  write_op_xattr->set_alloc_hint2(write_buffer_size, std::min(tail_size, write_chunk_size),
+                                  librados::ALLOC_HINT_FLAG_COMPRESSIBLE);
 #else
-    op->set_alloc_hint(write_buffer_size, length);
+  write_op_xattr->set_alloc_hint(write_buffer_size, std::min(tail_size, write_chunk_size));
 #endif
-    if (div == 1) {
-      op->write(0, *current_object->get_mail_buffer());
-    } else {
-      tmp_buffer.clear();
-      tmp_buffer.substr_of(*current_object->get_mail_buffer(), offset, length);
-      op->write(offset, tmp_buffer);
+  if (tail_size > write_chunk_size) {
+    // write the data in a window of chunks, the metadata operation follows once all chunks are written.
+    ret_val = write_chunks(current_object, flushed_size, tail_size);
+    if (ret_val < 0) {
+      delete write_op_xattr;
+      return ret_val;
     }
-    completion = librados::Rados::aio_create_completion();
+  } else if (tail_size > 0) {
+    write_op_xattr->write(flushed_size, *current_object->get_mail_buffer());
+  }
 
-    (*current_object->get_completion_op_map())[completion] = op;
+  return current_object->get_completion_group()->aio_operate(&get_io_ctx(), current_object->get_oid(),
+                                                             write_op_xattr);
+}
 
-    ret_val = get_io_ctx().aio_operate(current_object->get_oid(), completion, op);
-    if (ret_val < 0) {
-      break;
-    }
+int RadosStorageImpl::save_mail_chunk(RadosMailObject *mail, librados::bufferlist &chunk) {
+  if (!cluster->is_connected() || !io_ctx_created) {
+    return -1;
   }
+  // respect the write window, buffers of written chunks are freed by the completion callback
+  mail->get_completion_group()->wait_below(write_window);
+
+  librados::ObjectWriteOperation *op = new librados::ObjectWriteOperation();
+  op->write(mail->get_flushed_size(), chunk);
 
-  return ret_val;
+  int ret = mail->get_completion_group()->aio_operate(&get_io_ctx(), mail->get_oid(), op);
+  if (ret < 0) {
+    return ret;
+  }
+  mail->set_flushed_size(mail->get_flushed_size() + chunk.length());
+  return 0;
 }
 
 int RadosStorageImpl::save_mail(const std::string &oid, librados::bufferlist &buffer) {
@@ -100,8 +219,78 @@ int RadosStorageImpl::read_mail(const std::string &oid, librados::bufferlist *bu
   if (!cluster->is_connected() || !io_ctx_created) {
     return -1;
   }
-  size_t max = INT_MAX;
-  return get_io_ctx().read(oid, *buffer, max, 0);
+  // a length of 0 reads up to the end of the object, without a stat first
+  return get_io_ctx().read(oid, *buffer, 0, 0);
+}
+
+int RadosStorageImpl::read_mail(const std::string &oid, const uint64_t &size, librados::bufferlist *buffer) {
+  if (!cluster->is_connected() || !io_ctx_created) {
+    return -1;
+  }
+  if (size > INT_MAX) {
+    // return value is the number of bytes read.
+    return -EFBIG;
+  }
+  return get_io_ctx().read(oid, *buffer, size, 0);
+}
+
+int RadosStorageImpl::read_mail_object(RadosMailObject *mail, RadosStorageMetadataModule *metadata,
+                                       const bool &read_data, const uint64_t &size) {
+  if (!cluster->is_connected() || !io_ctx_created) {
+    return -1;
+  }
+  if (size > INT_MAX) {
+    return -EFBIG;
+  }
+  librados::ObjectReadOperation op;
+  uint64_t object_size = 0;
+  time_t save_date = 0;
+  int stat_ret = 0;
+  int read_ret = 0;
+
+  op.stat(&object_size, &save_date, &stat_ret);
+  if (metadata != nullptr) {
+    metadata->prepare_load_metadata(&op, mail);
+  }
+  if (read_data) {
+    mail->get_mail_buffer()->clear();
+    // a length of 0 reads up to the end of the object
+    op.read(0, size, mail->get_mail_buffer(), &read_ret);
+  }
+  int ret = get_io_ctx().operate(mail->get_oid(), &op, nullptr);
+  if (ret < 0) {
+    return ret;
+  }
+  if (stat_ret < 0) {
+    return stat_ret;
+  }
+  if (read_ret < 0) {
+    return read_ret;
+  }
+  mail->set_mail_size(object_size);
+  mail->set_rados_save_date(save_date);
+
+  if (metadata != nullptr) {
+    ret = metadata->finish_load_metadata(mail);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+  if (!read_data) {
+    return 0;
+  }
+  if (mail->get_mail_buffer()->length() > INT_MAX) {
+    return -EFBIG;
+  }
+  return mail->get_mail_buffer()->length();
+}
+
+int RadosStorageImpl::aio_read(const std::string &oid, librados::AioCompletion *c, librados::bufferlist *buffer,
+                               const uint64_t &len, const uint64_t &off) {
+  if (!cluster->is_connected() || !io_ctx_created) {
+    return -1;
+  }
+  return get_io_ctx().aio_read(oid, c, buffer, len, off);
 }
 
 
@@ -121,6 +310,81 @@ int RadosStorageImpl::delete_mail(const std::string &oid) {
   return get_io_ctx().remove(oid);
 }
 
+int RadosStorageImpl::delete_mails(const std::vector<std::string> &oids, const int &max_in_flight,
+                                   std::vector<int> *results) {
+  if (!cluster->is_connected() || !io_ctx_created) {
+    return -1;
+  }
+  std::deque<std::pair<size_t, librados::AioCompletion *>> in_flight;
+  size_t window = max_in_flight > 0 ? max_in_flight : 1;
+  size_t next = 0;
+  int failed = 0;
+
+  results->assign(oids.size(), 0);
+  while (next < oids.size() || !in_flight.empty()) {
+    if (next < oids.size() && in_flight.size() < window) {
+      librados::AioCompletion *completion = librados::Rados::aio_create_completion();
+      int ret = get_io_ctx().aio_remove(oids[next], completion);
+      if (ret < 0) {
+        completion->release();
+        (*results)[next] = ret;
+        failed++;
+      } else {
+        in_flight.push_back(std::make_pair(next, completion));
+      }
+      next++;
+      continue;
+    }
+    // window is full: removes complete roughly in order, wait for the oldest one
+    std::pair<size_t, librados::AioCompletion *> oldest = in_flight.front();
+    in_flight.pop_front();
+    oldest.second->wait_for_complete();
+    int ret = oldest.second->get_return_value();
+    oldest.second->release();
+    if (ret < 0) {
+      (*results)[oldest.first] = ret;
+      failed++;
+    }
+  }
+  return failed;
+}
+
+int RadosStorageImpl::load_metadata(const std::vector<RadosMailObject *> &mails, RadosStorageMetadataModule *metadata,
+                                    std::vector<int> *results) {
+  if (!cluster->is_connected() || !io_ctx_created) {
+    return -1;
+  }
+  std::vector<librados::ObjectReadOperation *> ops(mails.size(), nullptr);
+  std::vector<librados::AioCompletion *> completions(mails.size(), nullptr);
+  int failed = 0;
+
+  results->assign(mails.size(), 0);
+  for (size_t i = 0; i < mails.size(); i++) {
+    ops[i] = new librados::ObjectReadOperation();
+    metadata->prepare_load_metadata(ops[i], mails[i]);
+    completions[i] = librados::Rados::aio_create_completion();
+    int ret = get_io_ctx().aio_operate(mails[i]->get_oid(), completions[i], ops[i], nullptr);
+    if (ret < 0) {
+      completions[i]->release();
+      completions[i] = nullptr;
+      (*results)[i] = ret;
+    }
+  }
+  for (size_t i = 0; i < mails.size(); i++) {
+    if (completions[i] != nullptr) {
+      completions[i]->wait_for_complete();
+      int ret = completions[i]->get_return_value();
+      completions[i]->release();
+      (*results)[i] = ret < 0 ? ret : metadata->finish_load_metadata(mails[i]);
+    }
+    delete ops[i];
+    if ((*results)[i] < 0) {
+      failed++;
+    }
+  }
+  return failed;
+}
+
 int RadosStorageImpl::aio_operate(librados::IoCtx *io_ctx_, const std::string &oid, librados::AioCompletion *c,
                                   librados::ObjectWriteOperation *op) {
   if (!cluster->is_connected() || !io_ctx_created) {
@@ -134,6 +398,15 @@ int RadosStorageImpl::aio_operate(librados::IoCtx *io_ctx_, const std::string &o
   }
 }
 
+int RadosStorageImpl::aio_copy_from(RadosStorage *src, const std::string &oid, librados::AioCompletion *c,
+                                    librados::ObjectWriteOperation *op) {
+  if (!cluster->is_connected() || !io_ctx_created) {
+    return -1;
+  }
+  op->copy_from(oid, src->get_io_ctx(), 0);
+  return get_io_ctx().aio_operate(oid, c, op);
+}
+
 int RadosStorageImpl::stat_mail(const std::string &oid, uint64_t *psize, time_t *pmtime) {
   if (!cluster->is_connected() || !io_ctx_created) {
     return -1;
@@ -200,6 +473,7 @@ int RadosStorageImpl::create_connection(const std::string &poolname) {
   max_write_size = std::stoi(max_write_size_str);
   if (err == 0) {
     io_ctx_created = true;
+    pool_name = poolname;
   }
   return 0;
 }
@@ -209,20 +483,8 @@ void RadosStorageImpl::close_connection() {
     cluster->deinit();
   }
 }
-bool RadosStorageImpl::wait_for_write_operations_complete(
-    std::map<librados::AioCompletion *, librados::ObjectWriteOperation *> *completion_op_map) {
-  bool failed = false;
-  for (std::map<librados::AioCompletion *, librados::ObjectWriteOperation *>::iterator map_it =
-           completion_op_map->begin();
-       map_it != completion_op_map->end(); ++map_it) {
-    map_it->first->wait_for_complete_and_cb();
-    failed = map_it->first->get_return_value() < 0 || failed ? true : false;
-    // clean up
-    map_it->first->release();
-    map_it->second->remove();
-    delete map_it->second;
-  }
-  return failed;
+bool RadosStorageImpl::wait_for_write_operations_complete(RadosCompletionGroup *completion_group) {
+  return completion_group->wait() < 0;
 }
 
 bool RadosStorageImpl::wait_for_rados_operations(const std::vector<librmb::RadosMailObject *> &object_list) {
@@ -230,16 +492,11 @@ bool RadosStorageImpl::wait_for_rados_operations(const std::vector<librmb::Rados
     // wait for all writes to finish!
     // imaptest shows it's possible that begin -> continue -> finish cycle is invoked several times before
     // rbox_transaction_save_commit_pre is called.
+  // mails sharing a completion group are done with the first wait, the following ones return immediately.
   for (std::vector<librmb::RadosMailObject *>::const_iterator it_cur_obj = object_list.begin();
        it_cur_obj != object_list.end(); ++it_cur_obj) {
-    // if we come from copy mail, there is no operation to wait for.
-    if ((*it_cur_obj)->has_active_op()) {
-      bool op_failed = wait_for_write_operations_complete((*it_cur_obj)->get_completion_op_map());
-
-      ctx_failed = ctx_failed ? ctx_failed : op_failed;
-      (*it_cur_obj)->get_completion_op_map()->clear();
-      (*it_cur_obj)->set_active_op(false);
-    }
+    bool op_failed = wait_for_write_operations_complete((*it_cur_obj)->get_completion_group());
+    ctx_failed = ctx_failed ? ctx_failed : op_failed;
   }
   return ctx_failed;
 }
@@ -248,138 +505,125 @@ bool RadosStorageImpl::wait_for_rados_operations(const std::vector<librmb::Rados
 // assumes that destination io ctx is current io_ctx;
 bool RadosStorageImpl::move(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
                             std::list<RadosMetadata> &to_update, bool delete_source) {
-  if (!cluster->is_connected() || !io_ctx_created) {
+  RadosCompletionGroup completion_group;
+  if (aio_move(src_oid, src_ns, dest_oid, dest_ns, to_update, &completion_group) < 0 ||
+      completion_group.wait() < 0) {
     return false;
   }
-
-  int ret = 0;
-  librados::ObjectWriteOperation write_op;
-  librados::IoCtx src_io_ctx, dest_io_ctx;
-
-  librados::AioCompletion *completion = librados::Rados::aio_create_completion();
-
-  // destination io_ctx is current io_ctx
-  dest_io_ctx = io_ctx;
-
-  if (strcmp(src_ns, dest_ns) != 0) {
-    src_io_ctx.dup(dest_io_ctx);
-    src_io_ctx.set_namespace(src_ns);
-    dest_io_ctx.set_namespace(dest_ns);
-    write_op.copy_from(src_oid, src_io_ctx, 0);
-
-    } else {
-      src_io_ctx = dest_io_ctx;
+  if (delete_source && strcmp(src_ns, dest_ns) != 0) {
+    if (aio_delete_mail(src_oid, src_ns, &completion_group) < 0) {
+      return false;
     }
-
-    // because we create a copy, save date needs to be updated
-    // as an alternative we could use &ctx->data.save_date here if we save it to xattribute in write_metadata
-    // and restore it in read_metadata function. => save_date of copy/move will be same as source.
-    // write_op.mtime(&ctx->data.save_date);
-    time_t save_time = time(NULL);
-    write_op.mtime(&save_time);
-
-    // update metadata
-    for (std::list<RadosMetadata>::iterator it = to_update.begin(); it != to_update.end(); ++it) {
-      write_op.setxattr((*it).key.c_str(), (*it).bl);
-    }
-    ret = aio_operate(&dest_io_ctx, dest_oid, completion, &write_op);
-    if (ret >= 0) {
-      completion->wait_for_complete();
-      ret = completion->get_return_value();
-      if (delete_source && strcmp(src_ns, dest_ns) != 0 && ret == 0) {
-        ret = src_io_ctx.remove(src_oid);
-      }
-    }
-    completion->release();
-    // reset io_ctx
-    dest_io_ctx.set_namespace(dest_ns);
-    return ret == 0;
+    return completion_group.wait() == 0;
+  }
+  return true;
 }
 
 // assumes that destination io ctx is current io_ctx;
 bool RadosStorageImpl::copy(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
                             std::list<RadosMetadata> &to_update) {
-  if (!cluster->is_connected() || !io_ctx_created) {
+  RadosCompletionGroup completion_group;
+  if (aio_copy(src_oid, src_ns, dest_oid, dest_ns, to_update, &completion_group) < 0) {
     return false;
   }
+  return completion_group.wait() == 0;
+}
+
+int RadosStorageImpl::aio_move(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
+                               std::list<RadosMetadata> &to_update, RadosCompletionGroup *completion_group) {
+  // within a namespace the object stays, only its metadata is updated
+  return aio_copy_op(src_oid, src_ns, dest_oid, dest_ns, to_update, strcmp(src_ns, dest_ns) != 0, completion_group);
+}
 
-  librados::ObjectWriteOperation write_op;
-  librados::IoCtx src_io_ctx, dest_io_ctx;
+int RadosStorageImpl::aio_copy(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
+                               std::list<RadosMetadata> &to_update, RadosCompletionGroup *completion_group) {
+  return aio_copy_op(src_oid, src_ns, dest_oid, dest_ns, to_update, true, completion_group);
+}
 
+int RadosStorageImpl::aio_copy_op(std::string &src_oid, const char *src_ns, std::string &dest_oid,
+                                  const char *dest_ns, std::list<RadosMetadata> &to_update, bool copy_object,
+                                  RadosCompletionGroup *completion_group) {
+  if (!cluster->is_connected() || !io_ctx_created) {
+    return -1;
+  }
 
-  // destination io_ctx is current io_ctx
-  dest_io_ctx = io_ctx;
+  // io_ctx is shared, the namespaces are set on duplicates. librados keeps its own reference
+  // to the io context of a submitted operation.
+  librados::IoCtx dest_io_ctx;
+  dest_io_ctx.dup(io_ctx);
+  dest_io_ctx.set_namespace(dest_ns);
 
-  if (strcmp(src_ns, dest_ns) != 0) {
-    src_io_ctx.dup(dest_io_ctx);
+  librados::ObjectWriteOperation *write_op = new librados::ObjectWriteOperation();
+  if (copy_object) {
+    librados::IoCtx src_io_ctx;
+    src_io_ctx.dup(io_ctx);
     src_io_ctx.set_namespace(src_ns);
-    dest_io_ctx.set_namespace(dest_ns);
-  } else {
-    src_io_ctx = dest_io_ctx;
+    write_op->copy_from(src_oid, src_io_ctx, 0);
   }
-  write_op.copy_from(src_oid, src_io_ctx, 0);
 
   // because we create a copy, save date needs to be updated
   // as an alternative we could use &ctx->data.save_date here if we save it to xattribute in write_metadata
   // and restore it in read_metadata function. => save_date of copy/move will be same as source.
   // write_op.mtime(&ctx->data.save_date);
   time_t save_time = time(NULL);
-  write_op.mtime(&save_time);
+  write_op->mtime(&save_time);
 
   // update metadata
   for (std::list<RadosMetadata>::iterator it = to_update.begin(); it != to_update.end(); ++it) {
-    write_op.setxattr((*it).key.c_str(), (*it).bl);
+    write_op->setxattr((*it).key.c_str(), (*it).bl);
   }
-  int ret = 0;
-  librados::AioCompletion *completion = librados::Rados::aio_create_completion();
-  ret = aio_operate(&dest_io_ctx, dest_oid, completion, &write_op);
-  if (ret >= 0) {
-    ret = completion->wait_for_complete();
-    ret = completion->get_return_value();
-  }
-  completion->release();
-  // reset io_ctx
-  dest_io_ctx.set_namespace(dest_ns);
-  return ret == 0;
+  // write_op is deleted by the completion group
+  return completion_group->aio_operate(&dest_io_ctx, dest_oid, write_op);
+}
+
+int RadosStorageImpl::aio_delete_mail(const std::string &oid, const char *ns, RadosCompletionGroup *completion_group) {
+  if (!cluster->is_connected() || !io_ctx_created) {
+    return -1;
+  }
+  librados::IoCtx ns_io_ctx;
+  ns_io_ctx.dup(io_ctx);
+  ns_io_ctx.set_namespace(ns);
+
+  librados::ObjectWriteOperation *remove_op = new librados::ObjectWriteOperation();
+  remove_op->remove();
+  // removed already, e.g. by a concurrent expunge
+  return completion_group->aio_operate(&ns_io_ctx, oid, remove_op, -ENOENT);
 }
 
 // if save_async = true, don't forget to call wait_for_rados_operations e.g. wait_for_write_operations_complete
-// to wait for completion and free resources.
+// to wait for completion.
 bool RadosStorageImpl::save_mail(librados::ObjectWriteOperation *write_op_xattr, RadosMailObject *mail,
                                  bool save_async) {
-  if (!cluster->is_connected() || !io_ctx_created) {
+  if (write_op_xattr == nullptr || mail == nullptr) {
+    delete write_op_xattr;
     return false;
   }
-  if (write_op_xattr == nullptr || mail == nullptr) {
+  // the operation is owned by save_mail, also if it is not submitted
+  if (!cluster->is_connected() || !io_ctx_created) {
+    delete write_op_xattr;
     return false;
   }
   write_op_xattr->mtime(mail->get_rados_save_date());
+  // write_op_xattr is deleted by the completion group, also if the operation could not be submitted
   int ret = split_buffer_and_exec_op(mail, write_op_xattr, get_max_write_size_bytes());
-  mail->set_active_op(true);
   if (!save_async) {
     std::vector<librmb::RadosMailObject *> objects;
     objects.push_back(mail);
-    return wait_for_rados_operations(objects);
+    return !wait_for_rados_operations(objects) && ret == 0;
   }
-  if (ret != 0) {
-    write_op_xattr->remove();
-    delete write_op_xattr;
-    mail->set_active_op(false);
-  }
-
   return ret == 0;
 }
 // if save_async = true, don't forget to call wait_for_rados_operations e.g. wait_for_write_operations_complete
-// to wait for completion and free resources.
+// to wait for completion.
 bool RadosStorageImpl::save_mail(RadosMailObject *mail, bool &save_async) {
   if (!cluster->is_connected() || !io_ctx_created) {
     return false;
   }
-  // delete write_op_xattr is called after operation completes (wait_for_rados_operations)
+  // write_op_xattr is deleted once the operation completed
   librados::ObjectWriteOperation *write_op_xattr = new librados::ObjectWriteOperation();
 
   // set metadata
-  for (std::map<std::string, librados::bufferlist>::iterator it = mail->get_metadata()->begin();
+  for (std::map<std::string, librados::bufferlist>::const_iterator it = mail->get_metadata()->begin();
        it != mail->get_metadata()->end(); ++it) {
     write_op_xattr->setxattr(it->first.c_str(), it->second);
   }
@@ -389,8 +633,22 @@ bool RadosStorageImpl::save_mail(RadosMailObject *mail, bool &save_async) {
   }
   return save_mail(write_op_xattr, mail, save_async);
 }
-librmb::RadosMailObject *RadosStorageImpl::alloc_mail_object() { return new librmb::RadosMailObject(); }
+librmb::RadosMailObject *RadosStorageImpl::alloc_mail_object() {
+  if (mail_object_pool.empty()) {
+    return new librmb::RadosMailObject();
+  }
+  librmb::RadosMailObject *mail = mail_object_pool.back();
+  mail_object_pool.pop_back();
+  return mail;
+}
 void RadosStorageImpl::free_mail_object(librmb::RadosMailObject *mail) {
-  delete mail;
-  mail = nullptr;
+  if (mail == nullptr) {
+    return;
+  }
+  if (mail_object_pool.size() >= MAIL_OBJECT_POOL_SIZE) {
+    delete mail;
+    return;
+  }
+  mail->reset();
+  mail_object_pool.push_back(mail);
 }
@@ -14,8 +14,10 @@
 
 #include <stddef.h>
 
+#include <chrono>
 #include <map>
 #include <string>
+#include <vector>
 #include <cstdint>
 
 #include <rados/librados.hpp>
@@ -23,6 +25,16 @@
 #include "rados-storage.h"
 namespace librmb {
 
+/* a chunk of a mail written by write_chunks */
+struct ChunkWrite {
+  uint64_t offset;
+  ceph::bufferlist data;
+  librados::AioCompletion *completion;
+  librados::ObjectWriteOperation *op;
+  int attempts;
+  std::chrono::steady_clock::time_point start;
+};
+
 class RadosStorageImpl : public RadosStorage {
  public:
   explicit RadosStorageImpl(RadosCluster *cluster);
@@ -32,50 +44,97 @@ class RadosStorageImpl : public RadosStorage {
   int stat_mail(const std::string &oid, uint64_t *psize, time_t *pmtime);
   void set_namespace(const std::string &_nspace);
   std::string get_namespace() { return nspace; }
+  std::string get_pool_name() { return pool_name; }
   int get_max_write_size() { return max_write_size; }
   int get_max_write_size_bytes() { return max_write_size * 1024 * 1024; }
 
   int split_buffer_and_exec_op(RadosMailObject *current_object, librados::ObjectWriteOperation *write_op_xattr,
                                const uint64_t &max_write);
 
+  int save_mail_chunk(RadosMailObject *mail, librados::bufferlist &chunk);
+  void set_write_window(const int &max_ops) { write_window = max_ops > 0 ? max_ops : 1; }
+
   int delete_mail(RadosMailObject *mail);
   int delete_mail(const std::string &oid);
+  int delete_mails(const std::vector<std::string> &oids, const int &max_in_flight, std::vector<int> *results);
+  int load_metadata(const std::vector<RadosMailObject *> &mails, RadosStorageMetadataModule *metadata,
+                    std::vector<int> *results);
 
   int aio_operate(librados::IoCtx *io_ctx_, const std::string &oid, librados::AioCompletion *c,
                   librados::ObjectWriteOperation *op);
+  int aio_copy_from(RadosStorage *src, const std::string &oid, librados::AioCompletion *c,
+                    librados::ObjectWriteOperation *op);
   librados::NObjectIterator find_mails(const RadosMetadata *attr);
   int open_connection(const std::string &poolname);
   int open_connection(const std::string &poolname, const std::string &clustername, const std::string &rados_username);
   void close_connection();
-  bool wait_for_write_operations_complete(
-      std::map<librados::AioCompletion *, librados::ObjectWriteOperation *> *completion_op_map);
+  bool wait_for_write_operations_complete(RadosCompletionGroup *completion_group);
 
   bool wait_for_rados_operations(const std::vector<librmb::RadosMailObject *> &object_list);
 
   int read_mail(const std::string &oid, librados::bufferlist *buffer);
+  int read_mail(const std::string &oid, const uint64_t &size, librados::bufferlist *buffer);
+  int read_mail_object(RadosMailObject *mail, RadosStorageMetadataModule *metadata, const bool &read_data,
+                       const uint64_t &size);
+  int aio_read(const std::string &oid, librados::AioCompletion *c, librados::bufferlist *buffer, const uint64_t &len,
+               const uint64_t &off);
   bool move(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
             std::list<RadosMetadata> &to_update, bool delete_source);
   bool copy(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
             std::list<RadosMetadata> &to_update);
+  int aio_move(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
+               std::list<RadosMetadata> &to_update, RadosCompletionGroup *completion_group);
+  int aio_copy(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
+               std::list<RadosMetadata> &to_update, RadosCompletionGroup *completion_group);
+  int aio_delete_mail(const std::string &oid, const char *ns, RadosCompletionGroup *completion_group);
 
   int save_mail(const std::string &oid, librados::bufferlist &buffer);
   bool save_mail(RadosMailObject *mail, bool &save_async);
   bool save_mail(librados::ObjectWriteOperation *write_op_xattr, RadosMailObject *mail, bool save_async);
+  // mail objects are reused, e.g. by the mails of a FETCH or SEARCH
   librmb::RadosMailObject *alloc_mail_object();
 
   void free_mail_object(librmb::RadosMailObject *mail);
 
+ private:
+  int aio_copy_op(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
+                  std::list<RadosMetadata> &to_update, bool copy_object, RadosCompletionGroup *completion_group);
+
  private:
   int create_connection(const std::string &poolname);
 
+ protected:
+  int write_chunks(RadosMailObject *mail, const uint64_t &offset, const uint64_t &length);
+  /* submit the write of chunk, virtual for tests */
+  virtual int aio_write_chunk(const std::string &oid, ChunkWrite *chunk);
+  /* wait for the submitted write of chunk, returns its result */
+  virtual int wait_write_chunk(ChunkWrite *chunk);
+  void adapt_write_chunk_size(const uint64_t &length, const int64_t &latency_ms);
+  static bool is_transient_write_error(const int &ret);
+
+ protected:
+  // chunk size adapted to the observed write latency, 0 until the first large write
+  uint64_t write_chunk_size;
+
  private:
   RadosCluster *cluster;
   int max_write_size;
   std::string nspace;
+  std::string pool_name;
   librados::IoCtx io_ctx;
   bool io_ctx_created;
+  // max. number of chunk writes in flight
+  int write_window;
+  // freed mail objects, ready to be reused
+  std::vector<librmb::RadosMailObject *> mail_object_pool;
 
   static const char *CFG_OSD_MAX_WRITE_SIZE;
+  static const int WRITE_CHUNK_MAX_ATTEMPTS;
+  static const int64_t WRITE_CHUNK_RETRY_DEADLINE_MS;
+  static const int WRITE_CHUNK_MAX_RETRIES;
+  static const int64_t WRITE_CHUNK_TARGET_LATENCY_MS;
+  static const uint64_t WRITE_CHUNK_MIN_SIZE;
+  static const size_t MAIL_OBJECT_POOL_SIZE;
 };
 
 }  // namespace librmb
@@ -14,8 +14,10 @@
 
 #include <string>
 #include <map>
+#include <vector>
 
 #include "rados-mail-object.h"
+#include "rados-metadata-storage-module.h"
 #include <rados/librados.hpp>
 #include "rados-cluster.h"
 
@@ -32,6 +34,8 @@ class RadosStorage {
   virtual void set_namespace(const std::string &_nspace) = 0;
   /* get the object namespace */
   virtual std::string get_namespace() = 0;
+  /* name of the pool of the connection, empty until it is opened */
+  virtual std::string get_pool_name() = 0;
   /* get the max object size in mb */
   virtual int get_max_write_size() = 0;
   /* get the max object size in bytes */
@@ -42,12 +46,25 @@ class RadosStorage {
   virtual int split_buffer_and_exec_op(RadosMailObject *current_object, librados::ObjectWriteOperation *write_op_xattr,
                                        const uint64_t &max_write) = 0;
 
+  /* asynchron write of the next part of the mail, the chunk is written at the flushed size of the mail object */
+  virtual int save_mail_chunk(RadosMailObject *mail, librados::bufferlist &chunk) = 0;
+  /* max. number of chunk write operations per mail in flight */
+  virtual void set_write_window(const int &max_ops) = 0;
+
   /* deletes a mail object from rados*/
   virtual int delete_mail(RadosMailObject *mail) = 0;
   virtual int delete_mail(const std::string &oid) = 0;
+  /* deletes the mail objects asynchron with at most max_in_flight removes in flight. results receives the
+   * return value of each remove in the order of oids. returns the number of failed removes */
+  virtual int delete_mails(const std::vector<std::string> &oids, const int &max_in_flight,
+                           std::vector<int> *results) = 0;
   /* asynchron execution of a write operation */
   virtual int aio_operate(librados::IoCtx *io_ctx_, const std::string &oid, librados::AioCompletion *c,
                           librados::ObjectWriteOperation *op) = 0;
+  /* server side copy of the object oid of src into this storage, the osds copy data, attributes and omap.
+   * c and op belong to the caller and have to be kept until c completed */
+  virtual int aio_copy_from(RadosStorage *src, const std::string &oid, librados::AioCompletion *c,
+                            librados::ObjectWriteOperation *op) = 0;
   /* search for mails based on given Filter */
   virtual librados::NObjectIterator find_mails(const RadosMetadata *attr) = 0;
   /* open the rados connections with default cluster and username */
@@ -58,22 +75,45 @@ class RadosStorage {
   virtual void close_connection() = 0;
 
   /* wait for all write operations to complete */
-  virtual bool wait_for_write_operations_complete(
-      std::map<librados::AioCompletion*, librados::ObjectWriteOperation*>* completion_op_map) = 0;
+  virtual bool wait_for_write_operations_complete(RadosCompletionGroup *completion_group) = 0;
   virtual bool wait_for_rados_operations(const std::vector<librmb::RadosMailObject *> &object_list) = 0;
 
   /* save the mail object */
   virtual int save_mail(const std::string &oid, librados::bufferlist &buffer) = 0;
   /* read the complete mail object into bufferlist */
   virtual int read_mail(const std::string &oid, librados::bufferlist *buffer) = 0;
+  /* read the mail object of known size (e.g. physical size from index) into bufferlist */
+  virtual int read_mail(const std::string &oid, const uint64_t &size, librados::bufferlist *buffer) = 0;
+  /* stat the object into size and save date of mail, load its metadata with the metadata module (unless it is
+   * nullptr) and, if read_data, read up to size bytes of the mail (0: the complete mail) into the mail buffer.
+   * all in a single operation, returns the number of bytes read or < 0 */
+  virtual int read_mail_object(RadosMailObject *mail, RadosStorageMetadataModule *metadata, const bool &read_data,
+                               const uint64_t &size) = 0;
+  /* load the metadata of the mails with the metadata module, all reads in parallel. results receives the
+   * return value of each load in the order of mails. returns the number of failed loads */
+  virtual int load_metadata(const std::vector<RadosMailObject *> &mails, RadosStorageMetadataModule *metadata,
+                            std::vector<int> *results) = 0;
+  /* asynchron read of the given range of a mail object */
+  virtual int aio_read(const std::string &oid, librados::AioCompletion *c, librados::bufferlist *buffer,
+                       const uint64_t &len, const uint64_t &off) = 0;
   /* move a object from the given namespace to the other, updates the metadata given in to_update list */
   virtual bool move(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
                     std::list<RadosMetadata> &to_update, bool delete_source) = 0;
   /* copy a object from the given namespace to the other, updates the metadata given in to_update list */
   virtual bool copy(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
                     std::list<RadosMetadata> &to_update) = 0;
+  /* asynchron move, the operation is tracked by completion_group. the source object of a move between namespaces
+   * is not removed, remove it with aio_delete_mail once the move is complete */
+  virtual int aio_move(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
+                       std::list<RadosMetadata> &to_update, RadosCompletionGroup *completion_group) = 0;
+  /* asynchron copy, the operation is tracked by completion_group */
+  virtual int aio_copy(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
+                       std::list<RadosMetadata> &to_update, RadosCompletionGroup *completion_group) = 0;
+  /* asynchron remove of a object in the given namespace, the operation is tracked by completion_group */
+  virtual int aio_delete_mail(const std::string &oid, const char *ns, RadosCompletionGroup *completion_group) = 0;
   /* save the mail */
   virtual bool save_mail(RadosMailObject *mail, bool &save_async) = 0;
+  /* write_op_xattr is deleted once it completed or failed */
   virtual bool save_mail(librados::ObjectWriteOperation *write_op_xattr, RadosMailObject *mail, bool save_async) = 0;
   /* create a new RadosMailObject */
   virtual librmb::RadosMailObject *alloc_mail_object() = 0;
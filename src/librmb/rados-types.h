@@ -12,6 +12,8 @@
 #ifndef SRC_LIBRMB_RADOS_TYPES_H_
 #define SRC_LIBRMB_RADOS_TYPES_H_
 
+#include <cstdint>
+
 namespace librmb {
 #define GUID_128_SIZE 16
 
@@ -57,5 +59,54 @@ enum rbox_metadata_key {
   RBOX_METADATA_OLDV1_SAVE_TIME = 'S',
   RBOX_METADATA_OLDV1_SPACE = ' '
 };
+
+/* schema of the metadata table of a mail object, the position of a key is its slot */
+constexpr rbox_metadata_key RBOX_METADATA_KEYS[] = {
+    RBOX_METADATA_MAILBOX_GUID,   RBOX_METADATA_GUID,          RBOX_METADATA_POP3_UIDL,
+    RBOX_METADATA_POP3_ORDER,     RBOX_METADATA_RECEIVED_TIME, RBOX_METADATA_PHYSICAL_SIZE,
+    RBOX_METADATA_VIRTUAL_SIZE,   RBOX_METADATA_EXT_REF,       RBOX_METADATA_ORIG_MAILBOX,
+    RBOX_METADATA_MAIL_UID,       RBOX_METADATA_VERSION,       RBOX_METADATA_FROM_ENVELOPE,
+    RBOX_METADATA_PVT_FLAGS,      RBOX_METADATA_OLDV1_EXPUNGED, RBOX_METADATA_OLDV1_FLAGS,
+    RBOX_METADATA_OLDV1_KEYWORDS, RBOX_METADATA_OLDV1_SAVE_TIME, RBOX_METADATA_OLDV1_SPACE};
+constexpr int RBOX_METADATA_KEY_COUNT = sizeof(RBOX_METADATA_KEYS) / sizeof(RBOX_METADATA_KEYS[0]);
+static_assert(RBOX_METADATA_KEY_COUNT <= 32, "metadata key masks are 32 bit");
+
+/* slot of key by scanning the schema, only evaluated at compile time to fill RBOX_METADATA_INDEX */
+constexpr int rbox_metadata_scan(int key, int i = 0) {
+  return i == RBOX_METADATA_KEY_COUNT
+             ? -1
+             : (static_cast<unsigned char>(RBOX_METADATA_KEYS[i]) == key ? i : rbox_metadata_scan(key, i + 1));
+}
+
+#define RBOX_METADATA_SCAN_4(k) \
+  rbox_metadata_scan(k), rbox_metadata_scan((k) + 1), rbox_metadata_scan((k) + 2), rbox_metadata_scan((k) + 3)
+#define RBOX_METADATA_SCAN_16(k) \
+  RBOX_METADATA_SCAN_4(k), RBOX_METADATA_SCAN_4((k) + 4), RBOX_METADATA_SCAN_4((k) + 8), RBOX_METADATA_SCAN_4((k) + 12)
+#define RBOX_METADATA_SCAN_64(k)                                                                  \
+  RBOX_METADATA_SCAN_16(k), RBOX_METADATA_SCAN_16((k) + 16), RBOX_METADATA_SCAN_16((k) + 32), \
+      RBOX_METADATA_SCAN_16((k) + 48)
+/* slot of every key character, -1 for characters which are no key */
+constexpr int8_t RBOX_METADATA_INDEX[256] = {RBOX_METADATA_SCAN_64(0), RBOX_METADATA_SCAN_64(64),
+                                             RBOX_METADATA_SCAN_64(128), RBOX_METADATA_SCAN_64(192)};
+#undef RBOX_METADATA_SCAN_64
+#undef RBOX_METADATA_SCAN_16
+#undef RBOX_METADATA_SCAN_4
+
+/* slot of key, -1 if key is not part of the schema */
+constexpr int rbox_metadata_index(char key) { return RBOX_METADATA_INDEX[static_cast<unsigned char>(key)]; }
+static_assert(rbox_metadata_index(RBOX_METADATA_MAILBOX_GUID) == 0, "first slot");
+static_assert(rbox_metadata_index(RBOX_METADATA_OLDV1_SPACE) == RBOX_METADATA_KEY_COUNT - 1, "last slot");
+static_assert(rbox_metadata_index('x') == -1, "no key");
+
+/* bit of key in a key mask, 0 if key is not part of the schema */
+constexpr uint32_t rbox_metadata_bit(char key) {
+  return rbox_metadata_index(key) < 0 ? 0 : static_cast<uint32_t>(1) << rbox_metadata_index(key);
+}
+
+/* keys with a decimal value */
+constexpr uint32_t RBOX_METADATA_NUMERIC_KEYS =
+    rbox_metadata_bit(RBOX_METADATA_POP3_ORDER) | rbox_metadata_bit(RBOX_METADATA_RECEIVED_TIME) |
+    rbox_metadata_bit(RBOX_METADATA_PHYSICAL_SIZE) | rbox_metadata_bit(RBOX_METADATA_VIRTUAL_SIZE) |
+    rbox_metadata_bit(RBOX_METADATA_MAIL_UID) | rbox_metadata_bit(RBOX_METADATA_OLDV1_SAVE_TIME);
 }  // namespace
 #endif /* SRC_LIBRMB_RADOS_TYPES_H_ */
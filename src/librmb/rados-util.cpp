@@ -9,7 +9,9 @@
  * Foundation.  See file COPYING.
  */
 #include "rados-util.h"
+#include <deque>
 #include <string>
+#include <vector>
 #include <limits.h>
 #include <iostream>
 #include <sstream>
@@ -107,6 +109,15 @@ int RadosUtils::get_all_keys_and_values(librados::IoCtx *io_ctx, const std::stri
   return io_ctx->omap_get_vals_by_keys(oid, extended_keys, kv_map);
 }
 
+void RadosUtils::omap_get_all_vals(librados::ObjectReadOperation *read_op,
+                                   std::map<std::string, librados::bufferlist> *kv_map) {
+#ifdef HAVE_OMAP_GET_VALS2
+  read_op->omap_get_vals2("", LONG_MAX, kv_map, nullptr, nullptr);
+#else
+  read_op->omap_get_vals("", LONG_MAX, kv_map, nullptr);
+#endif
+}
+
 void RadosUtils::resolve_flags(const uint8_t &flags, std::string *flat) {
   std::stringbuf buf;
   std::ostream os(&buf);
@@ -150,15 +161,17 @@ int RadosUtils::osd_sub(librados::IoCtx *ioctx, const std::string &oid, const st
   return osd_add(ioctx, oid, key, -value_to_subtract);
 }
 
-std::string RadosUtils::get_metadata(librmb::rbox_metadata_key key, std::map<std::string, ceph::bufferlist> *metadata) {
+std::string RadosUtils::get_metadata(librmb::rbox_metadata_key key,
+                                     const std::map<std::string, ceph::bufferlist> *metadata) {
   string str_key(1, static_cast<char>(key));
   return get_metadata(str_key, metadata);
 }
 
-std::string RadosUtils::get_metadata(const std::string &key, std::map<std::string, ceph::bufferlist> *metadata) {
+std::string RadosUtils::get_metadata(const std::string &key, const std::map<std::string, ceph::bufferlist> *metadata) {
   std::string value;
-  if (metadata->find(key) != metadata->end()) {
-    value = (*metadata)[key].to_str();
+  std::map<std::string, ceph::bufferlist>::const_iterator it = metadata->find(key);
+  if (it != metadata->end()) {
+    value = it->second.to_str();
   }
   return value;
 }
@@ -176,7 +189,7 @@ bool RadosUtils::is_numeric_optional(std::string &text) {
   return text.find_first_not_of("0123456789") == std::string::npos;
 }
 
-bool RadosUtils::validate_metadata(map<string, ceph::bufferlist>* metadata) {
+bool RadosUtils::validate_metadata(const map<string, ceph::bufferlist>* metadata) {
   string uid = get_metadata(RBOX_METADATA_MAIL_UID, metadata);
   string recv_time_str = get_metadata(RBOX_METADATA_RECEIVED_TIME, metadata);
   string p_size = get_metadata(RBOX_METADATA_PHYSICAL_SIZE, metadata);
@@ -209,27 +222,78 @@ bool RadosUtils::validate_metadata(map<string, ceph::bufferlist>* metadata) {
 // assumes that destination is open and initialized with uses namespace
 int RadosUtils::move_to_alt(std::string &oid, RadosStorage *primary, RadosStorage *alt_storage,
                             RadosMetadataStorage *metadata, bool inverse) {
-  int ret = 0;
-  ret = copy_to_alt(oid, oid, primary, alt_storage, metadata, inverse);
-  if (ret >= 0) {
-    if (inverse) {
-      ret = alt_storage->get_io_ctx().remove(oid);
+  std::vector<std::string> oids(1, oid);
+  std::vector<int> results;
+  move_to_alt(oids, primary, alt_storage, metadata, inverse, 1, &results);
+  return results[0];
+}
+
+int RadosUtils::move_to_alt(const std::vector<std::string> &oids, RadosStorage *primary, RadosStorage *alt_storage,
+                            RadosMetadataStorage *metadata, bool inverse, const int &max_in_flight,
+                            std::vector<int> *results, bool server_side_copy) {
+  struct AltCopy {
+    size_t idx;
+    librados::AioCompletion *completion;
+    librados::ObjectWriteOperation *op;
+  };
+  RadosStorage *src = inverse ? alt_storage : primary;
+  RadosStorage *dest = inverse ? primary : alt_storage;
+  std::deque<AltCopy> in_flight;
+  size_t window = max_in_flight > 0 ? max_in_flight : 1;
+  size_t next = 0;
+
+  // the osds copy data, metadata and omap of the object, nothing is read by the client.
+  results->assign(oids.size(), server_side_copy ? 0 : -EOPNOTSUPP);
+  while (server_side_copy && (next < oids.size() || !in_flight.empty())) {
+    if (next < oids.size() && in_flight.size() < window) {
+      AltCopy copy;
+      copy.idx = next++;
+      copy.op = new librados::ObjectWriteOperation();
+      copy.completion = librados::Rados::aio_create_completion();
+      int ret = dest->aio_copy_from(src, oids[copy.idx], copy.completion, copy.op);
+      if (ret < 0) {
+        copy.completion->release();
+        delete copy.op;
+        (*results)[copy.idx] = ret;
+      } else {
+        in_flight.push_back(copy);
+      }
+      continue;
+    }
+    AltCopy copy = in_flight.front();
+    in_flight.pop_front();
+    copy.completion->wait_for_complete();
+    (*results)[copy.idx] = copy.completion->get_return_value();
+    copy.completion->release();
+    delete copy.op;
+  }
+
+  int failed = 0;
+  std::vector<std::string> copied;
+  for (size_t i = 0; i < oids.size(); i++) {
+    if ((*results)[i] < 0 && (*results)[i] != -ENOENT) {
+      // e.g. pools of different clusters, copy through the client
+      std::string oid = oids[i];
+      (*results)[i] = copy_to_alt(oid, oid, primary, alt_storage, metadata, inverse);
+    }
+    if ((*results)[i] < 0) {
+      failed++;
     } else {
-      ret = primary->get_io_ctx().remove(oid);
+      copied.push_back(oids[i]);
     }
   }
-  return ret;
+
+  // only the sources of complete copies are removed, a failed remove only leaves the source object behind.
+  std::vector<int> remove_results;
+  src->delete_mails(copied, max_in_flight, &remove_results);
+  return failed;
 }
 int RadosUtils::copy_to_alt(std::string &src_oid, std::string &dest_oid, RadosStorage *primary,
                             RadosStorage *alt_storage, RadosMetadataStorage *metadata, bool inverse) {
   int ret = 0;
 
-  // TODO; check that storage is connected and open.
-  if (primary == nullptr) {
-    return false;
-  }
-  if (alt_storage == nullptr) {
-    return false;
+  if (primary == nullptr || alt_storage == nullptr || metadata == nullptr) {
+    return -EINVAL;
   }
 
   RadosMailObject mail;
@@ -252,32 +316,26 @@ int RadosUtils::copy_to_alt(std::string &src_oid, std::string &dest_oid, RadosSt
 
   // load the metadata;
   ret = metadata->get_storage()->load_metadata(&mail);
+  metadata->get_storage()->set_io_ctx(&primary->get_io_ctx());
   if (ret < 0) {
+    delete write_op;
     return ret;
   }
 
   mail.set_oid(dest_oid);
   metadata->get_storage()->save_metadata(write_op, &mail);
 
+  // write_op is deleted by save_mail
+  RadosStorage *dest = inverse ? primary : alt_storage;
   bool async = true;
-  if (inverse) {
-    ret = primary->save_mail(write_op, &mail, async);
-  } else {
-    ret = alt_storage->save_mail(write_op, &mail, async);
+  if (!dest->save_mail(write_op, &mail, async)) {
+    return -EIO;
   }
-
-  bool success = false;
-  std::vector<librmb::RadosMailObject *> objects;
-  objects.push_back(&mail);
-  if (inverse) {
-    success = primary->wait_for_rados_operations(objects);
-    // ret = primary->aio_operate(&primary->get_io_ctx(), dest_oid, completion, &write_op);
-  } else {
-    success = alt_storage->wait_for_rados_operations(objects);
-    // ret = alt_storage->aio_operate(&alt_storage->get_io_ctx(), dest_oid, completion, &write_op);
+  // wait_for_rados_operations returns true if an operation failed
+  if (dest->wait_for_rados_operations(std::vector<librmb::RadosMailObject *>(1, &mail))) {
+    return -EIO;
   }
-
-  return success ? 0 : 1;
+  return 0;
 }
 
 }  // namespace librmb
@@ -18,6 +18,7 @@
 
 #include <string>
 #include <map>
+#include <vector>
 #include <rados/librados.hpp>
 #include "rados-storage.h"
 #include "rados-metadata-storage.h"
@@ -42,25 +43,36 @@ class RadosUtils {
 
   static void find_and_replace(std::string *source, std::string const &find, std::string const &replace);
 
+  /* add a read of all omap values to read_op */
+  static void omap_get_all_vals(librados::ObjectReadOperation *read_op,
+                                std::map<std::string, librados::bufferlist> *kv_map);
   static int get_all_keys_and_values(librados::IoCtx *io_ctx, const std::string &oid,
                                      std::map<std::string, librados::bufferlist> *kv_map);
   static void resolve_flags(const uint8_t &flags, std::string *flat);
+  /* copy the object through the client, returns 0 or < 0 */
   static int copy_to_alt(std::string &src_oid, std::string &dest_oid, RadosStorage *primary, RadosStorage *alt_storage,
                          RadosMetadataStorage *metadata, bool inverse);
   static int move_to_alt(std::string &oid, RadosStorage *primary, RadosStorage *alt_storage,
                          RadosMetadataStorage *metadata, bool inverse);
+  /* moves the objects with server side copies, at most max_in_flight moves are in flight. results receives the
+   * result of each move in the order of oids. returns the number of objects which could not be moved.
+   * objects which fail to be copied by the osds (or all with server_side_copy = false) are copied through the client,
+   * the source of an object is only removed once its copy is complete. */
+  static int move_to_alt(const std::vector<std::string> &oids, RadosStorage *primary, RadosStorage *alt_storage,
+                         RadosMetadataStorage *metadata, bool inverse, const int &max_in_flight,
+                         std::vector<int> *results, bool server_side_copy = true);
   static int osd_add(librados::IoCtx *ioctx, const std::string &oid, const std::string &key, long long value_to_add);
   static int osd_sub(librados::IoCtx *ioctx, const std::string &oid, const std::string &key,
                      long long value_to_subtract);
 
   static bool validate_metadata(
-      std::map<std::string, ceph::bufferlist>* metadata);
+      const std::map<std::string, ceph::bufferlist>* metadata);
 
   static std::string get_metadata(
       librmb::rbox_metadata_key key,
-      std::map<std::string, ceph::bufferlist>* metadata);
+      const std::map<std::string, ceph::bufferlist>* metadata);
   static std::string get_metadata(
-      const string& key, std::map<std::string, ceph::bufferlist>* metadata);
+      const string& key, const std::map<std::string, ceph::bufferlist>* metadata);
   static bool is_numeric(std::string &text);
   };
 
@@ -19,7 +19,12 @@
 #include "rados-dovecot-ceph-cfg-impl.h"
 #include "rados-namespace-manager.h"
 #include "rados-metadata-storage-ima.h"
+#include "rados-metadata-storage-bin.h"
 #include "rados-metadata-storage-default.h"
+#include "rados-mailbox-manifest.h"
+#include "rados-index-snapshot.h"
+#include "rados-mailbox-list.h"
+#include "rados-notifier.h"
 
 namespace librmb {
 
@@ -214,6 +219,56 @@ bool RmbCommands::sort_save_date(librmb::RadosMailObject *i, librmb::RadosMailOb
   return *i->get_rados_save_date() < *j->get_rados_save_date();
 }
 
+librmb::RadosMailObject *RmbCommands::load_object(librmb::RadosStorageMetadataModule *ms, const std::string &oid) {
+  uint64_t object_size = 0;
+  time_t save_date_rados;
+  int ret = storage->stat_mail(oid, &object_size, &save_date_rados);
+  if (ret != 0 || object_size <= 0) {
+    std::cout << " object '" << oid << "' is not a valid mail object, size = 0" << std::endl;
+    return nullptr;
+  }
+  librmb::RadosMailObject *mail = new librmb::RadosMailObject();
+  mail->set_oid(oid);
+  if (ms->load_metadata(mail) < 0) {
+    std::cout << " loading metadata of object '" << oid << "' faild " << std::endl;
+    delete mail;
+    return nullptr;
+  }
+
+  if (mail->get_metadata()->size() == 0) {
+    std::cout << " pool object " << oid << " is not a mail object" << std::endl;
+    delete mail;
+    return nullptr;
+  }
+
+  if (!librmb::RadosUtils::validate_metadata(mail->get_metadata())) {
+    std::cout << "object : " << oid << " metadata is not valid " << std::endl;
+    delete mail;
+    return nullptr;
+  }
+
+  mail->set_mail_size(object_size);
+  mail->set_rados_save_date(save_date_rados);
+  return mail;
+}
+
+void RmbCommands::sort_objects(std::vector<librmb::RadosMailObject *> &mail_objects, std::string &sort_string) {
+  if (sort_string.compare("uid") == 0) {
+    std::sort(mail_objects.begin(), mail_objects.end(), sort_uid);
+  } else if (sort_string.compare("recv_date") == 0) {
+    std::sort(mail_objects.begin(), mail_objects.end(), sort_recv_date);
+  } else if (sort_string.compare("phy_size") == 0) {
+    std::sort(mail_objects.begin(), mail_objects.end(), sort_phy_size);
+  } else {
+    std::sort(mail_objects.begin(), mail_objects.end(), sort_save_date);
+  }
+}
+
+bool RmbCommands::is_mail_oid(const std::string &oid) {
+  return !librmb::RadosMailboxManifest::is_manifest_oid(oid) && !librmb::RadosIndexSnapshot::is_snapshot_oid(oid) &&
+         !librmb::RadosNotifier::is_notify_oid(oid) && oid != librmb::RadosMailboxList::OID;
+}
+
 int RmbCommands::load_objects(librmb::RadosStorageMetadataModule *ms,
                               std::vector<librmb::RadosMailObject *> &mail_objects, std::string &sort_string) {
   if (ms == nullptr || storage == nullptr) {
@@ -223,58 +278,90 @@ int RmbCommands::load_objects(librmb::RadosStorageMetadataModule *ms,
   // get load all objects metadata into memory
   librados::NObjectIterator iter(storage->find_mails(nullptr));
   while (iter != librados::NObjectIterator::__EndObjectIterator) {
-    librmb::RadosMailObject *mail = new librmb::RadosMailObject();
     std::string oid = iter->get_oid();
-    uint64_t object_size = 0;
-    time_t save_date_rados;
-    int ret = storage->stat_mail(oid, &object_size, &save_date_rados);
-    if (ret != 0 || object_size <= 0) {
-      std::cout << " object '" << oid << "' is not a valid mail object, size = 0" << std::endl;
-      ++iter;
-      delete mail;
+    ++iter;
+    if (!is_mail_oid(oid)) {
       continue;
     }
-    mail->set_oid(oid);
-    if (ms->load_metadata(mail) < 0) {
-      std::cout << " loading metadata of object '" << oid << "' faild " << std::endl;
-      ++iter;
-      delete mail;
-      continue;
+    librmb::RadosMailObject *mail = load_object(ms, oid);
+    if (mail != nullptr) {
+      mail_objects.push_back(mail);
     }
+  }
 
-    if (mail->get_metadata()->size() == 0) {
-      std::cout << " pool object " << oid << " is not a mail object" << std::endl;
-      ++iter;
-      delete mail;
-      continue;
-    }
+  sort_objects(mail_objects, sort_string);
+  return 0;
+}
 
-    if (!librmb::RadosUtils::validate_metadata(mail->get_metadata())) {
-      std::cout << "object : " << oid << " metadata is not valid " << std::endl;
-      ++iter;
-      delete mail;
+int RmbCommands::load_manifest_objects(librmb::RadosStorageMetadataModule *ms,
+                                       std::vector<librmb::RadosMailObject *> &mail_objects,
+                                       std::string &sort_string, const std::string &mailbox_guid) {
+  if (ms == nullptr || storage == nullptr) {
+    return -1;
+  }
+
+  std::map<std::string, librmb::RadosManifestEntry> entries;
+  int ret = librmb::RadosMailboxManifest::load(&storage->get_io_ctx(), mailbox_guid, &entries);
+  if (ret < 0) {
+    std::cerr << " loading the manifest of mailbox " << mailbox_guid << " failed: " << ret << std::endl;
+    return ret;
+  }
+  int alt_count = 0;
+  for (std::map<std::string, librmb::RadosManifestEntry>::iterator it = entries.begin(); it != entries.end(); ++it) {
+    if (it->second.alt_storage) {
+      // not in this pool
+      alt_count++;
       continue;
     }
-
-    mail->set_mail_size(object_size);
-    mail->set_rados_save_date(save_date_rados);
-    ++iter;
-    mail_objects.push_back(mail);
+    librmb::RadosMailObject *mail = load_object(ms, it->first);
+    if (mail != nullptr) {
+      mail_objects.push_back(mail);
+    }
   }
-
-  if (sort_string.compare("uid") == 0) {
-    std::sort(mail_objects.begin(), mail_objects.end(), sort_uid);
-  } else if (sort_string.compare("recv_date") == 0) {
-    std::sort(mail_objects.begin(), mail_objects.end(), sort_recv_date);
-  } else if (sort_string.compare("phy_size") == 0) {
-    std::sort(mail_objects.begin(), mail_objects.end(), sort_phy_size);
-  } else {
-    std::sort(mail_objects.begin(), mail_objects.end(), sort_save_date);
+  if (alt_count > 0) {
+    std::cout << " " << alt_count << " mails of mailbox " << mailbox_guid << " are in the alternative storage"
+              << std::endl;
   }
 
+  sort_objects(mail_objects, sort_string);
   return 0;
 }
 
+int RmbCommands::update_manifest(std::vector<librmb::RadosMailObject *> &mail_objects,
+                                 std::vector<librmb::RadosMailObject *> &alt_mail_objects,
+                                 const std::string &mailbox_guid) {
+  // mailbox guid => (oid => entry)
+  std::map<std::string, std::map<std::string, librmb::RadosManifestEntry>> manifests;
+  std::vector<librmb::RadosMailObject *> *pools[] = {&mail_objects, &alt_mail_objects};
+  for (int i = 0; i < 2; i++) {
+    for (std::vector<librmb::RadosMailObject *>::iterator it = pools[i]->begin(); it != pools[i]->end(); ++it) {
+      std::string guid = (*it)->get_metadata(librmb::RBOX_METADATA_MAILBOX_GUID);
+      if (guid.empty() || (mailbox_guid.compare("-") != 0 && guid.compare(mailbox_guid) != 0)) {
+        continue;
+      }
+      librmb::RadosManifestEntry entry;
+      if (!librmb::RadosMailboxManifest::to_entry(*it, i == 1, &entry)) {
+        std::cout << " object " << (*it)->get_oid() << " has no uid or guid, not added to the manifest" << std::endl;
+        continue;
+      }
+      manifests[guid][(*it)->get_oid()] = entry;
+    }
+  }
+
+  int ret = 0;
+  for (auto &manifest : manifests) {
+    int ret_save = librmb::RadosMailboxManifest::save(&storage->get_io_ctx(), manifest.first, manifest.second);
+    if (ret_save < 0) {
+      std::cerr << " saving the manifest of mailbox " << manifest.first << " failed: " << ret_save << std::endl;
+      ret = ret_save;
+    } else {
+      std::cout << " manifest of mailbox " << manifest.first << " saved, " << manifest.second.size() << " mails"
+                << std::endl;
+    }
+  }
+  return ret;
+}
+
 int RmbCommands::print_mail(std::map<std::string, librmb::RadosMailBox *> *mailbox, std::string &output_dir,
                             bool download) {
   for (std::map<std::string, librmb::RadosMailBox *>::iterator it = mailbox->begin(); it != mailbox->end(); ++it) {
@@ -341,6 +428,49 @@ int RmbCommands::query_mail_storage(std::vector<librmb::RadosMailObject *> *mail
   return ret;
 }
 
+int RmbCommands::convert_metadata(librmb::RadosCephConfig &ceph_cfg, const std::string &oid) {
+  if (storage == nullptr) {
+    return -1;
+  }
+  librmb::RadosConfig dovecot_cfg;
+  dovecot_cfg.set_config_valid(true);
+  ceph_cfg.set_config_valid(true);
+  librmb::RadosDovecotCephCfgImpl cfg(dovecot_cfg, ceph_cfg);
+  librmb::RadosMetadataStorageBin bin(&storage->get_io_ctx(), &cfg);
+
+  std::vector<std::string> oids;
+  bool all = oid.compare("-") == 0;
+  if (all) {
+    librados::NObjectIterator iter(storage->find_mails(nullptr));
+    while (iter != librados::NObjectIterator::__EndObjectIterator) {
+      if (is_mail_oid(iter->get_oid())) {
+        oids.push_back(iter->get_oid());
+      }
+      ++iter;
+    }
+  } else {
+    oids.push_back(oid);
+  }
+
+  int converted = 0;
+  int failed = 0;
+  for (std::vector<std::string>::iterator it = oids.begin(); it != oids.end(); ++it) {
+    int ret = bin.convert_metadata(*it);
+    if (ret == -ENOENT && all) {
+      // expunged in the meantime
+      continue;
+    }
+    if (ret < 0) {
+      std::cerr << " converting the metadata of " << *it << " failed: " << ret << std::endl;
+      failed++;
+    } else {
+      converted += ret;
+    }
+  }
+  std::cout << " " << converted << " of " << oids.size() << " mails converted" << std::endl;
+  return failed > 0 ? -1 : 0;
+}
+
 RadosStorageMetadataModule *RmbCommands::init_metadata_storage_module(librmb::RadosCephConfig &ceph_cfg,
                                                                       std::string *uid) {
   librmb::RadosConfig dovecot_cfg;
@@ -359,6 +489,8 @@ RadosStorageMetadataModule *RmbCommands::init_metadata_storage_module(librmb::Ra
   std::string storage_module_name = ceph_cfg.get_metadata_storage_module();
   if (storage_module_name.compare(librmb::RadosMetadataStorageIma::module_name) == 0) {
     ms = new librmb::RadosMetadataStorageIma(&storage->get_io_ctx(), &cfg);
+  } else if (storage_module_name.compare(librmb::RadosMetadataStorageBin::module_name) == 0) {
+    ms = new librmb::RadosMetadataStorageBin(&storage->get_io_ctx(), &cfg);
   } else {
     ms = new librmb::RadosMetadataStorageDefault(&storage->get_io_ctx());
   }
@@ -45,6 +45,15 @@ class RmbCommands {
 
   int load_objects(librmb::RadosStorageMetadataModule *ms, std::vector<librmb::RadosMailObject *> &mail_objects,
                    std::string &sort_string);
+  /* load the mails listed by the manifest of the mailbox */
+  int load_manifest_objects(librmb::RadosStorageMetadataModule *ms, std::vector<librmb::RadosMailObject *> &mail_objects,
+                            std::string &sort_string, const std::string &mailbox_guid);
+  /* (re)build the manifest of mailbox_guid, or of all mailboxes with mailbox_guid = "-", from the loaded mails */
+  int update_manifest(std::vector<librmb::RadosMailObject *> &mail_objects,
+                      std::vector<librmb::RadosMailObject *> &alt_mail_objects, const std::string &mailbox_guid);
+
+  /* rewrite the metadata of oid, or of all mails of the namespace with oid = "-", as records of the bin module */
+  int convert_metadata(librmb::RadosCephConfig &ceph_cfg, const std::string &oid);
 
   int print_mail(std::map<std::string, librmb::RadosMailBox *> *mailbox, std::string &output_dir, bool download);
   int query_mail_storage(std::vector<librmb::RadosMailObject *> *mail_objects, librmb::CmdLineParser *parser,
@@ -55,6 +64,12 @@ class RmbCommands {
   static bool sort_phy_size(librmb::RadosMailObject *i, librmb::RadosMailObject *j);
   static bool sort_save_date(librmb::RadosMailObject *i, librmb::RadosMailObject *j);
 
+ private:
+  librmb::RadosMailObject *load_object(librmb::RadosStorageMetadataModule *ms, const std::string &oid);
+  /* false for the objects of the plugin which are no mails */
+  static bool is_mail_oid(const std::string &oid);
+  static void sort_objects(std::vector<librmb::RadosMailObject *> &mail_objects, std::string &sort_string);
+
  private:
   std::map<std::string, std::string> *opts;
   librmb::RadosStorage *storage;
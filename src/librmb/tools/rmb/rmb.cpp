@@ -159,6 +159,8 @@ static void usage(std::ostream &out) {
          "   -c    rados cluster name, default: 'ceph'\n"
          "   -u    rados user name, default: 'client.admin' \n"
          "   -D    debug output \n"
+         "   -M    mailbox guid, ls and get read the mails of the mailbox from its manifest\n"
+         "   -a    alternative storage pool, used by manifest\n"
          "\n"
          "\nMAIL COMMANDS\n"
          "    ls -    list all mails and mailbox statistic\n"
@@ -173,6 +175,11 @@ static void usage(std::ostream &out) {
          "    set     oid metadata value   e.g. U 1 B INBOX R \"2017-08-22 14:30\"\n"
          "    sort    values: uid, recv_date, save_date, phy_size\n"
          "    lspools list all available pools\n"
+         "    manifest mailbox_guid  (re)builds the manifest of the mailbox from the pool objects,\n"
+         "            use - to build the manifests of all mailboxes of the user. mails saved meanwhile\n"
+         "            are kept, a manifest rebuilt by someone else at the same time fails (-ECANCELED)\n"
+         "    convert oid  rewrites the metadata of the mail as binary record (rbox_metadata_storage=bin),\n"
+         "            use - to convert all mails of the user. converted mails can't be read by ima anymore\n"
          "\n"
          "    delete  deletes the ceph object, use oid attribute to identify mail.\n"
          "    rename  dovecot_user_name, rename a user\n"
@@ -232,6 +239,14 @@ static void parse_cmd_line_args(std::map<std::string, std::string> *opts, bool &
       (*opts)["rados_user"] = val;
     } else if (ceph_argparse_witharg(args, &i, &val, "-D", "--debug", static_cast<char>(NULL))) {
       (*opts)["debug"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "-M", "--manifest_mailbox", static_cast<char>(NULL))) {
+      (*opts)["manifest_mailbox"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "-a", "--alt", static_cast<char>(NULL))) {
+      (*opts)["alt_pool"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "manifest", "--manifest", static_cast<char>(NULL))) {
+      (*opts)["manifest"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "convert", "--convert", static_cast<char>(NULL))) {
+      (*opts)["convert"] = val;
     } else if (ceph_argparse_witharg(args, &i, &val, "ls", "--ls", static_cast<char>(NULL))) {
       (*opts)["ls"] = val;
     } else if (ceph_argparse_witharg(args, &i, &val, "get", "--get", static_cast<char>(NULL))) {
@@ -387,7 +402,11 @@ int main(int argc, const char **argv) {
   } else if (opts.find("ls") != opts.end()) {
     librmb::CmdLineParser parser(opts["ls"]);
     if (opts["ls"].compare("all") == 0 || opts["ls"].compare("-") == 0 || parser.parse_ls_string()) {
-      rmb_commands->load_objects(ms, mail_objects, sort_type);
+      if (opts.find("manifest_mailbox") != opts.end()) {
+        rmb_commands->load_manifest_objects(ms, mail_objects, sort_type, opts["manifest_mailbox"]);
+      } else {
+        rmb_commands->load_objects(ms, mail_objects, sort_type);
+      }
       rmb_commands->query_mail_storage(&mail_objects, &parser, false);
     }
   } else if (opts.find("get") != opts.end()) {
@@ -408,9 +427,45 @@ int main(int argc, const char **argv) {
 
     if (opts["get"].compare("all") == 0 || opts["get"].compare("-") == 0 || parser.parse_ls_string()) {
       // get load all objects metadata into memory
-      rmb_commands->load_objects(ms, mail_objects, sort_type);
+      if (opts.find("manifest_mailbox") != opts.end()) {
+        rmb_commands->load_manifest_objects(ms, mail_objects, sort_type, opts["manifest_mailbox"]);
+      } else {
+        rmb_commands->load_objects(ms, mail_objects, sort_type);
+      }
       rmb_commands->query_mail_storage(&mail_objects, &parser, true);
     }
+  } else if (opts.find("manifest") != opts.end()) {
+    std::vector<librmb::RadosMailObject *> alt_mail_objects;
+    bool alt_loaded = true;
+    rmb_commands->load_objects(ms, mail_objects, sort_type);
+    if (opts.find("alt_pool") != opts.end()) {
+      alt_loaded = false;
+      librmb::RadosStorageImpl alt_storage(&cluster);
+      int ret = alt_storage.open_connection(opts["alt_pool"], rados_cluster, rados_user);
+      if (ret < 0) {
+        std::cerr << " error opening the alternative storage pool. Errorcode: " << ret << std::endl;
+      } else {
+        librmb::RmbCommands alt_commands(&alt_storage, &cluster, &opts);
+        librmb::RadosStorageMetadataModule *alt_ms = alt_commands.init_metadata_storage_module(ceph_cfg, &uid);
+        if (alt_ms != nullptr) {
+          alt_loaded = alt_commands.load_objects(alt_ms, alt_mail_objects, sort_type) >= 0;
+          delete alt_ms;
+        }
+      }
+    }
+    // without the mails of the alternative storage the manifest would be incomplete
+    if (alt_loaded) {
+      if (rmb_commands->update_manifest(mail_objects, alt_mail_objects, opts["manifest"]) < 0) {
+        std::cerr << "error updating the manifest" << std::endl;
+      }
+    }
+    for (auto mo : alt_mail_objects) {
+      delete mo;
+    }
+  } else if (opts.find("convert") != opts.end()) {
+    if (rmb_commands->convert_metadata(ceph_cfg, opts["convert"]) < 0) {
+      std::cerr << "error converting the metadata" << std::endl;
+    }
   } else if (opts.find("set") != opts.end()) {
     std::string oid = opts["set"];
     if (!oid.empty() && metadata.size() > 0) {
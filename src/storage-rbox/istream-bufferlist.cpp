@@ -13,36 +13,190 @@
 extern "C" {
 #include "lib.h"
 #include "istream-private.h"
+#if DOVECOT_PREREQ(2, 3)
+#include "memarea.h"
+#endif
 }
 
 #include "istream-bufferlist.h"
 #include <rados/librados.hpp>
 
-static ssize_t i_stream_data_read(struct istream_private *stream) {
-  stream->istream.eof = TRUE;  // all in!
-  return -1;
+struct bufferlist_segment {
+  const unsigned char *data;
+  size_t size;
+  /* absolute stream offset of data[0] */
+  uoff_t offset;
+};
+
+struct bufferlist_istream {
+  struct istream_private istream;
+
+  struct bufferlist_segment *segments;
+  unsigned int segment_count;
+  /* segment of the last read, lookup hint for the next one */
+  unsigned int cur_segment;
+  uoff_t size;
+
+#if DOVECOT_PREREQ(2, 3)
+  /* the fragments live as long as the bufferlist, snapshots of them only
+     need a reference. unconsumed data spanning a segment boundary is
+     copied into a bridge of its own memarea, which a snapshot of the
+     parent stream keeps alive after the next read. */
+  struct memarea *fragments_memarea;
+#else
+  /* unconsumed data spanning a segment boundary is copied here. The
+     previous bridge stays valid until the next one is built. */
+  unsigned char *bridge, *prev_bridge;
+#endif
+};
+
+#if DOVECOT_PREREQ(2, 3)
+static void i_stream_bufferlist_free_bridge(void *bridge) { i_free(bridge); }
+
+static void i_stream_bufferlist_set_memarea(struct istream_private *stream, struct memarea *area) {
+  if (stream->memarea != NULL) {
+    memarea_unref(&stream->memarea);
+  }
+  stream->memarea = area;
+}
+#endif
+
+static unsigned int i_stream_bufferlist_find_segment(struct bufferlist_istream *bstream, uoff_t offset) {
+  unsigned int idx = bstream->cur_segment;
+  const struct bufferlist_segment *seg = &bstream->segments[idx];
+
+  if (offset >= seg->offset && offset < seg->offset + seg->size) {
+    return idx;
+  }
+  if (idx + 1 < bstream->segment_count && offset >= seg[1].offset && offset < seg[1].offset + seg[1].size) {
+    /* sequential read: next segment */
+    return idx + 1;
+  }
+  unsigned int left = 0, right = bstream->segment_count;
+  while (left + 1 < right) {
+    unsigned int mid = left + (right - left) / 2;
+    if (bstream->segments[mid].offset <= offset) {
+      left = mid;
+    } else {
+      right = mid;
+    }
+  }
+  return left;
+}
+
+static ssize_t i_stream_bufferlist_read(struct istream_private *stream) {
+  struct bufferlist_istream *bstream = (struct bufferlist_istream *)stream;
+  size_t tail = stream->pos - stream->skip;
+  uoff_t offset = stream->istream.v_offset + tail;
+
+  if (offset >= bstream->size) {
+    stream->istream.eof = TRUE;
+    return -1;
+  }
+  bstream->cur_segment = i_stream_bufferlist_find_segment(bstream, offset);
+  const struct bufferlist_segment *seg = &bstream->segments[bstream->cur_segment];
+  size_t seg_pos = offset - seg->offset;
+  size_t avail = seg->size - seg_pos;
+
+  if (tail == 0) {
+    /* nothing buffered, point directly into the bufferlist fragment */
+    stream->buffer = seg->data;
+    stream->skip = seg_pos;
+    stream->pos = seg->size;
+#if DOVECOT_PREREQ(2, 3)
+    if (stream->memarea != bstream->fragments_memarea) {
+      memarea_ref(bstream->fragments_memarea);
+      i_stream_bufferlist_set_memarea(stream, bstream->fragments_memarea);
+    }
+#endif
+    return avail;
+  }
+
+  /* the caller still holds data from the previous fragment and needs it to
+     stay contiguous. copy only that tail and a small piece of the next
+     fragment, the following reads go back to the fragments themselves. */
+  if (tail >= stream->max_buffer_size) {
+    return -2;
+  }
+  avail = I_MIN(avail, I_MAX(tail, IO_BLOCK_SIZE));
+  if (stream->max_buffer_size - tail < avail) {
+    avail = stream->max_buffer_size - tail;
+  }
+  unsigned char *bridge = i_new(unsigned char, tail + avail);
+  memcpy(bridge, stream->buffer + stream->skip, tail);
+  memcpy(bridge + tail, seg->data + seg_pos, avail);
+
+#if DOVECOT_PREREQ(2, 3)
+  i_stream_bufferlist_set_memarea(stream, memarea_init(bridge, tail + avail, i_stream_bufferlist_free_bridge, bridge));
+#else
+  i_free(bstream->prev_bridge);
+  bstream->prev_bridge = bstream->bridge;
+  bstream->bridge = bridge;
+#endif
+
+  stream->buffer = bridge;
+  stream->skip = 0;
+  stream->pos = tail + avail;
+  return avail;
 }
 
-static void i_stream_data_seek(struct istream_private *stream, uoff_t v_offset, bool mark ATTR_UNUSED) {
-  stream->skip = v_offset;
+static void i_stream_bufferlist_seek(struct istream_private *stream, uoff_t v_offset, bool mark ATTR_UNUSED) {
   stream->istream.v_offset = v_offset;
+  stream->skip = stream->pos = 0;
+  stream->istream.eof = FALSE;
+}
+
+static int i_stream_bufferlist_stat(struct istream_private *stream, bool exact ATTR_UNUSED) {
+  struct bufferlist_istream *bstream = (struct bufferlist_istream *)stream;
+  stream->statbuf.st_size = bstream->size;
+  return 0;
 }
 
 static void rbox_istream_destroy(struct iostream_private *stream) {
-  // nothing to do. but required, so that default destroy is not evoked!
-  // buffer is member of RboxMailObjec, which destroys the bufferlist
+  struct bufferlist_istream *bstream = (struct bufferlist_istream *)stream;
+  // the bufferlist itself is member of RboxMailObject, which destroys it
+  i_free(bstream->segments);
+#if DOVECOT_PREREQ(2, 3)
+  // bridges referenced by snapshots are freed with the snapshots
+  i_stream_bufferlist_set_memarea(&bstream->istream, NULL);
+  memarea_unref(&bstream->fragments_memarea);
+#else
+  i_free(bstream->bridge);
+  i_free(bstream->prev_bridge);
+#endif
 }
+
 struct istream *i_stream_create_from_bufferlist(librados::bufferlist *data, const size_t &size) {
+  struct bufferlist_istream *bstream;
   struct istream_private *stream;
 
-  stream = i_new(struct istream_private, 1);
-  stream->buffer = reinterpret_cast<const unsigned char *>(data->c_str());
-  stream->pos = size;
+  bstream = i_new(struct bufferlist_istream, 1);
+  bstream->segments = i_new(struct bufferlist_segment, I_MAX(data->get_num_buffers(), 1));
+
+  uoff_t offset = 0;
+  for (auto it = data->buffers().begin(); it != data->buffers().end() && offset < size; ++it) {
+    if (it->length() == 0) {
+      continue;
+    }
+    struct bufferlist_segment *seg = &bstream->segments[bstream->segment_count++];
+    seg->data = reinterpret_cast<const unsigned char *>(it->c_str());
+    seg->offset = offset;
+    seg->size = I_MIN(it->length(), size - offset);
+    offset += seg->size;
+  }
+  bstream->size = offset;
+
+  stream = &bstream->istream;
   stream->max_buffer_size = (size_t)-1;
-  ;
+#if DOVECOT_PREREQ(2, 3)
+  bstream->fragments_memarea = memarea_init_empty();
+  memarea_ref(bstream->fragments_memarea);
+  stream->memarea = bstream->fragments_memarea;
+#endif
 
-  stream->read = i_stream_data_read;
-  stream->seek = i_stream_data_seek;  // use default
+  stream->read = i_stream_bufferlist_read;
+  stream->seek = i_stream_bufferlist_seek;
+  stream->stat = i_stream_bufferlist_stat;
 
   stream->istream.readable_fd = FALSE;
   stream->istream.blocking = TRUE;
@@ -50,12 +204,11 @@ struct istream *i_stream_create_from_bufferlist(librados::bufferlist *data, cons
   stream->iostream.destroy = rbox_istream_destroy;
 
 #if DOVECOT_PREREQ(2, 3)
-  i_stream_create(stream, NULL, -1, ISTREAM_CREATE_FLAG_NOOP_SNAPSHOT);
+  i_stream_create(stream, NULL, -1, (enum istream_create_flag)0);
 #else
   i_stream_create(stream, NULL, -1);
 #endif
-  stream->statbuf.st_size = size - 1;
+  stream->statbuf.st_size = bstream->size;
   i_stream_set_name(&stream->istream, "(buffer)");
   return &stream->istream;
 }
-
@@ -0,0 +1,299 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ * Copyright (c) 2007-2017 Dovecot authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+extern "C" {
+#include "lib.h"
+#include "istream-private.h"
+#if DOVECOT_PREREQ(2, 3)
+#include "memarea.h"
+#endif
+}
+
+#include "istream-rados.h"
+#include <rados/librados.hpp>
+
+#define ISTREAM_RADOS_MAX_READ_AHEAD (4 * 1024 * 1024)
+
+struct rados_istream {
+  struct istream_private istream;
+
+  librmb::RadosStorage *storage;
+  std::string *oid;
+  uoff_t size;
+  size_t initial_read_ahead;
+  size_t read_ahead;
+
+  /* range currently exposed by the stream */
+  librados::bufferlist *chunk;
+  uoff_t chunk_offset;
+#if DOVECOT_PREREQ(2, 3)
+  /* owns the chunk. Snapshots of the stream keep a reference, so a range
+     is freed once no snapshot uses it anymore. Unconsumed data spanning
+     two ranges is copied into a bridge of its own memarea. */
+  struct memarea *chunk_memarea;
+#else
+  /* previous range, kept until the next one is loaded so that data returned
+     before the last read stays valid */
+  librados::bufferlist *prev_chunk;
+  /* unconsumed data spanning two ranges */
+  unsigned char *bridge, *prev_bridge;
+#endif
+
+  /* prefetched range */
+  librados::bufferlist *next_chunk;
+  librados::AioCompletion *next_completion;
+  uoff_t next_offset;
+};
+
+#if DOVECOT_PREREQ(2, 3)
+static void i_stream_rados_free_chunk(void *chunk) { delete static_cast<librados::bufferlist *>(chunk); }
+
+static void i_stream_rados_free_bridge(void *bridge) { i_free(bridge); }
+
+static void i_stream_rados_set_memarea(struct istream_private *stream, struct memarea *area) {
+  if (stream->memarea != NULL) {
+    memarea_unref(&stream->memarea);
+  }
+  stream->memarea = area;
+}
+#endif
+
+/* the fragment holding the chunk position, pos becomes the position within it */
+static const librados::bufferptr *i_stream_rados_find_segment(librados::bufferlist *chunk, size_t *pos) {
+  for (const auto &segment : chunk->buffers()) {
+    if (*pos < segment.length()) {
+      return &segment;
+    }
+    *pos -= segment.length();
+  }
+  return nullptr;
+}
+
+static int i_stream_rados_start_read(struct rados_istream *rstream, uoff_t offset) {
+  uint64_t len = I_MIN(rstream->read_ahead, rstream->size - offset);
+
+  rstream->next_chunk = new librados::bufferlist();
+  rstream->next_offset = offset;
+  rstream->next_completion = librados::Rados::aio_create_completion();
+  int ret = rstream->storage->aio_read(*rstream->oid, rstream->next_completion, rstream->next_chunk, len, offset);
+  if (ret < 0) {
+    rstream->next_completion->release();
+    rstream->next_completion = nullptr;
+    delete rstream->next_chunk;
+    rstream->next_chunk = nullptr;
+  }
+  return ret;
+}
+
+static int i_stream_rados_finish_read(struct rados_istream *rstream) {
+  rstream->next_completion->wait_for_complete();
+  int ret = rstream->next_completion->get_return_value();
+  rstream->next_completion->release();
+  rstream->next_completion = nullptr;
+  if (ret < 0) {
+    delete rstream->next_chunk;
+    rstream->next_chunk = nullptr;
+  }
+  return ret;
+}
+
+static int i_stream_rados_load_chunk(struct rados_istream *rstream, uoff_t offset) {
+  int ret;
+  bool sequential = rstream->chunk->length() > 0 && offset == rstream->chunk_offset + rstream->chunk->length();
+
+  if (rstream->next_completion != nullptr && rstream->next_offset != offset) {
+    /* seeked away from the prefetched range */
+    if (i_stream_rados_finish_read(rstream) == 0) {
+      delete rstream->next_chunk;
+      rstream->next_chunk = nullptr;
+    }
+  }
+  if (!sequential) {
+    rstream->read_ahead = rstream->initial_read_ahead;
+  }
+  if (rstream->next_completion == nullptr) {
+    if ((ret = i_stream_rados_start_read(rstream, offset)) < 0) {
+      return ret;
+    }
+  }
+  if ((ret = i_stream_rados_finish_read(rstream)) < 0) {
+    return ret;
+  }
+  if (rstream->next_chunk->length() == 0) {
+    /* object is smaller than expected */
+    delete rstream->next_chunk;
+    rstream->next_chunk = nullptr;
+    return -EIO;
+  }
+
+#if DOVECOT_PREREQ(2, 3)
+  memarea_unref(&rstream->chunk_memarea);
+  rstream->chunk = rstream->next_chunk;
+  // the area stands for all fragments of the chunk
+  rstream->chunk_memarea =
+      memarea_init(rstream->chunk, rstream->chunk->length(), i_stream_rados_free_chunk, rstream->chunk);
+#else
+  delete rstream->prev_chunk;
+  rstream->prev_chunk = rstream->chunk;
+  rstream->chunk = rstream->next_chunk;
+#endif
+  rstream->next_chunk = nullptr;
+  rstream->chunk_offset = offset;
+
+  /* the second sequential range on: prefetch the following one with a larger read ahead */
+  uoff_t end = offset + rstream->chunk->length();
+  if (sequential && end < rstream->size) {
+    rstream->read_ahead = I_MIN(rstream->read_ahead * 2, ISTREAM_RADOS_MAX_READ_AHEAD);
+    // on error the range is requested again by the next load
+    (void)i_stream_rados_start_read(rstream, end);
+  }
+  return 0;
+}
+
+static ssize_t i_stream_rados_read(struct istream_private *stream) {
+  struct rados_istream *rstream = (struct rados_istream *)stream;
+  size_t tail = stream->pos - stream->skip;
+  uoff_t offset = stream->istream.v_offset + tail;
+
+  if (offset >= rstream->size) {
+    stream->istream.eof = TRUE;
+    return -1;
+  }
+  if (offset < rstream->chunk_offset || offset >= rstream->chunk_offset + rstream->chunk->length()) {
+    int ret = i_stream_rados_load_chunk(rstream, offset);
+    if (ret < 0) {
+      i_error("reading mail range failed: oid=%s, offset=%llu, errorcode: %d", rstream->oid->c_str(),
+              (unsigned long long)offset, ret);
+      stream->istream.stream_errno = ret == -ENOENT ? ENOENT : EIO;
+      return -1;
+    }
+  }
+
+  // expose the fragment in place, c_str() would rebuild a fragmented chunk
+  size_t seg_pos = offset - rstream->chunk_offset;
+  const librados::bufferptr *segment = i_stream_rados_find_segment(rstream->chunk, &seg_pos);
+  i_assert(segment != nullptr);
+  const unsigned char *data = reinterpret_cast<const unsigned char *>(segment->c_str());
+  size_t avail = segment->length() - seg_pos;
+
+  if (tail == 0) {
+    stream->buffer = data;
+    stream->skip = seg_pos;
+    stream->pos = segment->length();
+#if DOVECOT_PREREQ(2, 3)
+    if (stream->memarea != rstream->chunk_memarea) {
+      memarea_ref(rstream->chunk_memarea);
+      i_stream_rados_set_memarea(stream, rstream->chunk_memarea);
+    }
+#endif
+    return avail;
+  }
+
+  /* keep the unconsumed tail contiguous with the beginning of the new range */
+  if (tail >= stream->max_buffer_size) {
+    return -2;
+  }
+  avail = I_MIN(avail, I_MAX(tail, IO_BLOCK_SIZE));
+  if (stream->max_buffer_size - tail < avail) {
+    avail = stream->max_buffer_size - tail;
+  }
+  unsigned char *bridge = i_new(unsigned char, tail + avail);
+  memcpy(bridge, stream->buffer + stream->skip, tail);
+  memcpy(bridge + tail, data + seg_pos, avail);
+
+#if DOVECOT_PREREQ(2, 3)
+  i_stream_rados_set_memarea(stream, memarea_init(bridge, tail + avail, i_stream_rados_free_bridge, bridge));
+#else
+  i_free(rstream->prev_bridge);
+  rstream->prev_bridge = rstream->bridge;
+  rstream->bridge = bridge;
+#endif
+
+  stream->buffer = bridge;
+  stream->skip = 0;
+  stream->pos = tail + avail;
+  return avail;
+}
+
+static void i_stream_rados_seek(struct istream_private *stream, uoff_t v_offset, bool mark ATTR_UNUSED) {
+  stream->istream.v_offset = v_offset;
+  stream->skip = stream->pos = 0;
+  stream->istream.eof = FALSE;
+}
+
+static int i_stream_rados_stat(struct istream_private *stream, bool exact ATTR_UNUSED) {
+  struct rados_istream *rstream = (struct rados_istream *)stream;
+  stream->statbuf.st_size = rstream->size;
+  return 0;
+}
+
+static void i_stream_rados_destroy(struct iostream_private *stream) {
+  struct rados_istream *rstream = (struct rados_istream *)stream;
+
+  if (rstream->next_completion != nullptr) {
+    // buffer is still in use by librados
+    (void)i_stream_rados_finish_read(rstream);
+  }
+  delete rstream->next_chunk;
+  delete rstream->oid;
+#if DOVECOT_PREREQ(2, 3)
+  // ranges and bridges referenced by snapshots are freed with the snapshots
+  i_stream_rados_set_memarea(&rstream->istream, NULL);
+  memarea_unref(&rstream->chunk_memarea);
+#else
+  delete rstream->chunk;
+  delete rstream->prev_chunk;
+  i_free(rstream->bridge);
+  i_free(rstream->prev_bridge);
+#endif
+}
+
+struct istream *i_stream_create_from_rados(librmb::RadosStorage *storage, const std::string &oid, const uint64_t &size,
+                                           const size_t &read_ahead) {
+  struct rados_istream *rstream;
+  struct istream_private *stream;
+
+  rstream = i_new(struct rados_istream, 1);
+  rstream->storage = storage;
+  rstream->oid = new std::string(oid);
+  rstream->size = size;
+  rstream->initial_read_ahead = rstream->read_ahead = I_MAX(read_ahead, IO_BLOCK_SIZE);
+  rstream->chunk = new librados::bufferlist();
+
+  stream = &rstream->istream;
+  stream->max_buffer_size = (size_t)-1;
+#if DOVECOT_PREREQ(2, 3)
+  rstream->chunk_memarea = memarea_init(rstream->chunk, 0, i_stream_rados_free_chunk, rstream->chunk);
+  memarea_ref(rstream->chunk_memarea);
+  stream->memarea = rstream->chunk_memarea;
+#else
+  rstream->prev_chunk = new librados::bufferlist();
+#endif
+
+  stream->read = i_stream_rados_read;
+  stream->seek = i_stream_rados_seek;
+  stream->stat = i_stream_rados_stat;
+
+  stream->istream.readable_fd = FALSE;
+  stream->istream.blocking = TRUE;
+  stream->istream.seekable = TRUE;
+  stream->iostream.destroy = i_stream_rados_destroy;
+
+#if DOVECOT_PREREQ(2, 3)
+  i_stream_create(stream, NULL, -1, (enum istream_create_flag)0);
+#else
+  i_stream_create(stream, NULL, -1);
+#endif
+  stream->statbuf.st_size = size;
+  i_stream_set_name(&stream->istream, oid.c_str());
+  return &stream->istream;
+}
@@ -0,0 +1,24 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ * Copyright (c) 2007-2017 Dovecot authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_STORAGE_RBOX_ISTREAM_RADOS_H_
+#define SRC_STORAGE_RBOX_ISTREAM_RADOS_H_
+
+#include <string>
+#include "rados-storage.h"
+
+/* istream reading the mail object lazily in ranges of read_ahead bytes. From the second
+ * sequential range on, each read doubles the range and prefetches the next one asynchronously. */
+struct istream *i_stream_create_from_rados(librmb::RadosStorage *storage, const std::string &oid, const uint64_t &size,
+                                           const size_t &read_ahead);
+
+#endif /* SRC_STORAGE_RBOX_ISTREAM_RADOS_H_ */
@@ -13,6 +13,7 @@
 
 #include "libstorage-rbox-plugin.h"
 #include "rbox-storage.h"
+#include "rbox-mailbox-list-rados.h"
 
 const char *storage_rbox_plugin_version = DOVECOT_ABI_VERSION;
 
@@ -37,11 +38,13 @@ void storage_rbox_plugin_init(struct module *module ATTR_UNUSED) {
   if (refcount++ > 0)
     return;
   mail_storage_class_register(&rbox_storage);
+  rbox_mailbox_list_register();
 }
 
 void storage_rbox_plugin_deinit(void) {
   if (--refcount > 0)
     return;
+  rbox_mailbox_list_unregister();
   mail_storage_class_unregister(&rbox_storage);
   //i_debug("%s v%s storage stopping", DOVECOT_CEPH_PLUGIN_PACKAGE_NAME, DOVECOT_CEPH_PLUGIN_PACKAGE_VERSION);
 }
@@ -16,12 +16,58 @@ extern "C" {
 }
 #include "ostream-bufferlist.h"
 
+#include <vector>
+
+/* appended data is copied into page aligned chunks of this size */
+#define O_STREAM_BUFFERLIST_CHUNK_SIZE (64 * 1024)
+/* max. number of chunks kept for reuse */
+#define O_STREAM_BUFFERLIST_POOL_SIZE 32
+
 struct bufferlist_ostream {
   struct ostream_private ostream;
   librados::bufferlist *buf;
+  /* chunk the next data is appended to, the bufferlist references its filled part */
+  ceph::bufferptr *chunk;
+  /* bytes taken out of the buffer by o_stream_bufferlist_splice() */
+  uoff_t spliced;
   bool seeked;
 };
 
+/* chunks are reused as soon as no bufferlist references them anymore (mail saved or freed).
+   the pool is shared by all streams of the process and not thread safe, dovecot processes are single threaded. */
+static std::vector<ceph::bufferptr> chunk_pool;
+
+static ceph::bufferptr o_stream_bufferlist_chunk_alloc() {
+  for (std::vector<ceph::bufferptr>::iterator it = chunk_pool.begin(); it != chunk_pool.end(); ++it) {
+    if (it->raw_nref() == 1) {
+      ceph::bufferptr chunk(*it);
+      chunk.set_length(0);
+      return chunk;
+    }
+  }
+  ceph::bufferptr chunk(ceph::buffer::create_page_aligned(O_STREAM_BUFFERLIST_CHUNK_SIZE));
+  chunk.set_length(0);
+  if (chunk_pool.size() < O_STREAM_BUFFERLIST_POOL_SIZE) {
+    chunk_pool.push_back(chunk);
+  }
+  return chunk;
+}
+
+static void o_stream_bufferlist_append(struct bufferlist_ostream *bstream, const char *data, size_t size) {
+  while (size > 0) {
+    if (bstream->chunk->unused_tail_length() == 0) {
+      *bstream->chunk = o_stream_bufferlist_chunk_alloc();
+    }
+    unsigned int off = bstream->chunk->length();
+    size_t len = I_MIN(size, bstream->chunk->unused_tail_length());
+    bstream->chunk->append(data, len);
+    // merged with the last segment, if it is the same chunk
+    bstream->buf->append(*bstream->chunk, off, len);
+    data += len;
+    size -= len;
+  }
+}
+
 static int o_stream_buffer_seek(struct ostream_private *stream, uoff_t offset) {
   struct bufferlist_ostream *bstream = (struct bufferlist_ostream *)stream;
   bstream->seeked = TRUE;
@@ -34,27 +80,37 @@ int o_stream_buffer_write_at(struct ostream_private *stream, const void *data, s
   struct bufferlist_ostream *bstream = (struct bufferlist_ostream *)stream;
   i_assert(bstream->buf != nullptr);
 
-  if (bstream->buf->length() == 0 || bstream->buf->length() == offset) {
-    bstream->buf->append(reinterpret_cast<const char *>(data));
-  } else if (offset == 0) {
-    std::string tmp = bstream->buf->to_str();  // create a copy
-    bstream->buf->clear();
-    bstream->buf->append(reinterpret_cast<const char *>(data));
-    bstream->buf->append(tmp);
-  } else {
-    // split buffer into two
-    std::string tmp = bstream->buf->to_str();  // create a copy
-    bstream->buf->clear();
-    bstream->buf->append(tmp.substr(0, offset));
-    bstream->buf->append(reinterpret_cast<const char *>(data));
-    bstream->buf->append(tmp.substr(offset, bstream->buf->length() - 1));
+  if (offset < bstream->spliced) {
+    // already written to rados
+    stream->ostream.stream_errno = EINVAL;
+    return -1;
+  }
+  offset -= bstream->spliced;
+  if (offset > bstream->buf->length()) {
+    stream->ostream.stream_errno = EINVAL;
+    return -1;
+  }
+  // overwrite the written data in place, the chunks belong to this stream. data past the end is appended.
+  size_t overwrite = I_MIN(size, bstream->buf->length() - offset);
+  if (overwrite > 0) {
+    bstream->buf->copy_in(offset, overwrite, reinterpret_cast<const char *>(data));
   }
+  o_stream_bufferlist_append(bstream, reinterpret_cast<const char *>(data) + overwrite, size - overwrite);
   return 0;
 }
 
+void o_stream_bufferlist_splice(struct ostream *output, size_t size, librados::bufferlist *chunk) {
+  struct bufferlist_ostream *bstream = (struct bufferlist_ostream *)output->real_stream;
+  i_assert(size <= bstream->buf->length());
+
+  bstream->buf->splice(0, size, chunk);
+  bstream->spliced += size;
+}
+
 static void rbox_ostream_destroy(struct iostream_private *stream) {
-  // nothing to do. but required, so that default destroy is not evoked!
-  // buffer is member of RboxMailObjec, which destroys the bufferlist
+  struct bufferlist_ostream *bstream = (struct bufferlist_ostream *)stream;
+  // buffer is member of RboxMailObject, which destroys the bufferlist
+  delete bstream->chunk;
 }
 
 static ssize_t o_stream_buffer_sendv(struct ostream_private *stream, const struct const_iovec *iov,
@@ -64,7 +120,7 @@ static ssize_t o_stream_buffer_sendv(struct ostream_private *stream, const struc
   unsigned int i;
 
   for (i = 0; i < iov_count; i++) {
-    bstream->buf->append(reinterpret_cast<const char *>(iov[i].iov_base), iov[i].iov_len);
+    o_stream_bufferlist_append(bstream, reinterpret_cast<const char *>(iov[i].iov_base), iov[i].iov_len);
     stream->ostream.offset += iov[i].iov_len;
     ret += iov[i].iov_len;
   }
@@ -85,6 +141,7 @@ struct ostream *o_stream_create_bufferlist(librados::bufferlist *buf) {
   bstream->ostream.write_at = o_stream_buffer_write_at;
   bstream->ostream.iostream.destroy = rbox_ostream_destroy;
   bstream->buf = buf;
+  bstream->chunk = new ceph::bufferptr();
   output = o_stream_create(&bstream->ostream, NULL, -1);
   o_stream_set_name(output, "(buffer)");
   return output;
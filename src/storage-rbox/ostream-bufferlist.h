@@ -20,4 +20,6 @@ extern "C" {
 
 struct ostream *o_stream_create_bufferlist(librados::bufferlist *buf);
 int o_stream_buffer_write_at(struct ostream_private *stream, const void *data, size_t size, uoff_t offset);
+/* moves the first size bytes of the buffer to chunk, following write_at offsets stay absolute */
+void o_stream_bufferlist_splice(struct ostream *output, size_t size, librados::bufferlist *chunk);
 #endif /* SRC_STORAGE_RBOX_OSTREAM_BUFFERLIST_H_ */
@@ -169,6 +169,7 @@ static int rbox_mail_storage_try_copy(struct mail_save_context **_ctx, struct ma
   i_debug("namespaces: src=%s, dst=%s", ns_src.c_str(), ns_dest.c_str());
 
   int ret_val = 0;
+  librmb::RadosStorage *storage = from_alt_storage ? r_storage->alt : r_storage->s;
 
   if (r_ctx->copying == TRUE) {
     if (rbox_get_index_record(mail) < 0) {
@@ -191,27 +192,20 @@ static int rbox_mail_storage_try_copy(struct mail_save_context **_ctx, struct ma
 
       set_mailbox_metadata(ctx, &metadata_update);
 
-      if (!from_alt_storage) {
-        if (!r_storage->s->copy(src_oid, ns_src.c_str(), dest_oid, ns_dest.c_str(), metadata_update)) {
-          i_error("copy mail failed: from namespace: %s to namespace %s: src_oid: %s, des_oid: %s", ns_src.c_str(),
-                  ns_dest.c_str(), src_oid.c_str(), dest_oid.c_str());
-          FUNC_END_RET("ret == -1, rados_storage->copy failed");
-          r_storage->s->free_mail_object(r_ctx->current_object);
-          r_ctx->current_object = nullptr;
-          return -1;
-        }
-      } else {
-        if (!r_storage->alt->copy(src_oid, ns_src.c_str(), dest_oid, ns_dest.c_str(), metadata_update)) {
-          i_error("copy mail failed: from namespace: %s to namespace %s: src_oid: %s, des_oid: %s", ns_src.c_str(),
-                  ns_dest.c_str(), src_oid.c_str(), dest_oid.c_str());
-          FUNC_END_RET("ret == -1, rados_storage->copy failed");
-          r_storage->s->free_mail_object(r_ctx->current_object);
-          r_ctx->current_object = nullptr;
-          return -1;
-        }
+      // the copy is waited for with the other operations of the transaction in commit_pre
+      r_ctx->completion_group.wait_below(r_storage->config->get_copy_window());
+      int ret = storage->aio_copy(src_oid, ns_src.c_str(), dest_oid, ns_dest.c_str(), metadata_update,
+                                  &r_ctx->completion_group);
+      if (ret < 0) {
+        i_error("copy mail failed: from namespace: %s to namespace %s: src_oid: %s, des_oid: %s, errorcode: %d",
+                ns_src.c_str(), ns_dest.c_str(), src_oid.c_str(), dest_oid.c_str(), ret);
+        FUNC_END_RET("ret == -1, rados_storage->aio_copy failed");
+        r_storage->s->free_mail_object(r_ctx->current_object);
+        r_ctx->current_object = nullptr;
+        return -1;
       }
       rbox_add_to_index(ctx);
-      i_debug("copy successfully finished: from src %s to oid = %s", src_oid.c_str(), dest_oid.c_str());
+      i_debug("copy submitted: from src %s to oid = %s", src_oid.c_str(), dest_oid.c_str());
     }
     if (ctx->moving) {
       std::string dest_oid = src_oid;
@@ -223,27 +217,38 @@ static int rbox_mail_storage_try_copy(struct mail_save_context **_ctx, struct ma
       guid_128_from_string(src_oid.c_str(), item->oid);
       array_append(&rmailbox->moved_items, &item, 1);
 
-      bool delete_source = true;
-      if (!from_alt_storage) {
-        if (!r_storage->s->move(src_oid, ns_src.c_str(), dest_oid, ns_dest.c_str(), metadata_update, delete_source)) {
-          i_error("move mail failed: from namespace: %s to namespace %s: src_oid: %s, des_oid: %s", ns_src.c_str(),
-                  ns_dest.c_str(), src_oid.c_str(), dest_oid.c_str());
-          FUNC_END_RET("ret == -1, rados_storage->move failed");
-          return -1;
-        }
+      // the move updates the metadata of the object
+      std::string pool = storage->get_pool_name();
+      r_storage->metadata_cache->invalidate(pool, ns_src, src_oid);
+      r_storage->metadata_cache->invalidate(pool, ns_dest, dest_oid);
+
+      r_ctx->completion_group.wait_below(r_storage->config->get_copy_window());
+      int ret = storage->aio_move(src_oid, ns_src.c_str(), dest_oid, ns_dest.c_str(), metadata_update,
+                                  &r_ctx->completion_group);
+      if (ret < 0) {
+        i_error("move mail failed: from namespace: %s to namespace %s: src_oid: %s, des_oid: %s, errorcode: %d",
+                ns_src.c_str(), ns_dest.c_str(), src_oid.c_str(), dest_oid.c_str(), ret);
+        FUNC_END_RET("ret == -1, rados_storage->aio_move failed");
+        return -1;
+      }
+      if (ns_src != ns_dest) {
+        // the source is removed once all copies of the transaction are complete
+        struct rbox_move_source source = {src_oid, ns_src, from_alt_storage};
+        r_ctx->move_sources.push_back(source);
       } else {
-        if (!r_storage->alt->move(src_oid, ns_src.c_str(), dest_oid, ns_dest.c_str(), metadata_update, delete_source)) {
-          i_error("move mail failed: from namespace: %s to namespace %s: src_oid: %s, des_oid: %s", ns_src.c_str(),
-                  ns_dest.c_str(), src_oid.c_str(), dest_oid.c_str());
-          FUNC_END_RET("ret == -1, rados_storage->move failed");
-          return -1;
-        }
+        r_ctx->moved_oids.insert(src_oid);
       }
-
       rbox_move_index(ctx, mail);
-      i_debug("move successfully finished from %s (ns=%s) to %s (ns=%s)", src_oid.c_str(), ns_src.c_str(),
+      i_debug("move submitted from %s (ns=%s) to %s (ns=%s)", src_oid.c_str(), ns_src.c_str(),
               src_oid.c_str(), ns_dest.c_str());
     }
+    if (r_storage->config->is_mailbox_manifest_enabled()) {
+      // the manifest entry of the copy gets the size of the source
+      uoff_t physical_size;
+      if (mail_get_physical_size(mail, &physical_size) == 0) {
+        r_ctx->current_object->set_mail_size(physical_size);
+      }
+    }
     index_copy_cache_fields(ctx, mail, r_ctx->seq);
     if (ctx->dest_mail != NULL) {
       mail_set_seq_saving(ctx->dest_mail, r_ctx->seq);
@@ -37,11 +37,15 @@ extern "C" {
 #include "rbox-storage.hpp"
 #include "../librmb/rados-storage-impl.h"
 #include "istream-bufferlist.h"
+#include "istream-rados.h"
 #include "rbox-mail.h"
 
 using librmb::RadosMailObject;
 using librmb::rbox_metadata_key;
 
+/* max. attribute bytes cached by a read ahead of metadata */
+#define RBOX_PRECACHE_MAX_BYTES (4 * 1024 * 1024)
+
 static void rbox_mail_set_expunged(struct rbox_mail *mail) {
   struct mail *_mail = &mail->imail.mail.mail;
 
@@ -78,7 +82,7 @@ int rbox_get_index_record(struct mail *_mail) {
     memcpy(rmail->index_guid, obox_rec->guid, sizeof(obox_rec->guid));
     memcpy(rmail->index_oid, obox_rec->oid, sizeof(obox_rec->oid));
 
-    rmail->mail_object->set_oid(guid_128_to_string(rmail->index_oid));
+    rmail->mail_object->set_oid(rmail->index_oid);
     rmail->last_seq = _mail->seq;
 
   }
@@ -102,24 +106,142 @@ struct mail *rbox_mail_alloc(struct mailbox_transaction_context *t, enum mail_fe
   return &mail->imail.mail.mail;
 }
 
-static int rbox_mail_metadata_get(struct rbox_mail *rmail, enum rbox_metadata_key key, char **value_r) {
+/* stat the object and load its metadata unless cached, with read_data also read up to size bytes of the mail
+ * (0: all of it). a single round trip, returns the bytes read or < 0 */
+static int rbox_mail_read_object(struct rbox_mail *rmail, librmb::RadosStorage *rados_storage, bool read_data,
+                                 uint64_t size) {
+  struct rbox_storage *r_storage = (struct rbox_storage *)rmail->imail.mail.mail.box->storage;
+  const std::string &oid = rmail->mail_object->get_oid();
+  std::string pool = rados_storage->get_pool_name();
+  librmb::RadosStorageMetadataModule *ms = nullptr;
+
+  if (!rmail->mail_object->has_metadata() &&
+      !r_storage->metadata_cache->load(pool, rados_storage->get_namespace(), oid, rmail->mail_object)) {
+    ms = r_storage->ms->get_storage();
+    ms->set_io_ctx(&rados_storage->get_io_ctx());
+  }
+  int ret = rados_storage->read_mail_object(rmail->mail_object, ms, read_data, size);
+  if (ret >= 0 && ms != nullptr) {
+    r_storage->metadata_cache->store(pool, rados_storage->get_namespace(), oid, rmail->mail_object);
+  }
+  return ret;
+}
+
+/* the object has been stat'ed by rbox_mail_read_object */
+static bool rbox_mail_is_stat_loaded(struct rbox_mail *rmail) {
+  return *rmail->mail_object->get_rados_save_date() != static_cast<time_t>(-1);
+}
+
+/* attribute bytes of a mail kept in the metadata cache */
+static size_t rbox_precache_bytes(librmb::RadosMailObject *mail) {
+  size_t bytes = 0;
+  for (std::map<std::string, ceph::bufferlist>::const_iterator it = mail->get_metadata()->begin();
+       it != mail->get_metadata()->end(); ++it) {
+    bytes += it->first.length() + it->second.length();
+  }
+  for (std::map<std::string, ceph::bufferlist>::const_iterator it = mail->get_extended_metadata()->begin();
+       it != mail->get_extended_metadata()->end(); ++it) {
+    bytes += it->first.length() + it->second.length();
+  }
+  return bytes;
+}
+
+/* read the metadata of the next mails into the metadata cache, all reads in parallel. walking a mailbox in
+ * sequence order then costs a round trip per rbox_precache_window mails instead of one per mail. mails
+ * accessed in another order, e.g. by a sorted search, are not read ahead, the reads would be wasted.
+ * the window is bounded by the size of the metadata cache, the cached bytes by RBOX_PRECACHE_MAX_BYTES */
+static void rbox_mail_precache_metadata(struct rbox_mail *rmail) {
+  struct mail *mail = (struct mail *)rmail;
+  struct rbox_mailbox *rbox = (struct rbox_mailbox *)mail->box;
+  struct rbox_storage *r_storage = (struct rbox_storage *)mail->box->storage;
+  size_t window = I_MIN(static_cast<size_t>(I_MAX(r_storage->config->get_precache_window(), 0)),
+                        r_storage->metadata_cache->get_max_entries());
+  bool sequential = mail->seq == rmail->last_metadata_seq + 1;
+
+  rmail->last_metadata_seq = mail->seq;
+  if (!sequential || window <= 1 || (mail->seq >= rmail->precache_seq1 && mail->seq <= rmail->precache_seq2)) {
+    return;
+  }
+  uint32_t seq2 = I_MIN(mail->seq + window - 1, mail_index_view_get_messages_count(mail->transaction->view));
+  librmb::RadosStorageMetadataModule *ms = r_storage->ms->get_storage();
+  // mails of the primary and of the alt storage
+  std::vector<librmb::RadosMailObject *> mails[2];
+  std::vector<uint32_t> seqs[2];
+
+  for (uint32_t seq = mail->seq; seq <= seq2; seq++) {
+    const void *rec_data;
+    mail_index_lookup_ext(mail->transaction->view, seq, rbox->ext_id, &rec_data, NULL);
+    if (rec_data == NULL) {
+      continue;
+    }
+    const struct obox_mail_index_record *obox_rec = static_cast<const struct obox_mail_index_record *>(rec_data);
+    uint8_t flags = mail_index_lookup(mail->transaction->view, seq)->flags;
+    bool alt_storage = is_alternate_storage_set(flags) && is_alternate_pool_valid(mail->box);
+    if (rbox_open_rados_connection(mail->box, alt_storage) < 0) {
+      continue;
+    }
+    librmb::RadosStorage *rados_storage = alt_storage ? r_storage->alt : r_storage->s;
+    std::string oid = guid_128_to_string(obox_rec->oid);
+    if (r_storage->metadata_cache->contains(rados_storage->get_pool_name(), rados_storage->get_namespace(), oid)) {
+      continue;
+    }
+    librmb::RadosMailObject *read = new librmb::RadosMailObject();
+    read->set_oid(oid);
+    mails[alt_storage ? 1 : 0].push_back(read);
+    seqs[alt_storage ? 1 : 0].push_back(seq);
+  }
+
+  // failed reads are repeated by the mail itself, which reports the error. so is a mail past the byte bound,
+  // the window then ends before it and the mail starts the next one
+  size_t bytes = 0;
+  uint32_t end_seq = seq2;
+  for (int i = 0; i < 2; i++) {
+    if (mails[i].empty()) {
+      continue;
+    }
+    librmb::RadosStorage *rados_storage = i == 1 ? r_storage->alt : r_storage->s;
+    std::vector<int> results;
+    bool loaded = rados_storage->load_metadata(mails[i], ms, &results) >= 0;
+    for (size_t j = 0; j < mails[i].size(); j++) {
+      if (loaded && results[j] >= 0 && seqs[i][j] <= end_seq) {
+        bytes += rbox_precache_bytes(mails[i][j]);
+        if (bytes > RBOX_PRECACHE_MAX_BYTES && seqs[i][j] > mail->seq) {
+          end_seq = seqs[i][j] - 1;
+        } else {
+          r_storage->metadata_cache->store(rados_storage->get_pool_name(), rados_storage->get_namespace(),
+                                           mails[i][j]->get_oid(), mails[i][j]);
+        }
+      }
+      delete mails[i][j];
+    }
+  }
+  rmail->precache_seq1 = mail->seq;
+  rmail->precache_seq2 = end_seq;
+}
+
+static int rbox_mail_metadata_load(struct rbox_mail *rmail) {
   struct mail *mail = (struct mail *)rmail;
   struct rbox_storage *r_storage = (struct rbox_storage *)mail->box->storage;
   int ret = -1;
   enum mail_flags flags = index_mail_get_flags(mail);
   bool alt_storage = is_alternate_storage_set(flags) && is_alternate_pool_valid(mail->box);
   if (rbox_open_rados_connection(mail->box, alt_storage) < 0) {
-    i_error("ERROR, cannot open rados connection (rbox_mail_metadata_get)");
+    i_error("ERROR, cannot open rados connection (rbox_mail_metadata_load)");
     return -1;
   }
 
-  // update metadata storage io_ctx and load metadata
-  if (alt_storage) {
-    r_storage->ms->get_storage()->set_io_ctx(&r_storage->alt->get_io_ctx());
-  } else {
-    r_storage->ms->get_storage()->set_io_ctx(&r_storage->s->get_io_ctx());
+  // metadata already loaded for this mail or cached, else the object is stat'ed along with loading it
+  librmb::RadosStorage *rados_storage = alt_storage ? r_storage->alt : r_storage->s;
+  ret = 0;
+  if (!rmail->mail_object->has_metadata()) {
+    rbox_mail_precache_metadata(rmail);
+  }
+  rmail->last_metadata_seq = mail->seq;
+  if (!rmail->mail_object->has_metadata() &&
+      !r_storage->metadata_cache->load(rados_storage->get_pool_name(), rados_storage->get_namespace(),
+                                       rmail->mail_object->get_oid(), rmail->mail_object)) {
+    ret = rbox_mail_read_object(rmail, rados_storage, false, 0);
   }
-  ret = r_storage->ms->get_storage()->load_metadata(rmail->mail_object);
   if (ret < 0) {
     if (ret == -ENOENT) {
       i_warning("Errorcode: %d cannot get x_attr from object %s, process %d", ret,
@@ -130,20 +252,40 @@ static int rbox_mail_metadata_get(struct rbox_mail *rmail, enum rbox_metadata_ke
     }
     return ret;
   }
+  return 0;
+}
+
+static int rbox_mail_metadata_get(struct rbox_mail *rmail, enum rbox_metadata_key key, char **value_r) {
+  int ret = rbox_mail_metadata_load(rmail);
+  if (ret < 0) {
+    return ret;
+  }
   std::string value = rmail->mail_object->get_metadata(key);
   if (!value.empty()) {
     *value_r = i_strdup(value.c_str());
   }
-
   return 0;
 }
 
+/* value of a numeric key without copying it, returns 1 if value_r was set, 0 if the key is not set and -EINVAL if it
+ * is no number */
+static int rbox_mail_metadata_get_number(struct rbox_mail *rmail, enum rbox_metadata_key key, uint64_t *value_r) {
+  int ret = rbox_mail_metadata_load(rmail);
+  if (ret < 0) {
+    return ret;
+  }
+  if (rmail->mail_object->get_metadata(key, value_r)) {
+    return 1;
+  }
+  return rmail->mail_object->get_metadata(key).empty() ? 0 : -EINVAL;
+}
+
 static int rbox_mail_get_received_date(struct mail *_mail, time_t *date_r) {
   FUNC_START();
   struct rbox_mail *rmail = (struct rbox_mail *)_mail;
   struct index_mail_data *data = &rmail->imail.data;
 
-  char *value = NULL;
+  uint64_t value = 0;
   int ret = 0;
 
   if (index_mail_get_received_date(_mail, date_r) == 0) {
@@ -151,7 +293,12 @@ static int rbox_mail_get_received_date(struct mail *_mail, time_t *date_r) {
     return ret;
   }
 
-  ret = rbox_mail_metadata_get(rmail, rbox_metadata_key::RBOX_METADATA_RECEIVED_TIME, &value);
+  ret = rbox_mail_metadata_get_number(rmail, rbox_metadata_key::RBOX_METADATA_RECEIVED_TIME, &value);
+  if (ret == -EINVAL) {
+    i_error("invalid value for received_date %s",
+            rmail->mail_object->get_metadata(rbox_metadata_key::RBOX_METADATA_RECEIVED_TIME).c_str());
+    return -1;
+  }
   if (ret < 0) {
     if (ret == -ENOENT) {
       rbox_mail_set_expunged(rmail);
@@ -162,25 +309,16 @@ static int rbox_mail_get_received_date(struct mail *_mail, time_t *date_r) {
     }
   }
 
-  if (value == NULL) {
+  if (ret == 0) {
     // file exists but receive date is unkown, due to missing index entry and missing
     // rados xattribute, as in sdbox this is not necessarily a error so return 0;
     return 0;
   }
-  try {
-    data->received_date = static_cast<time_t>(std::stol(value));
-    *date_r = data->received_date;
-  } catch (const std::invalid_argument &e) {
-    i_error("invalid value (invalid argument) for received_date %s", value);
-    ret = -1;
-  } catch (const std::out_of_range &e) {
-    i_error("invalid value (out of range) for received_date %s", value);
-    ret = -1;
-  }
-  i_free(value);
+  data->received_date = static_cast<time_t>(value);
+  *date_r = data->received_date;
 
   FUNC_END();
-  return ret;
+  return 0;
 }
 
 static int rbox_mail_get_save_date(struct mail *_mail, time_t *date_r) {
@@ -188,8 +326,6 @@ static int rbox_mail_get_save_date(struct mail *_mail, time_t *date_r) {
   struct rbox_mail *rmail = (struct rbox_mail *)_mail;
   struct index_mail_data *data = &rmail->imail.data;
   struct rbox_storage *r_storage = (struct rbox_storage *)_mail->box->storage;
-  uint64_t object_size = 0;
-  time_t save_date_rados = 0;
 
   enum mail_flags flags = index_mail_get_flags(_mail);
   bool alt_storage = is_alternate_storage_set(flags) && is_alternate_pool_valid(_mail->box);
@@ -204,27 +340,21 @@ static int rbox_mail_get_save_date(struct mail *_mail, time_t *date_r) {
     return -1;
   }
 
+  // the metadata is loaded along with the stat, the following lookups of the mail don't need another round trip
   librmb::RadosStorage *rados_storage = alt_storage ? r_storage->alt : r_storage->s;
-  int ret_val = rados_storage->stat_mail(rmail->mail_object->get_oid(), &object_size, &save_date_rados);
-  if (ret_val < 0) {
-    if (ret_val == -ENOENT) {
-      rbox_mail_set_expunged(rmail);
-      return -1;
-    } else {
-      FUNC_END_RET("ret == -1; cannot stat object to get received date and object size");
-      return -1;
-    }
-  }
-  if (save_date_rados == 0) {
-    // last chance is to stat the object to get the save date.
-    uint64_t psize;
-    if (rados_storage->stat_mail(rmail->mail_object->get_oid(), &psize, &save_date_rados) < 0) {
-      // at least it needs to exist?
-      return -1;
+  if (!rbox_mail_is_stat_loaded(rmail)) {
+    int ret_val = rbox_mail_read_object(rmail, rados_storage, false, 0);
+    if (ret_val < 0) {
+      if (ret_val == -ENOENT) {
+        rbox_mail_set_expunged(rmail);
+        return -1;
+      } else {
+        FUNC_END_RET("ret == -1; cannot stat object to get received date and object size");
+        return -1;
+      }
     }
   }
-  // check if this is null
-  *date_r = data->save_date = save_date_rados;
+  *date_r = data->save_date = *rmail->mail_object->get_rados_save_date();
 
   FUNC_END();
   return 0;
@@ -233,9 +363,8 @@ static int rbox_mail_get_save_date(struct mail *_mail, time_t *date_r) {
 int rbox_mail_get_virtual_size(struct mail *_mail, uoff_t *size_r) {
   struct rbox_mail *rmail = (struct rbox_mail *)_mail;
   struct index_mail_data *data = &rmail->imail.data;
-  char *value = NULL;
+  uint64_t value = 0;
   *size_r = -1;
-  int ret = 0;
 
   if (index_mail_get_virtual_size(_mail, size_r) == 0) {
     return 0;
@@ -250,28 +379,19 @@ int rbox_mail_get_virtual_size(struct mail *_mail, uoff_t *size_r) {
     return -1;
   }
 
-  if (rbox_mail_metadata_get(rmail, rbox_metadata_key::RBOX_METADATA_VIRTUAL_SIZE, &value) < 0) {
-    value = NULL;
+  int ret = rbox_mail_metadata_get_number(rmail, rbox_metadata_key::RBOX_METADATA_VIRTUAL_SIZE, &value);
+  if (ret == -EINVAL) {
+    i_error("invalid value for virtual size %s",
+            rmail->mail_object->get_metadata(rbox_metadata_key::RBOX_METADATA_VIRTUAL_SIZE).c_str());
   }
-
-  if (value == NULL) {
+  if (ret <= 0) {
     FUNC_END_RET("ret == -1; mail_object, no xattribute ");
     return -1;
   }
 
-  try {
-    data->virtual_size = std::stol(value);
-    *size_r = data->virtual_size;
-  } catch (const std::invalid_argument &e) {
-    i_error("invalid value (invalid argument) for received_date %s", value);
-    ret = -1;
-  } catch (const std::out_of_range &e) {
-    i_error("invalid value (out of range) for received_date %s", value);
-    ret = -1;
-  }
-  i_free(value);
-
-  return ret;
+  data->virtual_size = value;
+  *size_r = data->virtual_size;
+  return 0;
 }
 
 static int rbox_mail_get_physical_size(struct mail *_mail, uoff_t *size_r) {
@@ -282,7 +402,7 @@ static int rbox_mail_get_physical_size(struct mail *_mail, uoff_t *size_r) {
 
   *size_r = -1;
 
-  char *value = NULL;
+  uint64_t value = 0;
   if (index_mail_get_physical_size(_mail, size_r) == 0) {
     FUNC_END_RET("ret == 0");
     return 0;
@@ -294,32 +414,28 @@ static int rbox_mail_get_physical_size(struct mail *_mail, uoff_t *size_r) {
     return -1;
   }
 
-  if (rbox_mail_metadata_get(rmail, rbox_metadata_key::RBOX_METADATA_PHYSICAL_SIZE, &value) < 0) {
-    value = NULL;
+  int ret = rbox_mail_metadata_get_number(rmail, rbox_metadata_key::RBOX_METADATA_PHYSICAL_SIZE, &value);
+  if (ret < 0 && ret != -EINVAL) {
     FUNC_END_RET("ret == -1; rados_read_metadata ");
     return -1;
   }
 
-  if (value == NULL) {
+  if (ret <= 0) {
     enum mail_flags flags = index_mail_get_flags(_mail);
     bool alt_storage = is_alternate_storage_set(flags) && is_alternate_pool_valid(_mail->box);
 
     // no index entry, no xattribute,
-    // last change is to stat the object to get physical size.
-
+    // last change is the object size, it is usually stat'ed along with loading the metadata.
     librmb::RadosStorage *rados_storage = alt_storage ? r_storage->alt : r_storage->s;
-    uint64_t psize;
-    time_t pmtime;
-    if (rados_storage->stat_mail(rmail->mail_object->get_oid(), &psize, &pmtime) < 0) {
+    if (!rbox_mail_is_stat_loaded(rmail) && rbox_mail_read_object(rmail, rados_storage, false, 0) < 0) {
       // at least it needs to exists?
       return -1;
     }
 
-    // TODO: psize is uint64_t (64Bit = unsigned long int, 32Bit =unsigned long long int)
-    data->physical_size = psize;
+    data->physical_size = rmail->mail_object->get_mail_size();
     *size_r = data->physical_size;
   } else {
-    data->physical_size = std::stol(value);
+    data->physical_size = value;
     *size_r = data->physical_size;
   }
 
@@ -327,13 +443,122 @@ static int rbox_mail_get_physical_size(struct mail *_mail, uoff_t *size_r) {
   return 0;
 }
 
-static int get_mail_stream(struct rbox_mail *mail, librados::bufferlist *buffer, const size_t physical_size,
-                           struct istream **stream_r) {
+/* physical size from what is in memory already: the index data, the dovecot cache, a previous stat or the
+ * metadata cache. never reads from rados (index_mail_get_physical_size would open the stream), so the prefetch
+ * does not block on it */
+static bool rbox_mail_get_cached_physical_size(struct rbox_mail *rmail, librmb::RadosStorage *rados_storage,
+                                               uoff_t *size_r) {
+  struct rbox_storage *r_storage = (struct rbox_storage *)rmail->imail.mail.mail.box->storage;
+  struct index_mail_data *data = &rmail->imail.data;
+
+  if (data->physical_size != (uoff_t)-1) {
+    *size_r = data->physical_size;
+    return true;
+  }
+  if (index_mail_get_cached_uoff_t(&rmail->imail, MAIL_CACHE_PHYSICAL_FULL_SIZE, size_r)) {
+    return true;
+  }
+  if (rbox_mail_is_stat_loaded(rmail)) {
+    *size_r = rmail->mail_object->get_mail_size();
+    return true;
+  }
+  if (!rmail->mail_object->has_metadata() &&
+      !r_storage->metadata_cache->load(rados_storage->get_pool_name(), rados_storage->get_namespace(),
+                                       rmail->mail_object->get_oid(), rmail->mail_object)) {
+    return false;
+  }
+  uint64_t value;
+  if (!rmail->mail_object->get_metadata(rbox_metadata_key::RBOX_METADATA_PHYSICAL_SIZE, &value)) {
+    return false;
+  }
+  *size_r = value;
+  return true;
+}
+
+/* fill the cache fields of the mail, the metadata of the following mails is read along with it */
+static void rbox_mail_precache(struct mail *_mail) {
+  struct rbox_mail *rmail = (struct rbox_mail *)_mail;
+
+  if (rmail->mail_object != nullptr && !rmail->mail_object->has_metadata()) {
+    rbox_mail_precache_metadata(rmail);
+  }
+  index_mail_precache(_mail);
+}
+
+/* start reading the data of a mail which is going to be opened, so that the reads of the following mails
+ * overlap. only mails of a cached size are read, returns TRUE if nothing was started */
+static bool rbox_mail_prefetch(struct mail *_mail) {
+  struct rbox_mail *rmail = (struct rbox_mail *)_mail;
+  struct rbox_storage *r_storage = (struct rbox_storage *)_mail->box->storage;
+  struct index_mail_data *data = &rmail->imail.data;
+
+  if (!data->open_mail || data->stream != NULL || rmail->mail_object == nullptr ||
+      rmail->prefetch_completion != nullptr) {
+    return index_mail_prefetch(_mail);
+  }
+  uint64_t budget = r_storage->config->get_prefetch_size();
+  if (budget == 0) {
+    return index_mail_prefetch(_mail);
+  }
+
+  enum mail_flags flags = index_mail_get_flags(_mail);
+  bool alt_storage = is_alternate_storage_set(flags) && is_alternate_pool_valid(_mail->box);
+  if (rbox_open_rados_connection(_mail->box, alt_storage) < 0) {
+    return TRUE;
+  }
+  librmb::RadosStorage *rados_storage = alt_storage ? r_storage->alt : r_storage->s;
+
+  // only complete reads of a known size, larger mails are streamed by range anyway
+  uoff_t size;
+  uint64_t read_ahead = r_storage->config->get_read_ahead_size();
+  if (!rbox_mail_get_cached_physical_size(rmail, rados_storage, &size) || size == 0 || size > INT_MAX ||
+      (read_ahead > 0 && size > read_ahead)) {
+    return TRUE;
+  }
+  // the first mail is read ahead in any case, the others while they fit into the budget
+  if (r_storage->prefetch_bytes > 0 && r_storage->prefetch_bytes + size > budget) {
+    return TRUE;
+  }
+
+  librados::AioCompletion *completion = librados::Rados::aio_create_completion();
+  rmail->mail_object->get_mail_buffer()->clear();
+  if (rados_storage->aio_read(rmail->mail_object->get_oid(), completion, rmail->mail_object->get_mail_buffer(), size,
+                              0) < 0) {
+    completion->release();
+    return TRUE;
+  }
+  rmail->prefetch_completion = completion;
+  rmail->prefetch_size = size;
+  r_storage->prefetch_bytes += size;
+  return FALSE;
+}
+
+/* wait for the read started by rbox_mail_prefetch, returns the bytes read into the mail buffer, 0 if there is
+ * none or it failed */
+static int rbox_mail_prefetch_finish(struct rbox_mail *rmail) {
+  struct rbox_storage *r_storage = (struct rbox_storage *)rmail->imail.mail.mail.box->storage;
+
+  if (rmail->prefetch_completion == nullptr) {
+    return 0;
+  }
+  rmail->prefetch_completion->wait_for_complete();
+  int ret = rmail->prefetch_completion->get_return_value();
+  rmail->prefetch_completion->release();
+  rmail->prefetch_completion = nullptr;
+  r_storage->prefetch_bytes -= rmail->prefetch_size;
+
+  // a short read means the size was wrong, the mail is read again
+  if (ret < 0 || static_cast<uint64_t>(ret) != rmail->prefetch_size) {
+    rmail->mail_object->get_mail_buffer()->clear();
+    return 0;
+  }
+  return ret;
+}
+
+static int get_mail_stream(struct rbox_mail *mail, struct istream *input, struct istream **stream_r) {
   struct mail_private *pmail = &mail->imail.mail;
-  struct istream *input;  // = *stream_r;
   int ret = 0;
 
-  input = i_stream_create_from_bufferlist(buffer, physical_size);
   i_stream_seek(input, 0);
 
   *stream_r = input;
@@ -371,12 +596,61 @@ static int rbox_mail_get_stream(struct mail *_mail, bool get_body ATTR_UNUSED, s
       // make sure that mail_object is initialized,
       // else create and load guid from index.
       rmail->mail_object = rados_storage->alloc_mail_object();
+      rmail->mail_object_storage = rados_storage;
       rbox_get_index_record(_mail);
     }
-    rmail->mail_object->get_mail_buffer()->clear();
-
+    // the data may have been read ahead already
     _mail->transaction->stats.open_lookup_count++;
-    physical_size = rados_storage->read_mail(rmail->mail_object->get_oid(), rmail->mail_object->get_mail_buffer());
+    physical_size = rbox_mail_prefetch_finish(rmail);
+    if (physical_size <= 0) {
+      rmail->mail_object->get_mail_buffer()->clear();
+
+      uoff_t known_size;
+      bool size_known = rbox_mail_get_cached_physical_size(rmail, rados_storage, &known_size) && known_size > 0;
+      uint64_t read_ahead = ((struct rbox_storage *)_mail->box->storage)->config->get_read_ahead_size();
+
+      if (!size_known) {
+        // stat, metadata and the mail (or its first range) in a single round trip
+        physical_size = rbox_mail_read_object(rmail, rados_storage, true, read_ahead);
+        if (physical_size >= 0 && (uint64_t)physical_size < rmail->mail_object->get_mail_size()) {
+          // larger than the read ahead, continue like any mail of known size
+          size_known = true;
+          known_size = rmail->mail_object->get_mail_size();
+          rmail->mail_object->get_mail_buffer()->clear();
+        }
+      }
+
+      if (size_known && read_ahead > 0 && known_size > read_ahead) {
+        // header and partial fetches only need the first ranges of the mail, read them on demand
+        input = i_stream_create_from_rados(rados_storage, rmail->mail_object->get_oid(), known_size, read_ahead);
+        if (i_stream_read(input) < 0 && input->stream_errno != 0) {
+          bool not_found = input->stream_errno == ENOENT;
+          i_stream_unref(&input);
+          if (not_found) {
+            i_warning("Mail not found. %s, ns='%s', process %d", rmail->mail_object->get_oid().c_str(),
+                      rados_storage->get_namespace().c_str(), getpid());
+            rbox_mail_set_expunged(rmail);
+          }
+          FUNC_END_RET("ret == -1");
+          return -1;
+        }
+        if (get_mail_stream(rmail, input, &input) < 0) {
+          FUNC_END_RET("ret == -1");
+          return -1;
+        }
+        data->stream = input;
+        index_mail_set_read_buffer_size(_mail, input);
+        ret = index_mail_init_stream(&rmail->imail, hdr_size, body_size, stream_r);
+        FUNC_END();
+        return ret;
+      }
+
+      if (size_known) {
+        // size the read by the physical size (index or metadata), avoids requesting INT_MAX bytes
+        physical_size =
+            rados_storage->read_mail(rmail->mail_object->get_oid(), known_size, rmail->mail_object->get_mail_buffer());
+      }
+    }
     if (physical_size < 0) {
       if (physical_size == -ENOENT) {
         i_warning("Mail not found. %s, ns='%s', process %d", rmail->mail_object->get_oid().c_str(),
@@ -402,7 +676,8 @@ static int rbox_mail_get_stream(struct mail *_mail, bool get_body ATTR_UNUSED, s
       return -1;
     }
 
-    if (get_mail_stream(rmail, rmail->mail_object->get_mail_buffer(), physical_size, &input) < 0) {
+    input = i_stream_create_from_bufferlist(rmail->mail_object->get_mail_buffer(), physical_size);
+    if (get_mail_stream(rmail, input, &input) < 0) {
       FUNC_END_RET("ret == -1");
       return -1;
     }
@@ -541,10 +816,13 @@ static void rbox_mail_close(struct mail *_mail) {
   struct rbox_mail *rmail_ = (struct rbox_mail *)_mail;
   struct rbox_storage *r_storage = (struct rbox_storage *)_mail->box->storage;
 
+  // the pending read still writes to the mail buffer
+  (void)rbox_mail_prefetch_finish(rmail_);
   if (rmail_->mail_object != nullptr) {
-    r_storage->s->free_mail_object(rmail_->mail_object);
+    rmail_->mail_object_storage->free_mail_object(rmail_->mail_object);
     rmail_->mail_object = nullptr;
-
+    // the next mail object is a reused one, its oid has to be set from the index again
+    rmail_->last_seq = 0;
   }
 
   index_mail_close(_mail);
@@ -559,6 +837,7 @@ static void rbox_index_mail_set_seq(struct mail *_mail, uint32_t seq, bool savin
   if (rmail_->mail_object == nullptr) {
     struct rbox_storage *r_storage = (struct rbox_storage *)_mail->box->storage;
     rmail_->mail_object = r_storage->s->alloc_mail_object();
+    rmail_->mail_object_storage = r_storage->s;
     rbox_get_index_record(_mail);
   }
 }
@@ -567,7 +846,7 @@ static void rbox_index_mail_set_seq(struct mail *_mail, uint32_t seq, bool savin
 // rbox_mail_free,
 struct mail_vfuncs rbox_mail_vfuncs = {
     rbox_mail_close, index_mail_free, rbox_index_mail_set_seq, index_mail_set_uid, index_mail_set_uid_cache_updates,
-    index_mail_prefetch, index_mail_precache, index_mail_add_temp_wanted_fields,
+    rbox_mail_prefetch, rbox_mail_precache, index_mail_add_temp_wanted_fields,
 
     index_mail_get_flags, index_mail_get_keywords, index_mail_get_keyword_indexes, index_mail_get_modseq,
     index_mail_get_pvt_modseq, index_mail_get_parts, index_mail_get_date, rbox_mail_get_received_date,
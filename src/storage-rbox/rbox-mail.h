@@ -23,7 +23,18 @@ struct rbox_mail {
   guid_128_t index_oid;
 
   librmb::RadosMailObject *mail_object;
+  // storage mail_object was allocated from, it goes back to the pool of that storage
+  librmb::RadosStorage *mail_object_storage;
   uint32_t last_seq;  // TODO(jrse): init with -1
+
+  // read of the mail data into the mail buffer started by prefetch, nullptr if none
+  librados::AioCompletion *prefetch_completion;
+  uint64_t prefetch_size;
+
+  // sequences whose metadata has been read ahead into the metadata cache
+  uint32_t precache_seq1, precache_seq2;
+  // sequence of the last metadata lookup, a sequential walk starts reading ahead
+  uint32_t last_metadata_seq;
 };
 
 extern int rbox_get_index_record(struct mail *_mail);
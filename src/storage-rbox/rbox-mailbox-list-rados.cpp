@@ -0,0 +1,430 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include <map>
+#include <set>
+#include <string>
+
+#include <rados/librados.hpp>
+
+extern "C" {
+
+#include "dovecot-all.h"
+#include "imap-match.h"
+#include "mailbox-tree.h"
+#include "mailbox-list-subscriptions.h"
+#include "debug-helper.h"
+
+#include "rbox-storage.h"
+
+extern struct mailbox_list fs_mailbox_list;
+}
+
+#include "rbox-storage.hpp"
+#include "rbox-mailbox-list-rados.h"
+
+#include "../librmb/rados-mailbox-list.h"
+
+/*
+ * The rados layout is the fs layout with the mailboxes and subscriptions
+ * kept in a rados object of the user instead of the directory tree. The
+ * directories are still used for the index files, but they are created on
+ * demand, so LIST, LSUB and the existence of a mailbox don't depend on the
+ * files of the node.
+ *
+ * Mailboxes and subscriptions are stored by their vname.
+ */
+
+struct rbox_list_iterate_context {
+  struct mailbox_list_iterate_context ctx;
+
+  struct mailbox_tree_context *tree;
+  struct mailbox_tree_iterate_context *iter;
+  struct mailbox_info info;
+};
+
+static struct mailbox_list rbox_mailbox_list;
+
+bool rbox_is_rados_mailbox_list(struct mailbox_list *list) { return strcmp(list->name, RBOX_MAILBOX_LIST_NAME) == 0; }
+
+/* the helpers return a negative errno, the callers set the error of the list */
+static int rbox_list_get_io_ctx(struct mailbox_list *list, librados::IoCtx **io_ctx_r) {
+  struct mail_storage *storage = list->ns->storage;
+
+  if (storage == NULL || strcmp(storage->name, RBOX_STORAGE_NAME) != 0) {
+    i_error("rbox: layout %s requires rbox storage", RBOX_MAILBOX_LIST_NAME);
+    return -EINVAL;
+  }
+  int ret = rbox_storage_open_rados_connection(storage, list, false);
+  if (ret < 0) {
+    return ret;
+  }
+  *io_ctx_r = &((struct rbox_storage *)storage)->s->get_io_ctx();
+  return 0;
+}
+
+/* a user without a list gets one with the mailboxes and subscriptions found in the directory tree */
+static int rbox_list_import(struct mailbox_list *list, librados::IoCtx *io_ctx,
+                            std::map<std::string, std::string> *mailboxes, std::set<std::string> *subscriptions) {
+  const char *const patterns[] = {"*", NULL};
+  enum mailbox_list_iter_flags flags =
+      static_cast<enum mailbox_list_iter_flags>(MAILBOX_LIST_ITER_RAW_LIST | MAILBOX_LIST_ITER_NO_AUTO_BOXES);
+
+  struct mailbox_list_iterate_context *iter = fs_mailbox_list.v.iter_init(list, patterns, flags);
+  const struct mailbox_info *info;
+  while ((info = fs_mailbox_list.v.iter_next(iter)) != NULL) {
+    if ((info->flags & (MAILBOX_NOSELECT | MAILBOX_NONEXISTENT)) == 0) {
+      (*mailboxes)[info->vname] = "";
+    }
+  }
+  if (fs_mailbox_list.v.iter_deinit(iter) < 0) {
+    return -EIO;
+  }
+
+  if (fs_mailbox_list.v.subscriptions_refresh(list, list) < 0) {
+    return -EIO;
+  }
+  if (list->subscriptions != NULL) {
+    struct mailbox_tree_iterate_context *tree_iter =
+        mailbox_tree_iterate_init(list->subscriptions, NULL, MAILBOX_SUBSCRIBED);
+    const char *vname;
+    while (mailbox_tree_iterate_next(tree_iter, &vname) != NULL) {
+      subscriptions->insert(vname);
+    }
+    mailbox_tree_iterate_deinit(&tree_iter);
+  }
+
+  int ret = librmb::RadosMailboxList::save(io_ctx, *mailboxes, *subscriptions);
+  if (ret == -EEXIST) {
+    // imported by another process in the meantime, its list may already have been updated
+    mailboxes->clear();
+    subscriptions->clear();
+    return librmb::RadosMailboxList::load(io_ctx, mailboxes, subscriptions);
+  }
+  if (ret < 0) {
+    return ret;
+  }
+  i_debug("rbox: imported %zu mailboxes and %zu subscriptions into the mailbox list", mailboxes->size(),
+          subscriptions->size());
+  return 0;
+}
+
+static int rbox_list_load(struct mailbox_list *list, std::map<std::string, std::string> *mailboxes,
+                          std::set<std::string> *subscriptions) {
+  librados::IoCtx *io_ctx;
+
+  int ret = rbox_list_get_io_ctx(list, &io_ctx);
+  if (ret >= 0) {
+    ret = librmb::RadosMailboxList::load(io_ctx, mailboxes, subscriptions);
+  }
+  if (ret == -ENOENT) {
+    std::map<std::string, std::string> imported_mailboxes;
+    std::set<std::string> imported_subscriptions;
+    ret = rbox_list_import(list, io_ctx, &imported_mailboxes, &imported_subscriptions);
+    if (ret >= 0 && mailboxes != nullptr) {
+      mailboxes->swap(imported_mailboxes);
+    }
+    if (ret >= 0 && subscriptions != nullptr) {
+      subscriptions->swap(imported_subscriptions);
+    }
+  }
+  if (ret < 0) {
+    mailbox_list_set_critical(list, "rbox: loading the mailbox list failed: %d", ret);
+    return -1;
+  }
+  return 0;
+}
+
+/* updates fail with -ENOENT as long as the user has no list, it is imported and the update is repeated */
+template <typename Update>
+static int rbox_list_update(struct mailbox_list *list, Update update) {
+  librados::IoCtx *io_ctx;
+
+  int ret = rbox_list_get_io_ctx(list, &io_ctx);
+  if (ret < 0) {
+    return ret;
+  }
+  ret = update(io_ctx);
+  if (ret == -ENOENT) {
+    std::map<std::string, std::string> mailboxes;
+    std::set<std::string> subscriptions;
+    ret = rbox_list_import(list, io_ctx, &mailboxes, &subscriptions);
+    if (ret >= 0) {
+      ret = update(io_ctx);
+    }
+  }
+  return ret;
+}
+
+static struct mailbox_list_iterate_context *rbox_list_iter_init(struct mailbox_list *list,
+                                                                const char *const *patterns,
+                                                                enum mailbox_list_iter_flags flags) {
+  FUNC_START();
+  if ((flags & MAILBOX_LIST_ITER_SELECT_SUBSCRIBED) != 0) {
+    /* only subscribed mailboxes, the generic code lists them from the subscriptions */
+    return mailbox_list_subscriptions_iter_init(list, patterns, flags);
+  }
+
+  char sep = mail_namespace_get_sep(list->ns);
+  pool_t pool = pool_alloconly_create("rbox mailbox list iter", 1024);
+  struct rbox_list_iterate_context *ctx = p_new(pool, struct rbox_list_iterate_context, 1);
+  ctx->ctx.pool = pool;
+  ctx->ctx.list = list;
+  ctx->ctx.flags = flags;
+  ctx->ctx.glob = imap_match_init_multiple(pool, patterns, TRUE, sep);
+  array_create(&ctx->ctx.module_contexts, pool, sizeof(void *), 5);
+  ctx->info.ns = list->ns;
+
+  if ((flags & MAILBOX_LIST_ITER_RETURN_SUBSCRIBED) != 0 && mailbox_list_iter_subscriptions_refresh(list) < 0) {
+    ctx->ctx.failed = TRUE;
+    return &ctx->ctx;
+  }
+
+  std::map<std::string, std::string> mailboxes;
+  if (rbox_list_load(list, &mailboxes, nullptr) < 0) {
+    ctx->ctx.failed = TRUE;
+    return &ctx->ctx;
+  }
+  if ((list->ns->flags & NAMESPACE_FLAG_INBOX_USER) != 0) {
+    // INBOX always exists, it is created when it is opened the first time
+    mailboxes.insert(std::make_pair(std::string("INBOX"), std::string()));
+  }
+
+  // parents which are no mailbox themselves stay MAILBOX_NONEXISTENT
+  ctx->tree = mailbox_tree_init(sep);
+  for (std::map<std::string, std::string>::iterator it = mailboxes.begin(); it != mailboxes.end(); ++it) {
+    bool created;
+    struct mailbox_node *node = mailbox_tree_get(ctx->tree, it->first.c_str(), &created);
+    node->flags = MAILBOX_SELECT;
+  }
+  ctx->iter = mailbox_tree_iterate_init(ctx->tree, NULL, static_cast<enum mailbox_info_flags>(0));
+  FUNC_END();
+  return &ctx->ctx;
+}
+
+static const struct mailbox_info *rbox_list_iter_next(struct mailbox_list_iterate_context *_ctx) {
+  struct rbox_list_iterate_context *ctx = (struct rbox_list_iterate_context *)_ctx;
+  struct mailbox_node *node;
+  const char *vname;
+
+  if ((_ctx->flags & MAILBOX_LIST_ITER_SELECT_SUBSCRIBED) != 0) {
+    return mailbox_list_subscriptions_iter_next(_ctx);
+  }
+  if (ctx->iter == NULL) {
+    return NULL;
+  }
+  while ((node = mailbox_tree_iterate_next(ctx->iter, &vname)) != NULL) {
+    if (imap_match(_ctx->glob, vname) != IMAP_MATCH_YES) {
+      continue;
+    }
+    ctx->info.vname = vname;
+    ctx->info.flags = node->flags;
+    ctx->info.flags |= node->children != NULL ? MAILBOX_CHILDREN : MAILBOX_NOCHILDREN;
+    if ((_ctx->flags & MAILBOX_LIST_ITER_RETURN_SUBSCRIBED) != 0) {
+      mailbox_list_set_subscription_flags(_ctx->list, vname, &ctx->info.flags);
+    }
+    return &ctx->info;
+  }
+  return NULL;
+}
+
+static int rbox_list_iter_deinit(struct mailbox_list_iterate_context *_ctx) {
+  struct rbox_list_iterate_context *ctx = (struct rbox_list_iterate_context *)_ctx;
+
+  if ((_ctx->flags & MAILBOX_LIST_ITER_SELECT_SUBSCRIBED) != 0) {
+    return mailbox_list_subscriptions_iter_deinit(_ctx);
+  }
+  int ret = _ctx->failed ? -1 : 0;
+  if (ctx->iter != NULL) {
+    mailbox_tree_iterate_deinit(&ctx->iter);
+  }
+  if (ctx->tree != NULL) {
+    mailbox_tree_deinit(&ctx->tree);
+  }
+  pool_unref(&_ctx->pool);
+  return ret;
+}
+
+static int rbox_list_subscriptions_refresh(struct mailbox_list *src_list, struct mailbox_list *dest_list) {
+  std::set<std::string> subscriptions;
+
+  if (rbox_list_load(src_list, nullptr, &subscriptions) < 0) {
+    return -1;
+  }
+  if (dest_list->subscriptions == NULL) {
+    dest_list->subscriptions = mailbox_tree_init(mail_namespace_get_sep(dest_list->ns));
+  } else {
+    mailbox_tree_clear(dest_list->subscriptions);
+  }
+  for (std::set<std::string>::iterator it = subscriptions.begin(); it != subscriptions.end(); ++it) {
+    bool created;
+    struct mailbox_node *node = mailbox_tree_get(dest_list->subscriptions, it->c_str(), &created);
+    node->flags = MAILBOX_SUBSCRIBED;
+    while ((node = node->parent) != NULL) {
+      node->flags |= MAILBOX_CHILD_SUBSCRIBED;
+    }
+  }
+  return 0;
+}
+
+static int rbox_list_set_subscribed(struct mailbox_list *list, const char *name, bool set) {
+  // subscriptions may be given without the namespace prefix
+  std::string vname(name);
+  if (list->ns->prefix_len > 0 && strncmp(name, list->ns->prefix, list->ns->prefix_len) != 0) {
+    vname = list->ns->prefix + vname;
+  }
+  int ret = rbox_list_update(list, [&vname, set](librados::IoCtx *io_ctx) {
+    return librmb::RadosMailboxList::set_subscribed(io_ctx, vname, set);
+  });
+  if (ret < 0) {
+    mailbox_list_set_critical(list, "rbox: updating the subscription of %s failed: %d", vname.c_str(), ret);
+    return -1;
+  }
+  return 0;
+}
+
+static int rbox_list_delete_mailbox(struct mailbox_list *list, const char *name) {
+  if (fs_mailbox_list.v.delete_mailbox(list, name) < 0) {
+    return -1;
+  }
+  std::string vname(mailbox_list_get_vname(list, name));
+  int ret = rbox_list_update(list, [&vname](librados::IoCtx *io_ctx) {
+    return librmb::RadosMailboxList::remove_mailbox(io_ctx, vname);
+  });
+  if (ret < 0) {
+    mailbox_list_set_critical(list, "rbox: removing %s from the mailbox list failed: %d", vname.c_str(), ret);
+    return -1;
+  }
+  return 0;
+}
+
+/* the list is renamed first, it decides whether the rename is possible. a node without the directories of the
+ * mailbox has nothing else to rename. */
+static int rbox_list_rename_mailbox(struct mailbox_list *oldlist, const char *oldname, struct mailbox_list *newlist,
+                                    const char *newname) {
+  FUNC_START();
+  if (!rbox_is_rados_mailbox_list(newlist)) {
+    mailbox_list_set_error(oldlist, MAIL_ERROR_NOTPOSSIBLE, "Can't rename mailboxes to a different layout");
+    return -1;
+  }
+  std::string old_vname(mailbox_list_get_vname(oldlist, oldname));
+  std::string new_vname(mailbox_list_get_vname(newlist, newname));
+  char sep = mail_namespace_get_sep(oldlist->ns);
+
+  int ret = rbox_list_update(oldlist, [&old_vname, &new_vname, sep](librados::IoCtx *io_ctx) {
+    return librmb::RadosMailboxList::rename_mailbox(io_ctx, old_vname, new_vname, sep);
+  });
+  if (ret == -ENOENT) {
+    mailbox_list_set_error(oldlist, MAIL_ERROR_NOTFOUND, T_MAIL_ERR_MAILBOX_NOT_FOUND(old_vname.c_str()));
+    return -1;
+  }
+  if (ret == -EEXIST) {
+    mailbox_list_set_error(oldlist, MAIL_ERROR_EXISTS, "Target mailbox already exists");
+    return -1;
+  }
+  if (ret < 0) {
+    mailbox_list_set_critical(oldlist, "rbox: renaming %s in the mailbox list failed: %d", old_vname.c_str(), ret);
+    return -1;
+  }
+
+  if (fs_mailbox_list.v.rename_mailbox(oldlist, oldname, newlist, newname) < 0) {
+    enum mail_error error;
+    (void)mailbox_list_get_last_error(oldlist, &error);
+    if (error == MAIL_ERROR_NOTFOUND) {
+      return 0;
+    }
+    ret = rbox_list_update(oldlist, [&old_vname, &new_vname, sep](librados::IoCtx *io_ctx) {
+      return librmb::RadosMailboxList::rename_mailbox(io_ctx, new_vname, old_vname, sep);
+    });
+    if (ret < 0) {
+      i_error("rbox: reverting the rename of %s to %s failed: %d", old_vname.c_str(), new_vname.c_str(), ret);
+    }
+    return -1;
+  }
+  FUNC_END();
+  return 0;
+}
+
+static struct mailbox_list *rbox_list_alloc(void) {
+  struct mailbox_list *list = fs_mailbox_list.v.alloc();
+
+  // the fs list copies its own class
+  list->name = rbox_mailbox_list.name;
+  list->v = rbox_mailbox_list.v;
+  return list;
+}
+
+int rbox_mailbox_list_add(struct mailbox *box, const guid_128_t mailbox_guid) {
+  std::string vname(box->vname);
+  std::string guid(guid_128_to_string(mailbox_guid));
+
+  int ret = rbox_list_update(box->list, [&vname, &guid](librados::IoCtx *io_ctx) {
+    return librmb::RadosMailboxList::add_mailbox(io_ctx, vname, guid);
+  });
+  if (ret == -EEXIST) {
+    mailbox_list_set_error(box->list, MAIL_ERROR_EXISTS, "Mailbox already exists");
+    return -1;
+  }
+  if (ret < 0) {
+    mailbox_list_set_critical(box->list, "rbox: adding %s to the mailbox list failed: %d", box->vname, ret);
+    return -1;
+  }
+  return 0;
+}
+
+int rbox_mailbox_list_lookup(struct mailbox *box, bool *exists_r, guid_128_t mailbox_guid_r) {
+  librados::IoCtx *io_ctx;
+  std::string guid;
+
+  if (mailbox_guid_r != NULL) {
+    guid_128_empty(mailbox_guid_r);
+  }
+  int ret = rbox_list_get_io_ctx(box->list, &io_ctx);
+  if (ret >= 0) {
+    ret = librmb::RadosMailboxList::lookup(io_ctx, box->vname, exists_r, &guid);
+  }
+  if (ret == -ENOENT) {
+    std::map<std::string, std::string> mailboxes;
+    if (rbox_list_load(box->list, &mailboxes, nullptr) < 0) {
+      return -1;
+    }
+    std::map<std::string, std::string>::iterator it = mailboxes.find(box->vname);
+    *exists_r = it != mailboxes.end();
+    if (*exists_r) {
+      guid = it->second;
+    }
+    ret = 0;
+  }
+  if (ret < 0) {
+    mailbox_list_set_critical(box->list, "rbox: looking up %s in the mailbox list failed: %d", box->vname, ret);
+    return -1;
+  }
+  if (mailbox_guid_r != NULL && !guid.empty() && guid_128_from_string(guid.c_str(), mailbox_guid_r) < 0) {
+    guid_128_empty(mailbox_guid_r);
+  }
+  return 0;
+}
+
+void rbox_mailbox_list_register(void) {
+  rbox_mailbox_list = fs_mailbox_list;
+  rbox_mailbox_list.name = RBOX_MAILBOX_LIST_NAME;
+  rbox_mailbox_list.v.alloc = rbox_list_alloc;
+  rbox_mailbox_list.v.iter_init = rbox_list_iter_init;
+  rbox_mailbox_list.v.iter_next = rbox_list_iter_next;
+  rbox_mailbox_list.v.iter_deinit = rbox_list_iter_deinit;
+  rbox_mailbox_list.v.subscriptions_refresh = rbox_list_subscriptions_refresh;
+  rbox_mailbox_list.v.set_subscribed = rbox_list_set_subscribed;
+  rbox_mailbox_list.v.delete_mailbox = rbox_list_delete_mailbox;
+  rbox_mailbox_list.v.rename_mailbox = rbox_list_rename_mailbox;
+  mailbox_list_register(&rbox_mailbox_list);
+}
+
+void rbox_mailbox_list_unregister(void) { mailbox_list_unregister(&rbox_mailbox_list); }
@@ -0,0 +1,37 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_STORAGE_RBOX_RBOX_MAILBOX_LIST_RADOS_H_
+#define SRC_STORAGE_RBOX_RBOX_MAILBOX_LIST_RADOS_H_
+
+/* mail_location layout of the mailbox list kept in rados, e.g. rbox:~/rbox:LAYOUT=rados */
+#define RBOX_MAILBOX_LIST_NAME "rados"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "dovecot-all.h"
+
+extern void rbox_mailbox_list_register(void);
+extern void rbox_mailbox_list_unregister(void);
+
+extern bool rbox_is_rados_mailbox_list(struct mailbox_list *list);
+/* add a created mailbox to the list of its owner */
+extern int rbox_mailbox_list_add(struct mailbox *box, const guid_128_t mailbox_guid);
+/* mailbox_guid_r (may be NULL) is empty if the list doesn't know the guid, e.g. the mailbox has been imported */
+extern int rbox_mailbox_list_lookup(struct mailbox *box, bool *exists_r, guid_128_t mailbox_guid_r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SRC_STORAGE_RBOX_RBOX_MAILBOX_LIST_RADOS_H_
@@ -85,7 +85,8 @@ int setup_mail_object(struct mail_save_context *_ctx) {
   guid_128_generate(r_ctx->mail_oid);
 
   r_ctx->current_object = r_storage->s->alloc_mail_object();
-  r_ctx->current_object->set_oid(guid_128_to_string(r_ctx->mail_oid));
+  r_ctx->current_object->set_oid(r_ctx->mail_oid);
+  r_ctx->current_object->set_completion_group(&r_ctx->completion_group);
 
   if (mdata->guid != NULL) {
     string str(mdata->guid);
@@ -97,6 +98,18 @@ int setup_mail_object(struct mail_save_context *_ctx) {
   return 0;
 }
 
+/* the uid and size of the entry are known once the transaction is committed */
+static void rbox_save_add_manifest_entry(struct rbox_save_context *r_ctx, uint8_t flags) {
+  struct rbox_storage *r_storage = (struct rbox_storage *)&r_ctx->mbox->storage->storage;
+  if (!r_storage->config->is_mailbox_manifest_enabled()) {
+    return;
+  }
+  librmb::RadosManifestEntry &entry = r_ctx->manifest_entries[r_ctx->current_object->get_oid()];
+  entry.guid = guid_128_to_string(r_ctx->mail_guid);
+  entry.received_date = r_ctx->ctx.data.received_date;
+  entry.flags = flags;
+}
+
 void rbox_add_to_index(struct mail_save_context *_ctx) {
   FUNC_START();
   struct mail_save_data *mdata = &_ctx->data;
@@ -129,7 +142,7 @@ void rbox_add_to_index(struct mail_save_context *_ctx) {
   guid_128_generate(r_ctx->mail_oid);
 
   r_ctx->current_object = r_storage->s->alloc_mail_object();
-  r_ctx->current_object->set_oid(guid_128_to_string(r_ctx->mail_oid));
+  r_ctx->current_object->set_oid(r_ctx->mail_oid);
   r_ctx->objects.push_back(r_ctx->current_object);
 
   if (mdata->guid != NULL) {
@@ -149,6 +162,7 @@ void rbox_add_to_index(struct mail_save_context *_ctx) {
 
   mail_index_update_ext(r_ctx->trans, r_ctx->seq, r_ctx->mbox->ext_id, &rec, NULL);
   r_ctx->objects.push_back(r_ctx->current_object);
+  rbox_save_add_manifest_entry(r_ctx, save_flags);
 
   FUNC_END();
 }
@@ -181,7 +195,8 @@ void rbox_move_index(struct mail_save_context *_ctx, struct mail *src_mail) {
   guid_128_from_string(r_src_mail->mail_object->get_oid().c_str(), r_ctx->mail_oid);
 
   r_ctx->current_object = r_storage->s->alloc_mail_object();
-  r_ctx->current_object->set_oid(guid_128_to_string(r_ctx->mail_oid));
+  r_ctx->current_object->set_oid(r_ctx->mail_oid);
+  r_ctx->current_object->set_completion_group(&r_ctx->completion_group);
   r_ctx->objects.push_back(r_ctx->current_object);
 
   if (mdata->guid != NULL) {
@@ -198,6 +213,7 @@ void rbox_move_index(struct mail_save_context *_ctx, struct mail *src_mail) {
   memcpy(rec.guid, r_ctx->mail_guid, sizeof(r_ctx->mail_guid));
   memcpy(rec.oid, r_ctx->mail_oid, sizeof(r_ctx->mail_oid));
   mail_index_update_ext(r_ctx->trans, r_ctx->seq, r_ctx->mbox->ext_id, &rec, NULL);
+  rbox_save_add_manifest_entry(r_ctx, save_flags);
 
   if (_ctx->dest_mail != NULL) {
     mail_set_seq_saving(_ctx->dest_mail, r_ctx->seq);
@@ -243,6 +259,36 @@ int rbox_save_begin(struct mail_save_context *_ctx, struct istream *input) {
   return 0;
 }
 
+/* large mails: write complete chunks to rados while the mail is still being received */
+static int rbox_save_flush_chunks(struct rbox_save_context *r_ctx) {
+  struct rbox_storage *r_storage = (struct rbox_storage *)&r_ctx->mbox->storage->storage;
+  librados::bufferlist *buffer = r_ctx->current_object->get_mail_buffer();
+  uint64_t flush_size = r_storage->config->get_save_flush_size();
+
+  if (flush_size == 0 || buffer->length() < flush_size) {
+    return 0;
+  }
+  // always save to primary storage
+  if (rbox_open_rados_connection(r_ctx->ctx.transaction->box, false) < 0) {
+    i_error("ERROR, cannot open rados connection (rbox_save_flush_chunks)");
+    return -1;
+  }
+  uint64_t max_write = r_storage->s->get_max_write_size_bytes();
+  if (max_write > 0 && flush_size > max_write) {
+    flush_size = max_write;
+  }
+  while (buffer->length() >= flush_size) {
+    librados::bufferlist chunk;
+    o_stream_bufferlist_splice(r_ctx->output_stream, flush_size, &chunk);
+    int ret = r_storage->s->save_mail_chunk(r_ctx->current_object, chunk);
+    if (ret < 0) {
+      i_error("saving chunk of mail %s failed, errorcode: %d", r_ctx->current_object->get_oid().c_str(), ret);
+      return -1;
+    }
+  }
+  return 0;
+}
+
 int rbox_save_continue(struct mail_save_context *_ctx) {
   FUNC_START();
   struct rbox_save_context *r_ctx = (struct rbox_save_context *)_ctx;
@@ -264,6 +310,14 @@ int rbox_save_continue(struct mail_save_context *_ctx) {
     }
 
     index_mail_cache_parse_continue(_ctx->dest_mail);
+
+    if (rbox_save_flush_chunks(r_ctx) < 0) {
+      mail_storage_set_critical(storage, "write(%s) failed: cannot save chunk to rados",
+                                o_stream_get_name(_ctx->data.output));
+      r_ctx->failed = TRUE;
+      FUNC_END_RET("ret == -1");
+      return -1;
+    }
     /* both tee input readers may consume data from our primary
      input stream. we'll have to make sure we don't return with
      one of the streams still having data in them. */
@@ -382,6 +436,10 @@ static void clean_up_failed(struct rbox_save_context *r_ctx) {
 
   for (std::vector<RadosMailObject *>::iterator it_cur_obj = r_ctx->objects.begin(); it_cur_obj != r_ctx->objects.end();
        ++it_cur_obj) {
+    if (r_ctx->moved_oids.count((*it_cur_obj)->get_oid()) > 0) {
+      // moved within its namespace, this is still the source mail
+      continue;
+    }
     if (r_storage->s->delete_mail(*it_cur_obj) < 0) {
       i_error("Librados obj: %s, could not be removed", (*it_cur_obj)->get_oid().c_str());
     } else {
@@ -456,7 +514,9 @@ int rbox_save_finish(struct mail_save_context *_ctx) {
       r_ctx->failed = true;
     } else {
       bool async_write = true;
-      r_ctx->current_object->set_mail_size(r_ctx->current_object->get_mail_buffer()->length());
+      // chunks written in rbox_save_continue are no longer part of the mail buffer
+      r_ctx->current_object->set_mail_size(r_ctx->current_object->get_flushed_size() +
+                                           r_ctx->current_object->get_mail_buffer()->length());
       rbox_save_mail_set_metadata(r_ctx, r_ctx->current_object);
 
       // write_op will be deleted in [wait_for_operations]
@@ -495,18 +555,50 @@ static int rbox_save_assign_uids(struct rbox_save_context *r_ctx, const ARRAY_TY
   seq_range_array_iter_init(&iter, uids);
 
   RadosMetadata metadata;
+  int ret_val = 0;
+  std::map<std::string, librmb::RadosManifestEntry> manifest_update;
+  // the uid updates of all mails are sent in parallel and waited for once.
   for (std::vector<RadosMailObject *>::iterator it = r_ctx->objects.begin(); it != r_ctx->objects.end(); ++it) {
     r_ctx->current_object = *it;
     ret = seq_range_array_iter_nth(&iter, n++, &uid);
     i_assert(ret);
+    std::map<std::string, librmb::RadosManifestEntry>::iterator entry =
+        r_ctx->manifest_entries.find(r_ctx->current_object->get_oid());
+    if (entry != r_ctx->manifest_entries.end()) {
+      entry->second.uid = uid;
+      entry->second.size = r_ctx->current_object->get_mail_size();
+      manifest_update.insert(*entry);
+    }
     if (r_storage->config->is_mail_attribute(rbox_metadata_key::RBOX_METADATA_MAIL_UID)) {
       metadata.convert(rbox_metadata_key::RBOX_METADATA_MAIL_UID, uid);
-      int ret_val = r_storage->ms->get_storage()->set_metadata(r_ctx->current_object, metadata);
+      ret_val = r_storage->ms->get_storage()->aio_set_metadata(r_ctx->current_object, metadata);
       if (ret_val < 0) {
-        return -1;
+        i_error("setting uid of %s failed: %d", r_ctx->current_object->get_oid().c_str(), ret_val);
+        break;
       }
     }
   }
+
+  // the manifest is updated in parallel to the uids. mailboxes without a manifest are skipped.
+  librmb::RadosCompletionGroup manifest_group;
+  if (ret_val >= 0 && !manifest_update.empty()) {
+    librados::ObjectWriteOperation *op = new librados::ObjectWriteOperation();
+    librmb::RadosMailboxManifest::add_entries(op, manifest_update);
+    std::string manifest_oid = librmb::RadosMailboxManifest::get_oid(guid_128_to_string(r_ctx->mbox->mailbox_guid));
+    ret_val = manifest_group.aio_operate(&r_storage->s->get_io_ctx(), manifest_oid, op);
+  }
+  int manifest_ret = manifest_group.wait();
+  if (ret_val >= 0 && manifest_ret == -ENOENT) {
+    // the mailbox has no manifest, e.g. it was created before manifests were enabled
+    i_debug("mailbox %s has no manifest", r_ctx->mbox->box.vname);
+  } else if (manifest_ret < 0) {
+    ret_val = rbox_mailbox_manifest_failed(&r_ctx->mbox->box, manifest_ret);
+  }
+
+  // also wait in case of error, the operations reference the mail objects.
+  if (r_storage->s->wait_for_rados_operations(r_ctx->objects) || ret_val < 0) {
+    return -1;
+  }
   i_assert(!seq_range_array_iter_nth(&iter, n, &uid));
   return 0;
 }
@@ -565,6 +657,28 @@ int rbox_transaction_save_commit_pre(struct mail_save_context *_ctx) {
   return 0;
 }
 
+/* remove the sources of the moves between namespaces, the moved mails are committed */
+static void rbox_save_remove_move_sources(struct rbox_save_context *r_ctx) {
+  struct rbox_storage *r_storage = (struct rbox_storage *)&r_ctx->mbox->storage->storage;
+  librmb::RadosCompletionGroup completion_group;
+
+  for (std::vector<struct rbox_move_source>::iterator it = r_ctx->move_sources.begin();
+       it != r_ctx->move_sources.end(); ++it) {
+    librmb::RadosStorage *storage = it->alt_storage ? r_storage->alt : r_storage->s;
+    completion_group.wait_below(r_storage->config->get_copy_window());
+    int ret = storage->aio_delete_mail(it->oid, it->ns.c_str(), &completion_group);
+    if (ret < 0) {
+      i_error("removing source of moved mail failed: oid: %s, ns: %s, errorcode: %d", it->oid.c_str(),
+              it->ns.c_str(), ret);
+    }
+  }
+  int ret = completion_group.wait();
+  if (ret < 0) {
+    i_error("removing sources of moved mails failed: errorcode: %d", ret);
+  }
+  r_ctx->move_sources.clear();
+}
+
 void rbox_transaction_save_commit_post(struct mail_save_context *_ctx,
                                        struct mail_index_transaction_commit_result *result) {
   FUNC_START();
@@ -574,7 +688,9 @@ void rbox_transaction_save_commit_post(struct mail_save_context *_ctx,
 
   mail_index_sync_set_commit_result(r_ctx->sync_ctx->index_sync_ctx, result);
 
+  r_ctx->sync_ctx->changed = TRUE;
   (void)rbox_sync_finish(&r_ctx->sync_ctx, TRUE);
+  rbox_save_remove_move_sources(r_ctx);
   rbox_transaction_save_rollback(_ctx);
 
   FUNC_END();
@@ -12,6 +12,8 @@
 #ifndef SRC_STORAGE_RBOX_RBOX_SAVE_H_
 #define SRC_STORAGE_RBOX_RBOX_SAVE_H_
 
+#include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -19,6 +21,14 @@
 #include "mail-storage-private.h"
 
 #include "rados-mail-object.h"
+#include "rados-mailbox-manifest.h"
+
+/* source of a move between namespaces, removed once the transaction is committed */
+struct rbox_move_source {
+  std::string oid;
+  std::string ns;
+  bool alt_storage;
+};
 
 class rbox_save_context {
  public:
@@ -58,6 +68,13 @@ class rbox_save_context {
   const librmb::RadosStorage &rados_storage;
   std::vector<librmb::RadosMailObject *> objects;
   librmb::RadosMailObject *current_object;
+  // pending write operations of all mails in the transaction
+  librmb::RadosCompletionGroup completion_group;
+  // objects moved within their namespace, they are not removed on rollback
+  std::set<std::string> moved_oids;
+  std::vector<struct rbox_move_source> move_sources;
+  // manifest entries of the saved, copied and moved mails (oid => entry)
+  std::map<std::string, librmb::RadosManifestEntry> manifest_entries;
 
   unsigned int failed : 1;
   unsigned int finished : 1;
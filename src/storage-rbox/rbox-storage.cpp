@@ -12,8 +12,12 @@
 
 #include <sys/stat.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
 
+#include <functional>
 #include <string>
+#include <vector>
 
 #include <rados/librados.hpp>
 
@@ -29,10 +33,15 @@ extern "C" {
 #include "debug-helper.h"
 #include "guid.h"
 #include "mailbox-list-fs.h"
+#include "write-full.h"
+#include "ioloop.h"
+#include "mail-index-private.h"
+#include "mail-transaction-log.h"
 }
 
 #include "rbox-storage.hpp"
 #include "rbox-mailbox-list-fs.h"
+#include "rbox-mailbox-list-rados.h"
 
 #include "../librmb/rados-cluster-impl.h"
 #include "../librmb/rados-storage-impl.h"
@@ -40,6 +49,9 @@ extern "C" {
 #include "../librmb/rados-dovecot-ceph-cfg-impl.h"
 #include "../librmb/rados-guid-generator.h"
 #include "../librmb/rados-metadata-storage-impl.h"
+#include "../librmb/rados-mailbox-manifest.h"
+#include "../librmb/rados-index-snapshot.h"
+#include "../librmb/rados-notifier-impl.h"
 
 #include "rbox-copy.h"
 #include "rbox-mail.h"
@@ -72,6 +84,9 @@ struct mail_storage *rbox_storage_alloc(void) {
   storage->ns_mgr = new librmb::RadosNamespaceManager(storage->config);
   storage->ms = new librmb::RadosMetadataStorageImpl();
   storage->alt = new librmb::RadosStorageImpl(storage->cluster);
+  storage->notifier = nullptr;
+  storage->metadata_cache = new librmb::RadosMetadataCache();
+  storage->prefetch_bytes = 0;
   FUNC_END();
   return &storage->storage;
 }
@@ -164,6 +179,10 @@ void rbox_storage_destroy(struct mail_storage *_storage) {
   FUNC_START();
   struct rbox_storage *storage = (struct rbox_storage *)_storage;
 
+  if (storage->notifier != nullptr) {
+    delete storage->notifier;
+    storage->notifier = nullptr;
+  }
   if (storage->s != nullptr) {
     storage->s->close_connection();
     delete storage->s;
@@ -192,6 +211,10 @@ void rbox_storage_destroy(struct mail_storage *_storage) {
     delete storage->ms;
     storage->ms = nullptr;
   }
+  if (storage->metadata_cache != nullptr) {
+    delete storage->metadata_cache;
+    storage->metadata_cache = nullptr;
+  }
 
   index_storage_destroy(_storage);
 
@@ -298,12 +321,20 @@ static int rbox_open_mailbox(struct mailbox *box) {
   const char *box_path = mailbox_get_path(box);
   struct stat st;
 
+  bool exists = false;
   if (stat(box_path, &st) == 0) {
     /* exists, open it */
   } else if (errno == ENOENT) {
-    mail_storage_set_error(box->storage, MAIL_ERROR_NOTFOUND, T_MAIL_ERR_MAILBOX_NOT_FOUND(box->vname));
-    FUNC_END_RET("ret == -1");
-    return -1;
+    if (!rbox_is_rados_mailbox_list(box->list) || rbox_mailbox_list_lookup(box, &exists, NULL) < 0 || !exists) {
+      mail_storage_set_error(box->storage, MAIL_ERROR_NOTFOUND, T_MAIL_ERR_MAILBOX_NOT_FOUND(box->vname));
+      FUNC_END_RET("ret == -1");
+      return -1;
+    }
+    /* the mailbox list is in rados, the directory is created on the first node opening the mailbox */
+    if (mailbox_mkdir(box, box_path, MAILBOX_LIST_PATH_TYPE_MAILBOX) < 0) {
+      FUNC_END_RET("ret == -1");
+      return -1;
+    }
   } else if (errno == EACCES) {
     mail_storage_set_critical(box->storage, "%s", mail_error_eacces_msg("stat", box_path));
     FUNC_END_RET("ret == -1");
@@ -329,19 +360,24 @@ static int rbox_open_mailbox(struct mailbox *box) {
 
   return 0;
 }
-int read_plugin_configuration(struct mailbox *box) {
-  FUNC_START();
-  struct rbox_mailbox *mbox = (struct rbox_mailbox *)box;
-  struct rbox_storage *storage = (struct rbox_storage *)box->storage;
-
+static void rbox_storage_read_plugin_configuration(struct rbox_storage *storage) {
   if (!storage->config->is_config_valid()) {
     std::map<std::string, std::string> *map = storage->config->get_config();
     for (std::map<std::string, std::string>::iterator it = map->begin(); it != map->end(); ++it) {
       std::string setting = it->first;
-      storage->config->update_metadata(setting, mail_user_plugin_getenv(mbox->storage->storage.user, setting.c_str()));
+      storage->config->update_metadata(setting, mail_user_plugin_getenv(storage->storage.user, setting.c_str()));
     }
     storage->config->set_config_valid(true);
+    int cache_size = storage->config->get_metadata_cache_size();
+    storage->metadata_cache->set_max_entries(cache_size > 0 ? cache_size : 0);
+    int cache_ttl = storage->config->get_metadata_cache_ttl();
+    storage->metadata_cache->set_ttl(cache_ttl > 0 ? cache_ttl : 0);
   }
+}
+
+int read_plugin_configuration(struct mailbox *box) {
+  FUNC_START();
+  rbox_storage_read_plugin_configuration((struct rbox_storage *)box->storage);
   FUNC_END();
   return 0;
 }
@@ -353,22 +389,27 @@ bool is_alternate_pool_valid(struct mailbox *_box) {
 }
 
 int rbox_open_rados_connection(struct mailbox *box, bool alt_storage) {
+  return rbox_storage_open_rados_connection(box->storage, box->list, alt_storage);
+}
+
+int rbox_storage_open_rados_connection(struct mail_storage *storage, struct mailbox_list *list, bool alt_storage) {
   FUNC_START();
   int ret = -1;
 
   /* rados cluster connection */
-  struct rbox_mailbox *mbox = (struct rbox_mailbox *)box;
-  librmb::RadosStorage *rados_storage = mbox->storage->s;
+  struct rbox_storage *r_storage = (struct rbox_storage *)storage;
+  librmb::RadosStorage *rados_storage = r_storage->s;
 
   // initialize storage with plugin configuration
-  read_plugin_configuration(box);
-  ret = rados_storage->open_connection(mbox->storage->config->get_pool_name(),
-                                       mbox->storage->config->get_rados_cluster_name(),
-                                       mbox->storage->config->get_rados_username());
+  rbox_storage_read_plugin_configuration(r_storage);
+  ret = rados_storage->open_connection(r_storage->config->get_pool_name(), r_storage->config->get_rados_cluster_name(),
+                                       r_storage->config->get_rados_username());
+  rados_storage->set_write_window(r_storage->config->get_write_window());
 
   if (alt_storage) {
-    ret = mbox->storage->alt->open_connection(box->list->set.alt_dir, mbox->storage->config->get_rados_cluster_name(),
-                                              mbox->storage->config->get_rados_username());
+    ret = r_storage->alt->open_connection(list->set.alt_dir, r_storage->config->get_rados_cluster_name(),
+                                          r_storage->config->get_rados_username());
+    r_storage->alt->set_write_window(r_storage->config->get_write_window());
     //}
   }
   /*TODO:*/
@@ -382,32 +423,32 @@ int rbox_open_rados_connection(struct mailbox *box, bool alt_storage) {
     return ret;
   }
   // load rados configuration
-  ret = mbox->storage->config->load_rados_config();
+  ret = r_storage->config->load_rados_config();
   if (ret == -ENOENT) {  // config does not exist.
-    ret = mbox->storage->config->save_default_rados_config();
+    ret = r_storage->config->save_default_rados_config();
   }
   if (ret < 0) {
     i_error("unable to read rados_config return value : %d", ret);
     return ret;
   }
-  mbox->storage->ms->create_metadata_storage(&mbox->storage->s->get_io_ctx(), mbox->storage->config);
+  r_storage->ms->create_metadata_storage(&r_storage->s->get_io_ctx(), r_storage->config);
 
   std::string uid;
-  if (box->list->ns->owner != nullptr) {
-    uid = box->list->ns->owner->username;
-    uid += mbox->storage->config->get_user_suffix();
+  if (list->ns->owner != nullptr) {
+    uid = list->ns->owner->username;
+    uid += r_storage->config->get_user_suffix();
   } else {
-    uid = mbox->storage->config->get_public_namespace();
+    uid = r_storage->config->get_public_namespace();
   }
   std::string ns;
-  if (!mbox->storage->ns_mgr->lookup_key(uid, &ns)) {
+  if (!r_storage->ns_mgr->lookup_key(uid, &ns)) {
     RboxGuidGenerator guid_generator;
-    ret = mbox->storage->ns_mgr->add_namespace_entry(uid, &ns, &guid_generator) ? 0 : -1;
+    ret = r_storage->ns_mgr->add_namespace_entry(uid, &ns, &guid_generator) ? 0 : -1;
   }
   if (ret >= 0) {
     rados_storage->set_namespace(ns);
     if (alt_storage) {
-      mbox->storage->alt->set_namespace(ns);
+      r_storage->alt->set_namespace(ns);
     }
   } else {
     i_error("error namespace not set: for uid %s error code is: %d", uid.c_str(), ret);
@@ -542,6 +583,240 @@ int rbox_mailbox_create_indexes(struct mailbox *box, const struct mailbox_update
 
   return 0;
 }
+/* the index files kept in a snapshot, appended to the index prefix */
+static const char *const rbox_index_snapshot_files[] = {"", ".log", ".log.2", ".cache"};
+
+static int rbox_index_snapshot_dir(struct mailbox *box, const char **index_dir_r) {
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+
+  read_plugin_configuration(box);
+  // the snapshot is named after the mailbox guid, only the rados mailbox list knows it before the index is opened
+  if (r_storage->config->get_index_snapshot_interval() <= 0 || box->index_prefix == NULL ||
+      !rbox_is_rados_mailbox_list(box->list)) {
+    return 0;
+  }
+  // in-memory indexes have no files
+  return mailbox_get_path_to(box, MAILBOX_LIST_PATH_TYPE_INDEX, index_dir_r);
+}
+
+/* a node without the index files of the mailbox restores them from the snapshot. returns 1 if they have been
+ * restored, 0 if there is nothing to restore. */
+static int rbox_mailbox_restore_index_snapshot(struct mailbox *box) {
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+  const char *index_dir;
+  struct stat st;
+  bool exists = false;
+  guid_128_t mailbox_guid;
+
+  if (rbox_index_snapshot_dir(box, &index_dir) <= 0) {
+    return 0;
+  }
+  std::string index_path = std::string(index_dir) + "/" + box->index_prefix;
+  if (stat(index_path.c_str(), &st) == 0 || errno != ENOENT) {
+    return 0;
+  }
+  if (stat((index_path + ".log").c_str(), &st) == 0 || errno != ENOENT) {
+    return 0;
+  }
+  if (rbox_open_rados_connection(box, false) < 0) {
+    i_error("rbox_mailbox_restore_index_snapshot: connection to rados failed");
+    return 0;
+  }
+  if (rbox_mailbox_list_lookup(box, &exists, mailbox_guid) < 0 || !exists || guid_128_is_empty(mailbox_guid)) {
+    return 0;
+  }
+
+  std::map<std::string, librados::bufferlist> files;
+  int ret = librmb::RadosIndexSnapshot::load(&r_storage->s->get_io_ctx(), guid_128_to_string(mailbox_guid), &files);
+  if (ret < 0) {
+    if (ret != -ENOENT) {
+      i_error("loading the index snapshot of mailbox %s failed: %d", box->vname, ret);
+    }
+    return 0;
+  }
+  if (mailbox_mkdir(box, index_dir, MAILBOX_LIST_PATH_TYPE_INDEX) < 0) {
+    return 0;
+  }
+
+  const struct mailbox_permissions *perm = mailbox_get_permissions(box);
+  std::vector<std::string> restored;
+  for (size_t i = 0; i < N_ELEMENTS(rbox_index_snapshot_files); i++) {
+    std::string path = index_path + rbox_index_snapshot_files[i];
+    std::map<std::string, librados::bufferlist>::iterator file =
+        files.find(box->index_prefix + std::string(rbox_index_snapshot_files[i]));
+    if (file == files.end()) {
+      continue;
+    }
+    std::string temp_path = path + ".snapshot";
+    int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, perm->file_create_mode);
+    if (fd == -1) {
+      i_error("open(%s) failed: %m", temp_path.c_str());
+      ret = -1;
+      break;
+    }
+    ret = write_full(fd, file->second.c_str(), file->second.length());
+    if (ret < 0) {
+      i_error("write(%s) failed: %m", temp_path.c_str());
+    }
+    if (close(fd) < 0 && ret == 0) {
+      i_error("close(%s) failed: %m", temp_path.c_str());
+      ret = -1;
+    }
+    if (ret == 0 && rename(temp_path.c_str(), path.c_str()) < 0) {
+      i_error("rename(%s, %s) failed: %m", temp_path.c_str(), path.c_str());
+      ret = -1;
+    }
+    if (ret < 0) {
+      i_unlink_if_exists(temp_path.c_str());
+      break;
+    }
+    restored.push_back(path);
+  }
+  if (ret < 0) {
+    // an incomplete set of files is worse than none, the index is rebuilt instead
+    for (std::vector<std::string>::iterator it = restored.begin(); it != restored.end(); ++it) {
+      i_unlink_if_exists(it->c_str());
+    }
+    return 0;
+  }
+  i_debug("restored the index of mailbox %s from its snapshot", box->vname);
+  if (!restored.empty() &&
+      !(r_storage->config->is_update_attributes() &&
+        r_storage->config->is_mail_attribute(librmb::RBOX_METADATA_OLDV1_FLAGS) &&
+        r_storage->config->is_updateable_attribute(librmb::RBOX_METADATA_OLDV1_FLAGS))) {
+    i_warning("mailbox %s: the flags are not kept with the mails, changes since the snapshot are lost", box->vname);
+  }
+  return restored.empty() ? 0 : 1;
+}
+
+static int rbox_read_index_file(const std::string &path, librados::bufferlist *bl) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    if (errno == ENOENT) {
+      return 0;
+    }
+    i_error("open(%s) failed: %m", path.c_str());
+    return -1;
+  }
+  char buf[IO_BLOCK_SIZE];
+  ssize_t ret;
+  while ((ret = read(fd, buf, sizeof(buf))) > 0) {
+    bl->append(buf, ret);
+  }
+  if (ret < 0) {
+    i_error("read(%s) failed: %m", path.c_str());
+  }
+  i_close_fd(&fd);
+  return ret < 0 ? -1 : 1;
+}
+
+/* the position of the transaction log the index view is synced to, it moves with every change of the index */
+static void rbox_index_log_head(struct mailbox *box, uint32_t *file_seq_r, uint32_t *file_offset_r) {
+  const struct mail_index_header *hdr = mail_index_get_header(box->view);
+  *file_seq_r = hdr->log_file_seq;
+  *file_offset_r = hdr->log_file_head_offset;
+}
+
+static int rbox_read_index_files(struct mailbox *box, const char *index_dir,
+                                 std::map<std::string, librados::bufferlist> *files);
+
+/* write a snapshot of the index files, if the index changed and the last one is older than
+ * rbox_index_snapshot_interval */
+static void rbox_mailbox_save_index_snapshot(struct mailbox *box) {
+  struct rbox_mailbox *mbox = (struct rbox_mailbox *)box;
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+  const char *index_dir;
+  uint32_t file_seq, file_offset;
+
+  if (!box->opened || box->deleting || box->view == NULL || guid_128_is_empty(mbox->mailbox_guid) ||
+      rbox_index_snapshot_dir(box, &index_dir) <= 0) {
+    return;
+  }
+  rbox_index_log_head(box, &file_seq, &file_offset);
+  if (file_seq == mbox->snapshot_log_file_seq && file_offset == mbox->snapshot_log_file_offset) {
+    return;
+  }
+  if (rbox_open_rados_connection(box, false) < 0) {
+    i_error("rbox_mailbox_save_index_snapshot: connection to rados failed");
+    return;
+  }
+  librados::IoCtx *io_ctx = &r_storage->s->get_io_ctx();
+  std::string mailbox_guid = guid_128_to_string(mbox->mailbox_guid);
+  time_t save_time;
+  int ret = librmb::RadosIndexSnapshot::stat(io_ctx, mailbox_guid, &save_time);
+  if (ret < 0 && ret != -ENOENT) {
+    return;
+  }
+  if (ret >= 0 && save_time + r_storage->config->get_index_snapshot_interval() > time(NULL)) {
+    return;
+  }
+
+  std::map<std::string, librados::bufferlist> files;
+  if (rbox_read_index_files(box, index_dir, &files) < 0 || files.empty()) {
+    return;
+  }
+  ret = librmb::RadosIndexSnapshot::save(io_ctx, mailbox_guid, files);
+  if (ret < 0) {
+    i_error("saving the index snapshot of mailbox %s failed: %d", box->vname, ret);
+    return;
+  }
+  mbox->snapshot_log_file_seq = file_seq;
+  mbox->snapshot_log_file_offset = file_offset;
+}
+
+/* read the index files while holding the lock of the transaction log. the index is only written and the log only
+ * rotated by its holder, so the files belong together. */
+static int rbox_read_index_files(struct mailbox *box, const char *index_dir,
+                                 std::map<std::string, librados::bufferlist> *files) {
+  uint32_t file_seq;
+  uoff_t file_offset;
+
+#if DOVECOT_PREREQ(2, 3)
+  if (mail_transaction_log_sync_lock(box->index->log, "rbox index snapshot", &file_seq, &file_offset) < 0) {
+#else
+  if (mail_transaction_log_sync_lock(box->index->log, &file_seq, &file_offset) < 0) {
+#endif
+    return -1;
+  }
+  int ret = 0;
+  std::string index_path = std::string(index_dir) + "/" + box->index_prefix;
+  for (size_t i = 0; i < N_ELEMENTS(rbox_index_snapshot_files); i++) {
+    librados::bufferlist bl;
+    ret = rbox_read_index_file(index_path + rbox_index_snapshot_files[i], &bl);
+    if (ret < 0) {
+      break;
+    }
+    if (ret > 0) {
+      (*files)[box->index_prefix + std::string(rbox_index_snapshot_files[i])] = bl;
+    }
+  }
+#if DOVECOT_PREREQ(2, 3)
+  mail_transaction_log_sync_unlock(box->index->log, "rbox index snapshot");
+#else
+  mail_transaction_log_sync_unlock(box->index->log);
+#endif
+  return ret < 0 ? -1 : 0;
+}
+
+/* a snapshot must not outlive its mailbox */
+static void rbox_mailbox_remove_index_snapshot(struct mailbox *box) {
+  struct rbox_mailbox *mbox = (struct rbox_mailbox *)box;
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+  const char *index_dir;
+
+  if (guid_128_is_empty(mbox->mailbox_guid) || rbox_index_snapshot_dir(box, &index_dir) <= 0) {
+    return;
+  }
+  if (rbox_open_rados_connection(box, false) < 0) {
+    i_error("rbox_mailbox_remove_index_snapshot: connection to rados failed");
+    return;
+  }
+  int ret = librmb::RadosIndexSnapshot::remove(&r_storage->s->get_io_ctx(), guid_128_to_string(mbox->mailbox_guid));
+  if (ret < 0 && ret != -ENOENT) {
+    i_error("removing the index snapshot of mailbox %s failed: %d", box->vname, ret);
+  }
+}
+
 int rbox_mailbox_open(struct mailbox *box) {
   FUNC_START();
   struct rbox_mailbox *mbox = (struct rbox_mailbox *)box;
@@ -551,6 +826,8 @@ int rbox_mailbox_open(struct mailbox *box) {
   if (rbox_mailbox_alloc_index(mbox) < 0)
     return -1;
 
+  bool restored = rbox_mailbox_restore_index_snapshot(box) > 0;
+
   if (rbox_open_mailbox(box) < 0) {
     return -1;
   }
@@ -576,6 +853,12 @@ int rbox_mailbox_open(struct mailbox *box) {
   }
 
   memcpy(mbox->mailbox_guid, hdr.mailbox_guid, sizeof(mbox->mailbox_guid));
+  if (restored) {
+    /* the snapshot may be behind the mail objects, the next sync rebuilds the index with a new uidvalidity */
+    mbox->index_restored = TRUE;
+    rbox_set_mailbox_corrupted(box);
+  }
+  rbox_index_log_head(box, &mbox->snapshot_log_file_seq, &mbox->snapshot_log_file_offset);
   FUNC_END();
   return 0;
 }
@@ -594,6 +877,153 @@ void rbox_set_mailbox_corrupted(struct mailbox *box) {
   FUNC_END();
 }
 
+/* the notifier is created on first use, it uses the io context of the connected storage */
+static librmb::RadosNotifier *rbox_storage_get_notifier(struct rbox_storage *r_storage) {
+  if (r_storage->notifier == nullptr) {
+    r_storage->notifier = new librmb::RadosNotifierImpl(r_storage->cluster, r_storage->s);
+  }
+  return r_storage->notifier;
+}
+
+struct rbox_notify {
+  // the watch callback runs on a librados thread, it wakes up the ioloop via the pipe
+  int fd_in, fd_out;
+  struct io *io;
+  // retries a lost watch
+  struct timeout *to;
+  uint64_t handle;
+};
+
+#define RBOX_NOTIFY_REWATCH_MSECS (10 * 1000)
+
+static void rbox_notify_check(struct mailbox *box);
+
+static void rbox_notify_rewatch(void *context) { rbox_notify_check((struct mailbox *)context); }
+
+static void rbox_notify_check(struct mailbox *box) {
+  struct rbox_mailbox *rbox = (struct rbox_mailbox *)box;
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+
+  int ret = r_storage->notifier->check(rbox->notify->handle);
+  if (ret < 0) {
+    // changes of other processes are missed until the watch is back
+    if (rbox->notify->to == NULL) {
+      i_error("watching mailbox %s was lost: %d, retrying", box->vname, ret);
+      rbox->notify->to = timeout_add(RBOX_NOTIFY_REWATCH_MSECS, rbox_notify_rewatch, (void *)box);
+    }
+    return;
+  }
+  if (rbox->notify->to != NULL) {
+    i_info("watching mailbox %s again", box->vname);
+    timeout_remove(&rbox->notify->to);
+    // notifications may have been missed in the meantime
+    r_storage->metadata_cache->clear();
+    if (box->notify_callback != NULL) {
+      box->notify_callback(box, box->notify_context);
+    }
+  }
+}
+
+static void rbox_notify_input(void *context) {
+  struct mailbox *box = (struct mailbox *)context;
+  struct rbox_mailbox *rbox = (struct rbox_mailbox *)box;
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+  char buf[64];
+
+  // several notifications are handled by a single callback
+  ssize_t ret;
+  do {
+    ret = read(rbox->notify->fd_in, buf, sizeof(buf));
+  } while (ret > 0);
+  // another process changed the mailbox, the cached metadata may be stale
+  r_storage->metadata_cache->clear();
+  // a lost watch wakes up the mailbox, too
+  rbox_notify_check(box);
+  if (box->notify_callback != NULL) {
+    box->notify_callback(box, box->notify_context);
+  }
+}
+
+static void rbox_notify_watch(struct mailbox *box) {
+  struct rbox_mailbox *rbox = (struct rbox_mailbox *)box;
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+
+  if (rbox->notify != NULL || !r_storage->config->is_mailbox_notify_enabled()) {
+    return;
+  }
+  if (rbox_open_rados_connection(box, false) < 0) {
+    i_error("rbox_notify_watch: connection to rados failed");
+    return;
+  }
+  int fd[2];
+  if (pipe(fd) < 0) {
+    i_error("pipe() failed: %m");
+    return;
+  }
+  (void)fcntl(fd[0], F_SETFL, O_NONBLOCK);
+  (void)fcntl(fd[1], F_SETFL, O_NONBLOCK);
+
+  int fd_out = fd[1];
+  std::function<void()> wakeup = [fd_out]() {
+    char c = 0;
+    // a full pipe has a wakeup pending already
+    ssize_t written = write(fd_out, &c, 1);
+    (void)written;
+  };
+  std::string oid = librmb::RadosNotifier::get_oid(guid_128_to_string(rbox->mailbox_guid));
+  uint64_t handle;
+  int ret = rbox_storage_get_notifier(r_storage)->watch(oid, wakeup, &handle);
+  if (ret < 0) {
+    i_error("watching mailbox %s failed: %d", box->vname, ret);
+    i_close_fd(&fd[0]);
+    i_close_fd(&fd[1]);
+    return;
+  }
+  rbox->notify = i_new(struct rbox_notify, 1);
+  rbox->notify->fd_in = fd[0];
+  rbox->notify->fd_out = fd[1];
+  rbox->notify->handle = handle;
+  rbox->notify->io = io_add(fd[0], IO_READ, rbox_notify_input, (void *)box);
+}
+
+static void rbox_notify_unwatch(struct mailbox *box) {
+  struct rbox_mailbox *rbox = (struct rbox_mailbox *)box;
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+
+  if (rbox->notify == NULL) {
+    return;
+  }
+  io_remove(&rbox->notify->io);
+  if (rbox->notify->to != NULL) {
+    timeout_remove(&rbox->notify->to);
+  }
+  // no callback writes to the pipe once unwatch returns
+  int ret = r_storage->notifier->unwatch(rbox->notify->handle);
+  if (ret < 0) {
+    i_warning("unwatching mailbox %s failed: %d", box->vname, ret);
+  }
+  i_close_fd(&rbox->notify->fd_in);
+  i_close_fd(&rbox->notify->fd_out);
+  i_free_and_null(rbox->notify);
+}
+
+void rbox_notify_mailbox_changed(struct mailbox *box) {
+  struct rbox_mailbox *rbox = (struct rbox_mailbox *)box;
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+
+  if (!r_storage->config->is_mailbox_notify_enabled() || guid_128_is_empty(rbox->mailbox_guid)) {
+    return;
+  }
+  if (rbox_open_rados_connection(box, false) < 0) {
+    return;
+  }
+  std::string oid = librmb::RadosNotifier::get_oid(guid_128_to_string(rbox->mailbox_guid));
+  int ret = rbox_storage_get_notifier(r_storage)->notify(oid);
+  if (ret < 0) {
+    i_warning("notifying the changes of mailbox %s failed: %d", box->vname, ret);
+  }
+}
+
 static void rbox_mailbox_close(struct mailbox *box) {
   FUNC_START();
   struct rbox_mailbox *rbox = (struct rbox_mailbox *)box;
@@ -615,6 +1045,8 @@ static void rbox_mailbox_close(struct mailbox *box) {
   /*if (rbox->corrupted_rebuild_count != 0) {
     (void)rbox_sync(rbox);
   }*/
+  rbox_notify_unwatch(box);
+  rbox_mailbox_save_index_snapshot(box);
   index_storage_mailbox_close(box);
   FUNC_END();
 }
@@ -651,6 +1083,42 @@ static int dir_is_empty(struct mail_storage *storage, const char *path) {
   return ret;
 }
 
+/* a new mailbox starts with an empty manifest, which is kept up to date from now on */
+static int rbox_mailbox_create_manifest(struct mailbox *box) {
+  struct rbox_mailbox *mbox = (struct rbox_mailbox *)box;
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+
+  read_plugin_configuration(box);
+  if (!r_storage->config->is_mailbox_manifest_enabled()) {
+    return 0;
+  }
+  if (rbox_open_rados_connection(box, false) < 0) {
+    i_error("rbox_mailbox_create_manifest: connection to rados failed");
+    return -1;
+  }
+  int ret = librmb::RadosMailboxManifest::create(&r_storage->s->get_io_ctx(), guid_128_to_string(mbox->mailbox_guid));
+  if (ret < 0) {
+    i_error("creating the manifest of mailbox %s failed: %d", box->vname, ret);
+    return -1;
+  }
+  return 0;
+}
+
+/* an update of the manifest failed, it no longer lists all mails. it is marked as incomplete, so that a rebuild
+ * searches the pools instead. always returns -1. */
+int rbox_mailbox_manifest_failed(struct mailbox *box, int error) {
+  struct rbox_mailbox *mbox = (struct rbox_mailbox *)box;
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+
+  i_error("updating the manifest of mailbox %s failed: %d", box->vname, error);
+  int ret = librmb::RadosMailboxManifest::invalidate(&r_storage->s->get_io_ctx(), guid_128_to_string(mbox->mailbox_guid));
+  if (ret < 0) {
+    i_error("invalidating the manifest of mailbox %s failed: %d", box->vname, ret);
+  }
+  mail_storage_set_critical(box->storage, "updating the manifest of mailbox %s failed: %d", box->vname, error);
+  return -1;
+}
+
 int rbox_mailbox_create(struct mailbox *box, const struct mailbox_update *update, bool directory) {
   FUNC_START();
   struct rbox_storage *storage = (struct rbox_storage *)box->storage;
@@ -693,8 +1161,31 @@ int rbox_mailbox_create(struct mailbox *box, const struct mailbox_update *update
 
   i_debug("rbox_mailbox_create: mailbox update guid = %s",
           update != NULL ? guid_128_to_string(update->mailbox_guid) : "Invalid update");
+  struct mailbox_update list_update;
+  if (rbox_is_rados_mailbox_list(box->list)) {
+    /* the mailbox is added to the list before its index is created, if another node created it in the
+       meantime, the mailbox exists */
+    if (update != NULL) {
+      list_update = *update;
+    } else {
+      i_zero(&list_update);
+    }
+    if (guid_128_is_empty(list_update.mailbox_guid)) {
+      guid_128_generate(list_update.mailbox_guid);
+    }
+    update = &list_update;
+    if (rbox_mailbox_list_add(box, list_update.mailbox_guid) < 0) {
+      mail_storage_copy_list_error(box->storage, box->list);
+      FUNC_END_RET("rbox_mailbox_list_add: ret < 0");
+      return -1;
+    }
+  }
+  if (rbox_mailbox_create_indexes(box, update, NULL) < 0) {
+    FUNC_END_RET("rbox_mailbox_create_indexes: ret < 0");
+    return -1;
+  }
   FUNC_END();
-  return rbox_mailbox_create_indexes(box, update, NULL);
+  return rbox_mailbox_create_manifest(box);
 }
 
 static int rbox_mailbox_update(struct mailbox *box, const struct mailbox_update *update) {
@@ -736,26 +1227,56 @@ int rbox_mailbox_get_metadata(struct mailbox *box, enum mailbox_metadata_items i
   return 0;
 }
 
+static int rbox_mailbox_exists(struct mailbox *box, bool auto_boxes, enum mailbox_existence *existence_r) {
+  if (!rbox_is_rados_mailbox_list(box->list)) {
+    return index_storage_mailbox_exists(box, auto_boxes, existence_r);
+  }
+  if ((auto_boxes && mailbox_is_autocreated(box)) ||
+      (strcmp(box->name, "INBOX") == 0 && (box->list->ns->flags & NAMESPACE_FLAG_INBOX_USER) != 0)) {
+    *existence_r = MAILBOX_EXISTENCE_SELECT;
+    return 0;
+  }
+  bool exists;
+  if (rbox_mailbox_list_lookup(box, &exists, NULL) < 0) {
+    mail_storage_copy_list_error(box->storage, box->list);
+    return -1;
+  }
+  *existence_r = exists ? MAILBOX_EXISTENCE_SELECT : MAILBOX_EXISTENCE_NONE;
+  return 0;
+}
+
+static int rbox_mailbox_delete(struct mailbox *box) {
+  if (index_storage_mailbox_delete(box) < 0) {
+    return -1;
+  }
+  rbox_mailbox_remove_index_snapshot(box);
+  return 0;
+}
+
 void rbox_notify_changes(struct mailbox *box) {
   FUNC_START();
 
-  if (box->notify_callback == NULL)
+  if (box->notify_callback == NULL) {
     mailbox_watch_remove_all(box);
-  else
+    rbox_notify_unwatch(box);
+  } else {
+    // the directory watch still catches the changes of this host
     mailbox_watch_add(box, mailbox_get_path(box));
+    rbox_notify_watch(box);
+  }
 
   FUNC_END();
 }
 
 struct mailbox_vfuncs rbox_mailbox_vfuncs = {index_storage_is_readonly,
                                              index_storage_mailbox_enable,
-                                             index_storage_mailbox_exists,
+                                             rbox_mailbox_exists,
                                              rbox_mailbox_open,
                                              rbox_mailbox_close,
                                              index_storage_mailbox_free,
                                              rbox_mailbox_create,
                                              rbox_mailbox_update,
-                                             index_storage_mailbox_delete,
+                                             rbox_mailbox_delete,
                                              index_storage_mailbox_rename,
                                              index_storage_get_status,
                                              rbox_mailbox_get_metadata,
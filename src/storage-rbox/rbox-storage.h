@@ -33,7 +33,11 @@ extern bool is_alternate_storage_set(uint8_t flags);
 extern bool is_alternate_pool_valid(struct mailbox *_box);
 extern struct mail_storage rbox_storage;
 extern int rbox_open_rados_connection(struct mailbox *box, bool alt_storage);
+extern int rbox_storage_open_rados_connection(struct mail_storage *storage, struct mailbox_list *list,
+                                              bool alt_storage);
 extern int read_plugin_configuration(struct mailbox *box);
+extern void rbox_notify_mailbox_changed(struct mailbox *box);
+extern int rbox_mailbox_manifest_failed(struct mailbox *box, int error);
 
 #ifdef __cplusplus
 }
@@ -67,6 +71,13 @@ struct rbox_mailbox {
   uint32_t corrupted_rebuild_count;
 
   ARRAY(struct expunged_item *) moved_items;
+  /* watch of the notification object, NULL if not watched */
+  struct rbox_notify *notify;
+  /* the index files have been restored from a snapshot and are not rebuilt yet */
+  bool index_restored;
+  /* position of the transaction log at the last snapshot of the index, or when the mailbox was opened */
+  uint32_t snapshot_log_file_seq;
+  uint32_t snapshot_log_file_offset;
 };
 
 #endif  // SRC_STORAGE_RBOX_RBOX_STORAGE_H_
@@ -28,6 +28,8 @@
 #include "../librmb/rados-namespace-manager.h"
 #include "../librmb/rados-dovecot-ceph-cfg.h"
 #include "../librmb/rados-metadata-storage-impl.h"
+#include "../librmb/rados-notifier.h"
+#include "../librmb/rados-metadata-cache.h"
 
 struct rbox_storage {
   struct mail_storage storage;
@@ -38,6 +40,10 @@ struct rbox_storage {
   librmb::RadosNamespaceManager *ns_mgr;
   librmb::RadosMetadataStorage *ms;
   librmb::RadosStorage *alt;
+  librmb::RadosNotifier *notifier;
+  librmb::RadosMetadataCache *metadata_cache;
+  // bytes of the mail reads in flight started by rbox_mail_prefetch
+  uint64_t prefetch_bytes;
 };
 
 #endif
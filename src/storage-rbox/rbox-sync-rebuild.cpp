@@ -18,11 +18,18 @@ extern "C" {
 
 #include "rbox-sync-rebuild.h"
 
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+
 #include "rbox-storage.hpp"
 #include "rbox-mail.h"
 #include "encoding.h"
 #include "rados-mail-object.h"
 #include "rados-util.h"
+#include "rados-mailbox-manifest.h"
 
 using librmb::RadosMailObject;
 using librmb::rbox_metadata_key;
@@ -34,90 +41,220 @@ static uint32_t stoui32(const std::string &s) {
   return val;
 }
 
-int rbox_sync_add_object(struct index_rebuild_context *ctx, const std::string &oi, librmb::RadosMailObject *mail_obj,
-                         bool alt_storage) {
+/* metadata read of a mail object in flight */
+struct rbox_rebuild_read {
+  librmb::RadosMailObject *mail;
+  librados::ObjectReadOperation *op;
+  librados::AioCompletion *completion;
+  bool alt_storage;
+};
+
+static bool rbox_rebuild_entry_cmp(const struct rbox_rebuild_entry &a, const struct rbox_rebuild_entry &b) {
+  return a.uid < b.uid;
+}
+
+/* the sync keeps the attribute of the objects up to date */
+static bool rbox_sync_is_attribute_updated(struct mailbox *box, librmb::rbox_metadata_key key) {
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+  return r_storage->config->is_mail_attribute(key) && r_storage->config->is_update_attributes() &&
+         r_storage->config->is_updateable_attribute(key);
+}
+
+/* replace the flags and/or keywords of the record with the ones stored with the object */
+static void rbox_sync_set_object_flags(struct mailbox *box, struct mail_index_transaction *trans, uint32_t seq,
+                                       const struct rbox_rebuild_entry &entry, bool flags, bool keywords) {
+  if (flags && entry.has_flags) {
+    uint8_t rec_flags = (entry.flags & MAIL_FLAGS_NONRECENT) | (entry.alt_storage ? RBOX_INDEX_FLAG_ALT : 0);
+    mail_index_update_flags(trans, seq, MODIFY_REPLACE, (enum mail_flags)rec_flags);
+  }
+  if (keywords) {
+    T_BEGIN {
+      ARRAY_TYPE(const_string) names;
+      t_array_init(&names, entry.keywords.size() + 1);
+      for (std::vector<std::string>::const_iterator it = entry.keywords.begin(); it != entry.keywords.end(); ++it) {
+        const char *name = t_strdup(it->c_str());
+        array_append(&names, &name, 1);
+      }
+      array_append_zero(&names);
+      struct mail_keywords *kw = mail_index_keywords_create(box->index, array_idx(&names, 0));
+      mail_index_update_keywords(trans, seq, MODIFY_REPLACE, kw);
+      mail_index_keywords_unref(&kw);
+    }
+    T_END;
+  }
+}
+
+void rbox_sync_add_object(struct index_rebuild_context *ctx, const struct rbox_rebuild_entry &entry,
+                          const uint32_t &uid) {
   uint32_t seq;
   struct rbox_mailbox *rbox_mailbox = (struct rbox_mailbox *)ctx->box;
-  std::string xattr_mail_uid = mail_obj->get_metadata(rbox_metadata_key::RBOX_METADATA_MAIL_UID);
-  std::string xattr_guid = mail_obj->get_metadata(rbox_metadata_key::RBOX_METADATA_GUID);
 
-  uint32_t uid = stoui32(xattr_mail_uid);
   mail_index_append(ctx->trans, uid, &seq);
   i_debug("added to index %d", seq);
 
   /* save the 128bit GUID/OID to index record */
   struct obox_mail_index_record rec;
   i_zero(&rec);
-  // convert oid and guid to
-  guid_128_t oid;
-  if (guid_128_from_string(oi.c_str(), oid) < 0) {
-    i_error("guid_128 oi.c_str() string %s", oi.c_str());
-    return -1;
-  }
-  guid_128_t guid;
-  if (guid_128_from_string(xattr_guid.c_str(), guid) < 0) {
-    i_error("guid_128 xattr_guid string %s", xattr_guid.c_str());
-
-    return -1;
-  }
-  memcpy(rec.guid, guid, sizeof(guid));
-  memcpy(rec.oid, oid, sizeof(oid));
+  memcpy(rec.guid, entry.guid, sizeof(entry.guid));
+  memcpy(rec.oid, entry.oid, sizeof(entry.oid));
 
   mail_index_update_ext(ctx->trans, seq, rbox_mailbox->ext_id, &rec, NULL);
 
-  if (alt_storage) {
+  if (entry.alt_storage) {
     mail_index_update_flags(ctx->trans, seq, MODIFY_ADD, (enum mail_flags)RBOX_INDEX_FLAG_ALT);
   }
 
   T_BEGIN { index_rebuild_index_metadata(ctx, seq, uid); }
   T_END;
-  i_debug("rebuilding %s , with uid=%d", oi.c_str(), uid);
-
-  return 0;
+  // the old index may be a restored snapshot, which is behind the objects
+  rbox_sync_set_object_flags(ctx->box, ctx->trans, seq, entry,
+                             rbox_sync_is_attribute_updated(ctx->box, rbox_metadata_key::RBOX_METADATA_OLDV1_FLAGS),
+                             rbox_sync_is_attribute_updated(ctx->box, rbox_metadata_key::RBOX_METADATA_OLDV1_KEYWORDS));
+  i_debug("rebuilding %s , with uid=%d", guid_128_to_string(entry.oid), uid);
 }
-// find objects with mailbox_guid 'U' attribute
-int rbox_sync_rebuild_entry(struct index_rebuild_context *ctx, librados::NObjectIterator &iter, bool alt_storage) {
-  struct mail_storage *storage = ctx->box->storage;
-  struct rbox_storage *r_storage = (struct rbox_storage *)storage;
 
-  // find all objects with x attr M = mailbox_guid
-  // if non is found : set mailbox_deleted and mail_storage_set_critical...
+/* wait for the read and keep what the index needs of the object. with entries == nullptr the read is only
+ * released */
+static int rbox_sync_rebuild_finish_read(struct mailbox *box, struct rbox_rebuild_read *read,
+                                         std::vector<struct rbox_rebuild_entry> *entries) {
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+  librmb::RadosMailObject *mail_object = read->mail;
+  int ret = 0;
 
-  // it is required to check for duplicat uids,
-  // because if user moved / copied mails from mailbox to sub-mailbox,
-  // uid may stay the same (depends on configuration).
-  std::vector<std::string> uids;
+  read->completion->wait_for_complete();
+  int retx = read->completion->get_return_value();
+  read->completion->release();
+  delete read->op;
 
-  int found = 0;
-  int ret = 0;
-  while (iter != librados::NObjectIterator::__EndObjectIterator) {
-    std::map<std::string, ceph::bufferlist> attrset;
-    librmb::RadosMailObject mail_object;
-    mail_object.set_oid((*iter).get_oid());
-    int retx;
-    if (alt_storage) {
-      r_storage->ms->get_storage()->set_io_ctx(&r_storage->alt->get_io_ctx());
-      retx = r_storage->ms->get_storage()->load_metadata(&mail_object);
+  if (entries != nullptr) {
+    if (retx >= 0) {
+      retx = r_storage->ms->get_storage()->finish_load_metadata(mail_object);
+    }
+    if (retx < 0) {
+      i_error("loading metadata of object %s failed, skipping object: %d", mail_object->get_oid().c_str(), retx);
+    } else if (!librmb::RadosUtils::validate_metadata(mail_object->get_metadata())) {
+      i_error("metadata for object : %s is not valid, skipping object ", mail_object->get_oid().c_str());
     } else {
-      retx = r_storage->ms->get_storage()->load_metadata(&mail_object);
+      struct rbox_rebuild_entry entry;
+      std::string xattr_mail_uid = mail_object->get_metadata(rbox_metadata_key::RBOX_METADATA_MAIL_UID);
+      std::string xattr_guid = mail_object->get_metadata(rbox_metadata_key::RBOX_METADATA_GUID);
+
+      entry.uid = stoui32(xattr_mail_uid);
+      entry.alt_storage = read->alt_storage;
+      entry.flags = 0;
+      std::string xattr_flags = mail_object->get_metadata(rbox_metadata_key::RBOX_METADATA_OLDV1_FLAGS);
+      entry.has_flags = !xattr_flags.empty() && librmb::RadosUtils::string_to_flags(xattr_flags, &entry.flags);
+      for (std::map<std::string, ceph::bufferlist>::iterator it = mail_object->get_extended_metadata()->begin();
+           it != mail_object->get_extended_metadata()->end(); ++it) {
+        entry.keywords.push_back(it->second.to_str());
+      }
+      // convert oid and guid to
+      // a single bad object must not stop the rebuild of the others
+      if (guid_128_from_string(mail_object->get_oid().c_str(), entry.oid) < 0) {
+        i_error("oid of object %s is no guid, skipping object", mail_object->get_oid().c_str());
+      } else if (guid_128_from_string(xattr_guid.c_str(), entry.guid) < 0) {
+        i_error("guid %s of object %s is invalid, skipping object", xattr_guid.c_str(),
+                mail_object->get_oid().c_str());
+      } else {
+        entries->push_back(entry);
+      }
     }
+  }
+  delete mail_object;
+  return ret;
+}
 
-    if (!librmb::RadosUtils::validate_metadata(mail_object.get_metadata())) {
-      i_error("metadata for object : %s is not valid, skipping object ", mail_object.get_oid().c_str());
-      ++iter;
+static bool rbox_rebuild_source_next(struct rbox_rebuild_source *source, std::string *oid) {
+  if (source->next_oid < source->oids.size()) {
+    *oid = source->oids[source->next_oid++];
+    return true;
+  }
+  while (source->iter != librados::NObjectIterator::__EndObjectIterator) {
+    *oid = (*source->iter).get_oid();
+    ++source->iter;
+    if (source->manifest_oids.empty()) {
+      return true;
     }
-    if (retx >= 0) {
-      ret = rbox_sync_add_object(ctx, (*iter).get_oid(), &mail_object, alt_storage);
-      if (ret < 0) {
-        break;
+    if (source->manifest_oids.find(*oid) == source->manifest_oids.end()) {
+      i_warning("object %s is not in the manifest of the mailbox", oid->c_str());
+      return true;
+    }
+  }
+  return false;
+}
+
+/* read the metadata of the objects of all sources, the reads of both pools are pipelined. found receives the
+ * number of objects, entries what the index needs of the valid ones */
+static int rbox_sync_rebuild_read_objects(struct mailbox *box, std::vector<struct rbox_rebuild_source> &sources,
+                                          std::vector<struct rbox_rebuild_entry> *entries, int *found) {
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+  librmb::RadosStorageMetadataModule *ms = r_storage->ms->get_storage();
+  size_t window = I_MAX(r_storage->config->get_rebuild_window(), 1);
+  std::deque<struct rbox_rebuild_read> in_flight;
+
+  *found = 0;
+  int ret = 0;
+  while (ret >= 0) {
+    bool submitted = false;
+    // one object of each pool per round, so that both pools are read at the same time
+    for (std::vector<struct rbox_rebuild_source>::iterator it = sources.begin(); it != sources.end(); ++it) {
+      std::string oid;
+      if (!rbox_rebuild_source_next(&(*it), &oid)) {
+        continue;
       }
+      if (in_flight.size() >= window) {
+        ret = rbox_sync_rebuild_finish_read(box, &in_flight.front(), entries);
+        in_flight.pop_front();
+        if (ret < 0) {
+          break;
+        }
+      }
+      struct rbox_rebuild_read read;
+      read.mail = new librmb::RadosMailObject();
+      read.mail->set_oid(oid);
+      read.alt_storage = it->alt_storage;
+      read.op = new librados::ObjectReadOperation();
+      ms->prepare_load_metadata(read.op, read.mail);
+      read.completion = librados::Rados::aio_create_completion();
+      ++(*found);
+      submitted = true;
+
+      int retx = it->storage->get_io_ctx().aio_operate(read.mail->get_oid(), read.completion, read.op, nullptr);
+      if (retx < 0) {
+        i_error("reading metadata of object %s failed, skipping object: %d", read.mail->get_oid().c_str(), retx);
+        read.completion->release();
+        delete read.op;
+        delete read.mail;
+        continue;
+      }
+      in_flight.push_back(read);
+    }
+    if (!submitted) {
+      break;
     }
-    ++iter;
-    ++found;
   }
+  while (!in_flight.empty()) {
+    int retx = rbox_sync_rebuild_finish_read(box, &in_flight.front(), ret >= 0 ? entries : nullptr);
+    in_flight.pop_front();
+    ret = ret < 0 ? ret : retx;
+  }
+  return ret;
+}
+
+// find objects with mailbox_guid 'U' attribute
+int rbox_sync_rebuild_entry(struct index_rebuild_context *ctx, std::vector<struct rbox_rebuild_source> &sources) {
+  struct mail_storage *storage = ctx->box->storage;
+
+  // find all objects with x attr M = mailbox_guid
+  // if non is found : set mailbox_deleted and mail_storage_set_critical...
+
+  // the objects are added in uid order once all of them are known.
+  std::vector<struct rbox_rebuild_entry> entries;
+  int found = 0;
+  int ret = rbox_sync_rebuild_read_objects(ctx->box, sources, &entries, &found);
   if (ret < 0) {
+    // the caller rolls the rebuild back, the mailbox itself is still there
     i_error("error rbox_sync_add_objects for mbox %s", ctx->box->name);
-    mailbox_set_deleted(ctx->box);
     mail_storage_set_critical(storage, "find mailbox(%s) failed: %m", ctx->box->name);
     return -1;
   }
@@ -128,6 +265,21 @@ int rbox_sync_rebuild_entry(struct index_rebuild_context *ctx, librados::NObject
     return 0;
   }
 
+  // it is required to check for duplicat uids,
+  // because if user moved / copied mails from mailbox to sub-mailbox,
+  // uid may stay the same (depends on configuration).
+  std::stable_sort(entries.begin(), entries.end(), rbox_rebuild_entry_cmp);
+  uint32_t next_uid = entries.empty() ? 1 : entries.back().uid + 1;
+  uint32_t prev_uid = 0;
+  for (std::vector<struct rbox_rebuild_entry>::iterator it = entries.begin(); it != entries.end(); ++it) {
+    uint32_t uid = it->uid;
+    if (uid == 0 || uid == prev_uid) {
+      uid = next_uid++;
+      i_warning("object %s has a duplicate uid %u, using uid %u", guid_128_to_string(it->oid), it->uid, uid);
+    }
+    prev_uid = it->uid;
+    rbox_sync_add_object(ctx, *it, uid);
+  }
   return ret;
 }
 
@@ -143,11 +295,8 @@ void rbox_sync_set_uidvalidity(struct index_rebuild_context *ctx) {
                            sizeof(uid_validity), TRUE);
 }
 
-int search_objects(struct index_rebuild_context *ctx, bool alt_storage) {
-  struct rbox_mailbox *rbox = (struct rbox_mailbox *)ctx->box;
-  struct rbox_storage *r_storage = (struct rbox_storage *)ctx->box->storage;
-  librmb::RadosStorage *storage = alt_storage ? r_storage->alt : r_storage->s;
-  int ret = 0;
+librados::NObjectIterator search_objects(struct mailbox *box, librmb::RadosStorage *storage) {
+  struct rbox_mailbox *rbox = (struct rbox_mailbox *)box;
   std::string guid(guid_128_to_string(rbox->mailbox_guid));
   i_debug("guid is empty, using mailbox name to detect mail objects ");
   librmb::RadosMetadata attr_guid(rbox_metadata_key::RBOX_METADATA_MAILBOX_GUID, guid);
@@ -155,38 +304,244 @@ int search_objects(struct index_rebuild_context *ctx, bool alt_storage) {
 
   librados::NObjectIterator iter_guid(storage->find_mails(&attr_guid));
   if (iter_guid != librados::NObjectIterator::__EndObjectIterator) {
-    ret = rbox_sync_rebuild_entry(ctx, iter_guid, alt_storage);
-  } else {
-    librmb::RadosMetadata attr_name(rbox_metadata_key::RBOX_METADATA_ORIG_MAILBOX, rbox->box.name);
-    // rebuild index.
-    librados::NObjectIterator iter_name(storage->find_mails(&attr_name));
-    ret = rbox_sync_rebuild_entry(ctx, iter_name, alt_storage);
+    return iter_guid;
   }
-  return ret;
+  librmb::RadosMetadata attr_name(rbox_metadata_key::RBOX_METADATA_ORIG_MAILBOX, rbox->box.name);
+  return storage->find_mails(&attr_name);
 }
 
-int rbox_sync_index_rebuild_objects(struct index_rebuild_context *ctx) {
-  int ret = 0;
-  struct rbox_mailbox *rbox = (struct rbox_mailbox *)ctx->box;
-  rbox_sync_set_uidvalidity(ctx);
-
-  bool alt_storage = is_alternate_pool_valid(ctx->box);
+/* the objects of the mailbox in the primary and, if configured, the alternative storage */
+static int rbox_sync_rebuild_init_sources(struct mailbox *box, std::vector<struct rbox_rebuild_source> *sources) {
+  struct rbox_mailbox *rbox = (struct rbox_mailbox *)box;
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+  bool alt_storage = is_alternate_pool_valid(box);
 
-  if (rbox_open_rados_connection(ctx->box, alt_storage) < 0) {
+  if (rbox_open_rados_connection(box, alt_storage) < 0) {
     i_error("cannot open rados connection");
     return -1;
   }
 
-  search_objects(ctx, false);
+  sources->resize(alt_storage ? 2 : 1);
+  (*sources)[0].storage = r_storage->s;
+  (*sources)[0].alt_storage = false;
   if (alt_storage) {
     i_debug("ALT_STORAGE ACTIVE: '%s' ", rbox->box.list->set.alt_dir);
-    search_objects(ctx, true);
+    (*sources)[1].storage = r_storage->alt;
+    (*sources)[1].alt_storage = true;
+  }
+  for (std::vector<struct rbox_rebuild_source>::iterator it = sources->begin(); it != sources->end(); ++it) {
+    it->iter = librados::NObjectIterator::__EndObjectIterator;
+    it->next_oid = 0;
+  }
+
+  // the objects of a complete manifest are read first. the pools are searched in any case, the manifest may miss
+  // objects written by a process which had it disabled or whose update of it got lost.
+  std::map<std::string, librmb::RadosManifestEntry> manifest;
+  if (r_storage->config->is_mailbox_manifest_enabled() &&
+      librmb::RadosMailboxManifest::load(&r_storage->s->get_io_ctx(), guid_128_to_string(rbox->mailbox_guid),
+                                         &manifest) >= 0) {
+    i_debug("rebuilding mailbox %s from its manifest, %zu entries", box->name, manifest.size());
+    for (std::map<std::string, librmb::RadosManifestEntry>::iterator it = manifest.begin(); it != manifest.end();
+         ++it) {
+      if (!it->second.alt_storage) {
+        (*sources)[0].oids.push_back(it->first);
+      } else if (alt_storage) {
+        (*sources)[1].oids.push_back(it->first);
+      } else {
+        i_warning("object %s is in the alternative storage, which is not configured", it->first.c_str());
+      }
+    }
+  }
+  for (std::vector<struct rbox_rebuild_source>::iterator it = sources->begin(); it != sources->end(); ++it) {
+    it->manifest_oids.insert(it->oids.begin(), it->oids.end());
+    it->iter = search_objects(box, it->storage);
+  }
+  return 0;
+}
+
+int rbox_sync_index_rebuild_objects(struct index_rebuild_context *ctx) {
+  int ret = 0;
+  rbox_sync_set_uidvalidity(ctx);
+
+  std::vector<struct rbox_rebuild_source> sources;
+  if (rbox_sync_rebuild_init_sources(ctx->box, &sources) < 0) {
+    return -1;
+  }
+  ret = rbox_sync_rebuild_entry(ctx, sources);
+  if (ret < 0) {
+    return -1;
   }
 
   rbox_sync_update_header(ctx);
   return ret;
 }
 
+/* the object is listed in the pool alt_storage, its index record says it is in the other pool. the listing may be
+ * outdated, e.g. the mail is being moved, so the record is only corrected if the object is in the listed pool only. */
+static bool rbox_sync_repair_verify_location(struct mailbox *box, const std::string &oid, bool alt_storage) {
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+  uint64_t size;
+  time_t save_date;
+
+  librmb::RadosStorage *listed = alt_storage ? r_storage->alt : r_storage->s;
+  if (listed->stat_mail(oid, &size, &save_date) < 0) {
+    return false;
+  }
+  if (!alt_storage && !is_alternate_pool_valid(box)) {
+    // the record points to an alternative storage which is not configured
+    return true;
+  }
+  librmb::RadosStorage *indexed = alt_storage ? r_storage->s : r_storage->alt;
+  return indexed->stat_mail(oid, &size, &save_date) == -ENOENT;
+}
+
+/* compare the index records with the objects of the mailbox. objects without a record are appended, records
+ * without an object are expunged, all other records are kept as they are. returns 0 if the index can't be repaired
+ * and needs a full rebuild. */
+static int rbox_sync_index_repair(struct rbox_mailbox *mbox) {
+  struct mailbox *box = &mbox->box;
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+
+  if (guid_128_is_empty(mbox->mailbox_guid)) {
+    return 0;
+  }
+  struct mail_index_view *view = mail_index_view_open(box->index);
+  const struct mail_index_header *hdr = mail_index_get_header(view);
+  if (hdr->uid_validity == 0) {
+    mail_index_view_close(&view);
+    return 0;
+  }
+  struct mail_index_transaction *trans = mail_index_transaction_begin(view, MAIL_INDEX_TRANSACTION_FLAG_EXTERNAL);
+
+  // oid => seq of the index records
+  std::map<std::string, uint32_t> records;
+  unsigned int expunged = 0;
+  uint32_t count = mail_index_view_get_messages_count(view);
+  for (uint32_t seq = 1; seq <= count; seq++) {
+    const void *rec_data;
+    mail_index_lookup_ext(view, seq, mbox->ext_id, &rec_data, NULL);
+    const struct obox_mail_index_record *obox_rec = static_cast<const struct obox_mail_index_record *>(rec_data);
+    if (obox_rec == NULL || guid_128_is_empty(obox_rec->oid)) {
+      mail_index_expunge(trans, seq);
+      expunged++;
+      continue;
+    }
+    std::string oid = guid_128_to_string(obox_rec->oid);
+    if (!records.insert(std::make_pair(oid, seq)).second) {
+      i_warning("repair: object %s has more than one index record, expunging seq %u", oid.c_str(), seq);
+      mail_index_expunge(trans, seq);
+      expunged++;
+    }
+  }
+
+  std::vector<struct rbox_rebuild_source> sources;
+  if (rbox_sync_rebuild_init_sources(box, &sources) < 0) {
+    mail_index_transaction_rollback(&trans);
+    mail_index_view_close(&view);
+    return -1;
+  }
+
+  // only the objects without a record are read, the alt flag of the others is corrected if necessary
+  std::set<std::string> listed;
+  std::vector<struct rbox_rebuild_source> missing(sources.size());
+  for (size_t i = 0; i < sources.size(); i++) {
+    missing[i].storage = sources[i].storage;
+    missing[i].alt_storage = sources[i].alt_storage;
+    missing[i].iter = librados::NObjectIterator::__EndObjectIterator;
+    missing[i].next_oid = 0;
+
+    std::string oid;
+    while (rbox_rebuild_source_next(&sources[i], &oid)) {
+      if (librmb::RadosMailboxManifest::is_manifest_oid(oid) || !listed.insert(oid).second) {
+        continue;
+      }
+      std::map<std::string, uint32_t>::iterator record = records.find(oid);
+      if (record == records.end()) {
+        missing[i].oids.push_back(oid);
+        continue;
+      }
+      const struct mail_index_record *rec = mail_index_lookup(view, record->second);
+      if (is_alternate_storage_set(rec->flags) != sources[i].alt_storage &&
+          rbox_sync_repair_verify_location(box, oid, sources[i].alt_storage)) {
+        mail_index_update_flags(trans, record->second, sources[i].alt_storage ? MODIFY_ADD : MODIFY_REMOVE,
+                                (enum mail_flags)RBOX_INDEX_FLAG_ALT);
+      }
+    }
+  }
+
+  if (listed.empty() && !records.empty()) {
+    // nothing found at all, don't trust the listing
+    mail_index_transaction_rollback(&trans);
+    mail_index_view_close(&view);
+    return 0;
+  }
+
+  // records without a listed object are expunged only if the object is really gone
+  for (std::map<std::string, uint32_t>::iterator it = records.begin(); it != records.end(); ++it) {
+    if (listed.find(it->first) != listed.end()) {
+      continue;
+    }
+    const struct mail_index_record *rec = mail_index_lookup(view, it->second);
+    bool alt_storage = is_alternate_storage_set(rec->flags) && is_alternate_pool_valid(box);
+    librmb::RadosStorage *storage = alt_storage ? r_storage->alt : r_storage->s;
+    uint64_t size;
+    time_t save_date;
+    if (storage->stat_mail(it->first, &size, &save_date) == -ENOENT) {
+      mail_index_expunge(trans, it->second);
+      expunged++;
+    }
+  }
+
+  std::vector<struct rbox_rebuild_entry> entries;
+  int found = 0;
+  if (rbox_sync_rebuild_read_objects(box, missing, &entries, &found) < 0) {
+    mail_index_transaction_rollback(&trans);
+    mail_index_view_close(&view);
+    return -1;
+  }
+
+  // appended mails need uids above the existing ones, the uid of the object is kept if possible
+  std::stable_sort(entries.begin(), entries.end(), rbox_rebuild_entry_cmp);
+  uint32_t next_uid = hdr->next_uid;
+  for (std::vector<struct rbox_rebuild_entry>::iterator it = entries.begin(); it != entries.end(); ++it) {
+    uint32_t uid = it->uid >= next_uid ? it->uid : next_uid;
+    next_uid = uid + 1;
+
+    uint32_t seq;
+    mail_index_append(trans, uid, &seq);
+    struct obox_mail_index_record rec;
+    i_zero(&rec);
+    memcpy(rec.guid, it->guid, sizeof(it->guid));
+    memcpy(rec.oid, it->oid, sizeof(it->oid));
+    mail_index_update_ext(trans, seq, mbox->ext_id, &rec, NULL);
+    if (it->alt_storage) {
+      mail_index_update_flags(trans, seq, MODIFY_ADD, (enum mail_flags)RBOX_INDEX_FLAG_ALT);
+    }
+    // the mail has no record to copy the flags and keywords from, the object has them as well
+    rbox_sync_set_object_flags(box, trans, seq, *it, true, !it->keywords.empty());
+  }
+
+  struct sdbox_index_header rbox_hdr;
+  bool need_resize;
+  if (rbox_read_header(mbox, &rbox_hdr, FALSE, &need_resize) == 0) {
+    uint32_t rebuild_count = rbox_hdr.rebuild_count + 1;
+    if (rebuild_count == 0) {
+      rebuild_count = 1;
+    }
+    mail_index_update_header_ext(trans, mbox->hdr_ext_id, offsetof(struct sdbox_index_header, rebuild_count),
+                                 &rebuild_count, sizeof(rebuild_count));
+  }
+
+  i_warning("rbox %s: Repaired index, %zu records appended, %u records expunged", mailbox_get_path(box),
+            entries.size(), expunged);
+#ifdef DOVECOT_CEPH_PLUGINS_HAVE_MAIL_INDEX_HDR_FLAG_FSCKD
+  mail_index_unset_fscked(trans);
+#endif
+  int ret = mail_index_transaction_commit(&trans);
+  mail_index_view_close(&view);
+  return ret < 0 ? -1 : 1;
+}
+
 int rbox_sync_index_rebuild(struct rbox_mailbox *mbox, bool force) {
   struct index_rebuild_context *ctx;
   struct mail_index_view *view;
@@ -204,6 +559,16 @@ int rbox_sync_index_rebuild(struct rbox_mailbox *mbox, bool force) {
     i_debug("index could not be opened");
     // try to determine mailbox guid via xattr.
   }
+  // a forced rebuild has to reread everything, a restored index needs a new uidvalidity
+  if (!force && !mbox->index_restored && mbox->storage->config->is_index_repair_enabled()) {
+    ret = rbox_sync_index_repair(mbox);
+    if (ret != 0) {
+      mbox->corrupted_rebuild_count = 0;
+      return ret < 0 ? -1 : 0;
+    }
+    i_debug("index of %s can't be repaired, rebuilding it", mailbox_get_path(&mbox->box));
+  }
+
   i_warning("rbox %s: Rebuilding index, guid: %s , mailbox_name: %s, alt_storage: %s", mailbox_get_path(&mbox->box),
             guid_128_to_string(mbox->mailbox_guid), mbox->box.name, mbox->box.list->set.alt_dir);
 
@@ -221,10 +586,19 @@ int rbox_sync_index_rebuild(struct rbox_mailbox *mbox, bool force) {
   if (ret < 0) {
     mail_index_transaction_rollback(&trans);
   } else {
+    if (mbox->index_restored) {
+      /* the uids of a restored snapshot may have been given to other mails since it was saved */
+      uint32_t uid_validity = rbox_get_uidvalidity_next(mbox->box.list);
+      mail_index_update_header(trans, offsetof(struct mail_index_header, uid_validity), &uid_validity,
+                               sizeof(uid_validity), TRUE);
+    }
 #ifdef DOVECOT_CEPH_PLUGINS_HAVE_MAIL_INDEX_HDR_FLAG_FSCKD
     mail_index_unset_fscked(trans);
 #endif
     ret = mail_index_transaction_commit(&trans);
+    if (ret == 0) {
+      mbox->index_restored = FALSE;
+    }
   }
   mail_index_view_close(&view);
   mbox->corrupted_rebuild_count = 0;
@@ -13,23 +13,46 @@
 #define SRC_STORAGE_RBOX_RBOX_SYNC_REBUILD_H_
 
 #include <map>
+#include <set>
 #include <string>
+#include <vector>
 #include <rados/librados.hpp>
 #include "rados-mail-object.h"
+#include "rados-storage.h"
 
 extern "C" {
 #include "index-rebuild.h"
 }
-extern int rbox_sync_add_object(struct index_rebuild_context *ctx, const std::string &oi,
-                                librmb::RadosMailObject *mail_obj, bool alt_storage);
+/* what the index needs of a mail object found while rebuilding */
+struct rbox_rebuild_entry {
+  uint32_t uid;
+  guid_128_t oid;
+  guid_128_t guid;
+  bool alt_storage;
+  // flags and keywords stored with the object
+  bool has_flags;
+  uint8_t flags;
+  std::vector<std::string> keywords;
+};
+
+/* the mail objects of the mailbox in one pool, listed by the manifest of the mailbox or found by searching the pool */
+struct rbox_rebuild_source {
+  librmb::RadosStorage *storage;
+  librados::NObjectIterator iter;
+  std::vector<std::string> oids;
+  size_t next_oid;
+  // oids of the manifest, the listing of the pool only adds the objects missing in it
+  std::set<std::string> manifest_oids;
+  bool alt_storage;
+};
+
+extern void rbox_sync_add_object(struct index_rebuild_context *ctx, const struct rbox_rebuild_entry &entry,
+                                 const uint32_t &uid);
 
-extern int rbox_sync_index_rebuild(struct index_rebuild_context *ctx, librados::NObjectIterator &iter,
-                                   bool alt_storage);
 extern void rbox_sync_set_uidvalidity(struct index_rebuild_context *ctx);
 
 extern int rbox_sync_index_rebuild_objects(struct index_rebuild_context *ctx);
-extern int rbox_sync_rebuild_entry(struct index_rebuild_context *ctx, librados::NObjectIterator &iter,
-                                   bool alt_storage);
+extern int rbox_sync_rebuild_entry(struct index_rebuild_context *ctx, std::vector<struct rbox_rebuild_source> &sources);
 extern int rbox_sync_index_rebuild(struct rbox_mailbox *mbox, bool force);
-extern int search_objects(struct index_rebuild_context *ctx, bool alt_storage);
+extern librados::NObjectIterator search_objects(struct mailbox *box, librmb::RadosStorage *storage);
 #endif  // SRC_STORAGE_RBOX_RBOX_SYNC_REBUILD_H_
@@ -10,6 +10,13 @@
  * Foundation.  See file COPYING.
  */
 
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
 #include <rados/librados.hpp>
 
 extern "C" {
@@ -19,6 +26,8 @@ extern "C" {
 #include "rbox-sync.h"
 #include "debug-helper.h"
 }
+#include "rados-completion-group.h"
+#include "rados-mailbox-manifest.h"
 #include "rados-util.h"
 #include "rbox-storage.hpp"
 #include "rbox-mail.h"
@@ -73,139 +82,253 @@ static void rbox_sync_expunge(struct rbox_sync_context *ctx, uint32_t seq1, uint
   FUNC_END();
 }
 
-static int update_extended_metadata(struct rbox_sync_context *ctx, uint32_t seq1, uint32_t seq2, const int &keyword_idx,
-                                    bool remove) {
-  FUNC_START();
-  uint32_t uid = -1;
-  int ret = 0;
+/* metadata changes of one mail, collected for a sync run */
+struct rbox_sync_update {
+  bool alt_storage;
+  bool update_flags;
+  bool update_manifest;
+  uint8_t flags;
+  std::map<std::string, librados::bufferlist> set_keywords;
+  std::set<std::string> remove_keywords;
+  // result of the write
+  int result;
+};
+typedef std::map<std::string, struct rbox_sync_update> rbox_sync_updates;
+
+static struct rbox_sync_update *rbox_sync_get_update(struct rbox_sync_context *ctx, uint32_t seq,
+                                                     rbox_sync_updates &updates) {
   struct mailbox *box = &ctx->mbox->box;
-  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+  guid_128_t index_oid;
 
-  for (; seq1 <= seq2; seq1++) {
-    mail_index_lookup_uid(ctx->sync_view, seq1, &uid);
-    /* TODO:  */
-    const struct mail_index_record *rec;
-    rec = mail_index_lookup(ctx->sync_view, seq1);
-    bool alt_storage = is_alternate_storage_set(rec->flags) && is_alternate_pool_valid(box);
+  if (rbox_get_oid_from_index(ctx->sync_view, seq, ((struct rbox_mailbox *)box)->ext_id, &index_oid) < 0) {
+    return NULL;
+  }
+  std::string oid = guid_128_to_string(index_oid);
+  rbox_sync_updates::iterator it = updates.find(oid);
+  if (it != updates.end()) {
+    return &it->second;
+  }
+  const struct mail_index_record *rec = mail_index_lookup(ctx->sync_view, seq);
+  struct rbox_sync_update *update = &updates[oid];
+  update->alt_storage = is_alternate_storage_set(rec->flags) && is_alternate_pool_valid(box);
+  update->update_flags = false;
+  update->update_manifest = false;
+  update->flags = rec->flags & MAIL_FLAGS_NONRECENT;
+  update->result = 0;
+  return update;
+}
 
-    if (rbox_open_rados_connection(box, alt_storage) < 0) {
-      i_error("rbox_sync_object_expunge: connection to rados failed");
-      return -1;
-    }
-    if (alt_storage) {
-      r_storage->ms->get_storage()->set_io_ctx(&r_storage->alt->get_io_ctx());
-    } else {
-      r_storage->ms->get_storage()->set_io_ctx(&r_storage->s->get_io_ctx());
-    }
-    /* END TODO*/
+/* expunged mails are not updated anymore, their objects are removed once the sync is committed */
+static void rbox_sync_drop_updates(struct rbox_sync_context *ctx, uint32_t seq1, uint32_t seq2,
+                                   rbox_sync_updates &updates) {
+  struct mailbox *box = &ctx->mbox->box;
+  guid_128_t index_oid;
 
-    guid_128_t index_oid;
+  for (; seq1 <= seq2 && !updates.empty(); seq1++) {
     if (rbox_get_oid_from_index(ctx->sync_view, seq1, ((struct rbox_mailbox *)box)->ext_id, &index_oid) >= 0) {
-      const char *oid = guid_128_to_string(index_oid);
+      updates.erase(guid_128_to_string(index_oid));
+    }
+  }
+}
 
+static void update_extended_metadata(struct rbox_sync_context *ctx, uint32_t seq1, uint32_t seq2,
+                                     const int &keyword_idx, bool remove, rbox_sync_updates &updates) {
+  FUNC_START();
+  std::string ext_key = std::to_string(keyword_idx);
 
-      std::string key_oid(oid);
-      std::string ext_key = std::to_string(keyword_idx);
-      if (remove) {
-        ret = r_storage->ms->get_storage()->remove_keyword_metadata(key_oid, ext_key);
-      } else {
-        unsigned int count;
-        const char *const *keywords = array_get(&ctx->sync_view->index->keywords, &count);
-        std::string key_value = keywords[keyword_idx];
-        librmb::RadosMetadata ext_metata(ext_key, key_value);
-        ret = r_storage->ms->get_storage()->update_keyword_metadata(key_oid, &ext_metata);
-      }
-      if (ret < 0) {
-        break;
-      }
+  for (; seq1 <= seq2; seq1++) {
+    struct rbox_sync_update *update = rbox_sync_get_update(ctx, seq1, updates);
+    if (update == NULL) {
+      continue;
+    }
+    if (remove) {
+      update->set_keywords.erase(ext_key);
+      update->remove_keywords.insert(ext_key);
+    } else {
+      unsigned int count;
+      const char *const *keywords = array_get(&ctx->sync_view->index->keywords, &count);
+      librmb::RadosMetadata ext_metadata(ext_key, keywords[keyword_idx]);
+      update->remove_keywords.erase(ext_key);
+      update->set_keywords[ext_key] = ext_metadata.bl;
     }
   }
-  // reset metadatas storage
-  r_storage->ms->get_storage()->set_io_ctx(&r_storage->s->get_io_ctx());
   FUNC_END();
-  return ret;
 }
 
 static int move_to_alt(struct rbox_sync_context *ctx, uint32_t seq1, uint32_t seq2, bool inverse) {
   struct mailbox *box = &ctx->mbox->box;
   struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
-  bool ret = -1;
   // make sure alternative storage is open
   if (rbox_open_rados_connection(box, true) < 0) {
-    i_error("rbox_sync_object_expunge: connection to rados failed");
+    i_error("move_to_alt: connection to rados failed");
     return -1;
   }
+  std::vector<std::string> oids;
+  std::vector<uint32_t> seqs;
   for (; seq1 <= seq2; seq1++) {
     guid_128_t index_oid;
     if (rbox_get_oid_from_index(ctx->sync_view, seq1, ((struct rbox_mailbox *)&ctx->mbox->box)->ext_id, &index_oid) >=
         0) {
-      std::string oid = guid_128_to_string(index_oid);
-      i_debug("found oid: %s", oid.c_str());
-      ret = librmb::RadosUtils::move_to_alt(oid, r_storage->s, r_storage->alt, r_storage->ms, inverse);
-      if (inverse) {
-        mail_index_update_flags(ctx->trans, seq1, MODIFY_REMOVE, (enum mail_flags)RBOX_INDEX_FLAG_ALT);
-      } else {
-        mail_index_update_flags(ctx->trans, seq1, MODIFY_ADD, (enum mail_flags)RBOX_INDEX_FLAG_ALT);
-      }
+      oids.push_back(guid_128_to_string(index_oid));
+      seqs.push_back(seq1);
     }
   }
-  return ret;  // TODO: fix this
+
+  // the objects are copied by the osds, at most sync_window moves are in flight.
+  std::vector<int> results;
+  int failed = librmb::RadosUtils::move_to_alt(oids, r_storage->s, r_storage->alt, r_storage->ms, inverse,
+                                               r_storage->config->get_sync_window(), &results);
+  librmb::RadosStorage *dest = inverse ? r_storage->s : r_storage->alt;
+  std::map<std::string, librmb::RadosManifestEntry> manifest_update;
+  for (size_t i = 0; i < oids.size(); i++) {
+    uint64_t size;
+    time_t mtime;
+    if (results[i] == -ENOENT && dest->stat_mail(oids[i], &size, &mtime) >= 0) {
+      // moved by an earlier run which didn't get to its index update
+      results[i] = 0;
+    }
+    if (results[i] < 0) {
+      i_error("move_to_alt: moving oid: %s failed, errorcode: %d", oids[i].c_str(), results[i]);
+      // the flag was committed by the transaction which requested the move, but the object is still in the
+      // source pool. revert it, so the mail stays readable and the move can be requested again.
+      mail_index_update_flags(ctx->trans, seqs[i], inverse ? MODIFY_ADD : MODIFY_REMOVE,
+                              (enum mail_flags)RBOX_INDEX_FLAG_ALT);
+      continue;
+    }
+    mail_index_update_flags(ctx->trans, seqs[i], inverse ? MODIFY_REMOVE : MODIFY_ADD,
+                            (enum mail_flags)RBOX_INDEX_FLAG_ALT);
+    if (r_storage->config->is_mailbox_manifest_enabled()) {
+      librmb::RadosManifestEntry &entry = manifest_update[oids[i]];
+      entry.flags = mail_index_lookup(ctx->sync_view, seqs[i])->flags & MAIL_FLAGS_NONRECENT;
+      entry.alt_storage = !inverse;
+    }
+  }
+
+  if (!manifest_update.empty()) {
+    librados::ObjectWriteOperation op;
+    librmb::RadosMailboxManifest::update_flags(&op, manifest_update);
+    int ret = r_storage->s->get_io_ctx().operate(
+        librmb::RadosMailboxManifest::get_oid(guid_128_to_string(ctx->mbox->mailbox_guid)), &op);
+    // -ENOENT: the mailbox has no manifest
+    if (ret < 0 && ret != -ENOENT) {
+      return rbox_mailbox_manifest_failed(box, ret);
+    }
+  }
+  return failed > 0 ? -1 : 0;
 }
 
-static int update_flags(struct rbox_sync_context *ctx, uint32_t seq1, uint32_t seq2, uint8_t &add_flags,
-                        uint8_t &remove_flags) {
+static void update_flags(struct rbox_sync_context *ctx, uint32_t seq1, uint32_t seq2, uint8_t add_flags,
+                         uint8_t remove_flags, bool update_attribute, bool update_manifest,
+                         rbox_sync_updates &updates) {
   FUNC_START();
-  struct mailbox *box = &ctx->mbox->box;
-  uint32_t uid;
-  int ret = 0;
-  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+  add_flags &= MAIL_FLAGS_NONRECENT;
+  remove_flags &= MAIL_FLAGS_NONRECENT;
 
+  // the index holds the current flags, so the object attribute can be written without reading it first.
   for (; seq1 <= seq2; seq1++) {
-    mail_index_lookup_uid(ctx->sync_view, seq1, &uid);
-    /* TODO:  */
-    const struct mail_index_record *rec;
-    rec = mail_index_lookup(ctx->sync_view, seq1);
+    struct rbox_sync_update *update = rbox_sync_get_update(ctx, seq1, updates);
+    if (update == NULL) {
+      continue;
+    }
+    update->flags = (update->flags & ~remove_flags) | add_flags;
+    update->update_flags = update->update_flags || update_attribute;
+    update->update_manifest = update->update_manifest || update_manifest;
+  }
+  FUNC_END();
+}
 
-    bool alt_storage = is_alternate_storage_set(rec->flags) && is_alternate_pool_valid(box);
-    if (rbox_open_rados_connection(box, alt_storage) < 0) {
-      i_error("rbox_sync_object_expunge: connection to rados failed");
-      return -1;
+/* write the collected metadata changes, one guarded operation per mail with a bounded number in flight */
+static int rbox_sync_flush_updates(struct rbox_sync_context *ctx, rbox_sync_updates &updates) {
+  FUNC_START();
+  struct mailbox *box = &ctx->mbox->box;
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+  librmb::RadosCompletionGroup completion_group;
+  int window = r_storage->config->get_sync_window();
+  int ret = 0;
+  std::map<std::string, librmb::RadosManifestEntry> manifest_update;
+
+  for (rbox_sync_updates::iterator it = updates.begin(); it != updates.end(); ++it) {
+    struct rbox_sync_update *update = &it->second;
+    if (update->update_manifest) {
+      librmb::RadosManifestEntry &entry = manifest_update[it->first];
+      entry.flags = update->flags;
+      entry.alt_storage = update->alt_storage;
     }
-    if (alt_storage) {
-      r_storage->ms->get_storage()->set_io_ctx(&r_storage->alt->get_io_ctx());
-    } else {
-      r_storage->ms->get_storage()->set_io_ctx(&r_storage->s->get_io_ctx());
+    if (!update->update_flags && update->set_keywords.empty() && update->remove_keywords.empty()) {
+      continue;
+    }
+    if (rbox_open_rados_connection(box, update->alt_storage) < 0) {
+      i_error("rbox_sync_flush_updates: connection to rados failed");
+      ret = -1;
+      break;
     }
 
-    guid_128_t index_oid;
-    if (rbox_get_oid_from_index(ctx->sync_view, seq1, ((struct rbox_mailbox *)box)->ext_id, &index_oid) >= 0) {
-      const char *oid = guid_128_to_string(index_oid);
-
-      librmb::RadosMailObject mail_object;
-      mail_object.set_oid(oid);
-      r_storage->ms->get_storage()->load_metadata(&mail_object);
-      std::string flags_metadata = mail_object.get_metadata(librmb::RBOX_METADATA_OLDV1_FLAGS);
-      uint8_t flags;
-      if (librmb::RadosUtils::string_to_flags(flags_metadata, &flags)) {
-        if (add_flags != 0) {
-          flags |= add_flags;
-        }
-        if (remove_flags != 0) {
-          flags &= ~remove_flags;
-        }
+    librados::ObjectWriteOperation *op = new librados::ObjectWriteOperation();
+    // the mail may have been expunged by another process in the meantime, don't recreate it.
+    op->assert_exists();
+    std::list<librmb::RadosMetadata> to_update;
+    std::string flags_metadata;
+    if (update->update_flags && librmb::RadosUtils::flags_to_string(update->flags, &flags_metadata)) {
+      to_update.push_back(librmb::RadosMetadata(librmb::RBOX_METADATA_OLDV1_FLAGS, flags_metadata));
+    }
+    int prepare_ret = r_storage->ms->get_storage()->prepare_update_metadata(op, to_update, update->set_keywords,
+                                                                           update->remove_keywords);
+    if (prepare_ret < 0) {
+      i_error("sync: metadata of oid=%s can't be updated by the metadata module: %d", it->first.c_str(), prepare_ret);
+      delete op;
+      ret = -1;
+      break;
+    }
 
-        if (librmb::RadosUtils::flags_to_string(flags, &flags_metadata)) {
-          librmb::RadosMetadata update(librmb::RBOX_METADATA_OLDV1_FLAGS, flags_metadata);
-          ret = r_storage->ms->get_storage()->set_metadata(&mail_object, update);
-        }
+    completion_group.wait_below(window);
+    librmb::RadosStorage *rados_storage = update->alt_storage ? r_storage->alt : r_storage->s;
+    r_storage->metadata_cache->invalidate(rados_storage->get_pool_name(), rados_storage->get_namespace(), it->first);
+    // -ENOENT is checked per mail below, it doesn't fail the group
+    if (completion_group.aio_operate(&rados_storage->get_io_ctx(), it->first, op, -ENOENT, &update->result) < 0) {
+      i_error("sync: updating metadata of oid=%s failed", it->first.c_str());
+      ret = -1;
+      break;
+    }
+  }
+
+  // the manifest lives in the primary storage, mailboxes without a manifest (-ENOENT) are skipped.
+  librmb::RadosCompletionGroup manifest_group;
+  if (ret == 0 && !manifest_update.empty()) {
+    librados::ObjectWriteOperation *op = new librados::ObjectWriteOperation();
+    librmb::RadosMailboxManifest::update_flags(op, manifest_update);
+    std::string manifest_oid = librmb::RadosMailboxManifest::get_oid(guid_128_to_string(ctx->mbox->mailbox_guid));
+    if (rbox_open_rados_connection(box, false) < 0) {
+      delete op;
+      ret = -1;
+    } else {
+      int manifest_ret = manifest_group.aio_operate(&r_storage->s->get_io_ctx(), manifest_oid, op);
+      if (manifest_ret >= 0) {
+        manifest_ret = manifest_group.wait();
+      }
+      if (manifest_ret < 0 && manifest_ret != -ENOENT) {
+        ret = rbox_mailbox_manifest_failed(box, manifest_ret);
       }
     }
   }
-  // reset metadatas storage
-  r_storage->ms->get_storage()->set_io_ctx(&r_storage->s->get_io_ctx());
+
+  int wait_ret = completion_group.wait();
+  if (wait_ret < 0) {
+    ret = -1;
+  }
+  for (rbox_sync_updates::iterator it = updates.begin(); it != updates.end(); ++it) {
+    if (it->second.result == -ENOENT) {
+      // the object is not in the pool of the index record, the index repair takes care of it.
+      // the other mails of the mailbox are still synced.
+      i_warning("sync: oid=%s doesn't exist, metadata update skipped", it->first.c_str());
+    } else if (it->second.result < 0) {
+      i_error("sync: updating metadata of oid=%s failed: %d", it->first.c_str(), it->second.result);
+    }
+  }
+  updates.clear();
   FUNC_END();
   return ret;
 }
+
 static int rbox_sync_index(struct rbox_sync_context *ctx) {
   FUNC_START();
   struct mailbox *box = &ctx->mbox->box;
@@ -232,15 +355,20 @@ static int rbox_sync_index(struct rbox_sync_context *ctx) {
     mailbox_recent_flags_set_seqs(&ctx->mbox->box, ctx->sync_view, seq1, seq2);
   }
 
+  // flag and keyword changes are collected per mail and written at once.
+  rbox_sync_updates updates;
+
   while (mail_index_sync_next(ctx->index_sync_ctx, &sync_rec)) {
     if (!mail_index_lookup_seq_range(ctx->sync_view, sync_rec.uid1, sync_rec.uid2, &seq1, &seq2)) {
       /* already expunged, nothing to do. */
       continue;
     }
     struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+    ctx->changed = TRUE;
 
     switch (sync_rec.type) {
       case MAIL_INDEX_SYNC_TYPE_EXPUNGE:
+        rbox_sync_drop_updates(ctx, seq1, seq2, updates);
         rbox_sync_expunge(ctx, seq1, seq2);
         break;
       case MAIL_INDEX_SYNC_TYPE_FLAGS:
@@ -249,19 +377,30 @@ static int rbox_sync_index(struct rbox_sync_context *ctx) {
           // type = SDBOX_SYNC_ENTRY_TYPE_MOVE_TO_ALT;
 
           // move object from mail_storage to apternative_storage.
+          if (rbox_sync_flush_updates(ctx, updates) < 0) {
+            return -1;
+          }
           int ret = move_to_alt(ctx, seq1, seq2, false);
           i_debug("setting move to alt flag! %d", ret);
         } else if (is_alternate_storage_set(sync_rec.remove_flags) && is_alternate_pool_valid(box)) {
           // type = SDBOX_SYNC_ENTRY_TYPE_MOVE_FROM_ALT;
 
+          if (rbox_sync_flush_updates(ctx, updates) < 0) {
+            return -1;
+          }
           int ret = move_to_alt(ctx, seq1, seq2, true);
           i_debug("removeing  alt flag! %d", ret);
         }
 
-        else if (r_storage->config->is_mail_attribute(librmb::RBOX_METADATA_OLDV1_FLAGS) &&
-                 r_storage->config->is_update_attributes() &&
-                 r_storage->config->is_updateable_attribute(librmb::RBOX_METADATA_OLDV1_FLAGS)) {
-          update_flags(ctx, seq1, seq2, sync_rec.add_flags, sync_rec.remove_flags);
+        else {
+          bool update_attribute = r_storage->config->is_mail_attribute(librmb::RBOX_METADATA_OLDV1_FLAGS) &&
+                                  r_storage->config->is_update_attributes() &&
+                                  r_storage->config->is_updateable_attribute(librmb::RBOX_METADATA_OLDV1_FLAGS);
+          bool update_manifest = r_storage->config->is_mailbox_manifest_enabled();
+          if (update_attribute || update_manifest) {
+            update_flags(ctx, seq1, seq2, sync_rec.add_flags, sync_rec.remove_flags, update_attribute,
+                         update_manifest, updates);
+          }
         }
         break;
       case MAIL_INDEX_SYNC_TYPE_KEYWORD_ADD:
@@ -269,9 +408,7 @@ static int rbox_sync_index(struct rbox_sync_context *ctx) {
             r_storage->config->is_update_attributes() &&
             r_storage->config->is_updateable_attribute(librmb::RBOX_METADATA_OLDV1_KEYWORDS)) {
           // sync_rec.keyword_idx;
-          if (update_extended_metadata(ctx, seq1, seq2, sync_rec.keyword_idx, false) < 0) {
-            return -1;
-          }
+          update_extended_metadata(ctx, seq1, seq2, sync_rec.keyword_idx, false, updates);
         }
         break;
       case MAIL_INDEX_SYNC_TYPE_KEYWORD_REMOVE:
@@ -280,15 +417,16 @@ static int rbox_sync_index(struct rbox_sync_context *ctx) {
             r_storage->config->is_updateable_attribute(librmb::RBOX_METADATA_OLDV1_KEYWORDS)) {
           /* FIXME: should be bother calling sync_notify()? */
           // sync_rec.keyword_idx
-          if (update_extended_metadata(ctx, seq1, seq2, sync_rec.keyword_idx, true) < 0) {
-            return -1;
-          }
+          update_extended_metadata(ctx, seq1, seq2, sync_rec.keyword_idx, true, updates);
         }
         break;
       default:
         break;
     }
   }
+  if (rbox_sync_flush_updates(ctx, updates) < 0) {
+    return -1;
+  }
 
   if (box->v.sync_notify != NULL)
     box->v.sync_notify(box, 0, static_cast<mailbox_sync_type>(0));
@@ -394,70 +532,123 @@ int rbox_sync_begin(struct rbox_mailbox *mbox, struct rbox_sync_context **ctx_r,
   return 0;
 }
 
-static void rbox_sync_object_expunge(struct rbox_sync_context *ctx, struct expunged_item *item) {
+static void rbox_sync_objects_expunge(struct rbox_sync_context *ctx, const std::vector<struct expunged_item *> &items,
+                                      bool alt_storage) {
   FUNC_START();
-  int ret_remove = -1;
   struct mailbox *box = &ctx->mbox->box;
   struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
 
-  const char *oid = guid_128_to_string(item->oid);
-
-  if (rbox_open_rados_connection(box, item->alt_storage) < 0) {
-    i_error("rbox_sync_object_expunge: connection to rados failed");
+  if (items.empty()) {
+    FUNC_END();
     return;
   }
-  if (!item->alt_storage) {
-    ret_remove = r_storage->s->delete_mail(oid);
-  } else {
-    ret_remove = r_storage->alt->delete_mail(oid);
+  if (rbox_open_rados_connection(box, alt_storage) < 0) {
+    i_error("rbox_sync_objects_expunge: connection to rados failed");
+    FUNC_END_RET("ret == -1");
+    return;
   }
-  // callback
-  /* do sync_notify only when the file was unlinked by us */
-  if (box->v.sync_notify != NULL) {
-    box->v.sync_notify(box, item->uid, MAILBOX_SYNC_TYPE_EXPUNGE);
+
+  std::vector<std::string> oids;
+  oids.reserve(items.size());
+  for (std::vector<struct expunged_item *>::const_iterator it = items.begin(); it != items.end(); ++it) {
+    oids.push_back(guid_128_to_string((*it)->oid));
   }
 
+  std::vector<int> results;
+  librmb::RadosStorage *rados_storage = alt_storage ? r_storage->alt : r_storage->s;
+  std::string pool = rados_storage->get_pool_name();
+  for (std::vector<std::string>::iterator it = oids.begin(); it != oids.end(); ++it) {
+    r_storage->metadata_cache->invalidate(pool, rados_storage->get_namespace(), *it);
+  }
+  int ret_remove = rados_storage->delete_mails(oids, r_storage->config->get_expunge_window(), &results);
   if (ret_remove < 0) {
-    i_error("sync: object expunged: oid=%s, process-id=%d, delete_mail return value= %d", guid_128_to_string(item->oid),
-            getpid(), ret_remove);
+    results.assign(oids.size(), ret_remove);
+  }
+
+  for (size_t i = 0; i < items.size(); i++) {
+    // callback
+    /* do sync_notify only when the file was unlinked by us */
+    if (box->v.sync_notify != NULL) {
+      box->v.sync_notify(box, items[i]->uid, MAILBOX_SYNC_TYPE_EXPUNGE);
+    }
+    if (results[i] < 0) {
+      i_error("sync: object expunged: oid=%s, process-id=%d, delete_mail return value= %d", oids[i].c_str(), getpid(),
+              results[i]);
+    }
   }
 
   FUNC_END();
 }
 
-static void rbox_sync_expunge_rbox_objects(struct rbox_sync_context *ctx) {
+/* remove the expunged mails from the manifest, moved mails included: they belong to their new mailbox now */
+static int rbox_sync_manifest_expunge(struct rbox_sync_context *ctx, struct expunged_item *const *items,
+                                      unsigned int count) {
+  struct mailbox *box = &ctx->mbox->box;
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+
+  if (!r_storage->config->is_mailbox_manifest_enabled()) {
+    return 0;
+  }
+  if (rbox_open_rados_connection(box, false) < 0) {
+    i_error("rbox_sync_manifest_expunge: connection to rados failed");
+    return -1;
+  }
+  std::set<std::string> oids;
+  for (unsigned int i = 0; i < count; i++) {
+    oids.insert(guid_128_to_string(items[i]->oid));
+  }
+  librados::ObjectWriteOperation op;
+  librmb::RadosMailboxManifest::remove_entries(&op, oids);
+  int ret = r_storage->s->get_io_ctx().operate(
+      librmb::RadosMailboxManifest::get_oid(guid_128_to_string(ctx->mbox->mailbox_guid)), &op);
+  if (ret < 0 && ret != -ENOENT) {
+    return rbox_mailbox_manifest_failed(box, ret);
+  }
+  return 0;
+}
+
+static int rbox_sync_expunge_rbox_objects(struct rbox_sync_context *ctx) {
   FUNC_START();
   struct expunged_item *const *items, *item;
-  struct expunged_item *const *moved_items, *moved_item;
+  struct expunged_item *const *moved_items;
   unsigned int count, moved_count = 0;
   unsigned int i, j = 0;
+  int ret = 0;
 
   /* NOTE: Index is no longer locked. Multiple processes may be deleting
      the objects at the same time. */
   ctx->mbox->box.tmp_sync_view = ctx->sync_view;
 
-  // rbox_sync_object_expunge;
   items = array_get(&ctx->expunged_items, &count);
 
   if (count > 0) {
+    // moved mails are still referenced by the destination mailbox
+    std::unordered_set<std::string> moved_oids;
     moved_items = array_get(&ctx->mbox->moved_items, &moved_count);
+    for (j = 0; j < moved_count; j++) {
+      moved_oids.insert(std::string(reinterpret_cast<const char *>(moved_items[j]->oid), sizeof(guid_128_t)));
+    }
+
+    std::vector<struct expunged_item *> primary_items, alt_items;
     for (i = 0; i < count; i++) {
-      T_BEGIN {
-        item = items[i];
-        bool moved = FALSE;
-        for (j = 0; j < moved_count; j++) {
-          moved_item = moved_items[j];
-          if (guid_128_equals(moved_item->oid, item->oid)) {
-            moved = TRUE;
-            break;
-          }
-        }
-        if (moved != TRUE) {
-          rbox_sync_object_expunge(ctx, item);
-        }
+      item = items[i];
+      if (moved_oids.find(std::string(reinterpret_cast<const char *>(item->oid), sizeof(guid_128_t))) !=
+          moved_oids.end()) {
+        continue;
       }
-      T_END;
+      if (item->alt_storage) {
+        alt_items.push_back(item);
+      } else {
+        primary_items.push_back(item);
+      }
+    }
+
+    T_BEGIN {
+      rbox_sync_objects_expunge(ctx, primary_items, false);
+      rbox_sync_objects_expunge(ctx, alt_items, true);
+      ret = rbox_sync_manifest_expunge(ctx, items, count);
     }
+    T_END;
   }
 
   if (ctx->mbox->box.v.sync_notify != NULL) {
@@ -466,6 +657,7 @@ static void rbox_sync_expunge_rbox_objects(struct rbox_sync_context *ctx) {
 
   ctx->mbox->box.tmp_sync_view = NULL;
   FUNC_END();
+  return ret;
 }
 
 int rbox_sync_finish(struct rbox_sync_context **_ctx, bool success) {
@@ -483,8 +675,14 @@ int rbox_sync_finish(struct rbox_sync_context **_ctx, bool success) {
       FUNC_END_RET("ret == -1");
       ret = -1;
     } else {
-      rbox_sync_expunge_rbox_objects(ctx);
+      // the index is committed, but the manifest no longer matches it
+      if (rbox_sync_expunge_rbox_objects(ctx) < 0) {
+        ret = -1;
+      }
       mail_index_view_close(&ctx->sync_view);
+      if (ctx->changed) {
+        rbox_notify_mailbox_changed(&ctx->mbox->box);
+      }
     }
   } else {
     mail_index_sync_rollback(&ctx->index_sync_ctx);
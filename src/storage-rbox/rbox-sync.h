@@ -32,6 +32,8 @@ struct rbox_sync_context {
   size_t path_dir_prefix_len;
   uint32_t uid_validity;
   ARRAY(struct expunged_item *) expunged_items;
+  /* mails were added, expunged or changed, the watchers of the mailbox are notified */
+  bool changed;
 };
 
 struct expunge_callback_data {
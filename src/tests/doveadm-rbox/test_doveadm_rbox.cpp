@@ -0,0 +1,271 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include <errno.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../storage-mock-rbox/TestCase.h"
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wshadow"           // turn off warnings for Dovecot :-(
+#pragma GCC diagnostic ignored "-Wundef"            // turn off warnings for Dovecot :-(
+#pragma GCC diagnostic ignored "-Wredundant-decls"  // turn off warnings for Dovecot :-(
+#ifndef __cplusplus
+#pragma GCC diagnostic ignored "-Wdeclaration-after-statement"  // turn off warnings for Dovecot :-(
+#endif
+
+extern "C" {
+#include "lib.h"
+#include "mail-user.h"
+#include "mail-storage.h"
+#include "mail-storage-service.h"
+#include "mail-namespace.h"
+#include "mailbox-list.h"
+#include "mail-index.h"
+#include "mail-search-build.h"
+
+#include "doveadm-rbox-tier.h"
+}
+#include "dovecot-ceph-plugin-config.h"
+#include "../test-utils/it_utils.h"
+
+#include "rbox-storage.hpp"
+#include "../mocks/mock_test.h"
+using ::testing::Return;
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::Matcher;
+using ::testing::ReturnRef;
+#pragma GCC diagnostic pop
+
+#if DOVECOT_PREREQ(2, 3)
+#define mailbox_get_last_internal_error(box, error_r) mailbox_get_last_internal_error(box, error_r)
+#else
+#define mailbox_get_last_internal_error(box, error_r) mailbox_get_last_error(box, error_r)
+#endif
+
+static const char *message =
+    "From: user@domain.org\n"
+    "Date: Sat, 24 Mar 2017 23:00:00 +0200\n"
+    "Mime-Version: 1.0\n"
+    "Content-Type: text/plain; charset=us-ascii\n"
+    "\n"
+    "body\n";
+
+static bool tier_killed() { return true; }
+
+/* mail objects with their sizes loaded already, so the size search doesn't go to rados */
+static librmb::RadosMailObject *alloc_mail_object_with_size() {
+  librmb::RadosMailObject *obj = new librmb::RadosMailObject();
+  size_t physical_size = strlen(message);
+  size_t virtual_size = physical_size + std::count(message, message + physical_size, '\n');
+  librmb::RadosMetadata physical(librmb::RBOX_METADATA_PHYSICAL_SIZE, physical_size);
+  obj->add_metadata(physical);
+  librmb::RadosMetadata virt(librmb::RBOX_METADATA_VIRTUAL_SIZE, virtual_size);
+  obj->add_metadata(virt);
+  librmb::RadosMetadata recv_date(librmb::RBOX_METADATA_RECEIVED_TIME, time(NULL));
+  obj->add_metadata(recv_date);
+  return obj;
+}
+
+static void free_mail_object(librmb::RadosMailObject *obj) { delete obj; }
+
+/* the client copy of the move, the server side copy needs a cluster */
+static int read_mail(const std::string &oid, librados::bufferlist *buffer) {
+  buffer->append(message);
+  return 0;
+}
+
+static unsigned int count_tiered(struct mailbox *box) {
+  unsigned int count = 0;
+  uint32_t seq, messages = mail_index_view_get_messages_count(box->view);
+  for (seq = 1; seq <= messages; seq++) {
+    if ((mail_index_lookup(box->view, seq)->flags & MAIL_INDEX_MAIL_FLAG_BACKEND) != 0) {
+      count++;
+    }
+  }
+  return count;
+}
+
+TEST_F(StorageTest, init) {}
+
+TEST(doveadm_rbox, tier_parse_option) {
+  struct rbox_tier_settings set;
+  rbox_tier_settings_init(&set);
+  EXPECT_EQ(0u, set.min_age_days);
+  EXPECT_EQ(0u, set.min_size);
+  EXPECT_EQ(static_cast<unsigned int>(RBOX_TIER_DEFAULT_BATCH_SIZE), set.batch_size);
+  EXPECT_EQ(static_cast<unsigned int>(RBOX_TIER_DEFAULT_INTERVAL_MSECS), set.interval_msecs);
+
+  EXPECT_EQ(1, rbox_tier_parse_option(&set, 'd', "30"));
+  EXPECT_EQ(30u, set.min_age_days);
+  EXPECT_EQ(1, rbox_tier_parse_option(&set, 's', "1048576"));
+  EXPECT_EQ(1048576u, set.min_size);
+  EXPECT_EQ(1, rbox_tier_parse_option(&set, 'b', "10"));
+  EXPECT_EQ(10u, set.batch_size);
+  EXPECT_EQ(1, rbox_tier_parse_option(&set, 'i', "0"));
+  EXPECT_EQ(0u, set.interval_msecs);
+
+  // invalid values
+  EXPECT_EQ(-1, rbox_tier_parse_option(&set, 'd', "thirty"));
+  EXPECT_EQ(-1, rbox_tier_parse_option(&set, 's', "-1"));
+  EXPECT_EQ(-1, rbox_tier_parse_option(&set, 'b', "0"));
+  EXPECT_EQ(-1, rbox_tier_parse_option(&set, 'i', ""));
+  // no tier option, left to doveadm
+  EXPECT_EQ(0, rbox_tier_parse_option(&set, 'u', "user"));
+}
+
+TEST_F(StorageTest, tier_no_alt_storage) {
+  struct mail_namespace *ns = mail_namespace_find_inbox(s_test_mail_user->namespaces);
+  ASSERT_NE(ns, nullptr);
+  struct mailbox *box = mailbox_alloc(ns->list, "INBOX", MAILBOX_FLAG_IGNORE_ACLS);
+  // the test user has no mail_alt_dir
+  EXPECT_EQ(-1, rbox_tier_check_mailbox(box));
+  mailbox_free(&box);
+}
+
+TEST_F(StorageTest, tier_mailbox) {
+  const char *mailbox = "INBOX";
+
+  librmbtest::RadosStorageMock *storage_mock = new librmbtest::RadosStorageMock();
+  librados::IoCtx test_ioctx;
+  EXPECT_CALL(*storage_mock, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
+  EXPECT_CALL(*storage_mock, wait_for_rados_operations(_)).WillRepeatedly(Return(false));
+  EXPECT_CALL(*storage_mock, save_mail(Matcher<librados::ObjectWriteOperation *>(_), _, _))
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(*storage_mock, alloc_mail_object()).WillRepeatedly(Invoke(alloc_mail_object_with_size));
+  EXPECT_CALL(*storage_mock, free_mail_object(_)).WillRepeatedly(Invoke(free_mail_object));
+
+  // testdata
+  for (int i = 0; i < 3; i++) {
+    testutils::ItUtils::add_mail(message, mailbox, StorageTest::s_test_mail_user->namespaces, storage_mock);
+  }
+
+  struct mail_namespace *ns = mail_namespace_find_inbox(s_test_mail_user->namespaces);
+  ASSERT_NE(ns, nullptr);
+  struct mailbox *box = mailbox_alloc(ns->list, mailbox, MAILBOX_FLAG_IGNORE_ACLS);
+
+  // set the Mock storage
+  struct rbox_storage *storage = (struct rbox_storage *)box->storage;
+  delete storage->s;
+
+  librmbtest::RadosStorageMock *storage_mock_tier = new librmbtest::RadosStorageMock();
+  EXPECT_CALL(*storage_mock_tier, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
+  EXPECT_CALL(*storage_mock_tier, open_connection(_, _, _)).WillRepeatedly(Return(1));
+  EXPECT_CALL(*storage_mock_tier, wait_for_rados_operations(_)).WillRepeatedly(Return(false));
+  EXPECT_CALL(*storage_mock_tier, alloc_mail_object()).WillRepeatedly(Invoke(alloc_mail_object_with_size));
+  EXPECT_CALL(*storage_mock_tier, free_mail_object(_)).WillRepeatedly(Invoke(free_mail_object));
+  // each tiered mail is read once by the copy and removed from the primary storage by the sync
+  EXPECT_CALL(*storage_mock_tier, read_mail(_, _)).Times(3).WillRepeatedly(Invoke(read_mail));
+  std::vector<std::string> removed;
+  EXPECT_CALL(*storage_mock_tier, delete_mails(_, _, _))
+      .WillRepeatedly(
+          Invoke([&removed](const std::vector<std::string> &oids, const int &, std::vector<int> *results) -> int {
+            removed.insert(removed.end(), oids.begin(), oids.end());
+            results->assign(oids.size(), 0);
+            return 0;
+          }));
+  EXPECT_CALL(*storage_mock_tier, delete_mail(Matcher<librmb::RadosMailObject *>(_))).Times(0);
+  storage->s = storage_mock_tier;
+
+  const char *alt_dir = box->list->set.alt_dir;
+  box->list->set.alt_dir = "mail_storage_alt";
+  delete storage->alt;
+  librmbtest::RadosStorageMock *storage_mock_alt = new librmbtest::RadosStorageMock();
+  EXPECT_CALL(*storage_mock_alt, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
+  EXPECT_CALL(*storage_mock_alt, open_connection(_, _, _)).WillRepeatedly(Return(1));
+  EXPECT_CALL(*storage_mock_alt, wait_for_rados_operations(_)).WillRepeatedly(Return(false));
+  EXPECT_CALL(*storage_mock_alt, alloc_mail_object()).WillRepeatedly(Invoke(alloc_mail_object_with_size));
+  EXPECT_CALL(*storage_mock_alt, free_mail_object(_)).WillRepeatedly(Invoke(free_mail_object));
+  // not in the same cluster, the copies go through the client
+  EXPECT_CALL(*storage_mock_alt, aio_copy_from(_, _, _, _)).Times(3).WillRepeatedly(Return(-EXDEV));
+  EXPECT_CALL(*storage_mock_alt, save_mail(Matcher<librados::ObjectWriteOperation *>(_), _, _))
+      .Times(3)
+      .WillRepeatedly(Return(true));
+  storage->alt = storage_mock_alt;
+
+  delete storage->config;
+  librmbtest::RadosDovecotCephCfgMock *cfg_mock = new librmbtest::RadosDovecotCephCfgMock();
+  std::string user = "client.admin";
+  std::string cluster = "ceph";
+  std::string pool = "mail_storage";
+  std::string suffix = "_u";
+  EXPECT_CALL(*cfg_mock, is_config_valid()).WillRepeatedly(Return(true));
+  EXPECT_CALL(*cfg_mock, get_rados_username()).WillRepeatedly(ReturnRef(user));
+  EXPECT_CALL(*cfg_mock, get_rados_cluster_name()).WillRepeatedly(ReturnRef(cluster));
+  EXPECT_CALL(*cfg_mock, get_pool_name()).WillRepeatedly(ReturnRef(pool));
+  EXPECT_CALL(*cfg_mock, get_user_suffix()).WillRepeatedly(ReturnRef(suffix));
+  storage->ns_mgr->set_config(cfg_mock);
+  storage->config = cfg_mock;
+
+  delete storage->ms;
+  librmbtest::RadosMetadataStorageProducerMock *ms_p_mock = new librmbtest::RadosMetadataStorageProducerMock();
+  storage->ms = ms_p_mock;
+  librmbtest::RadosStorageMetadataMock ms_mock;
+  EXPECT_CALL(*ms_p_mock, get_storage()).WillRepeatedly(Return(&ms_mock));
+  EXPECT_CALL(ms_mock, aio_set_metadata(_, _)).WillRepeatedly(Return(0));
+  EXPECT_CALL(ms_mock, load_metadata(_)).WillRepeatedly(Return(0));
+
+  ASSERT_EQ(1, rbox_tier_check_mailbox(box));
+  if (mailbox_open(box) < 0) {
+    FAIL() << "Opening mailbox " << mailbox << " failed: " << mailbox_get_last_internal_error(box, NULL);
+  }
+
+  struct rbox_tier_settings set;
+  rbox_tier_settings_init(&set);
+  set.interval_msecs = 0;
+  unsigned int count;
+
+  // no mail is large enough: no-op
+  set.min_size = 1024 * 1024;
+  struct mail_search_args *search_args = rbox_tier_build_search_args(&set);
+  EXPECT_EQ(0, rbox_tier_mailbox(&set, search_args, box, NULL, &count));
+  EXPECT_EQ(0u, count);
+  EXPECT_EQ(0u, count_tiered(box));
+  EXPECT_TRUE(removed.empty());
+  mail_search_args_unref(&search_args);
+
+  // killed before the first batch
+  set.min_size = 10;
+  search_args = rbox_tier_build_search_args(&set);
+  EXPECT_EQ(-1, rbox_tier_mailbox(&set, search_args, box, tier_killed, &count));
+  EXPECT_EQ(0u, count);
+  EXPECT_EQ(0u, count_tiered(box));
+  EXPECT_TRUE(removed.empty());
+
+  // all mails, in batches of 2. the sync after each batch copies them to the alt storage
+  set.batch_size = 2;
+  EXPECT_EQ(0, rbox_tier_mailbox(&set, search_args, box, NULL, &count));
+  EXPECT_EQ(3u, count);
+  EXPECT_EQ(3u, count_tiered(box));
+  EXPECT_EQ(3u, removed.size());
+
+  // the mails in the alternate storage are skipped
+  EXPECT_EQ(0, rbox_tier_mailbox(&set, search_args, box, NULL, &count));
+  EXPECT_EQ(0u, count);
+  EXPECT_EQ(3u, count_tiered(box));
+  EXPECT_EQ(3u, removed.size());
+  mail_search_args_unref(&search_args);
+
+  box->list->set.alt_dir = alt_dir;
+  mailbox_free(&box);
+}
+
+TEST_F(StorageTest, deinit) {}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleMock(&argc, argv);
+  return RUN_ALL_TESTS();
+}
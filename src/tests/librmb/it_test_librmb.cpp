@@ -9,6 +9,8 @@
  * Foundation.  See file COPYING.
  */
 
+#include <errno.h>
+#include <limits.h>
 #include <ctime>
 #include <rados/librados.hpp>
 
@@ -19,13 +21,39 @@
 #include "gmock/gmock.h"
 #include "../../librmb/rados-metadata-storage-default.h"
 #include "../../librmb/rados-metadata-storage-ima.h"
+#include "../../librmb/rados-metadata-storage-impl.h"
 #include "../../librmb/rados-dovecot-ceph-cfg-impl.h"
 #include "../../librmb/rados-util.h"
+#include "../../librmb/rados-mailbox-manifest.h"
+#include "../../librmb/rados-index-snapshot.h"
+#include "../../librmb/rados-mailbox-list.h"
 #include "../../librmb/tools/rmb/rmb-commands.h"
 
 using ::testing::AtLeast;
 using ::testing::Return;
-
+using ::testing::_;
+using ::testing::Invoke;
+
+// records the chunk writes of split_buffer_and_exec_op with their results
+class RadosStorageWriteRecorder : public librmb::RadosStorageImpl {
+ public:
+  explicit RadosStorageWriteRecorder(librmb::RadosCluster *cluster_) : librmb::RadosStorageImpl(cluster_) {}
+
+  struct Write {
+    uint64_t offset;
+    uint64_t length;
+    int ret;
+  };
+  std::vector<Write> writes;
+
+ protected:
+  int wait_write_chunk(librmb::ChunkWrite *chunk) {
+    int ret = librmb::RadosStorageImpl::wait_write_chunk(chunk);
+    Write w = {chunk->offset, chunk->data.length(), ret};
+    writes.push_back(w);
+    return ret;
+  }
+};
 
 TEST(librmb, mock_test) {
   librmbtest::RadosClusterMock cluster;
@@ -46,7 +74,7 @@ TEST(librmb, split_write_operation) {
 
   librados::ObjectWriteOperation *op = new librados::ObjectWriteOperation();
   librmb::RadosClusterImpl cluster;
-  librmb::RadosStorageImpl storage(&cluster);
+  RadosStorageWriteRecorder storage(&cluster);
 
   std::string pool_name("test");
   std::string ns("t");
@@ -58,12 +86,14 @@ TEST(librmb, split_write_operation) {
   int ret_storage = storage.split_buffer_and_exec_op(&obj, op, max_size);
 
   // wait for op to finish.
-  storage.wait_for_write_operations_complete(obj.get_completion_op_map());
+  bool wait_failed = storage.wait_for_write_operations_complete(obj.get_completion_group());
 
   // stat the object
   uint64_t size;
   time_t save_date;
   int ret_stat = storage.stat_mail(obj.get_oid(), &size, &save_date);
+  librados::bufferlist bl;
+  int ret_read = storage.read_mail(obj.get_oid(), &bl);
 
   // remove it
   int ret_remove = storage.delete_mail(&obj);
@@ -73,9 +103,21 @@ TEST(librmb, split_write_operation) {
 
   EXPECT_EQ(buffer_length, size);
   EXPECT_EQ(0, ret_storage);
+  EXPECT_FALSE(wait_failed);
   EXPECT_EQ(0, ret_stat);
+  EXPECT_EQ(static_cast<int>(buffer_length), ret_read);
+  EXPECT_EQ("abcdefghijklmn", bl.to_str());
   EXPECT_EQ(0, ret_remove);
-  EXPECT_EQ(5, (int)obj.get_completion_op_map()->size());
+  // the data is written in several chunks, the first one of max_size, which cover the mail in order
+  ASSERT_LE(2u, storage.writes.size());
+  EXPECT_EQ(max_size, storage.writes[0].length);
+  uint64_t offset = 0;
+  for (size_t i = 0; i < storage.writes.size(); i++) {
+    EXPECT_EQ(offset, storage.writes[i].offset);
+    EXPECT_EQ(0, storage.writes[i].ret);
+    offset += storage.writes[i].length;
+  }
+  EXPECT_EQ(buffer_length, offset);
 }
 
 TEST(librmb1, split_write_operation_1) {
@@ -90,7 +132,7 @@ TEST(librmb1, split_write_operation_1) {
 
   librados::ObjectWriteOperation *op = new librados::ObjectWriteOperation();
   librmb::RadosClusterImpl cluster;
-  librmb::RadosStorageImpl storage(&cluster);
+  RadosStorageWriteRecorder storage(&cluster);
 
   std::string pool_name("test");
   std::string ns("t");
@@ -102,12 +144,14 @@ TEST(librmb1, split_write_operation_1) {
   int ret_storage = storage.split_buffer_and_exec_op(&obj, op, max_size);
 
   // wait for op to finish.
-  storage.wait_for_write_operations_complete(obj.get_completion_op_map());
+  bool wait_failed = storage.wait_for_write_operations_complete(obj.get_completion_group());
 
   // stat the object
   uint64_t size;
   time_t save_date;
   int ret_stat = storage.stat_mail(obj.get_oid(), &size, &save_date);
+  librados::bufferlist bl;
+  int ret_read = storage.read_mail(obj.get_oid(), &bl);
 
   // remove it
   int ret_remove = storage.delete_mail(obj.get_oid());
@@ -117,9 +161,13 @@ TEST(librmb1, split_write_operation_1) {
 
   EXPECT_EQ(buffer_length, size);
   EXPECT_EQ(0, ret_storage);
+  EXPECT_FALSE(wait_failed);
   EXPECT_EQ(0, ret_stat);
+  EXPECT_EQ(static_cast<int>(buffer_length), ret_read);
+  EXPECT_EQ("HALLO_WELT_", bl.to_str());
   EXPECT_EQ(0, ret_remove);
-  EXPECT_EQ(1, (int)obj.get_completion_op_map()->size());
+  // fits into a single write, which is the metadata operation itself
+  EXPECT_EQ(0u, storage.writes.size());
 }
 
 TEST(librmb1, convert_types) {
@@ -174,7 +222,7 @@ TEST(librmb1, read_mail) {
   int ret_storage = storage.split_buffer_and_exec_op(&obj, op, max_size);
 
   // wait for op to finish.
-  storage.wait_for_write_operations_complete(obj.get_completion_op_map());
+  storage.wait_for_write_operations_complete(obj.get_completion_group());
 
   // stat the object
   uint64_t size;
@@ -235,7 +283,7 @@ TEST(librmb, load_metadata) {
   int ret_storage = storage.split_buffer_and_exec_op(&obj, op, max_size);
 
   // wait for op to finish.
-  storage.wait_for_write_operations_complete(obj.get_completion_op_map());
+  bool wait_failed = storage.wait_for_write_operations_complete(obj.get_completion_group());
 
   ms.load_metadata(&obj);
   std::cout << "load metadata ok" << std::endl;
@@ -247,7 +295,7 @@ TEST(librmb, load_metadata) {
   EXPECT_EQ(buffer_length, size);
   EXPECT_EQ(0, ret_storage);
   EXPECT_EQ(0, ret_stat);
-  EXPECT_EQ(5, (int)obj.get_completion_op_map()->size());
+  EXPECT_FALSE(wait_failed);
   EXPECT_EQ(2, (int)obj.get_metadata()->size());
   std::cout << " load with null" << std::endl;
   int i = ms.load_metadata(nullptr);
@@ -294,7 +342,7 @@ TEST(librmb, AttributeVersions) {
   int ret_storage = storage.split_buffer_and_exec_op(&obj, op, max_size);
   EXPECT_EQ(ret_storage, 0);
   // wait for op to finish.
-  storage.wait_for_write_operations_complete(obj.get_completion_op_map());
+  storage.wait_for_write_operations_complete(obj.get_completion_group());
 
   // stat the object
   uint64_t size;
@@ -325,9 +373,174 @@ TEST(librmb, AttributeVersions) {
   cluster.deinit();
 }
 
+TEST(librmb, aio_set_metadata) {
+  uint64_t max_size = 3;
+  librmb::RadosMailObject obj;
+  obj.get_mail_buffer()->append("abcdefghijklmn");
+  obj.set_mail_size(obj.get_mail_buffer()->length());
+  obj.set_oid("test_aio_set_metadata");
+
+  librados::ObjectWriteOperation *op = new librados::ObjectWriteOperation();
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+
+  std::string pool_name("test");
+  std::string ns("t");
+
+  int open_connection = storage.open_connection(pool_name);
+  storage.set_namespace(ns);
+  EXPECT_EQ(0, open_connection);
+
+  librmb::RadosMetadataStorageDefault ms(&storage.get_io_ctx());
+
+  int ret_storage = storage.split_buffer_and_exec_op(&obj, op, max_size);
+  EXPECT_EQ(ret_storage, 0);
+  std::vector<librmb::RadosMailObject *> objects;
+  objects.push_back(&obj);
+  EXPECT_FALSE(storage.wait_for_rados_operations(objects));
+
+  // update uid, operation is added to the completion group of the mail object
+  librmb::RadosMetadata metadata(librmb::RBOX_METADATA_MAIL_UID, "42");
+  EXPECT_EQ(0, ms.aio_set_metadata(&obj, metadata));
+  EXPECT_FALSE(storage.wait_for_rados_operations(objects));
+  EXPECT_EQ("42", librmb::RadosUtils::get_metadata(librmb::RBOX_METADATA_MAIL_UID, obj.get_metadata()));
+
+  librmb::RadosMailObject loaded;
+  loaded.set_oid(obj.get_oid());
+  EXPECT_EQ(0, ms.load_metadata(&loaded));
+  EXPECT_EQ("42", librmb::RadosUtils::get_metadata(librmb::RBOX_METADATA_MAIL_UID, loaded.get_metadata()));
+
+  storage.delete_mail(obj.get_oid());
+  // tear down
+  cluster.deinit();
+}
+
 // standard call order for metadata updates
 // 1. save_metadata
 // 2. set_metadata (update uid)
+TEST(librmb, aio_load_metadata) {
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+  EXPECT_EQ(0, storage.open_connection("test"));
+  storage.set_namespace("t");
+
+  librmb::RadosMetadataStorageDefault ms(&storage.get_io_ctx());
+  std::string oid = "test_aio_load_metadata";
+  librados::bufferlist bl;
+  bl.append("abc");
+  EXPECT_EQ(0, storage.save_mail(oid, bl));
+  librmb::RadosMetadata uid(librmb::RBOX_METADATA_MAIL_UID, "5");
+  librmb::RadosMetadata guid(librmb::RBOX_METADATA_GUID, "67ffff24efc0e559194f00009c60b9f7");
+  std::map<std::string, librados::bufferlist> omap;
+  omap["1"] = bl;
+  librados::ObjectWriteOperation write_op;
+  write_op.setxattr(uid.key.c_str(), uid.bl);
+  write_op.setxattr(guid.key.c_str(), guid.bl);
+  write_op.omap_set(omap);
+  EXPECT_EQ(0, storage.get_io_ctx().operate(oid, &write_op));
+
+  librmb::RadosMailObject obj;
+  obj.set_oid(oid);
+  librados::ObjectReadOperation read_op;
+  ms.prepare_load_metadata(&read_op, &obj);
+  librados::AioCompletion *completion = librados::Rados::aio_create_completion();
+  EXPECT_EQ(0, storage.get_io_ctx().aio_operate(oid, completion, &read_op, nullptr));
+  completion->wait_for_complete();
+  EXPECT_EQ(0, completion->get_return_value());
+  completion->release();
+  EXPECT_EQ(0, ms.finish_load_metadata(&obj));
+
+  // same result as load_metadata
+  librmb::RadosMailObject obj2;
+  obj2.set_oid(oid);
+  EXPECT_EQ(0, ms.load_metadata(&obj2));
+  EXPECT_EQ(obj2.get_metadata()->size(), obj.get_metadata()->size());
+  EXPECT_EQ("5", obj.get_metadata(librmb::RBOX_METADATA_MAIL_UID));
+  EXPECT_EQ(1, (int)obj.get_extended_metadata()->size());
+
+  storage.delete_mail(oid);
+  // tear down
+  cluster.deinit();
+}
+TEST(librmb, read_mail_object) {
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+  EXPECT_EQ(0, storage.open_connection("test"));
+  storage.set_namespace("t");
+
+  librmb::RadosMetadataStorageDefault ms(&storage.get_io_ctx());
+  std::string oid = "test_read_mail_object";
+  librados::bufferlist bl;
+  bl.append("hello world\n");
+  EXPECT_EQ(0, storage.save_mail(oid, bl));
+  librmb::RadosMetadata uid(librmb::RBOX_METADATA_MAIL_UID, "5");
+  librados::ObjectWriteOperation write_op;
+  write_op.setxattr(uid.key.c_str(), uid.bl);
+  EXPECT_EQ(0, storage.get_io_ctx().operate(oid, &write_op));
+  uint64_t size;
+  time_t save_date;
+  EXPECT_EQ(0, storage.stat_mail(oid, &size, &save_date));
+
+  // size, save date, metadata and data of a single operation
+  librmb::RadosMailObject obj;
+  obj.set_oid(oid);
+  EXPECT_EQ(static_cast<int>(bl.length()), storage.read_mail_object(&obj, &ms, true, 0));
+  EXPECT_EQ(bl.length(), obj.get_mail_size());
+  EXPECT_EQ(save_date, *obj.get_rados_save_date());
+  EXPECT_EQ("5", obj.get_metadata(librmb::RBOX_METADATA_MAIL_UID));
+  EXPECT_EQ("hello world\n", obj.get_mail_buffer()->to_str());
+
+  // a part of the data, no metadata
+  librmb::RadosMailObject part;
+  part.set_oid(oid);
+  EXPECT_EQ(5, storage.read_mail_object(&part, nullptr, true, 5));
+  EXPECT_EQ("hello", part.get_mail_buffer()->to_str());
+  EXPECT_EQ(bl.length(), part.get_mail_size());
+  EXPECT_FALSE(part.has_metadata());
+
+  // the stat only, no data
+  librmb::RadosMailObject stat;
+  stat.set_oid(oid);
+  EXPECT_EQ(0, storage.read_mail_object(&stat, &ms, false, 0));
+  EXPECT_EQ(bl.length(), stat.get_mail_size());
+  EXPECT_EQ(0u, stat.get_mail_buffer()->length());
+
+  // errors of each step are returned: the object
+  librmb::RadosMailObject missing;
+  missing.set_oid("test_read_mail_object_missing");
+  EXPECT_EQ(-ENOENT, storage.read_mail_object(&missing, &ms, true, 0));
+
+  // the reads of the metadata module
+  librmbtest::RadosStorageMetadataMock ms_mock;
+  EXPECT_CALL(ms_mock, prepare_load_metadata(_, _))
+      .WillOnce(Invoke([&uid](librados::ObjectReadOperation *read_op, librmb::RadosMailObject *) -> void {
+        // the uid is 5, the comparison fails
+        librados::bufferlist other;
+        other.append("6");
+        read_op->cmpxattr(uid.key.c_str(), LIBRADOS_CMPXATTR_OP_EQ, other);
+      }));
+  librmb::RadosMailObject mismatch;
+  mismatch.set_oid(oid);
+  EXPECT_EQ(-ECANCELED, storage.read_mail_object(&mismatch, &ms_mock, true, 0));
+
+  // preparing the metadata
+  librmbtest::RadosStorageMetadataMock ms_mock2;
+  EXPECT_CALL(ms_mock2, prepare_load_metadata(_, _)).Times(1);
+  EXPECT_CALL(ms_mock2, finish_load_metadata(_)).WillOnce(Return(-EINVAL));
+  librmb::RadosMailObject invalid;
+  invalid.set_oid(oid);
+  EXPECT_EQ(-EINVAL, storage.read_mail_object(&invalid, &ms_mock2, true, 0));
+
+  // the size of the read
+  librmb::RadosMailObject too_large;
+  too_large.set_oid(oid);
+  EXPECT_EQ(-EFBIG, storage.read_mail_object(&too_large, nullptr, true, static_cast<uint64_t>(INT_MAX) + 1));
+
+  storage.delete_mail(oid);
+  // tear down
+  cluster.deinit();
+}
+
 TEST(librmb, json_ima) {
   librados::IoCtx io_ctx;
   uint64_t max_size = 3;
@@ -371,7 +584,7 @@ TEST(librmb, json_ima) {
   EXPECT_EQ(ret_storage, 0);
 
   // wait for op to finish.
-  storage.wait_for_write_operations_complete(obj.get_completion_op_map());
+  storage.wait_for_write_operations_complete(obj.get_completion_group());
 
   // check
   std::map<std::string, ceph::bufferlist> attr_list;
@@ -440,7 +653,7 @@ TEST(librmb, json_ima_2) {
   EXPECT_EQ(ret_storage, 0);
 
   // wait for op to finish.
-  storage.wait_for_write_operations_complete(obj.get_completion_op_map());
+  storage.wait_for_write_operations_complete(obj.get_completion_group());
 
   // check there should be ima and F (Flags)
   std::map<std::string, ceph::bufferlist> attr_list;
@@ -516,7 +729,7 @@ TEST(librmb, json_ima_3) {
   EXPECT_EQ(ret_storage, 0);
 
   // wait for op to finish.
-  storage.wait_for_write_operations_complete(obj.get_completion_op_map());
+  storage.wait_for_write_operations_complete(obj.get_completion_group());
 
   // check there should be ima and F (Flags)
   std::map<std::string, ceph::bufferlist> attr_list;
@@ -533,7 +746,7 @@ TEST(librmb, json_ima_3) {
   storage.get_io_ctx().getxattrs(obj.get_oid(), attr_list);
   EXPECT_EQ(2, attr_list.size());
 
-  obj.get_metadata()->clear();
+  obj.clear_metadata();
   obj.get_extended_metadata()->clear();
   std::cout << "loading metatadata" << std::endl;
   ms.load_metadata(&obj);
@@ -594,7 +807,7 @@ TEST(librmb, test_default_metadata_load_attributes) {
    EXPECT_EQ(ret_storage, 0);
 
    // wait for op to finish.
-   storage.wait_for_write_operations_complete(obj.get_completion_op_map());
+   storage.wait_for_write_operations_complete(obj.get_completion_group());
 
    librmb::RadosMailObject obj2;
    obj2.set_oid("test_ima");
@@ -1161,6 +1374,552 @@ TEST(librmb, rmb_load_objects_invalid_metadata) {
   // tear down
   cluster.deinit();
 }
+TEST(librmb, delete_mails) {
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+
+  std::string pool_name("test");
+  std::string ns("t");
+
+  int open_connection = storage.open_connection(pool_name);
+  storage.set_namespace(ns);
+  EXPECT_EQ(0, open_connection);
+
+  std::vector<std::string> oids;
+  for (int i = 0; i < 10; i++) {
+    std::string oid = "test_delete_mails_" + std::to_string(i);
+    oids.push_back(oid);
+    if (i != 5) {
+      librados::bufferlist bl;
+      bl.append("abc");
+      EXPECT_EQ(0, storage.save_mail(oid, bl));
+    }
+  }
+
+  // window smaller than the number of objects, object 5 does not exist
+  std::vector<int> results;
+  EXPECT_EQ(1, storage.delete_mails(oids, 3, &results));
+  EXPECT_EQ(oids.size(), results.size());
+  for (size_t i = 0; i < results.size(); i++) {
+    EXPECT_EQ(i == 5 ? -ENOENT : 0, results[i]);
+  }
+
+  uint64_t size;
+  time_t save_date;
+  EXPECT_EQ(-ENOENT, storage.stat_mail(oids[0], &size, &save_date));
+  // tear down
+  cluster.deinit();
+}
+TEST(librmb, move_to_alt_batch) {
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+  librmb::RadosStorageImpl alt_storage(&cluster);
+
+  std::string ns("t");
+  EXPECT_EQ(0, storage.open_connection("test"));
+  storage.set_namespace(ns);
+  EXPECT_EQ(0, alt_storage.open_connection("test_alt"));
+  alt_storage.set_namespace(ns);
+
+  librmb::RadosDovecotCephCfgImpl cfg(&storage.get_io_ctx());
+  librmb::RadosMetadataStorageImpl ms;
+  ms.create_metadata_storage(&storage.get_io_ctx(), &cfg);
+
+  std::vector<std::string> oids;
+  for (int i = 0; i < 6; i++) {
+    std::string oid = "test_move_to_alt_batch_" + std::to_string(i);
+    oids.push_back(oid);
+    if (i != 2) {
+      librados::bufferlist bl;
+      bl.append("abc");
+      EXPECT_EQ(0, storage.save_mail(oid, bl));
+    }
+  }
+
+  // object 2 does not exist
+  std::vector<int> results;
+  EXPECT_EQ(1, librmb::RadosUtils::move_to_alt(oids, &storage, &alt_storage, &ms, false, 2, &results));
+  EXPECT_EQ(oids.size(), results.size());
+  uint64_t size;
+  time_t save_date;
+  for (size_t i = 0; i < oids.size(); i++) {
+    EXPECT_EQ(i == 2 ? -ENOENT : 0, results[i]);
+    EXPECT_EQ(-ENOENT, storage.stat_mail(oids[i], &size, &save_date));
+    if (i != 2) {
+      EXPECT_EQ(0, alt_storage.stat_mail(oids[i], &size, &save_date));
+      EXPECT_EQ(3, size);
+    }
+  }
+
+  // and back
+  oids.erase(oids.begin() + 2);
+  EXPECT_EQ(0, librmb::RadosUtils::move_to_alt(oids, &storage, &alt_storage, &ms, true, 2, &results));
+  for (size_t i = 0; i < oids.size(); i++) {
+    EXPECT_EQ(0, storage.stat_mail(oids[i], &size, &save_date));
+    EXPECT_EQ(-ENOENT, alt_storage.stat_mail(oids[i], &size, &save_date));
+  }
+  std::vector<int> remove_results;
+  storage.delete_mails(oids, 2, &remove_results);
+  // tear down
+  cluster.deinit();
+}
+TEST(librmb, move_to_alt_batch_client_copy) {
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+  librmb::RadosStorageImpl alt_storage(&cluster);
+  // not opened, the copies fail
+  librmb::RadosStorageImpl closed_storage(&cluster);
+
+  std::string ns("t");
+  EXPECT_EQ(0, storage.open_connection("test"));
+  storage.set_namespace(ns);
+  EXPECT_EQ(0, alt_storage.open_connection("test_alt"));
+  alt_storage.set_namespace(ns);
+
+  librmb::RadosDovecotCephCfgImpl cfg(&storage.get_io_ctx());
+  librmb::RadosMetadataStorageImpl ms;
+  ms.create_metadata_storage(&storage.get_io_ctx(), &cfg);
+
+  std::vector<std::string> oids;
+  for (int i = 0; i < 3; i++) {
+    std::string oid = "test_move_to_alt_batch_client_" + std::to_string(i);
+    oids.push_back(oid);
+    librados::bufferlist bl;
+    bl.append("abc");
+    EXPECT_EQ(0, storage.save_mail(oid, bl));
+  }
+
+  // a failed copy keeps the source
+  std::vector<int> results;
+  EXPECT_EQ(3, librmb::RadosUtils::move_to_alt(oids, &storage, &closed_storage, &ms, false, 2, &results, false));
+  uint64_t size;
+  time_t save_date;
+  for (size_t i = 0; i < oids.size(); i++) {
+    EXPECT_GT(0, results[i]);
+    EXPECT_EQ(0, storage.stat_mail(oids[i], &size, &save_date));
+  }
+
+  EXPECT_EQ(0, librmb::RadosUtils::move_to_alt(oids, &storage, &alt_storage, &ms, false, 2, &results, false));
+  for (size_t i = 0; i < oids.size(); i++) {
+    EXPECT_EQ(0, results[i]);
+    EXPECT_EQ(-ENOENT, storage.stat_mail(oids[i], &size, &save_date));
+    EXPECT_EQ(0, alt_storage.stat_mail(oids[i], &size, &save_date));
+    EXPECT_EQ(3, size);
+  }
+  std::vector<int> remove_results;
+  alt_storage.delete_mails(oids, 2, &remove_results);
+  // tear down
+  cluster.deinit();
+}
+TEST(librmb, aio_copy_and_move) {
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+
+  EXPECT_EQ(0, storage.open_connection("test"));
+  storage.set_namespace("t");
+
+  std::string src_oid = "test_aio_copy_src";
+  std::string dest_oid = "test_aio_copy_dest";
+  librados::bufferlist bl;
+  bl.append("abc");
+  EXPECT_EQ(0, storage.save_mail(src_oid, bl));
+
+  std::list<librmb::RadosMetadata> to_update;
+  librmb::RadosMetadata mailbox_guid(librmb::RBOX_METADATA_MAILBOX_GUID, "abc");
+  to_update.push_back(mailbox_guid);
+
+  // copy within the namespace and move the source to another namespace in one group
+  librmb::RadosCompletionGroup completion_group;
+  EXPECT_EQ(0, storage.aio_copy(src_oid, "t", dest_oid, "t", to_update, &completion_group));
+  EXPECT_EQ(0, completion_group.wait());
+  EXPECT_EQ(0, storage.aio_move(src_oid, "t", src_oid, "t_moved", to_update, &completion_group));
+  EXPECT_EQ(0, completion_group.wait());
+  EXPECT_EQ(0, storage.aio_delete_mail(src_oid, "t", &completion_group));
+  EXPECT_EQ(0, completion_group.wait());
+
+  uint64_t size;
+  time_t save_date;
+  EXPECT_EQ(-ENOENT, storage.stat_mail(src_oid, &size, &save_date));
+  EXPECT_EQ(0, storage.stat_mail(dest_oid, &size, &save_date));
+  EXPECT_EQ(3, size);
+  librados::bufferlist value;
+  EXPECT_EQ(3, storage.get_io_ctx().getxattr(dest_oid, "M", value));
+
+  // the source is removed already
+  EXPECT_EQ(0, storage.aio_delete_mail(src_oid, "t", &completion_group));
+  EXPECT_EQ(0, completion_group.wait());
+
+  storage.set_namespace("t_moved");
+  EXPECT_EQ(0, storage.stat_mail(src_oid, &size, &save_date));
+  storage.delete_mail(src_oid);
+  storage.set_namespace("t");
+  storage.delete_mail(dest_oid);
+  // tear down
+  cluster.deinit();
+}
+TEST(librmb, completion_group_ignored_error) {
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+  EXPECT_EQ(0, storage.open_connection("test"));
+  storage.set_namespace("t");
+  librados::IoCtx *io_ctx = &storage.get_io_ctx();
+  librmb::RadosCompletionGroup completion_group;
+
+  // -ENOENT only counts as success for the operations which tolerate it
+  librados::ObjectWriteOperation *remove_op = new librados::ObjectWriteOperation();
+  remove_op->remove();
+  EXPECT_EQ(0, completion_group.aio_operate(io_ctx, "completion_group_missing", remove_op, -ENOENT));
+  EXPECT_EQ(0, completion_group.wait());
+
+  librados::ObjectWriteOperation *update_op = new librados::ObjectWriteOperation();
+  update_op->assert_exists();
+  update_op->setxattr("F", librados::bufferlist());
+  EXPECT_EQ(0, completion_group.aio_operate(io_ctx, "completion_group_missing", update_op));
+  EXPECT_EQ(-ENOENT, completion_group.wait());
+
+  // an ignored error doesn't hide the errors of the other operations
+  remove_op = new librados::ObjectWriteOperation();
+  remove_op->remove();
+  EXPECT_EQ(0, completion_group.aio_operate(io_ctx, "completion_group_missing", remove_op, -ENOENT));
+  EXPECT_EQ(0, completion_group.wait());
+  update_op = new librados::ObjectWriteOperation();
+  update_op->assert_exists();
+  EXPECT_EQ(0, completion_group.aio_operate(io_ctx, "completion_group_missing", update_op, -EEXIST));
+  EXPECT_EQ(-ENOENT, completion_group.wait());
+
+  uint64_t size;
+  time_t save_date;
+  EXPECT_EQ(-ENOENT, storage.stat_mail("completion_group_missing", &size, &save_date));
+  // tear down
+  cluster.deinit();
+}
+
+TEST(librmb, save_mail_chunks) {
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+  librmb::RadosMailObject obj;
+  obj.set_oid("test_save_mail_chunks");
+  std::string data = "abcdefghijklmnopqrstuvwxyz";
+
+  // not connected
+  librados::bufferlist chunk;
+  chunk.append(data.substr(0, 10));
+  EXPECT_EQ(-1, storage.save_mail_chunk(&obj, chunk));
+  EXPECT_EQ(0u, obj.get_flushed_size());
+
+  EXPECT_EQ(0, storage.open_connection("test"));
+  storage.set_namespace("t");
+
+  // two chunks ahead of the tail, which is written along with the metadata
+  for (int i = 0; i < 2; i++) {
+    librados::bufferlist bl;
+    bl.append(data.substr(i * 10, 10));
+    EXPECT_EQ(0, storage.save_mail_chunk(&obj, bl));
+  }
+  EXPECT_EQ(20u, obj.get_flushed_size());
+  obj.get_mail_buffer()->append(data.substr(20));
+  obj.set_mail_size(data.length());
+  obj.set_rados_save_date(time(NULL));
+  librados::ObjectWriteOperation *write_op = new librados::ObjectWriteOperation();
+  write_op->setxattr("B", librados::bufferlist());
+  EXPECT_TRUE(storage.save_mail(write_op, &obj, false));
+
+  librados::bufferlist read_bl;
+  EXPECT_EQ(static_cast<int>(data.length()), storage.read_mail(obj.get_oid(), &read_bl));
+  EXPECT_EQ(data, read_bl.to_str());
+
+  // a mail which failed after its first chunk is removed like any other failed mail
+  librmb::RadosMailObject partial;
+  partial.set_oid("test_save_mail_chunks_partial");
+  librados::bufferlist first;
+  first.append(data.substr(0, 10));
+  EXPECT_EQ(0, storage.save_mail_chunk(&partial, first));
+  std::vector<librmb::RadosMailObject *> objects;
+  objects.push_back(&partial);
+  EXPECT_FALSE(storage.wait_for_rados_operations(objects));
+  uint64_t size;
+  time_t save_date;
+  EXPECT_EQ(0, storage.stat_mail(partial.get_oid(), &size, &save_date));
+  EXPECT_EQ(10u, size);
+  EXPECT_EQ(0, storage.delete_mail(&partial));
+  EXPECT_EQ(-ENOENT, storage.stat_mail(partial.get_oid(), &size, &save_date));
+
+  EXPECT_EQ(0, storage.delete_mail(&obj));
+  // tear down
+  cluster.deinit();
+}
+
+TEST(librmb, mailbox_manifest) {
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+  EXPECT_EQ(0, storage.open_connection("test"));
+  storage.set_namespace("t");
+  std::string mailbox_guid = "1ef5d8b9c3d4e5f6a7b8c9d0e1f2a3b4";
+  std::map<std::string, librmb::RadosManifestEntry> entries;
+
+  // no manifest, updates are not applied
+  EXPECT_EQ(-ENOENT, librmb::RadosMailboxManifest::load(&storage.get_io_ctx(), mailbox_guid, &entries));
+  librmb::RadosManifestEntry entry;
+  entry.uid = 1;
+  entry.guid = "67ffff24efc0e559194f00009c60b9f7";
+  entry.size = 100;
+  entry.received_date = 1508000000;
+  entries["oid_1"] = entry;
+  librados::ObjectWriteOperation add_op;
+  librmb::RadosMailboxManifest::add_entries(&add_op, entries);
+  EXPECT_EQ(-ENOENT, storage.get_io_ctx().operate(librmb::RadosMailboxManifest::get_oid(mailbox_guid), &add_op));
+
+  EXPECT_EQ(0, librmb::RadosMailboxManifest::create(&storage.get_io_ctx(), mailbox_guid));
+  librados::ObjectWriteOperation add_op2;
+  entry.uid = 2;
+  entry.alt_storage = true;
+  entries["oid_2"] = entry;
+  librmb::RadosMailboxManifest::add_entries(&add_op2, entries);
+  EXPECT_EQ(0, storage.get_io_ctx().operate(librmb::RadosMailboxManifest::get_oid(mailbox_guid), &add_op2));
+
+  std::map<std::string, librmb::RadosManifestEntry> flags;
+  flags["oid_1"].flags = 0x08;
+  librados::ObjectWriteOperation flags_op;
+  librmb::RadosMailboxManifest::update_flags(&flags_op, flags);
+  EXPECT_EQ(0, storage.get_io_ctx().operate(librmb::RadosMailboxManifest::get_oid(mailbox_guid), &flags_op));
+
+  std::map<std::string, librmb::RadosManifestEntry> loaded;
+  EXPECT_EQ(0, librmb::RadosMailboxManifest::load(&storage.get_io_ctx(), mailbox_guid, &loaded));
+  EXPECT_EQ(2, (int)loaded.size());
+  EXPECT_EQ(1, (int)loaded["oid_1"].uid);
+  EXPECT_EQ("67ffff24efc0e559194f00009c60b9f7", loaded["oid_1"].guid);
+  EXPECT_EQ(100, (int)loaded["oid_1"].size);
+  EXPECT_EQ(1508000000, loaded["oid_1"].received_date);
+  EXPECT_EQ(0x08, loaded["oid_1"].flags);
+  EXPECT_FALSE(loaded["oid_1"].alt_storage);
+  EXPECT_TRUE(loaded["oid_2"].alt_storage);
+
+  // flags of a removed mail are not loaded
+  std::set<std::string> oids;
+  oids.insert("oid_2");
+  librados::ObjectWriteOperation remove_op;
+  librmb::RadosMailboxManifest::remove_entries(&remove_op, oids);
+  EXPECT_EQ(0, storage.get_io_ctx().operate(librmb::RadosMailboxManifest::get_oid(mailbox_guid), &remove_op));
+  flags.clear();
+  flags["oid_2"].flags = 0x01;
+  librados::ObjectWriteOperation flags_op2;
+  librmb::RadosMailboxManifest::update_flags(&flags_op2, flags);
+  EXPECT_EQ(0, storage.get_io_ctx().operate(librmb::RadosMailboxManifest::get_oid(mailbox_guid), &flags_op2));
+  loaded.clear();
+  EXPECT_EQ(0, librmb::RadosMailboxManifest::load(&storage.get_io_ctx(), mailbox_guid, &loaded));
+  EXPECT_EQ(1, (int)loaded.size());
+
+  // save replaces the manifest, more entries than fit into one operation
+  entries.clear();
+  for (int i = 0; i < 2500; i++) {
+    entry.uid = i + 1;
+    entries["oid_" + std::to_string(i)] = entry;
+  }
+  EXPECT_EQ(0, librmb::RadosMailboxManifest::save(&storage.get_io_ctx(), mailbox_guid, entries));
+  loaded.clear();
+  EXPECT_EQ(0, librmb::RadosMailboxManifest::load(&storage.get_io_ctx(), mailbox_guid, &loaded));
+  EXPECT_EQ(2500, (int)loaded.size());
+
+  // entries of mails which are not saved are removed
+  entries.erase("oid_0");
+  EXPECT_EQ(0, librmb::RadosMailboxManifest::save(&storage.get_io_ctx(), mailbox_guid, entries));
+  loaded.clear();
+  EXPECT_EQ(0, librmb::RadosMailboxManifest::load(&storage.get_io_ctx(), mailbox_guid, &loaded));
+  EXPECT_EQ(2499, (int)loaded.size());
+  EXPECT_TRUE(loaded.find("oid_0") == loaded.end());
+
+  // an incomplete manifest is not loaded
+  EXPECT_EQ(0, librmb::RadosMailboxManifest::invalidate(&storage.get_io_ctx(), mailbox_guid));
+  loaded.clear();
+  EXPECT_EQ(-ENODATA, librmb::RadosMailboxManifest::load(&storage.get_io_ctx(), mailbox_guid, &loaded));
+  EXPECT_EQ(0, librmb::RadosMailboxManifest::save(&storage.get_io_ctx(), mailbox_guid, entries));
+  EXPECT_EQ(0, librmb::RadosMailboxManifest::load(&storage.get_io_ctx(), mailbox_guid, &loaded));
+  EXPECT_EQ(2499, (int)loaded.size());
+  EXPECT_TRUE(librmb::RadosMailboxManifest::is_manifest_oid(librmb::RadosMailboxManifest::get_oid(mailbox_guid)));
+  EXPECT_FALSE(librmb::RadosMailboxManifest::is_manifest_oid("oid_1"));
+
+  storage.delete_mail(librmb::RadosMailboxManifest::get_oid(mailbox_guid));
+  // tear down
+  cluster.deinit();
+}
+
+TEST(librmb, index_snapshot) {
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+  EXPECT_EQ(0, storage.open_connection("test"));
+  storage.set_namespace("t");
+  std::string mailbox_guid = "2ef5d8b9c3d4e5f6a7b8c9d0e1f2a3b4";
+  std::map<std::string, librados::bufferlist> files;
+  time_t save_time;
+
+  EXPECT_EQ(-ENOENT, librmb::RadosIndexSnapshot::load(&storage.get_io_ctx(), mailbox_guid, &files));
+  EXPECT_EQ(-ENOENT, librmb::RadosIndexSnapshot::stat(&storage.get_io_ctx(), mailbox_guid, &save_time));
+
+  files["dovecot.index"].append("index");
+  files["dovecot.index.log"].append("log data");
+  files["dovecot.index.cache"].append("");
+  EXPECT_EQ(0, librmb::RadosIndexSnapshot::save(&storage.get_io_ctx(), mailbox_guid, files));
+  EXPECT_EQ(0, librmb::RadosIndexSnapshot::stat(&storage.get_io_ctx(), mailbox_guid, &save_time));
+
+  std::map<std::string, librados::bufferlist> loaded;
+  EXPECT_EQ(0, librmb::RadosIndexSnapshot::load(&storage.get_io_ctx(), mailbox_guid, &loaded));
+  EXPECT_EQ(3, (int)loaded.size());
+  EXPECT_EQ("index", loaded["dovecot.index"].to_str());
+  EXPECT_EQ("log data", loaded["dovecot.index.log"].to_str());
+  EXPECT_EQ(0, (int)loaded["dovecot.index.cache"].length());
+
+  // a newer snapshot replaces the old one
+  files.erase("dovecot.index.cache");
+  files["dovecot.index.log"].append(" appended");
+  EXPECT_EQ(0, librmb::RadosIndexSnapshot::save(&storage.get_io_ctx(), mailbox_guid, files));
+  loaded.clear();
+  EXPECT_EQ(0, librmb::RadosIndexSnapshot::load(&storage.get_io_ctx(), mailbox_guid, &loaded));
+  EXPECT_EQ(2, (int)loaded.size());
+  EXPECT_EQ("log data appended", loaded["dovecot.index.log"].to_str());
+
+  // unknown format versions are not restored
+  librados::bufferlist version;
+  version.append("0");
+  storage.get_io_ctx().setxattr(librmb::RadosIndexSnapshot::get_oid(mailbox_guid), "V", version);
+  EXPECT_EQ(-EINVAL, librmb::RadosIndexSnapshot::load(&storage.get_io_ctx(), mailbox_guid, &loaded));
+
+  EXPECT_TRUE(librmb::RadosIndexSnapshot::is_snapshot_oid(librmb::RadosIndexSnapshot::get_oid(mailbox_guid)));
+  EXPECT_EQ(0, librmb::RadosIndexSnapshot::remove(&storage.get_io_ctx(), mailbox_guid));
+  EXPECT_EQ(-ENOENT, librmb::RadosIndexSnapshot::stat(&storage.get_io_ctx(), mailbox_guid, &save_time));
+  // tear down
+  cluster.deinit();
+}
+
+TEST(librmb, mailbox_list) {
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+  EXPECT_EQ(0, storage.open_connection("test"));
+  storage.set_namespace("t");
+  librados::IoCtx *io_ctx = &storage.get_io_ctx();
+  std::map<std::string, std::string> mailboxes;
+  std::set<std::string> subscriptions;
+  bool exists;
+
+  // no list, updates are not applied
+  EXPECT_EQ(-ENOENT, librmb::RadosMailboxList::load(io_ctx, &mailboxes, &subscriptions));
+  EXPECT_EQ(-ENOENT, librmb::RadosMailboxList::add_mailbox(io_ctx, "INBOX", "guid_inbox"));
+  EXPECT_EQ(-ENOENT, librmb::RadosMailboxList::lookup(io_ctx, "INBOX", &exists, nullptr));
+
+  mailboxes["INBOX"] = "guid_inbox";
+  mailboxes["imported"] = "";
+  subscriptions.insert("INBOX");
+  EXPECT_EQ(0, librmb::RadosMailboxList::save(io_ctx, mailboxes, subscriptions));
+  // the list is imported once
+  EXPECT_EQ(-EEXIST, librmb::RadosMailboxList::save(io_ctx, mailboxes, subscriptions));
+  EXPECT_EQ(0, librmb::RadosMailboxList::add_mailbox(io_ctx, "a", "guid_a"));
+  // an existing mailbox is not replaced, an imported one without guid gets one
+  EXPECT_EQ(-EEXIST, librmb::RadosMailboxList::add_mailbox(io_ctx, "a", "guid_other"));
+  std::string guid;
+  EXPECT_EQ(0, librmb::RadosMailboxList::lookup(io_ctx, "imported", &exists, &guid));
+  EXPECT_TRUE(exists);
+  EXPECT_EQ("", guid);
+  EXPECT_EQ(0, librmb::RadosMailboxList::add_mailbox(io_ctx, "imported", "guid_imported"));
+  EXPECT_EQ(0, librmb::RadosMailboxList::lookup(io_ctx, "imported", &exists, &guid));
+  EXPECT_EQ("guid_imported", guid);
+  EXPECT_EQ(0, librmb::RadosMailboxList::remove_mailbox(io_ctx, "imported"));
+  EXPECT_EQ(0, librmb::RadosMailboxList::add_mailbox(io_ctx, "a.b", "guid_b"));
+  EXPECT_EQ(0, librmb::RadosMailboxList::add_mailbox(io_ctx, "ab", "guid_ab"));
+  EXPECT_EQ(0, librmb::RadosMailboxList::set_subscribed(io_ctx, "a", true));
+
+  EXPECT_EQ(0, librmb::RadosMailboxList::lookup(io_ctx, "a.b", &exists, &guid));
+  EXPECT_TRUE(exists);
+  EXPECT_EQ("guid_b", guid);
+  EXPECT_EQ(0, librmb::RadosMailboxList::lookup(io_ctx, "c", &exists, &guid));
+  EXPECT_FALSE(exists);
+
+  // children are renamed with their parent, similar names are not
+  EXPECT_EQ(-EEXIST, librmb::RadosMailboxList::rename_mailbox(io_ctx, "a", "ab", '.'));
+  EXPECT_EQ(-ENOENT, librmb::RadosMailboxList::rename_mailbox(io_ctx, "c", "d", '.'));
+  EXPECT_EQ(0, librmb::RadosMailboxList::rename_mailbox(io_ctx, "a", "c", '.'));
+  mailboxes.clear();
+  subscriptions.clear();
+  EXPECT_EQ(0, librmb::RadosMailboxList::load(io_ctx, &mailboxes, &subscriptions));
+  EXPECT_EQ(4, (int)mailboxes.size());
+  EXPECT_EQ("guid_a", mailboxes["c"]);
+  EXPECT_EQ("guid_b", mailboxes["c.b"]);
+  EXPECT_EQ("guid_ab", mailboxes["ab"]);
+  EXPECT_TRUE(mailboxes.find("a") == mailboxes.end());
+  // subscriptions are independent of the mailboxes
+  EXPECT_EQ(2, (int)subscriptions.size());
+  EXPECT_TRUE(subscriptions.find("a") != subscriptions.end());
+
+  EXPECT_EQ(0, librmb::RadosMailboxList::remove_mailbox(io_ctx, "c.b"));
+  EXPECT_EQ(0, librmb::RadosMailboxList::set_subscribed(io_ctx, "a", false));
+  mailboxes.clear();
+  subscriptions.clear();
+  EXPECT_EQ(0, librmb::RadosMailboxList::load(io_ctx, &mailboxes, &subscriptions));
+  EXPECT_EQ(3, (int)mailboxes.size());
+  EXPECT_EQ(1, (int)subscriptions.size());
+
+  storage.delete_mail(librmb::RadosMailboxList::OID);
+  // tear down
+  cluster.deinit();
+}
+
+TEST(librmb, rmb_convert_metadata) {
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+  EXPECT_EQ(0, storage.open_connection("rmb_tool_tests"));
+  storage.set_namespace("t_convert");
+  librmb::RadosCephConfig ceph_cfg(&storage.get_io_ctx());
+  librmb::RadosDovecotCephCfgImpl cfg(&storage.get_io_ctx());
+  librmb::RadosMetadataStorageIma ima(&storage.get_io_ctx(), &cfg);
+  librmb::RadosMetadataStorageDefault def(&storage.get_io_ctx());
+  librmb::RadosMetadataStorageBin bin(&storage.get_io_ctx(), &cfg);
+
+  librmb::RadosMailObject obj_ima;
+  obj_ima.set_oid("convert_ima");
+  librmb::RadosMailObject obj_default;
+  obj_default.set_oid("convert_default");
+  librmb::RadosMailObject *objects[] = {&obj_ima, &obj_default};
+  for (int i = 0; i < 2; i++) {
+    objects[i]->get_mail_buffer()->append("abcdefghijklmn");
+    objects[i]->set_mail_size(objects[i]->get_mail_buffer()->length());
+    librmb::RadosMetadata guid(librmb::RBOX_METADATA_GUID, "0123456789abcdef");
+    librmb::RadosMetadata recv_time(librmb::RBOX_METADATA_RECEIVED_TIME, 12345677L);
+    objects[i]->add_metadata(guid);
+    objects[i]->add_metadata(recv_time);
+    librados::ObjectWriteOperation *op = new librados::ObjectWriteOperation();
+    if (i == 0) {
+      ima.save_metadata(op, objects[i]);
+    } else {
+      def.save_metadata(op, objects[i]);
+    }
+    EXPECT_EQ(0, storage.split_buffer_and_exec_op(objects[i], op, 1024));
+    storage.wait_for_write_operations_complete(objects[i]->get_completion_group());
+  }
+
+  std::map<std::string, std::string> opts;
+  opts["namespace"] = "t_convert";
+  librmb::RmbCommands rmb_commands(&storage, &cluster, &opts);
+  EXPECT_EQ(0, rmb_commands.convert_metadata(ceph_cfg, "-"));
+  // converted already
+  EXPECT_EQ(0, bin.convert_metadata("convert_ima"));
+  EXPECT_EQ(-1, rmb_commands.convert_metadata(ceph_cfg, "convert_missing"));
+
+  for (int i = 0; i < 2; i++) {
+    // only the record is left, ima doesn't read it
+    std::map<std::string, ceph::bufferlist> attr;
+    EXPECT_EQ(0, storage.get_io_ctx().getxattrs(objects[i]->get_oid(), attr));
+    EXPECT_EQ(1u, attr.size());
+    EXPECT_TRUE(attr.find(librmb::RadosMetadataStorageBin::RECORD_ATTRIBUTE) != attr.end());
+
+    librmb::RadosMailObject loaded;
+    loaded.set_oid(objects[i]->get_oid());
+    EXPECT_EQ(0, bin.load_metadata(&loaded));
+    EXPECT_EQ("0123456789abcdef", loaded.get_metadata(librmb::RBOX_METADATA_GUID));
+    EXPECT_EQ("12345677", loaded.get_metadata(librmb::RBOX_METADATA_RECEIVED_TIME));
+    storage.delete_mail(objects[i]);
+  }
+  // tear down
+  cluster.deinit();
+}
+
 TEST(librmb, mock_obj) {}
 int main(int argc, char **argv) {
   ::testing::InitGoogleMock(&argc, argv);
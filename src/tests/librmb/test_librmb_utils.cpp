@@ -9,11 +9,26 @@
  * Foundation.  See file COPYING.
  */
 
+#include <errno.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <new>
 #include <ctime>
+#include <list>
+#include <map>
+#include <set>
+#include <vector>
 #include <rados/librados.hpp>
 
 #include "../../librmb/rados-cluster-impl.h"
 #include "../../librmb/rados-ceph-json-config.h"
+#include "../../librmb/rados-notifier-local.h"
+#include "../../librmb/rados-metadata-cache.h"
+#include "../../librmb/rados-metadata-storage-bin.h"
+#include "../../librmb/rados-metadata-storage-default.h"
+#include "../../librmb/rados-metadata-storage-ima.h"
 #include "../../librmb/rados-storage-impl.h"
 #include "mock_test.h"
 #include "gtest/gtest.h"
@@ -21,9 +36,27 @@
 #include "rados-util.h"
 #include "rados-types.h"
 
+using ::testing::_;
 using ::testing::AtLeast;
 using ::testing::Return;
 
+// heap allocations while count_allocations is set, to measure the mail object pool
+static std::atomic<bool> count_allocations(false);
+static std::atomic<uint64_t> allocations(0);
+
+void *operator new(size_t size) {
+  if (count_allocations) {
+    allocations++;
+  }
+  void *p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
 TEST(librmb, utils_convert_str_to_time) {
   time_t test_time;
   // %Y-%m-%d %H:%M:%S
@@ -124,6 +157,426 @@ TEST(librmb, find_and_replace) {
   EXPECT_EQ(str_hello, text);
 }
 
+TEST(librmb, notifier_local) {
+  librmb::RadosNotifierLocal notifier;
+  std::string oid = librmb::RadosNotifier::get_oid("abc");
+  EXPECT_EQ("notify.abc", oid);
+
+  int calls_1 = 0;
+  int calls_2 = 0;
+  uint64_t handle_1, handle_2, handle_3;
+  EXPECT_EQ(0, notifier.watch(oid, [&calls_1]() { calls_1++; }, &handle_1));
+  EXPECT_EQ(0, notifier.watch(oid, [&calls_2]() { calls_2++; }, &handle_2));
+  EXPECT_EQ(0, notifier.watch("notify.other", [&calls_2]() { calls_2 += 10; }, &handle_3));
+  EXPECT_NE(handle_1, handle_2);
+
+  EXPECT_EQ(0, notifier.notify(oid));
+  EXPECT_EQ(1, calls_1);
+  EXPECT_EQ(1, calls_2);
+
+  EXPECT_EQ(0, notifier.check(handle_1));
+  EXPECT_EQ(0, notifier.unwatch(handle_1));
+  EXPECT_EQ(-ENOENT, notifier.unwatch(handle_1));
+  EXPECT_EQ(-ENOENT, notifier.check(handle_1));
+  EXPECT_EQ(0, notifier.notify(oid));
+  EXPECT_EQ(1, calls_1);
+  EXPECT_EQ(2, calls_2);
+
+  EXPECT_EQ(0, notifier.unwatch(handle_2));
+  EXPECT_EQ(0, notifier.unwatch(handle_3));
+}
+
+class RadosMetadataCacheTest : public librmb::RadosMetadataCache {
+ public:
+  RadosMetadataCacheTest(size_t max_entries_, time_t ttl_) : RadosMetadataCache(max_entries_, ttl_), clock(1000) {}
+  time_t clock;
+
+ protected:
+  time_t now() { return clock; }
+};
+
+TEST(librmb, metadata_cache) {
+  librmb::RadosMetadataCache cache(2);
+  librmb::RadosMailObject mail;
+  librmb::RadosMetadata received(librmb::RBOX_METADATA_RECEIVED_TIME, "1234");
+  mail.add_metadata(received);
+
+  librmb::RadosMailObject loaded;
+  EXPECT_FALSE(cache.load("pool", "ns", "oid1", &loaded));
+  cache.store("pool", "ns", "oid1", &mail);
+  cache.store("pool", "ns", "oid2", &mail);
+  EXPECT_TRUE(cache.load("pool", "ns", "oid1", &loaded));
+  EXPECT_EQ("1234", loaded.get_metadata(librmb::RBOX_METADATA_RECEIVED_TIME));
+  EXPECT_FALSE(cache.load("pool", "other_ns", "oid1", &loaded));
+  // the same oid in the alt pool is another object
+  EXPECT_FALSE(cache.load("alt_pool", "ns", "oid1", &loaded));
+
+  // oid2 is the least recently used one
+  cache.store("pool", "ns", "oid3", &mail);
+  EXPECT_EQ(2u, cache.size());
+  EXPECT_FALSE(cache.load("pool", "ns", "oid2", &loaded));
+  EXPECT_TRUE(cache.load("pool", "ns", "oid1", &loaded));
+
+  cache.invalidate("pool", "ns", "oid1");
+  EXPECT_FALSE(cache.load("pool", "ns", "oid1", &loaded));
+  cache.set_max_entries(0);
+  EXPECT_EQ(0u, cache.size());
+  cache.store("pool", "ns", "oid1", &mail);
+  EXPECT_FALSE(cache.load("pool", "ns", "oid1", &loaded));
+}
+
+TEST(librmb, metadata_cache_ttl) {
+  RadosMetadataCacheTest cache(10, 30);
+  librmb::RadosMailObject mail;
+  librmb::RadosMetadata received(librmb::RBOX_METADATA_RECEIVED_TIME, "1234");
+  mail.add_metadata(received);
+  librmb::RadosMailObject loaded;
+
+  cache.store("pool", "ns", "oid1", &mail);
+  cache.clock += 29;
+  EXPECT_TRUE(cache.contains("pool", "ns", "oid1"));
+  EXPECT_TRUE(cache.load("pool", "ns", "oid1", &loaded));
+  // a load doesn't extend the lifetime, changes of other processes show up after ttl seconds
+  cache.clock += 1;
+  EXPECT_FALSE(cache.contains("pool", "ns", "oid1"));
+  EXPECT_FALSE(cache.load("pool", "ns", "oid1", &loaded));
+  EXPECT_EQ(0u, cache.size());
+
+  // storing again starts a new lifetime
+  cache.store("pool", "ns", "oid1", &mail);
+  cache.clock += 10;
+  EXPECT_TRUE(cache.load("pool", "ns", "oid1", &loaded));
+
+  cache.set_ttl(0);
+  cache.clock += 1000;
+  EXPECT_TRUE(cache.load("pool", "ns", "oid1", &loaded));
+  cache.clear();
+  EXPECT_FALSE(cache.load("pool", "ns", "oid1", &loaded));
+}
+
+TEST(librmb, metadata_storage_bin_record) {
+  std::map<std::string, ceph::bufferlist> metadata;
+  metadata[std::string(1, static_cast<char>(librmb::RBOX_METADATA_RECEIVED_TIME))].append("1234");
+  metadata[std::string(1, static_cast<char>(librmb::RBOX_METADATA_MAILBOX_GUID))].append("0123456789abcdef");
+  // leading zero, kept as string
+  metadata[std::string(1, static_cast<char>(librmb::RBOX_METADATA_MAIL_UID))].append("0042");
+  std::map<std::string, ceph::bufferlist> keywords;
+  keywords["1"].append("$Forwarded");
+
+  ceph::bufferlist bl;
+  librmb::RadosMetadataStorageBin::encode_record(metadata, keywords, &bl);
+  EXPECT_TRUE(librmb::RadosMetadataStorageBin::is_record(bl));
+
+  librmb::RadosMailObject mail;
+  EXPECT_EQ(0, librmb::RadosMetadataStorageBin::decode_record(bl, &mail));
+  EXPECT_EQ("1234", mail.get_metadata(librmb::RBOX_METADATA_RECEIVED_TIME));
+  EXPECT_EQ("0123456789abcdef", mail.get_metadata(librmb::RBOX_METADATA_MAILBOX_GUID));
+  EXPECT_EQ("0042", mail.get_metadata(librmb::RBOX_METADATA_MAIL_UID));
+  EXPECT_EQ("$Forwarded", (*mail.get_extended_metadata())["1"].to_str());
+
+  ceph::bufferlist json;
+  json.append("{\"R\":\"1234\"}");
+  EXPECT_FALSE(librmb::RadosMetadataStorageBin::is_record(json));
+  EXPECT_EQ(-EINVAL, librmb::RadosMetadataStorageBin::decode_record(json, &mail));
+
+  ceph::bufferlist truncated;
+  truncated.append(bl.c_str(), bl.length() - 1);
+  librmb::RadosMailObject mail2;
+  EXPECT_EQ(-EINVAL, librmb::RadosMetadataStorageBin::decode_record(truncated, &mail2));
+}
+
+TEST(librmb, metadata_prepare_update) {
+  std::list<librmb::RadosMetadata> to_update;
+  to_update.push_back(librmb::RadosMetadata(librmb::RBOX_METADATA_OLDV1_FLAGS, "0x1"));
+  std::map<std::string, ceph::bufferlist> set_keywords;
+  set_keywords["1"].append("$Forwarded");
+  std::set<std::string> remove_keywords;
+  remove_keywords.insert("2");
+
+  librmb::RadosMetadataStorageDefault def(nullptr);
+  librados::ObjectWriteOperation op;
+  EXPECT_EQ(0, def.prepare_update_metadata(&op, to_update, set_keywords, remove_keywords));
+  EXPECT_EQ(3u, op.size());
+
+  librmbtest::RadosDovecotCephCfgMock cfg;
+  EXPECT_CALL(cfg, is_update_attributes()).WillRepeatedly(Return(true));
+  EXPECT_CALL(cfg, is_updateable_attribute(_)).WillRepeatedly(Return(true));
+  librmb::RadosMetadataStorageIma ima(nullptr, &cfg);
+  librados::ObjectWriteOperation ima_op;
+  EXPECT_EQ(0, ima.prepare_update_metadata(&ima_op, to_update, set_keywords, remove_keywords));
+  EXPECT_EQ(3u, ima_op.size());
+
+  // immutable, part of the json or the binary record
+  librmbtest::RadosDovecotCephCfgMock immutable_cfg;
+  EXPECT_CALL(immutable_cfg, is_update_attributes()).WillRepeatedly(Return(true));
+  EXPECT_CALL(immutable_cfg, is_updateable_attribute(_)).WillRepeatedly(Return(false));
+  librmb::RadosMetadataStorageIma immutable_ima(nullptr, &immutable_cfg);
+  librados::ObjectWriteOperation immutable_op;
+  EXPECT_EQ(-EINVAL, immutable_ima.prepare_update_metadata(&immutable_op, to_update, set_keywords, remove_keywords));
+  librmb::RadosMetadataStorageBin immutable_bin(nullptr, &immutable_cfg);
+  std::list<librmb::RadosMetadata> no_attributes;
+  EXPECT_EQ(-EINVAL,
+            immutable_bin.prepare_update_metadata(&immutable_op, no_attributes, set_keywords, remove_keywords));
+  std::map<std::string, ceph::bufferlist> no_keywords;
+  std::set<std::string> no_removed;
+  EXPECT_EQ(0, immutable_bin.prepare_update_metadata(&immutable_op, no_attributes, no_keywords, no_removed));
+}
+
+TEST(librmb, metadata_index) {
+  for (int i = 0; i < librmb::RBOX_METADATA_KEY_COUNT; i++) {
+    EXPECT_EQ(i, librmb::rbox_metadata_index(static_cast<char>(librmb::RBOX_METADATA_KEYS[i])));
+  }
+  int keys = 0;
+  for (int c = 0; c < 256; c++) {
+    keys += librmb::rbox_metadata_index(static_cast<char>(c)) >= 0 ? 1 : 0;
+  }
+  EXPECT_EQ(librmb::RBOX_METADATA_KEY_COUNT, keys);
+  EXPECT_EQ(-1, librmb::rbox_metadata_index('x'));
+  EXPECT_EQ(-1, librmb::rbox_metadata_index(static_cast<char>(0xff)));
+  EXPECT_EQ(0u, librmb::rbox_metadata_bit('x'));
+}
+
+TEST(librmb, mail_object_metadata_table) {
+  librmb::RadosMailObject mail;
+  EXPECT_FALSE(mail.has_metadata());
+  librmb::RadosMetadata uid(librmb::RBOX_METADATA_MAIL_UID, "42");
+  mail.add_metadata(uid);
+  librmb::RadosMetadata guid(librmb::RBOX_METADATA_GUID, "abc");
+  mail.add_metadata(guid);
+  EXPECT_TRUE(mail.has_metadata());
+
+  uint64_t value = 0;
+  EXPECT_TRUE(mail.get_metadata(librmb::RBOX_METADATA_MAIL_UID, &value));
+  EXPECT_EQ(42u, value);
+  EXPECT_EQ("42", mail.get_metadata("U"));
+  // no numeric key
+  EXPECT_FALSE(mail.get_metadata(librmb::RBOX_METADATA_GUID, &value));
+  EXPECT_FALSE(mail.get_metadata(librmb::RBOX_METADATA_RECEIVED_TIME, &value));
+
+  // added after the table was built
+  librmb::RadosMetadata uid2(librmb::RBOX_METADATA_MAIL_UID, "43");
+  mail.add_metadata(uid2);
+  EXPECT_TRUE(mail.get_metadata(librmb::RBOX_METADATA_MAIL_UID, &value));
+  EXPECT_EQ(43u, value);
+
+  // replaced by attributes read by librados
+  std::map<std::string, ceph::bufferlist> loaded;
+  loaded["U"].append("x");
+  loaded["G"].append("def");
+  mail.swap_metadata(&loaded);
+  EXPECT_EQ(2u, loaded.size());
+  EXPECT_FALSE(mail.get_metadata(librmb::RBOX_METADATA_MAIL_UID, &value));
+  EXPECT_EQ("def", mail.get_metadata(librmb::RBOX_METADATA_GUID));
+  // the table points into the new map, not into the swapped out one
+  loaded.clear();
+  EXPECT_EQ("x", mail.get_metadata("U"));
+
+  // a pending read fills the load buffer only
+  (*mail.get_metadata_load_buffer())["U"].append("44");
+  EXPECT_EQ("x", mail.get_metadata("U"));
+  mail.swap_metadata(mail.get_metadata_load_buffer());
+  EXPECT_TRUE(mail.get_metadata(librmb::RBOX_METADATA_MAIL_UID, &value));
+  EXPECT_EQ(44u, value);
+
+  mail.clear_metadata();
+  EXPECT_FALSE(mail.has_metadata());
+  EXPECT_EQ("", mail.get_metadata(librmb::RBOX_METADATA_GUID));
+}
+
+TEST(librmb, json_config_attribute_masks) {
+  librmb::RadosCephJsonConfig config;
+  EXPECT_TRUE(config.is_mail_attribute(librmb::RBOX_METADATA_GUID));
+  EXPECT_FALSE(config.is_mail_attribute(librmb::RBOX_METADATA_OLDV1_KEYWORDS));
+  EXPECT_TRUE(config.is_updateable_attribute(librmb::RBOX_METADATA_ORIG_MAILBOX));
+
+  config.update_mail_attribute("KF");
+  EXPECT_FALSE(config.is_mail_attribute(librmb::RBOX_METADATA_GUID));
+  EXPECT_TRUE(config.is_mail_attribute(librmb::RBOX_METADATA_OLDV1_KEYWORDS));
+  EXPECT_TRUE(config.is_mail_attribute(librmb::RBOX_METADATA_OLDV1_FLAGS));
+  config.set_updateable_attributes("");
+  EXPECT_FALSE(config.is_updateable_attribute(librmb::RBOX_METADATA_ORIG_MAILBOX));
+}
+
+TEST(librmb, mail_object_reuse) {
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+
+  librmb::RadosMailObject *mail = storage.alloc_mail_object();
+  const uint8_t oid[GUID_128_SIZE] = {0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef,
+                                      0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0xff};
+  mail->set_oid(oid);
+  EXPECT_EQ("0123456789abcdef00112233445566ff", mail->get_oid());
+  librmb::RadosMetadata uid(librmb::RBOX_METADATA_MAIL_UID, "1");
+  mail->add_metadata(uid);
+  mail->set_mail_size(10);
+  librmb::RadosCompletionGroup group;
+  mail->set_completion_group(&group);
+  storage.free_mail_object(mail);
+
+  librmb::RadosMailObject *reused = storage.alloc_mail_object();
+  EXPECT_EQ(mail, reused);
+  EXPECT_EQ("", reused->get_oid());
+  EXPECT_FALSE(reused->has_metadata());
+  EXPECT_EQ(static_cast<uint64_t>(-1), reused->get_mail_size());
+  EXPECT_NE(&group, reused->get_completion_group());
+  storage.free_mail_object(reused);
+}
+
+/* a mail of a cursor: object, oid and the loaded uid */
+static void use_mail_object(librmb::RadosMailObject *mail, const uint8_t *oid, librmb::RadosMetadata *uid) {
+  mail->set_oid(oid);
+  (void)mail->get_oid();
+  mail->add_metadata(*uid);
+}
+
+TEST(librmb, mail_object_pool_allocations) {
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+  const uint8_t oid[GUID_128_SIZE] = {0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef,
+                                      0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0xff};
+  librmb::RadosMetadata uid(librmb::RBOX_METADATA_MAIL_UID, "1");
+  const int mails = 1000;
+
+  // warm up the pool
+  storage.free_mail_object(storage.alloc_mail_object());
+
+  allocations = 0;
+  count_allocations = true;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i = 0; i < mails; i++) {
+    librmb::RadosMailObject *mail = new librmb::RadosMailObject();
+    use_mail_object(mail, oid, &uid);
+    delete mail;
+  }
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  count_allocations = false;
+  uint64_t unpooled = allocations;
+  std::cout << "new/delete: " << unpooled << " allocations, "
+            << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << " us" << std::endl;
+
+  allocations = 0;
+  count_allocations = true;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < mails; i++) {
+    librmb::RadosMailObject *mail = storage.alloc_mail_object();
+    use_mail_object(mail, oid, &uid);
+    storage.free_mail_object(mail);
+  }
+  end = std::chrono::steady_clock::now();
+  count_allocations = false;
+  uint64_t pooled = allocations;
+  std::cout << "pool: " << pooled << " allocations, "
+            << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << " us" << std::endl;
+
+  // at least the object and the oid are not allocated again
+  EXPECT_LE(pooled + 2 * mails, unpooled);
+}
+
+/* chunk writes without a cluster, the results of the writes are scripted per offset */
+class RadosStorageChunkTest : public librmb::RadosStorageImpl {
+ public:
+  RadosStorageChunkTest() : librmb::RadosStorageImpl(nullptr) {}
+  using librmb::RadosStorageImpl::adapt_write_chunk_size;
+  using librmb::RadosStorageImpl::write_chunks;
+  using librmb::RadosStorageImpl::write_chunk_size;
+
+  // offset => results of the attempts, missing attempts succeed
+  std::map<uint64_t, std::vector<int>> results;
+  // offsets in submission order
+  std::vector<uint64_t> submitted;
+
+ protected:
+  int aio_write_chunk(const std::string &oid, librmb::ChunkWrite *chunk) {
+    chunk->attempts++;
+    chunk->start = std::chrono::steady_clock::now();
+    submitted.push_back(chunk->offset);
+    return 0;
+  }
+  int wait_write_chunk(librmb::ChunkWrite *chunk) {
+    std::vector<int> &r = results[chunk->offset];
+    return static_cast<size_t>(chunk->attempts) <= r.size() ? r[chunk->attempts - 1] : 0;
+  }
+};
+
+TEST(librmb, adapt_write_chunk_size) {
+  RadosStorageChunkTest storage;
+  const uint64_t mb = 1024 * 1024;
+  storage.write_chunk_size = 4 * mb;
+
+  // slow writes halve the chunk size down to 1 MB
+  storage.adapt_write_chunk_size(4 * mb, 1000);
+  EXPECT_EQ(2 * mb, storage.write_chunk_size);
+  storage.adapt_write_chunk_size(2 * mb, 1000);
+  storage.adapt_write_chunk_size(1 * mb, 1000);
+  EXPECT_EQ(1 * mb, storage.write_chunk_size);
+  // latencies in between and the last, partial chunk of a mail keep it
+  storage.adapt_write_chunk_size(1 * mb, 300);
+  storage.adapt_write_chunk_size(mb / 2, 10);
+  EXPECT_EQ(1 * mb, storage.write_chunk_size);
+  // fast writes double it up to the max. write size (10 MB)
+  storage.adapt_write_chunk_size(1 * mb, 10);
+  EXPECT_EQ(2 * mb, storage.write_chunk_size);
+  storage.adapt_write_chunk_size(2 * mb, 10);
+  storage.adapt_write_chunk_size(4 * mb, 10);
+  storage.adapt_write_chunk_size(8 * mb, 10);
+  EXPECT_EQ(static_cast<uint64_t>(storage.get_max_write_size_bytes()), storage.write_chunk_size);
+}
+
+TEST(librmb, write_chunks_retry) {
+  librmb::RadosMailObject mail;
+  mail.set_oid("oid");
+  mail.get_mail_buffer()->append("0123456789");
+
+  // the failed chunk is retried behind the others
+  {
+    RadosStorageChunkTest storage;
+    storage.set_write_window(4);
+    storage.write_chunk_size = 3;
+    storage.results[3] = {-ETIMEDOUT};
+    EXPECT_EQ(0, storage.write_chunks(&mail, 0, 10));
+    EXPECT_EQ((std::vector<uint64_t>{0, 3, 6, 9, 3}), storage.submitted);
+  }
+  // permanent errors are not retried
+  {
+    RadosStorageChunkTest storage;
+    storage.set_write_window(4);
+    storage.write_chunk_size = 3;
+    storage.results[3] = {-ENOSPC};
+    EXPECT_EQ(-ENOSPC, storage.write_chunks(&mail, 0, 10));
+    EXPECT_EQ((std::vector<uint64_t>{0, 3, 6, 9}), storage.submitted);
+  }
+  // a chunk is written 3 times at most
+  {
+    RadosStorageChunkTest storage;
+    storage.set_write_window(4);
+    storage.write_chunk_size = 3;
+    storage.results[6] = {-ETIMEDOUT, -ETIMEDOUT, -ETIMEDOUT};
+    EXPECT_EQ(-ETIMEDOUT, storage.write_chunks(&mail, 0, 10));
+    EXPECT_EQ((std::vector<uint64_t>{0, 3, 6, 9, 6, 6}), storage.submitted);
+  }
+  // a mail has 4 retries, whatever the number of chunks in flight
+  {
+    RadosStorageChunkTest storage;
+    storage.set_write_window(8);
+    storage.write_chunk_size = 3;
+    storage.results[0] = {-ETIMEDOUT, -ETIMEDOUT};
+    storage.results[3] = {-ETIMEDOUT, -ETIMEDOUT};
+    storage.results[6] = {-ETIMEDOUT};
+    EXPECT_EQ(-ETIMEDOUT, storage.write_chunks(&mail, 0, 9));
+    EXPECT_EQ((std::vector<uint64_t>{0, 3, 6, 0, 3, 6, 0}), storage.submitted);
+  }
+  {
+    RadosStorageChunkTest storage;
+    storage.set_write_window(1);
+    storage.write_chunk_size = 3;
+    storage.results[0] = {-ETIMEDOUT};
+    storage.results[3] = {-ETIMEDOUT};
+    EXPECT_EQ(0, storage.write_chunks(&mail, 0, 10));
+    // the chunk size doubled after the first fast write
+    EXPECT_EQ((std::vector<uint64_t>{0, 0, 3, 3, 9}), storage.submitted);
+  }
+}
+
 TEST(librmb, mock_obj) {}
 int main(int argc, char **argv) {
   ::testing::InitGoogleMock(&argc, argv);
@@ -14,6 +14,7 @@
 
 #include "../../librmb/rados-cluster.h"
 #include "../../librmb/rados-dictionary.h"
+#include "../../librmb/rados-notifier.h"
 #include "../../librmb/rados-dovecot-config.h"
 #include "../../librmb/rados-storage.h"
 #include "../../librmb/rados-dovecot-ceph-cfg.h"
@@ -34,6 +35,7 @@ class RadosStorageMock : public RadosStorage {
   MOCK_METHOD3(stat_mail, int(const std::string &oid, uint64_t *psize, time_t *pmtime));
   MOCK_METHOD1(set_namespace, void(const std::string &nspace));
   MOCK_METHOD0(get_namespace, std::string());
+  MOCK_METHOD0(get_pool_name, std::string());
   MOCK_METHOD0(get_max_write_size, int());
   MOCK_METHOD0(get_max_write_size_bytes, int());
 
@@ -41,25 +43,43 @@ class RadosStorageMock : public RadosStorage {
                int(RadosMailObject *current_object, librados::ObjectWriteOperation *write_op_xattr,
                    const uint64_t &max_write));
 
+  MOCK_METHOD2(save_mail_chunk, int(RadosMailObject *mail, librados::bufferlist &chunk));
+  MOCK_METHOD1(set_write_window, void(const int &max_ops));
+
   MOCK_METHOD1(delete_mail, int(RadosMailObject *mail));
   MOCK_METHOD1(delete_mail, int(const std::string &oid));
+  MOCK_METHOD3(delete_mails,
+               int(const std::vector<std::string> &oids, const int &max_in_flight, std::vector<int> *results));
   MOCK_METHOD4(aio_operate, int(librados::IoCtx *io_ctx_, const std::string &oid, librados::AioCompletion *c,
                                 librados::ObjectWriteOperation *op));
+  MOCK_METHOD4(aio_copy_from, int(RadosStorage *src, const std::string &oid, librados::AioCompletion *c,
+                                  librados::ObjectWriteOperation *op));
   MOCK_METHOD1(find_mails, librados::NObjectIterator(const RadosMetadata *attr));
   MOCK_METHOD1(open_connection, int(const std::string &poolname));
   MOCK_METHOD3(open_connection,
                int(const std::string &poolname, const std::string &clustername, const std::string &rados_username));
   MOCK_METHOD0(close_connection, void());
-  MOCK_METHOD1(wait_for_write_operations_complete,
-               bool(std::map<librados::AioCompletion *, librados::ObjectWriteOperation *> *completion_op_map));
+  MOCK_METHOD1(wait_for_write_operations_complete, bool(librmb::RadosCompletionGroup *completion_group));
   MOCK_METHOD1(wait_for_rados_operations, bool(const std::vector<librmb::RadosMailObject *> &object_list));
 
   MOCK_METHOD2(read_mail, int(const std::string &oid, librados::bufferlist *buffer));
+  MOCK_METHOD3(read_mail, int(const std::string &oid, const uint64_t &size, librados::bufferlist *buffer));
+  MOCK_METHOD4(read_mail_object, int(RadosMailObject *mail, RadosStorageMetadataModule *metadata,
+                                     const bool &read_data, const uint64_t &size));
+  MOCK_METHOD3(load_metadata, int(const std::vector<RadosMailObject *> &mails, RadosStorageMetadataModule *metadata,
+                                  std::vector<int> *results));
+  MOCK_METHOD5(aio_read, int(const std::string &oid, librados::AioCompletion *c, librados::bufferlist *buffer,
+                             const uint64_t &len, const uint64_t &off));
   MOCK_METHOD6(move, bool(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
                           std::list<RadosMetadata> &to_update, bool delete_source));
 
   MOCK_METHOD5(copy, bool(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
                           std::list<RadosMetadata> &to_update));
+  MOCK_METHOD6(aio_move, int(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
+                             std::list<RadosMetadata> &to_update, RadosCompletionGroup *completion_group));
+  MOCK_METHOD6(aio_copy, int(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
+                             std::list<RadosMetadata> &to_update, RadosCompletionGroup *completion_group));
+  MOCK_METHOD3(aio_delete_mail, int(const std::string &oid, const char *ns, RadosCompletionGroup *completion_group));
   MOCK_METHOD2(save_mail, int(const std::string &oid, librados::bufferlist &bufferlist));
   MOCK_METHOD2(save_mail, bool(RadosMailObject *mail, bool &save_async));
   MOCK_METHOD3(save_mail, bool(librados::ObjectWriteOperation *write_op, RadosMailObject *mail, bool save_async));
@@ -72,8 +92,14 @@ class RadosStorageMetadataMock : public RadosStorageMetadataModule {
  public:
   MOCK_METHOD1(set_io_ctx, void(librados::IoCtx *io_ctx));
   MOCK_METHOD1(load_metadata, int(RadosMailObject *mail));
+  MOCK_METHOD2(prepare_load_metadata, void(librados::ObjectReadOperation *read_op, RadosMailObject *mail));
+  MOCK_METHOD1(finish_load_metadata, int(RadosMailObject *mail));
   MOCK_METHOD2(set_metadata, int(RadosMailObject *mail, RadosMetadata &xattr));
+  MOCK_METHOD2(aio_set_metadata, int(RadosMailObject *mail, RadosMetadata &xattr));
   MOCK_METHOD2(update_metadata, bool(std::string &oid, std::list<RadosMetadata> &to_update));
+  MOCK_METHOD4(prepare_update_metadata,
+               int(librados::ObjectWriteOperation *write_op, std::list<RadosMetadata> &to_update,
+                   std::map<std::string, ceph::bufferlist> &set_keywords, std::set<std::string> &remove_keywords));
   // MOCK_METHOD2(save_metadata, void(librados::ObjectWriteOperation *write_op, RadosMailObject *mail));
   void save_metadata(librados::ObjectWriteOperation *write_op, RadosMailObject *mail) {
     // delete write_op to avoid memory leak in case mocks are used
@@ -123,9 +149,20 @@ class RadosClusterMock : public RadosCluster {
   MOCK_METHOD1(pool_create, int(const std::string &pool));
   MOCK_METHOD2(io_ctx_create, int(const std::string &pool, librados::IoCtx *io_ctx));
   MOCK_METHOD2(get_config_option, int(const char *option, std::string *value));
+  MOCK_METHOD0(watch_flush, int());
   MOCK_METHOD0(is_connected, bool());
 };
 
+using librmb::RadosNotifier;
+
+class RadosNotifierMock : public RadosNotifier {
+ public:
+  MOCK_METHOD3(watch, int(const std::string &oid, const std::function<void()> &callback, uint64_t *handle));
+  MOCK_METHOD1(unwatch, int(uint64_t handle));
+  MOCK_METHOD1(notify, int(const std::string &oid));
+  MOCK_METHOD1(check, int(uint64_t handle));
+};
+
 
 using librmb::RadosDovecotCephCfg;
 class RadosDovecotCephCfgMock : public RadosDovecotCephCfg {
@@ -139,6 +176,21 @@ class RadosDovecotCephCfgMock : public RadosDovecotCephCfg {
   MOCK_METHOD1(is_updateable_attribute, bool(enum librmb::rbox_metadata_key key));
   MOCK_METHOD1(set_update_attributes, void(const std::string &update_attributes_));
   MOCK_METHOD0(is_ceph_posix_bugfix_enabled, bool());
+  MOCK_METHOD0(is_mailbox_manifest_enabled, bool());
+  MOCK_METHOD0(is_index_repair_enabled, bool());
+  MOCK_METHOD0(is_mailbox_notify_enabled, bool());
+  MOCK_METHOD0(get_read_ahead_size, uint64_t());
+  MOCK_METHOD0(get_save_flush_size, uint64_t());
+  MOCK_METHOD0(get_write_window, int());
+  MOCK_METHOD0(get_sync_window, int());
+  MOCK_METHOD0(get_expunge_window, int());
+  MOCK_METHOD0(get_rebuild_window, int());
+  MOCK_METHOD0(get_copy_window, int());
+  MOCK_METHOD0(get_metadata_cache_size, int());
+  MOCK_METHOD0(get_metadata_cache_ttl, int());
+  MOCK_METHOD0(get_index_snapshot_interval, int());
+  MOCK_METHOD0(get_precache_window, int());
+  MOCK_METHOD0(get_prefetch_size, uint64_t());
 
   MOCK_METHOD1(update_mail_attributes, void(const char *value));
   MOCK_METHOD1(update_updatable_attributes, void(const char *value));
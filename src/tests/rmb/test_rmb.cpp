@@ -95,7 +95,7 @@ TEST(rmb1, save_mail) {
   librmb::RadosMailObject mail;
   librados::bufferlist bl;
   bl.append("1");
-  (*mail.get_metadata())["U"] = bl;
+  mail.add_metadata("U", bl);
   std::string mail_guid = "defg";
   mail.get_mail_buffer()->append("hallo welt\nbababababa\n");
   mail.set_oid(mail_guid);
@@ -9,6 +9,11 @@
  * Foundation.  See file COPYING.
  */
 
+#include <errno.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
 #include "../storage-mock-rbox/TestCase.h"
 #include "gtest/gtest.h"
 #include "gmock/gmock.h"
@@ -28,6 +33,7 @@ extern "C" {
 #include "mail-storage-service.h"
 #include "mail-namespace.h"
 #include "mailbox-list.h"
+#include "mail-index.h"
 #include "ioloop.h"
 #include "istream.h"
 #include "mail-search-build.h"
@@ -48,6 +54,7 @@ using ::testing::Return;
 using ::testing::_;
 using ::testing::Matcher;
 using ::testing::ReturnRef;
+using ::testing::Invoke;
 #pragma GCC diagnostic pop
 
 #if DOVECOT_PREREQ(2, 3)
@@ -204,7 +211,7 @@ TEST_F(StorageTest, exec_write_op_fails) {
 
   librmbtest::RadosStorageMetadataMock ms_mock;
   EXPECT_CALL(*ms_p_mock, get_storage()).WillRepeatedly(Return(&ms_mock));
-  EXPECT_CALL(ms_mock, set_metadata(_, _)).WillRepeatedly(Return(0));
+  EXPECT_CALL(ms_mock, aio_set_metadata(_, _)).WillRepeatedly(Return(0));
 
   // TODO: EXPECT_CALL(*storage_mock, set_metadata(_, _)).WillRepeatedly(Return(0));
 
@@ -317,6 +324,7 @@ TEST_F(StorageTest, write_op_fails) {
       .WillRepeatedly(Return(true));
 
   EXPECT_CALL(*storage_mock, read_mail(_, _)).WillRepeatedly(Return(-2));
+  EXPECT_CALL(*storage_mock, read_mail_object(_, _, _, _)).WillRepeatedly(Return(-2));
 
   librmb::RadosMailObject *test_obj = new librmb::RadosMailObject();
   librmb::RadosMailObject *test_obj2 = new librmb::RadosMailObject();
@@ -347,7 +355,7 @@ TEST_F(StorageTest, write_op_fails) {
 
   librmbtest::RadosStorageMetadataMock ms_mock;
   EXPECT_CALL(*ms_p_mock, get_storage()).WillRepeatedly(Return(&ms_mock));
-  EXPECT_CALL(ms_mock, set_metadata(_, _)).WillRepeatedly(Return(0));
+  EXPECT_CALL(ms_mock, aio_set_metadata(_, _)).WillRepeatedly(Return(0));
 
   bool save_failed = FALSE;
 
@@ -397,6 +405,215 @@ TEST_F(StorageTest, write_op_fails) {
   delete test_obj2;
 }
 
+TEST_F(StorageTest, save_mail_in_chunks) {
+  struct mail_namespace *ns = mail_namespace_find_inbox(s_test_mail_user->namespaces);
+  ASSERT_NE(ns, nullptr);
+  struct mailbox *box = mailbox_alloc(ns->list, "INBOX", (mailbox_flags)0);
+  ASSERT_NE(box, nullptr);
+  ASSERT_GE(mailbox_open(box), 0);
+
+  // 7 complete chunks of 16 bytes and a tail of 6 bytes
+  std::string message =
+      "From: user@domain.org\n"
+      "Date: Sat, 24 Mar 2017 23:00:00 +0200\n"
+      "Content-Type: text/plain; charset=us-ascii\n"
+      "\n"
+      "body of 13 ch\n";
+  ASSERT_EQ(118u, message.length());
+  struct istream *input = i_stream_create_from_data(message.c_str(), message.length());
+
+#ifdef DOVECOT_CEPH_PLUGIN_HAVE_MAIL_STORAGE_TRANSACTION_OLD_SIGNATURE
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL);
+#else
+  char reason[256];
+  memset(reason, '\0', sizeof(reason));
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL, reason);
+#endif
+  struct mail_save_context *save_ctx = mailbox_save_alloc(trans);
+  // set the Mock storage
+  struct rbox_storage *storage = (struct rbox_storage *)box->storage;
+  delete storage->s;
+
+  librmbtest::RadosStorageMock *storage_mock = new librmbtest::RadosStorageMock();
+  librados::IoCtx test_ioctx;
+  EXPECT_CALL(*storage_mock, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
+  EXPECT_CALL(*storage_mock, open_connection(_, _, _)).WillRepeatedly(Return(1));
+  EXPECT_CALL(*storage_mock, wait_for_rados_operations(_)).WillRepeatedly(Return(false));
+
+  // what would have been written to rados, in order
+  std::string written;
+  std::vector<uint64_t> chunk_offsets;
+  EXPECT_CALL(*storage_mock, save_mail_chunk(_, _))
+      .Times(7)
+      .WillRepeatedly(Invoke([&](librmb::RadosMailObject *mail, librados::bufferlist &chunk) -> int {
+        chunk_offsets.push_back(mail->get_flushed_size());
+        written.append(chunk.to_str());
+        mail->set_flushed_size(mail->get_flushed_size() + chunk.length());
+        return 0;
+      }));
+  // the tail is written along with the metadata
+  uint64_t mail_size = 0;
+  EXPECT_CALL(*storage_mock, save_mail(Matcher<librados::ObjectWriteOperation *>(_), _, _))
+      .Times(1)
+      .WillOnce(Invoke([&](librados::ObjectWriteOperation *, librmb::RadosMailObject *mail, bool) -> bool {
+        written.append(mail->get_mail_buffer()->to_str());
+        mail_size = mail->get_mail_size();
+        return true;
+      }));
+  EXPECT_CALL(*storage_mock, delete_mail(Matcher<librmb::RadosMailObject *>(_))).Times(0);
+
+  librmb::RadosMailObject *test_obj = new librmb::RadosMailObject();
+  librmb::RadosMailObject *test_obj2 = new librmb::RadosMailObject();
+  EXPECT_CALL(*storage_mock, alloc_mail_object()).WillOnce(Return(test_obj)).WillOnce(Return(test_obj2));
+  EXPECT_CALL(*storage_mock, free_mail_object(_)).Times(AtLeast(1));
+
+  delete storage->config;
+  librmbtest::RadosDovecotCephCfgMock *cfg_mock = new librmbtest::RadosDovecotCephCfgMock();
+  std::string user = "client.admin";
+  std::string cluster = "ceph";
+  std::string pool = "mail_storage";
+  std::string suffix = "_u";
+  EXPECT_CALL(*cfg_mock, is_config_valid()).WillRepeatedly(Return(true));
+  EXPECT_CALL(*cfg_mock, get_rados_username()).WillRepeatedly(ReturnRef(user));
+  EXPECT_CALL(*cfg_mock, get_rados_cluster_name()).WillRepeatedly(ReturnRef(cluster));
+  EXPECT_CALL(*cfg_mock, get_pool_name()).WillRepeatedly(ReturnRef(pool));
+  EXPECT_CALL(*cfg_mock, get_user_suffix()).WillRepeatedly(ReturnRef(suffix));
+  EXPECT_CALL(*cfg_mock, get_save_flush_size()).WillRepeatedly(Return(16));
+  storage->ns_mgr->set_config(cfg_mock);
+  storage->config = cfg_mock;
+  storage->s = storage_mock;
+
+  delete storage->ms;
+  librmbtest::RadosMetadataStorageProducerMock *ms_p_mock = new librmbtest::RadosMetadataStorageProducerMock();
+  storage->ms = ms_p_mock;
+  librmbtest::RadosStorageMetadataMock ms_mock;
+  EXPECT_CALL(*ms_p_mock, get_storage()).WillRepeatedly(Return(&ms_mock));
+  EXPECT_CALL(ms_mock, aio_set_metadata(_, _)).WillRepeatedly(Return(0));
+
+  ASSERT_GE(mailbox_save_begin(&save_ctx, input), 0);
+  ssize_t ret;
+  do {
+    ASSERT_GE(mailbox_save_continue(save_ctx), 0);
+  } while ((ret = i_stream_read(input)) > 0);
+  EXPECT_EQ(ret, -1);
+  EXPECT_GE(mailbox_save_finish(&save_ctx), 0);
+  EXPECT_GE(mailbox_transaction_commit(&trans), 0);
+  if (trans != nullptr) {
+    mailbox_transaction_rollback(&trans);
+  }
+
+  ASSERT_EQ(7u, chunk_offsets.size());
+  for (unsigned int i = 0; i < chunk_offsets.size(); i++) {
+    EXPECT_EQ(i * 16, chunk_offsets[i]);
+  }
+  EXPECT_EQ(message.length(), mail_size);
+  EXPECT_EQ(message, written);
+
+  i_stream_unref(&input);
+  mailbox_free(&box);
+
+  delete test_obj;
+  delete test_obj2;
+}
+
+TEST_F(StorageTest, save_mail_chunk_fails) {
+  struct mail_namespace *ns = mail_namespace_find_inbox(s_test_mail_user->namespaces);
+  ASSERT_NE(ns, nullptr);
+  struct mailbox *box = mailbox_alloc(ns->list, "INBOX", (mailbox_flags)0);
+  ASSERT_NE(box, nullptr);
+  ASSERT_GE(mailbox_open(box), 0);
+
+  const char *message =
+      "From: user@domain.org\n"
+      "Date: Sat, 24 Mar 2017 23:00:00 +0200\n"
+      "Mime-Version: 1.0\n"
+      "Content-Type: text/plain; charset=us-ascii\n"
+      "\n"
+      "body\n";
+  struct istream *input = i_stream_create_from_data(message, strlen(message));
+
+#ifdef DOVECOT_CEPH_PLUGIN_HAVE_MAIL_STORAGE_TRANSACTION_OLD_SIGNATURE
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL);
+#else
+  char reason[256];
+  memset(reason, '\0', sizeof(reason));
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL, reason);
+#endif
+  struct mail_save_context *save_ctx = mailbox_save_alloc(trans);
+  // set the Mock storage
+  struct rbox_storage *storage = (struct rbox_storage *)box->storage;
+  delete storage->s;
+
+  librmbtest::RadosStorageMock *storage_mock = new librmbtest::RadosStorageMock();
+  librados::IoCtx test_ioctx;
+  EXPECT_CALL(*storage_mock, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
+  EXPECT_CALL(*storage_mock, open_connection(_, _, _)).WillRepeatedly(Return(1));
+  EXPECT_CALL(*storage_mock, wait_for_rados_operations(_)).WillRepeatedly(Return(false));
+
+  // the first chunk is written, the second one fails
+  librmb::RadosMailObject *chunk_obj = nullptr;
+  EXPECT_CALL(*storage_mock, save_mail_chunk(_, _))
+      .Times(2)
+      .WillOnce(Invoke([&](librmb::RadosMailObject *mail, librados::bufferlist &chunk) -> int {
+        chunk_obj = mail;
+        mail->set_flushed_size(mail->get_flushed_size() + chunk.length());
+        return 0;
+      }))
+      .WillOnce(Return(-EIO));
+  // the tail is never written, the partially written object is removed
+  EXPECT_CALL(*storage_mock, save_mail(Matcher<librados::ObjectWriteOperation *>(_), _, _)).Times(0);
+  librmb::RadosMailObject *deleted_obj = nullptr;
+  EXPECT_CALL(*storage_mock, delete_mail(Matcher<librmb::RadosMailObject *>(_)))
+      .Times(1)
+      .WillOnce(Invoke([&](librmb::RadosMailObject *mail) -> int {
+        deleted_obj = mail;
+        return 0;
+      }));
+
+  librmb::RadosMailObject *test_obj = new librmb::RadosMailObject();
+  librmb::RadosMailObject *test_obj2 = new librmb::RadosMailObject();
+  EXPECT_CALL(*storage_mock, alloc_mail_object()).WillOnce(Return(test_obj)).WillOnce(Return(test_obj2));
+  EXPECT_CALL(*storage_mock, free_mail_object(_)).Times(AtLeast(1));
+
+  delete storage->config;
+  librmbtest::RadosDovecotCephCfgMock *cfg_mock = new librmbtest::RadosDovecotCephCfgMock();
+  std::string user = "client.admin";
+  std::string cluster = "ceph";
+  std::string pool = "mail_storage";
+  std::string suffix = "_u";
+  EXPECT_CALL(*cfg_mock, is_config_valid()).WillRepeatedly(Return(true));
+  EXPECT_CALL(*cfg_mock, get_rados_username()).WillRepeatedly(ReturnRef(user));
+  EXPECT_CALL(*cfg_mock, get_rados_cluster_name()).WillRepeatedly(ReturnRef(cluster));
+  EXPECT_CALL(*cfg_mock, get_pool_name()).WillRepeatedly(ReturnRef(pool));
+  EXPECT_CALL(*cfg_mock, get_user_suffix()).WillRepeatedly(ReturnRef(suffix));
+  EXPECT_CALL(*cfg_mock, get_save_flush_size()).WillRepeatedly(Return(16));
+  storage->ns_mgr->set_config(cfg_mock);
+  storage->config = cfg_mock;
+  storage->s = storage_mock;
+
+  delete storage->ms;
+  librmbtest::RadosMetadataStorageProducerMock *ms_p_mock = new librmbtest::RadosMetadataStorageProducerMock();
+  storage->ms = ms_p_mock;
+  librmbtest::RadosStorageMetadataMock ms_mock;
+  EXPECT_CALL(*ms_p_mock, get_storage()).WillRepeatedly(Return(&ms_mock));
+  EXPECT_CALL(ms_mock, aio_set_metadata(_, _)).WillRepeatedly(Return(0));
+
+  ASSERT_GE(mailbox_save_begin(&save_ctx, input), 0);
+  EXPECT_LT(mailbox_save_continue(save_ctx), 0);
+  mailbox_save_cancel(&save_ctx);
+  EXPECT_EQ(save_ctx, nullptr);
+  mailbox_transaction_rollback(&trans);
+
+  EXPECT_NE(chunk_obj, nullptr);
+  EXPECT_EQ(chunk_obj, deleted_obj);
+
+  i_stream_unref(&input);
+  mailbox_free(&box);
+
+  delete test_obj;
+  delete test_obj2;
+}
+
 TEST_F(StorageTest, mock_copy_failed_due_to_rados_err) {
   struct mailbox_transaction_context *desttrans;
   struct mail_save_context *save_ctx;
@@ -466,7 +683,7 @@ TEST_F(StorageTest, mock_copy_failed_due_to_rados_err) {
   EXPECT_CALL(*storage_mock_copy, wait_for_rados_operations(_)).Times(AtLeast(1)).WillRepeatedly(Return(false));
 
   // TODO: EXPECT_CALL(*storage_mock_copy, set_metadata(_, _)).WillRepeatedly(Return(0));
-  EXPECT_CALL(*storage_mock_copy, copy(_, _, _, _, _)).WillRepeatedly(Return(false));
+  EXPECT_CALL(*storage_mock_copy, aio_copy(_, _, _, _, _, _)).WillRepeatedly(Return(-1));
   EXPECT_CALL(*storage_mock_copy, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
 
   storage->s = storage_mock_copy;
@@ -484,12 +701,13 @@ TEST_F(StorageTest, mock_copy_failed_due_to_rados_err) {
 
   librmbtest::RadosStorageMetadataMock ms_mock;
   EXPECT_CALL(*ms_p_mock, get_storage()).WillRepeatedly(Return(&ms_mock));
-  EXPECT_CALL(ms_mock, set_metadata(_, _)).WillRepeatedly(Return(0));
+  EXPECT_CALL(ms_mock, aio_set_metadata(_, _)).WillRepeatedly(Return(0));
 
   EXPECT_CALL(*cfg_mock, get_rados_username()).WillRepeatedly(ReturnRef(user));
   EXPECT_CALL(*cfg_mock, get_rados_cluster_name()).WillRepeatedly(ReturnRef(cluster));
   EXPECT_CALL(*cfg_mock, get_pool_name()).WillRepeatedly(ReturnRef(pool));
   EXPECT_CALL(*cfg_mock, get_user_suffix()).WillRepeatedly(ReturnRef(suffix));
+  EXPECT_CALL(*cfg_mock, get_copy_window()).WillRepeatedly(Return(64));
   storage->ns_mgr->set_config(cfg_mock);
 
   storage->config = cfg_mock;
@@ -537,6 +755,439 @@ TEST_F(StorageTest, mock_copy_failed_due_to_rados_err) {
 
 }
 
+TEST_F(StorageTest, mail_prefetch_uses_cached_size_only) {
+  const char *message =
+      "From: user@domain.org\n"
+      "Date: Sat, 24 Mar 2017 23:00:00 +0200\n"
+      "Mime-Version: 1.0\n"
+      "Content-Type: text/plain; charset=us-ascii\n"
+      "\n"
+      "body\n";
+  const char *mailbox = "INBOX";
+
+  librmbtest::RadosStorageMock *storage_mock = new librmbtest::RadosStorageMock();
+  EXPECT_CALL(*storage_mock, wait_for_rados_operations(_)).Times(AtLeast(1)).WillRepeatedly(Return(false));
+  librados::IoCtx test_ioctx;
+  EXPECT_CALL(*storage_mock, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
+  EXPECT_CALL(*storage_mock, save_mail(Matcher<librados::ObjectWriteOperation *>(_), _, _))
+      .WillRepeatedly(Return(true));
+  librmb::RadosMailObject *test_obj_save = new librmb::RadosMailObject();
+  librmb::RadosMailObject *test_obj_save2 = new librmb::RadosMailObject();
+  EXPECT_CALL(*storage_mock, alloc_mail_object())
+      .Times(2)
+      .WillOnce(Return(test_obj_save))
+      .WillOnce(Return(test_obj_save2));
+
+  // testdata
+  testutils::ItUtils::add_mail(message, mailbox, StorageTest::s_test_mail_user->namespaces, storage_mock);
+
+  delete test_obj_save;
+  delete test_obj_save2;
+
+  struct mail_namespace *ns = mail_namespace_find_inbox(s_test_mail_user->namespaces);
+  ASSERT_NE(ns, nullptr);
+  struct mailbox *box = mailbox_alloc(ns->list, mailbox, MAILBOX_FLAG_READONLY);
+
+  // set the Mock storage
+  struct rbox_storage *storage = (struct rbox_storage *)box->storage;
+  delete storage->s;
+
+  librmbtest::RadosStorageMock *storage_mock_read = new librmbtest::RadosStorageMock();
+  // neither the size nor the metadata is in memory
+  librmb::RadosMailObject *test_object = new librmb::RadosMailObject();
+  // the metadata has been read already
+  librmb::RadosMailObject *test_object2 = new librmb::RadosMailObject();
+  librmb::RadosMetadata size = librmb::RadosMetadata(librmb::RBOX_METADATA_PHYSICAL_SIZE, strlen(message));
+  test_object2->add_metadata(size);
+
+  EXPECT_CALL(*storage_mock_read, alloc_mail_object())
+      .Times(2)
+      .WillOnce(Return(test_object))
+      .WillOnce(Return(test_object2));
+  EXPECT_CALL(*storage_mock_read, free_mail_object(_)).Times(AtLeast(0));
+  EXPECT_CALL(*storage_mock_read, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
+  EXPECT_CALL(*storage_mock_read, open_connection(_, _, _)).WillRepeatedly(Return(1));
+  // the prefetch must not fall back to a synchronous read of the size
+  EXPECT_CALL(*storage_mock_read, stat_mail(_, _, _)).Times(0);
+  EXPECT_CALL(*storage_mock_read, read_mail(_, _)).Times(0);
+  EXPECT_CALL(*storage_mock_read, read_mail_object(_, _, _, _)).Times(0);
+  // only the mail of a cached size is read ahead, the aio read fails to not leave a completion behind
+  EXPECT_CALL(*storage_mock_read, aio_read(_, _, _, static_cast<uint64_t>(strlen(message)), 0))
+      .Times(1)
+      .WillOnce(Return(-1));
+  storage->s = storage_mock_read;
+
+  delete storage->ms;
+  librmbtest::RadosMetadataStorageProducerMock *ms_p_mock = new librmbtest::RadosMetadataStorageProducerMock();
+  storage->ms = ms_p_mock;
+  librmbtest::RadosStorageMetadataMock ms_mock;
+  EXPECT_CALL(*ms_p_mock, get_storage()).WillRepeatedly(Return(&ms_mock));
+  EXPECT_CALL(ms_mock, load_metadata(_)).Times(0);
+
+  delete storage->config;
+  librmbtest::RadosDovecotCephCfgMock *cfg_mock = new librmbtest::RadosDovecotCephCfgMock();
+  std::string user = "client.admin";
+  std::string cluster = "ceph";
+  std::string pool = "mail_storage";
+  std::string suffix = "_u";
+  EXPECT_CALL(*cfg_mock, is_config_valid()).WillRepeatedly(Return(true));
+  EXPECT_CALL(*cfg_mock, get_rados_username()).WillRepeatedly(ReturnRef(user));
+  EXPECT_CALL(*cfg_mock, get_rados_cluster_name()).WillRepeatedly(ReturnRef(cluster));
+  EXPECT_CALL(*cfg_mock, get_pool_name()).WillRepeatedly(ReturnRef(pool));
+  EXPECT_CALL(*cfg_mock, get_user_suffix()).WillRepeatedly(ReturnRef(suffix));
+  EXPECT_CALL(*cfg_mock, get_prefetch_size()).WillRepeatedly(Return(1024 * 1024));
+  EXPECT_CALL(*cfg_mock, get_read_ahead_size()).WillRepeatedly(Return(0));
+  storage->ns_mgr->set_config(cfg_mock);
+  storage->config = cfg_mock;
+
+  if (mailbox_open(box) < 0) {
+    FAIL() << "Opening mailbox " << mailbox << " failed: " << mailbox_get_last_internal_error(box, NULL);
+  }
+
+#ifdef DOVECOT_CEPH_PLUGIN_HAVE_MAIL_STORAGE_TRANSACTION_OLD_SIGNATURE
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, static_cast<mailbox_transaction_flags>(0));
+#else
+  char reason[256];
+  memset(reason, '\0', sizeof(reason));
+  struct mailbox_transaction_context *trans =
+      mailbox_transaction_begin(box, static_cast<mailbox_transaction_flags>(0), reason);
+#endif
+  struct mail *mail = mail_alloc(trans, MAIL_FETCH_STREAM_BODY, NULL);
+
+  mail_set_seq(mail, 1);
+  // nothing started, the size is not known without a round trip
+  EXPECT_TRUE(mail_prefetch(mail));
+
+  mail_free(&mail);
+
+  mail = mail_alloc(trans, MAIL_FETCH_STREAM_BODY, NULL);
+  mail_set_seq(mail, 1);
+  // nothing started either, the aio read failed
+  EXPECT_TRUE(mail_prefetch(mail));
+
+  mail_free(&mail);
+  mailbox_transaction_rollback(&trans);
+  mailbox_free(&box);
+
+  delete test_object;
+  delete test_object2;
+}
+
+TEST_F(StorageTest, precache_metadata_in_one_batch) {
+  const char *message =
+      "From: user@domain.org\n"
+      "Date: Sat, 24 Mar 2017 23:00:00 +0200\n"
+      "Mime-Version: 1.0\n"
+      "Content-Type: text/plain; charset=us-ascii\n"
+      "\n"
+      "body\n";
+  const char *mailbox = "INBOX";
+
+  librmbtest::RadosStorageMock *storage_mock = new librmbtest::RadosStorageMock();
+  EXPECT_CALL(*storage_mock, wait_for_rados_operations(_)).WillRepeatedly(Return(false));
+  librados::IoCtx test_ioctx;
+  EXPECT_CALL(*storage_mock, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
+  EXPECT_CALL(*storage_mock, save_mail(Matcher<librados::ObjectWriteOperation *>(_), _, _))
+      .WillRepeatedly(Return(true));
+  librmb::RadosMailObject *test_obj_save = new librmb::RadosMailObject();
+  librmb::RadosMailObject *test_obj_save2 = new librmb::RadosMailObject();
+  EXPECT_CALL(*storage_mock, alloc_mail_object())
+      .Times(2)
+      .WillOnce(Return(test_obj_save))
+      .WillOnce(Return(test_obj_save2));
+
+  // testdata, the mails of the other tests are in the mailbox as well
+  testutils::ItUtils::add_mail(message, mailbox, StorageTest::s_test_mail_user->namespaces, storage_mock);
+
+  delete test_obj_save;
+  delete test_obj_save2;
+
+  struct mail_namespace *ns = mail_namespace_find_inbox(s_test_mail_user->namespaces);
+  ASSERT_NE(ns, nullptr);
+  struct mailbox *box = mailbox_alloc(ns->list, mailbox, MAILBOX_FLAG_READONLY);
+
+  struct rbox_storage *storage = (struct rbox_storage *)box->storage;
+  delete storage->s;
+  librmbtest::RadosStorageMock *storage_mock_read = new librmbtest::RadosStorageMock();
+  EXPECT_CALL(*storage_mock_read, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
+  EXPECT_CALL(*storage_mock_read, open_connection(_, _, _)).WillRepeatedly(Return(1));
+  EXPECT_CALL(*storage_mock_read, alloc_mail_object())
+      .WillRepeatedly(Invoke([]() -> librmb::RadosMailObject * { return new librmb::RadosMailObject(); }));
+  EXPECT_CALL(*storage_mock_read, free_mail_object(_))
+      .WillRepeatedly(Invoke([](librmb::RadosMailObject *mail) -> void { delete mail; }));
+  // all mails are read ahead along with the first one, the others are cache hits
+  size_t batch = 0;
+  EXPECT_CALL(*storage_mock_read, load_metadata(_, _, _))
+      .Times(1)
+      .WillOnce(Invoke([&batch](const std::vector<librmb::RadosMailObject *> &mails,
+                                librmb::RadosStorageMetadataModule *, std::vector<int> *results) -> int {
+        batch = mails.size();
+        for (std::vector<librmb::RadosMailObject *>::const_iterator it = mails.begin(); it != mails.end(); ++it) {
+          librmb::RadosMetadata guid(librmb::RBOX_METADATA_GUID, "guid-" + (*it)->get_oid());
+          (*it)->add_metadata(guid);
+        }
+        results->assign(mails.size(), 0);
+        return 0;
+      }));
+  EXPECT_CALL(*storage_mock_read, read_mail_object(_, _, _, _)).Times(0);
+  storage->s = storage_mock_read;
+
+  delete storage->ms;
+  librmbtest::RadosMetadataStorageProducerMock *ms_p_mock = new librmbtest::RadosMetadataStorageProducerMock();
+  storage->ms = ms_p_mock;
+  librmbtest::RadosStorageMetadataMock ms_mock;
+  EXPECT_CALL(*ms_p_mock, get_storage()).WillRepeatedly(Return(&ms_mock));
+  EXPECT_CALL(ms_mock, load_metadata(_)).Times(0);
+
+  delete storage->config;
+  librmbtest::RadosDovecotCephCfgMock *cfg_mock = new librmbtest::RadosDovecotCephCfgMock();
+  std::string user = "client.admin";
+  std::string cluster = "ceph";
+  std::string pool = "mail_storage";
+  std::string suffix = "_u";
+  EXPECT_CALL(*cfg_mock, is_config_valid()).WillRepeatedly(Return(true));
+  EXPECT_CALL(*cfg_mock, get_rados_username()).WillRepeatedly(ReturnRef(user));
+  EXPECT_CALL(*cfg_mock, get_rados_cluster_name()).WillRepeatedly(ReturnRef(cluster));
+  EXPECT_CALL(*cfg_mock, get_pool_name()).WillRepeatedly(ReturnRef(pool));
+  EXPECT_CALL(*cfg_mock, get_user_suffix()).WillRepeatedly(ReturnRef(suffix));
+  EXPECT_CALL(*cfg_mock, get_precache_window()).WillRepeatedly(Return(64));
+  storage->ns_mgr->set_config(cfg_mock);
+  storage->config = cfg_mock;
+  // the window is bounded by the metadata cache
+  size_t max_entries = storage->metadata_cache->get_max_entries();
+  storage->metadata_cache->clear();
+  storage->metadata_cache->set_max_entries(128);
+
+  if (mailbox_open(box) < 0) {
+    FAIL() << "Opening mailbox " << mailbox << " failed: " << mailbox_get_last_internal_error(box, NULL);
+  }
+  uint32_t messages = mail_index_view_get_messages_count(box->view);
+  ASSERT_GE(messages, 2u);
+  ASSERT_LE(messages, 64u);
+
+#ifdef DOVECOT_CEPH_PLUGIN_HAVE_MAIL_STORAGE_TRANSACTION_OLD_SIGNATURE
+  struct mailbox_transaction_context *trans = mailbox_transaction_begin(box, static_cast<mailbox_transaction_flags>(0));
+#else
+  char reason[256];
+  memset(reason, '\0', sizeof(reason));
+  struct mailbox_transaction_context *trans =
+      mailbox_transaction_begin(box, static_cast<mailbox_transaction_flags>(0), reason);
+#endif
+  struct mail *mail = mail_alloc(trans, static_cast<mail_fetch_field>(0), NULL);
+  for (uint32_t seq = 1; seq <= messages; seq++) {
+    mail_set_seq(mail, seq);
+    const char *guid = NULL;
+    EXPECT_EQ(0, mail_get_special(mail, MAIL_FETCH_GUID, &guid));
+    ASSERT_NE(guid, nullptr);
+    EXPECT_EQ(0, strncmp("guid-", guid, 5));
+  }
+  EXPECT_EQ(static_cast<size_t>(messages), batch);
+  EXPECT_EQ(static_cast<size_t>(messages), storage->metadata_cache->size());
+
+  mail_free(&mail);
+  mailbox_transaction_rollback(&trans);
+  storage->metadata_cache->clear();
+  storage->metadata_cache->set_max_entries(max_entries);
+  mailbox_free(&box);
+}
+
+/* the client copy of move_to_alt, the server side copy needs a cluster */
+static int read_mail_fails_once(const std::string &oid, librados::bufferlist *buffer) {
+  static bool failed = false;
+  if (!failed) {
+    failed = true;
+    return -EIO;
+  }
+  buffer->append("body\n");
+  return 0;
+}
+
+TEST_F(StorageTest, move_to_alt_reverts_failed_moves) {
+  const char *message =
+      "From: user@domain.org\n"
+      "Date: Sat, 24 Mar 2017 23:00:00 +0200\n"
+      "Mime-Version: 1.0\n"
+      "Content-Type: text/plain; charset=us-ascii\n"
+      "\n"
+      "body\n";
+  const char *mailbox = "INBOX";
+
+  librmbtest::RadosStorageMock *storage_mock = new librmbtest::RadosStorageMock();
+  EXPECT_CALL(*storage_mock, wait_for_rados_operations(_)).WillRepeatedly(Return(false));
+  librados::IoCtx test_ioctx;
+  EXPECT_CALL(*storage_mock, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
+  EXPECT_CALL(*storage_mock, save_mail(Matcher<librados::ObjectWriteOperation *>(_), _, _))
+      .WillRepeatedly(Return(true));
+  librmb::RadosMailObject *test_obj_save = new librmb::RadosMailObject();
+  librmb::RadosMailObject *test_obj_save2 = new librmb::RadosMailObject();
+  EXPECT_CALL(*storage_mock, alloc_mail_object())
+      .Times(2)
+      .WillOnce(Return(test_obj_save))
+      .WillOnce(Return(test_obj_save2));
+
+  // testdata, the mails of the other tests are in the mailbox as well
+  testutils::ItUtils::add_mail(message, mailbox, StorageTest::s_test_mail_user->namespaces, storage_mock);
+
+  delete test_obj_save;
+  delete test_obj_save2;
+
+  struct mail_namespace *ns = mail_namespace_find_inbox(s_test_mail_user->namespaces);
+  ASSERT_NE(ns, nullptr);
+  struct mailbox *box = mailbox_alloc(ns->list, mailbox, MAILBOX_FLAG_IGNORE_ACLS);
+  const char *alt_dir = box->list->set.alt_dir;
+  box->list->set.alt_dir = "mail_storage_alt";
+
+  struct rbox_storage *storage = (struct rbox_storage *)box->storage;
+  delete storage->s;
+  librmbtest::RadosStorageMock *storage_mock_primary = new librmbtest::RadosStorageMock();
+  EXPECT_CALL(*storage_mock_primary, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
+  EXPECT_CALL(*storage_mock_primary, open_connection(_, _, _)).WillRepeatedly(Return(1));
+  EXPECT_CALL(*storage_mock_primary, read_mail(_, _)).WillRepeatedly(Invoke(read_mail_fails_once));
+  std::vector<std::string> removed;
+  EXPECT_CALL(*storage_mock_primary, delete_mails(_, _, _))
+      .WillOnce(Invoke([&removed](const std::vector<std::string> &oids, const int &, std::vector<int> *results) -> int {
+        removed = oids;
+        results->assign(oids.size(), 0);
+        return 0;
+      }));
+  storage->s = storage_mock_primary;
+
+  delete storage->alt;
+  librmbtest::RadosStorageMock *storage_mock_alt = new librmbtest::RadosStorageMock();
+  EXPECT_CALL(*storage_mock_alt, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
+  EXPECT_CALL(*storage_mock_alt, open_connection(_, _, _)).WillRepeatedly(Return(1));
+  EXPECT_CALL(*storage_mock_alt, wait_for_rados_operations(_)).WillRepeatedly(Return(false));
+  // the pools are not in the same cluster, every mail is copied through the client
+  EXPECT_CALL(*storage_mock_alt, aio_copy_from(_, _, _, _)).WillRepeatedly(Return(-EXDEV));
+  storage->alt = storage_mock_alt;
+
+  delete storage->ms;
+  librmbtest::RadosMetadataStorageProducerMock *ms_p_mock = new librmbtest::RadosMetadataStorageProducerMock();
+  storage->ms = ms_p_mock;
+  librmbtest::RadosStorageMetadataMock ms_mock;
+  EXPECT_CALL(*ms_p_mock, get_storage()).WillRepeatedly(Return(&ms_mock));
+  EXPECT_CALL(ms_mock, load_metadata(_)).WillRepeatedly(Return(0));
+
+  delete storage->config;
+  librmbtest::RadosDovecotCephCfgMock *cfg_mock = new librmbtest::RadosDovecotCephCfgMock();
+  std::string user = "client.admin";
+  std::string cluster = "ceph";
+  std::string pool = "mail_storage";
+  std::string suffix = "_u";
+  EXPECT_CALL(*cfg_mock, is_config_valid()).WillRepeatedly(Return(true));
+  EXPECT_CALL(*cfg_mock, get_rados_username()).WillRepeatedly(ReturnRef(user));
+  EXPECT_CALL(*cfg_mock, get_rados_cluster_name()).WillRepeatedly(ReturnRef(cluster));
+  EXPECT_CALL(*cfg_mock, get_pool_name()).WillRepeatedly(ReturnRef(pool));
+  EXPECT_CALL(*cfg_mock, get_user_suffix()).WillRepeatedly(ReturnRef(suffix));
+  EXPECT_CALL(*cfg_mock, get_sync_window()).WillRepeatedly(Return(4));
+  storage->ns_mgr->set_config(cfg_mock);
+  storage->config = cfg_mock;
+
+  if (mailbox_open(box) < 0) {
+    FAIL() << "Opening mailbox " << mailbox << " failed: " << mailbox_get_last_internal_error(box, NULL);
+  }
+  uint32_t messages = mail_index_view_get_messages_count(box->view);
+  ASSERT_GE(messages, 2u);
+
+  // the first mail fails to be read, the others are copied to the alt storage and removed from the primary one
+  EXPECT_CALL(*storage_mock_alt, save_mail(Matcher<librados::ObjectWriteOperation *>(_), _, _))
+      .Times(messages - 1)
+      .WillRepeatedly(Return(true));
+
+  // a normal transaction, the flag change becomes a sync record
+  struct mail_index_transaction *trans =
+      mail_index_transaction_begin(box->view, static_cast<mail_index_transaction_flags>(0));
+  mail_index_update_flags_range(trans, 1, messages, MODIFY_ADD, (enum mail_flags)RBOX_INDEX_FLAG_ALT);
+  ASSERT_EQ(0, mail_index_transaction_commit(&trans));
+  ASSERT_EQ(0, mailbox_sync(box, static_cast<mailbox_sync_flags>(0)));
+
+  uint32_t alt = 0;
+  for (uint32_t seq = 1; seq <= messages; seq++) {
+    if (is_alternate_storage_set(mail_index_lookup(box->view, seq)->flags)) {
+      alt++;
+    }
+  }
+  // the failed mail is still in the primary storage, so is its index record
+  EXPECT_EQ(messages - 1, alt);
+  EXPECT_EQ(static_cast<size_t>(messages - 1), removed.size());
+
+  box->list->set.alt_dir = alt_dir;
+  mailbox_free(&box);
+}
+
+/* separate fragments, as librados returns them for a large object */
+static void append_fragment(librados::bufferlist *bl, const char *data) {
+  bl->push_back(librados::bufferptr(data, strlen(data)));
+}
+
+TEST_F(StorageTest, istream_bufferlist_fragments) {
+  const char *fragments[] = {"From: user@domain.org\n", "Subject: fragments\n", "\nbody\n"};
+  librados::bufferlist buffer;
+  for (int i = 0; i < 3; i++) {
+    append_fragment(&buffer, fragments[i]);
+  }
+  ASSERT_EQ(3u, buffer.get_num_buffers());
+  std::string message = buffer.to_str();
+  size_t first = strlen(fragments[0]);
+  size_t second = strlen(fragments[1]);
+
+  struct istream *input = i_stream_create_from_bufferlist(&buffer, buffer.length());
+
+  // the size is known without reading
+  uoff_t size;
+  EXPECT_EQ(1, i_stream_get_size(input, TRUE, &size));
+  EXPECT_EQ(message.length(), size);
+  const struct stat *st;
+  EXPECT_EQ(0, i_stream_stat(input, TRUE, &st));
+  EXPECT_EQ(static_cast<off_t>(message.length()), st->st_size);
+
+  // the first read returns the first fragment in place
+  const unsigned char *data;
+  size_t data_size;
+  EXPECT_GT(i_stream_read_data(input, &data, &data_size, 0), 0);
+  EXPECT_EQ(message.substr(0, first), std::string(reinterpret_cast<const char *>(data), data_size));
+
+  // contiguous data across all fragments
+  i_stream_skip(input, 6);
+  EXPECT_GT(i_stream_read_data(input, &data, &data_size, message.length() - 6 - 1), 0);
+  EXPECT_EQ(message.substr(6), std::string(reinterpret_cast<const char *>(data), data_size));
+  i_stream_skip(input, data_size);
+  EXPECT_EQ(-1, i_stream_read(input));
+  EXPECT_TRUE(input->eof);
+
+  // back into the first fragment
+  i_stream_seek(input, 2);
+  EXPECT_GT(i_stream_read_data(input, &data, &data_size, 0), 0);
+  EXPECT_EQ(message.substr(2, first - 2), std::string(reinterpret_cast<const char *>(data), data_size));
+
+  // into the middle of the second one
+  i_stream_seek(input, first + 3);
+  EXPECT_GT(i_stream_read_data(input, &data, &data_size, 0), 0);
+  EXPECT_EQ(message.substr(first + 3, second - 3), std::string(reinterpret_cast<const char *>(data), data_size));
+
+  // a parent stream reading across the fragments
+  i_stream_seek(input, 0);
+  struct istream *limit = i_stream_create_limit(input, (uoff_t)-1);
+  std::string read;
+  while (i_stream_read_data(limit, &data, &data_size, 0) > 0) {
+    read.append(reinterpret_cast<const char *>(data), data_size);
+    i_stream_skip(limit, data_size);
+  }
+  EXPECT_EQ(message, read);
+  i_stream_unref(&limit);
+  i_stream_unref(&input);
+
+  // the stream ends at the given size, within the second fragment
+  input = i_stream_create_from_bufferlist(&buffer, first + 4);
+  EXPECT_EQ(1, i_stream_get_size(input, TRUE, &size));
+  EXPECT_EQ(first + 4, size);
+  EXPECT_GT(i_stream_read_data(input, &data, &data_size, first + 4 - 1), 0);
+  EXPECT_EQ(message.substr(0, first + 4), std::string(reinterpret_cast<const char *>(data), data_size));
+  i_stream_skip(input, data_size);
+  EXPECT_EQ(-1, i_stream_read(input));
+  i_stream_unref(&input);
+}
+
 TEST_F(StorageTest, copy_input_to_output_stream) {
   librados::bufferlist buffer;
   librados::bufferlist buffer_out;
@@ -567,16 +1218,54 @@ TEST_F(StorageTest, eval_output_append) {
   std::string toappend = "def";
   o_stream_buffer_write_at(output->real_stream, reinterpret_cast<const void *>(toappend.c_str()), toappend.length(), 0);
   EXPECT_EQ(toappend, buffer_out.to_str());
+  // written data is overwritten
   std::string toappend2 = "abc";
   o_stream_buffer_write_at(output->real_stream, reinterpret_cast<const void *>(toappend2.c_str()), toappend2.length(),
                            0);
-  EXPECT_EQ("abcdef", buffer_out.to_str());
-  std::string toapend3 = "ghjk";
-  o_stream_buffer_write_at(output->real_stream, reinterpret_cast<const void *>(toapend3.c_str()), toapend3.length(), 6);
+  EXPECT_EQ("abc", buffer_out.to_str());
+  std::string toapend3 = "defghjk";
+  o_stream_buffer_write_at(output->real_stream, reinterpret_cast<const void *>(toapend3.c_str()), toapend3.length(), 3);
   EXPECT_EQ("abcdefghjk", buffer_out.to_str());
   std::string toapend4 = "i";
   o_stream_buffer_write_at(output->real_stream, reinterpret_cast<const void *>(toapend4.c_str()), toapend4.length(), 8);
-  EXPECT_EQ("abcdefghijk", buffer_out.to_str());
+  EXPECT_EQ("abcdefghik", buffer_out.to_str());
+  // overwrites past the end append the rest
+  std::string toapend5 = "jkl";
+  o_stream_buffer_write_at(output->real_stream, reinterpret_cast<const void *>(toapend5.c_str()), toapend5.length(), 9);
+  EXPECT_EQ("abcdefghijkl", buffer_out.to_str());
+  // no gaps
+  EXPECT_EQ(-1, o_stream_buffer_write_at(output->real_stream, reinterpret_cast<const void *>(toapend5.c_str()),
+                                         toapend5.length(), 13));
+  EXPECT_EQ("abcdefghijkl", buffer_out.to_str());
+  o_stream_unref(&output);
+}
+
+TEST_F(StorageTest, eval_output_append_chunks) {
+  librados::bufferlist buffer_out;
+  struct ostream *output = o_stream_create_bufferlist(&buffer_out);
+
+  // more than one chunk
+  std::string data(100 * 1024, 'a');
+  data[70 * 1024] = 'b';
+  EXPECT_EQ(static_cast<ssize_t>(data.length()), o_stream_send(output, data.c_str(), data.length()));
+  EXPECT_EQ(data.length(), buffer_out.length());
+  EXPECT_EQ(data, buffer_out.to_str());
+
+  std::string patch = "xyz";
+  o_stream_buffer_write_at(output->real_stream, reinterpret_cast<const void *>(patch.c_str()), patch.length(),
+                           70 * 1024);
+  data.replace(70 * 1024, patch.length(), patch);
+  EXPECT_EQ(data, buffer_out.to_str());
+  // across the chunk boundary
+  o_stream_buffer_write_at(output->real_stream, reinterpret_cast<const void *>(patch.c_str()), patch.length(),
+                           64 * 1024 - 1);
+  data.replace(64 * 1024 - 1, patch.length(), patch);
+  EXPECT_EQ(data, buffer_out.to_str());
+  EXPECT_EQ(data.length(), buffer_out.length());
+
+  std::string tail = "tail";
+  EXPECT_EQ(static_cast<ssize_t>(tail.length()), o_stream_send(output, tail.c_str(), tail.length()));
+  EXPECT_EQ(data + tail, buffer_out.to_str());
   o_stream_unref(&output);
 }
 
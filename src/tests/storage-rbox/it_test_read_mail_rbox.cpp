@@ -9,6 +9,9 @@
  * Foundation.  See file COPYING.
  */
 
+#include <errno.h>
+#include <string>
+
 #include "gtest/gtest.h"
 #include "gmock/gmock.h"
 #include "TestCase.h"
@@ -40,6 +43,7 @@ extern "C" {
 #include "../mocks/mock_test.h"
 #include "dovecot-ceph-plugin-config.h"
 #include "../test-utils/it_utils.h"
+#include "../../storage-rbox/istream-rados.h"
 
 using ::testing::AtLeast;
 using ::testing::Return;
@@ -167,6 +171,55 @@ TEST_F(StorageTest, mail_copy_mail_in_inbox) {
   mailbox_free(&box);
 }
 
+static std::string read_stream(struct istream *input) {
+  const unsigned char *data;
+  size_t size;
+  std::string read;
+  while (i_stream_read_data(input, &data, &size, 0) > 0) {
+    read.append(reinterpret_cast<const char *>(data), size);
+    i_stream_skip(input, size);
+  }
+  return read;
+}
+
+TEST_F(StorageTest, read_mail_ranges) {
+  struct mail_namespace *ns = mail_namespace_find_inbox(s_test_mail_user->namespaces);
+  struct mailbox *box = mailbox_alloc(ns->list, "INBOX", MAILBOX_FLAG_READONLY);
+  ASSERT_GE(mailbox_open(box), 0);
+  librmb::RadosStorage *storage = ((struct rbox_storage *)box->storage)->s;
+
+  // several ranges of the smallest read ahead
+  std::string content;
+  for (int i = 0; content.length() < 3 * IO_BLOCK_SIZE + 100; i++) {
+    content += "line " + std::to_string(i) + "\n";
+  }
+  std::string oid = "read_mail_ranges";
+  librados::bufferlist bl;
+  bl.append(content);
+  ASSERT_EQ(0, storage->save_mail(oid, bl));
+
+  // sequential reads, from the second range on prefetched
+  struct istream *input = i_stream_create_from_rados(storage, oid, content.length(), IO_BLOCK_SIZE);
+  EXPECT_EQ(content, read_stream(input));
+  EXPECT_TRUE(input->eof);
+  EXPECT_EQ(0, input->stream_errno);
+
+  // seek outside of the loaded and the prefetched range
+  i_stream_seek(input, 10);
+  EXPECT_EQ(content.substr(10), read_stream(input));
+  EXPECT_EQ(0, input->stream_errno);
+  i_stream_unref(&input);
+
+  // the object is shorter than the given size
+  input = i_stream_create_from_rados(storage, oid, content.length() + IO_BLOCK_SIZE, IO_BLOCK_SIZE);
+  EXPECT_EQ(content, read_stream(input));
+  EXPECT_EQ(EIO, input->stream_errno);
+  i_stream_unref(&input);
+
+  EXPECT_EQ(0, storage->delete_mail(oid));
+  mailbox_free(&box);
+}
+
 TEST_F(StorageTest, deinit) {}
 
 int main(int argc, char **argv) {
@@ -0,0 +1,110 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+#include "TestCase.h"
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wshadow"           // turn off warnings for Dovecot :-(
+#pragma GCC diagnostic ignored "-Wundef"            // turn off warnings for Dovecot :-(
+#pragma GCC diagnostic ignored "-Wredundant-decls"  // turn off warnings for Dovecot :-(
+#ifndef __cplusplus
+#pragma GCC diagnostic ignored "-Wdeclaration-after-statement"  // turn off warnings for Dovecot :-(
+#endif
+
+extern "C" {
+#include "lib.h"
+#include "mail-user.h"
+#include "mail-storage.h"
+#include "mail-storage-service.h"
+#include "mail-namespace.h"
+#include "mailbox-list.h"
+#include "ioloop.h"
+#include "istream.h"
+#include "mail-index.h"
+
+#include "libdict-rados-plugin.h"
+}
+#include "rbox-storage.hpp"
+#include "rados-util.h"
+#include "../mocks/mock_test.h"
+#include "../test-utils/it_utils.h"
+
+using ::testing::AtLeast;
+using ::testing::Return;
+
+TEST_F(SyncTest, init) {}
+
+/* the index lost the record of a mail, the repair appends it again with the flags of the object */
+TEST_F(SyncTest, repair_restores_missing_index_record) {
+  const char *message =
+      "From: user@domain.org\n"
+      "Date: Sat, 24 Mar 2017 23:00:00 +0200\n"
+      "Mime-Version: 1.0\n"
+      "Content-Type: text/plain; charset=us-ascii\n"
+      "\n"
+      "body\n";
+
+  const char *mailbox = "INBOX";
+  testutils::ItUtils::add_mail(message, mailbox, SyncTest::s_test_mail_user->namespaces);
+  testutils::ItUtils::add_mail(message, mailbox, SyncTest::s_test_mail_user->namespaces);
+
+  struct mail_namespace *ns = mail_namespace_find_inbox(s_test_mail_user->namespaces);
+  ASSERT_NE(ns, nullptr);
+  struct mailbox *box = mailbox_alloc(ns->list, mailbox, MAILBOX_FLAG_IGNORE_ACLS);
+  ASSERT_GE(mailbox_open(box), 0);
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+  struct rbox_mailbox *mbox = (struct rbox_mailbox *)box;
+  r_storage->config->update_metadata("rbox_index_repair", "true");
+  ASSERT_GE(mailbox_sync(box, static_cast<mailbox_sync_flags>(0)), 0);
+  EXPECT_EQ((uint32_t)2, mail_index_view_get_messages_count(box->view));
+
+  // the object of the first mail is flagged
+  const void *rec_data;
+  mail_index_lookup_ext(box->view, 1, mbox->ext_id, &rec_data, NULL);
+  std::string oid = guid_128_to_string(static_cast<const struct obox_mail_index_record *>(rec_data)->oid);
+  std::string flags;
+  EXPECT_TRUE(librmb::RadosUtils::flags_to_string(MAIL_FLAGGED, &flags));
+  librmb::RadosMetadata metadata(librmb::rbox_metadata_key::RBOX_METADATA_OLDV1_FLAGS, flags);
+  EXPECT_EQ(0, r_storage->s->get_io_ctx().setxattr(oid, metadata.key.c_str(), metadata.bl));
+
+  // remove its record without touching the object
+  struct mail_index_view *view = mail_index_view_open(box->index);
+  struct mail_index_transaction *trans = mail_index_transaction_begin(view, MAIL_INDEX_TRANSACTION_FLAG_EXTERNAL);
+  mail_index_expunge(trans, 1);
+  EXPECT_EQ(0, mail_index_transaction_commit(&trans));
+  mail_index_view_close(&view);
+  ASSERT_GE(mailbox_sync(box, static_cast<mailbox_sync_flags>(0)), 0);
+  EXPECT_EQ((uint32_t)1, mail_index_view_get_messages_count(box->view));
+  uint32_t next_uid = mail_index_get_header(box->view)->next_uid;
+
+  rbox_set_mailbox_corrupted(box);
+  ASSERT_GE(mailbox_sync(box, static_cast<mailbox_sync_flags>(0)), 0);
+  EXPECT_EQ((uint32_t)2, mail_index_view_get_messages_count(box->view));
+
+  // the other record is kept, the appended one gets a new uid and the flags of the object
+  const struct mail_index_record *rec = mail_index_lookup(box->view, 2);
+  EXPECT_GE(rec->uid, next_uid);
+  EXPECT_TRUE((rec->flags & MAIL_FLAGGED) != 0);
+  EXPECT_FALSE(is_alternate_storage_set(rec->flags));
+  mail_index_lookup_ext(box->view, 2, mbox->ext_id, &rec_data, NULL);
+  EXPECT_EQ(oid, guid_128_to_string(static_cast<const struct obox_mail_index_record *>(rec_data)->oid));
+
+  mailbox_free(&box);
+}
+
+TEST_F(SyncTest, deinit) {}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleMock(&argc, argv);
+  return RUN_ALL_TESTS();
+}